@@ -44,7 +44,7 @@ int main(int argc, char *argv[])
 			return 0;
 		}
 		ouster_meta_parse(content, &meta);
-		free(content);
+		ouster_os_free(content);
 		ouster_lut_init(&lut, &meta);
 		printf("Column window: %i %i\n", meta.mid0, meta.mid1);
 	}
@@ -57,9 +57,9 @@ int main(int argc, char *argv[])
 	ouster_field_t fields[FIELD_COUNT] = {
 	    [FIELD_RANGE] = {.quantity = OUSTER_QUANTITY_RANGE, .depth = 4}};
 
-	ouster_field_init(fields, FIELD_COUNT, &meta);
-
-	ouster_lidar_t lidar = {0};
+	// Two frames, one is filled while the other is converted
+	ouster_frame_pool_t pool;
+	ouster_frame_pool_init(&pool, &meta, fields, FIELD_COUNT, 2);
 
 	double *xyz = calloc(1, lut.w * lut.h * sizeof(double) * 3);
 
@@ -75,12 +75,13 @@ int main(int argc, char *argv[])
 		if (a & (1 << SOCK_INDEX_LIDAR)) {
 			char buf[1024 * 100];
 			int64_t n = ouster_net_read(socks[SOCK_INDEX_LIDAR], buf, sizeof(buf));
-			printf("%-10s %5ji, mid = %5ji\n", "SOCK_LIDAR", (intmax_t)n, (intmax_t)lidar.last_mid);
-			ouster_lidar_get_fields(&lidar, &meta, buf, fields, FIELD_COUNT);
-			if (lidar.last_mid == meta.mid1) {
-				ouster_lut_cartesian_f64(&lut, fields[FIELD_RANGE].data, xyz, 3);
-				ouster_field_zero(fields, FIELD_COUNT);
-				printf("mid_loss %i\n", lidar.mid_loss);
+			printf("%-10s %5ji, mid = %5ji\n", "SOCK_LIDAR", (intmax_t)n, (intmax_t)pool.current->lidar.last_mid);
+			// Columns not received are zero, no need to clear the fields after each frame
+			ouster_frame_t *frame = (n == meta.lidar_packet_size) ? ouster_frame_pool_push(&pool, buf) : NULL;
+			if (frame) {
+				ouster_lut_cartesian_f64(&lut, frame->fields[FIELD_RANGE].data, xyz, sizeof(double) * 3);
+				printf("mid_loss %i, columns %i\n", frame->lidar.mid_loss, frame->valid_count);
+				ouster_frame_pool_release(&pool, frame);
 			}
 		}
 
@@ -92,6 +93,7 @@ int main(int argc, char *argv[])
 	}
 
 	free(xyz);
+	ouster_frame_pool_fini(&pool);
 
 	return 0;
 }
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ouster_clib.h>
+
+typedef void (*convert_t)(void *arg, ouster_pool_t *pool);
+
+typedef struct
+{
+	ouster_lut_t lut;
+	ouster_lut_f32_t lut32;
+	uint32_t *range;
+	void *out;
+} bench_t;
+
+static void convert_f64(void *arg, ouster_pool_t *pool)
+{
+	bench_t *b = arg;
+	ouster_lut_cartesian_f64_parallel(&b->lut, b->range, b->out, sizeof(double) * 3, pool);
+}
+
+static void convert_f32(void *arg, ouster_pool_t *pool)
+{
+	bench_t *b = arg;
+	ouster_lut_cartesian_f32_parallel(&b->lut, b->range, b->out, sizeof(float) * 3, pool);
+}
+
+static void convert_f32_soa(void *arg, ouster_pool_t *pool)
+{
+	bench_t *b = arg;
+	ouster_lut_f32_cartesian_aos_parallel(&b->lut32, b->range, b->out, sizeof(float) * 3, pool);
+}
+
+/* Returns the median time of one conversion in microseconds */
+static double measure(convert_t fn, bench_t *b, ouster_pool_t *pool, int iterations)
+{
+	double *t = ouster_os_calloc(iterations * sizeof(double));
+	// Warm up caches and wake up the workers
+	fn(b, pool);
+	for (int i = 0; i < iterations; ++i) {
+		int64_t t0 = ouster_os_clock_ns();
+		fn(b, pool);
+		t[i] = (double)(ouster_os_clock_ns() - t0) / 1000.0;
+	}
+	// Insertion sort, iterations is small
+	for (int i = 1; i < iterations; ++i) {
+		for (int j = i; (j > 0) && (t[j - 1] > t[j]); --j) {
+			double tmp = t[j];
+			t[j] = t[j - 1];
+			t[j - 1] = tmp;
+		}
+	}
+	double median = t[iterations / 2];
+	ouster_os_free(t);
+	return median;
+}
+
+int main(int argc, char *argv[])
+{
+	ouster_os_set_api_defaults();
+
+	if (argc <= 1) {
+		printf("Missing input meta file\n");
+		printf("Usage: %s meta.json [max_threads] [iterations]\n", argv[0]);
+		return 0;
+	}
+
+	int max_threads = (argc > 2) ? atoi(argv[2]) : ouster_pool_cpu_count();
+	int iterations = (argc > 3) ? atoi(argv[3]) : 200;
+	max_threads = (max_threads > 0) ? max_threads : 1;
+	iterations = (iterations > 0) ? iterations : 1;
+
+	ouster_meta_t meta = {0};
+	bench_t b = {0};
+	{
+		char *content = ouster_fs_readfile(argv[1]);
+		if (content == NULL) {
+			return 0;
+		}
+		ouster_meta_parse(content, &meta);
+		ouster_os_free(content);
+	}
+	ouster_lut_init(&b.lut, &meta);
+	ouster_lut_f32_init(&b.lut32, &b.lut);
+
+	int n = b.lut.w * b.lut.h;
+	b.range = ouster_os_malloc(n * sizeof(uint32_t));
+	b.out = ouster_os_malloc(n * sizeof(double) * 3);
+	srand(1);
+	for (int i = 0; i < n; ++i) {
+		// Every tenth pixel has no return
+		b.range[i] = (i % 10) ? (uint32_t)(500 + rand() % 100000) : 0;
+	}
+
+	printf("Frame %ix%i, %i iterations, %i cpus\n", b.lut.w, b.lut.h, iterations, ouster_pool_cpu_count());
+	printf("threads   f64 [us]   f32 [us]   f32 soa lut [us]   speedup\n");
+	double base = 0;
+	for (int threads = 1; threads <= max_threads; ++threads) {
+		ouster_pool_t pool;
+		ouster_pool_init(&pool, threads);
+		double t64 = measure(convert_f64, &b, &pool, iterations);
+		double t32 = measure(convert_f32, &b, &pool, iterations);
+		double tsoa = measure(convert_f32_soa, &b, &pool, iterations);
+		ouster_pool_fini(&pool);
+		base = (threads == 1) ? tsoa : base;
+		printf("%7i %10.1f %10.1f %18.1f %9.2f\n", threads, t64, t32, tsoa, base / tsoa);
+	}
+
+	ouster_os_free(b.out);
+	ouster_os_free(b.range);
+	ouster_lut_f32_fini(&b.lut32);
+	ouster_lut_fini(&b.lut);
+	return 0;
+}
\ No newline at end of file
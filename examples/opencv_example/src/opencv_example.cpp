@@ -57,7 +57,7 @@ int main(int argc, char *argv[])
 			return 0;
 		}
 		ouster_meta_parse(content, &meta);
-		free((void *)content);
+		ouster_os_free((void *)content);
 	} else {
 		printf("Missing input file argument");
 		return 0;
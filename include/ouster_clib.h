@@ -68,6 +68,21 @@
 #undef OUSTER_ENABLE_LOG
 #endif
 
+/** \def OUSTER_LOG_MAX_LEVEL
+ * Log calls with a level above this are removed at compile time, see OUSTER_LOG_LEVEL_ERROR
+ */
+#ifndef OUSTER_LOG_MAX_LEVEL
+#define OUSTER_LOG_MAX_LEVEL 1
+#endif
+
+/** \def OUSTER_ENABLE_PROFILE
+ * Record latency histograms of the pipeline stages, see ouster_profile.h. Not defined by default
+ */
+
+/** \def OUSTER_ENABLE_TRACE
+ * Record begin and end events of the pipeline stages, see ouster_trace.h. Not defined by default
+ */
+
 /** @} */ // end of options
 
 /** @} */ // end of core
@@ -75,16 +90,26 @@
 #include "ouster_clib/ouster_log.h"
 #include "ouster_clib/ouster_types.h"
 #include "ouster_clib/ouster_os_api.h"
+#include "ouster_clib/ouster_arena.h"
+#include "ouster_clib/ouster_profile.h"
+#include "ouster_clib/ouster_trace.h"
 #include "ouster_clib/ouster_assert.h"
 #include "ouster_clib/ouster_field.h"
+#include "ouster_clib/ouster_codec.h"
 #include "ouster_clib/ouster_fs.h"
 #include "ouster_clib/ouster_lidar.h"
 #include "ouster_clib/ouster_lut.h"
+#include "ouster_clib/ouster_projection.h"
 #include "ouster_clib/ouster_meta.h"
 #include "ouster_clib/ouster_net.h"
 #include "ouster_clib/ouster_sock.h"
 #include "ouster_clib/ouster_vec.h"
 #include "ouster_clib/ouster_http.h"
+#include "ouster_clib/ouster_pool.h"
+#include "ouster_clib/ouster_queue.h"
+#include "ouster_clib/ouster_frame.h"
+#include "ouster_clib/ouster_broadcast.h"
+#include "ouster_clib/ouster_pipeline.h"
 
 #ifdef OUSTER_NO_UDPCAP
 #undef OUSTER_USE_UDPCAP
@@ -97,6 +122,8 @@
 
 #ifdef OUSTER_USE_UDPCAP
 #include "ouster_clib/ouster_udpcap.h"
+#include "ouster_clib/ouster_blackbox.h"
+#include "ouster_clib/ouster_batch.h"
 #endif
 
 #ifdef OUSTER_USE_DUMP
@@ -0,0 +1,85 @@
+/**
+ * @defgroup arena Arena allocator
+ * @brief Huge page backed bump allocator and a pooled allocator for ouster_os_api
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_ARENA_H
+#define OUSTER_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Alignment of all allocations */
+#define OUSTER_ARENA_ALIGN 16
+
+typedef struct
+{
+	char *base;
+	size_t capacity;
+	/** Bytes handed out, only grows until ouster_arena_reset() */
+	size_t used;
+	/** Size of the mapping including alignment */
+	size_t map_size;
+	char *map;
+} ouster_arena_t;
+
+/** Reserves capacity bytes of anonymous memory aligned to 2 MB and asks for transparent huge pages.
+ * Pages are touched on first use, call ouster_arena_prefault() to move that cost out of the real-time path.
+ *
+ * @param arena The arena
+ * @param capacity Size in bytes
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_arena_init(ouster_arena_t *arena, size_t capacity);
+
+/** Unmaps the memory, all allocations become invalid
+ *
+ * @param arena The arena
+ */
+void ouster_arena_fini(ouster_arena_t *arena);
+
+/** Touches every page so later allocations do not page fault
+ *
+ * @param arena The arena
+ */
+void ouster_arena_prefault(ouster_arena_t *arena);
+
+/** Allocates from the arena, thread safe
+ *
+ * @param arena The arena
+ * @param size Bytes
+ * @return Memory aligned to OUSTER_ARENA_ALIGN or NULL when the arena is full
+ */
+void *ouster_arena_alloc(ouster_arena_t *arena, size_t size);
+
+/** Frees everything allocated since ouster_arena_init() or the last reset, e.g. at the end of each frame
+ *
+ * @param arena The arena
+ */
+void ouster_arena_reset(ouster_arena_t *arena);
+
+/** Installs a pooled allocator in ouster_os_api.
+ * Blocks come in power of two size classes from one huge page backed arena and are recycled, never returned to the system.
+ * Each thread keeps a small cache of free blocks per class, so steady state malloc and free take no lock and make no system calls.
+ * Blocks larger than 16 MB or beyond capacity fall back to the system allocator.
+ * Call once before any other ouster function allocates.
+ *
+ * @param capacity Size of the arena in bytes
+ * @return Returns 0 on ok otherwise -1 and the defaults of ouster_os_set_api_defaults() are kept
+ */
+int ouster_os_set_api_arena(size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_ARENA_H
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,84 @@
+/**
+ * @defgroup batch Parallel capture decoding
+ * @brief Decodes the frames of a capture file on a thread pool and delivers them in order
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_BATCH_H
+#define OUSTER_BATCH_H
+
+#include "ouster_clib/ouster_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	/** Frame number counted from the start of the capture */
+	int index;
+	/** Decode state after the last packet of the frame, e.g. frame_id and mid_loss */
+	ouster_lidar_t lidar;
+	/** Number of lidar packets in the frame */
+	int packets;
+	/** Decoded fields in the order of ouster_batch_desc_t::fields */
+	ouster_field_t *fields;
+	int fcount;
+	/** Pointcloud, x,y,z doubles per pixel. NULL when no lut is given */
+	double *xyz;
+} ouster_batch_frame_t;
+
+/** Frame callback, called in capture order from the thread calling ouster_batch_run()
+ *
+ * @param arg User argument
+ * @param frame The decoded frame, only valid during the call
+ */
+typedef void (*ouster_batch_fn_t)(void *arg, ouster_batch_frame_t const *frame);
+
+typedef struct
+{
+	ouster_meta_t *meta;
+	/** Optional, converts the OUSTER_QUANTITY_RANGE field to xyz */
+	ouster_lut_t const *lut;
+	/** Quantity and depth of the fields to decode, like ouster_field_init() */
+	ouster_field_t const *fields;
+	int fcount;
+	/** Number of decode threads, 0 uses all CPUs */
+	int threads;
+	/** Frames decoded per thread before delivering them, 0 uses 2 */
+	int frames_per_thread;
+	ouster_batch_fn_t fn;
+	void *arg;
+} ouster_batch_desc_t;
+
+typedef struct
+{
+	/** Number of frames delivered */
+	int frames;
+	/** Number of capture segments that ended with an incomplete record */
+	int truncated;
+	/** Number of capture segments that could not be opened */
+	int missing;
+} ouster_batch_stats_t;
+
+/** Decodes all frames of a capture file.
+ * Packets of a batch of frames are read sequentially, then the frames are decoded in parallel
+ * with their own ouster_lidar_t, fields and xyz buffers, then delivered in order.
+ * Frames read before a read error are still delivered.
+ *
+ * @param desc What to decode and where to deliver it
+ * @param path Capture file or segmented capture, see ouster_udpcap_reader_open()
+ * @param stats Optional output of what was read, also when an error is returned
+ * @return Returns 0 on ok otherwise udpcap error code
+ */
+int ouster_batch_run(ouster_batch_desc_t const *desc, char const *path, ouster_batch_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_BATCH_H
+
+/** @} */
\ No newline at end of file
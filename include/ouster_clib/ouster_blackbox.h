@@ -0,0 +1,107 @@
+/**
+ * @defgroup blackbox Black-box recorder
+ * @brief Keeps the last seconds of UDP packets in memory and dumps them to a capture file on trigger
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_BLACKBOX_H
+#define OUSTER_BLACKBOX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "ouster_clib/ouster_udpcap.h"
+
+/** Incident captures are named <path>.incidentNNNN */
+#define OUSTER_BLACKBOX_FILE_FORMAT "%s.incident%04i"
+
+typedef struct
+{
+	char path[OUSTER_UDPCAP_PATH_MAX];
+	/** Preallocated ring memory */
+	char *data;
+	int64_t capacity;
+	/** Offset of the next record to write */
+	int64_t head;
+	/** Offset of the oldest record */
+	int64_t tail;
+	/** Offset of the oldest record not yet written to the incident capture */
+	int64_t dump;
+	/** Bytes in use including padding */
+	int64_t used;
+	/** Bytes from dump to head not yet written to the incident capture */
+	int64_t dump_used;
+	/** Records younger than this are kept */
+	int64_t window_ns;
+	/** Keep writing this long after a trigger */
+	int64_t post_ns;
+	/** Set by ouster_blackbox_trigger() */
+	int trigger_request;
+	/** Time of the last trigger, valid while dumping */
+	int64_t trigger_t;
+	int dumping;
+	/** The post trigger time has passed, only the backlog remains to be written */
+	int dump_closing;
+	int incidents;
+	/** Records evicted before they were older than window_ns */
+	int64_t overwritten;
+	/** Packets not stored because writing an incident failed */
+	int64_t dropped;
+	ouster_udpcap_writer_t writer;
+} ouster_blackbox_t;
+
+/** Allocates the ring buffer
+ *
+ * @param bb The black-box recorder
+ * @param path Incident captures are written to path.incident0000, path.incident0001, ...
+ * @param capacity Size of the ring buffer in bytes
+ * @param window_ns How many nanoseconds of packets before a trigger to keep
+ * @param post_ns How many nanoseconds of packets after a trigger to write
+ */
+void ouster_blackbox_init(ouster_blackbox_t *bb, char const *path, int64_t capacity, int64_t window_ns, int64_t post_ns);
+
+/** Finishes an ongoing incident capture and frees the ring buffer
+ *
+ * @param bb The black-box recorder
+ */
+void ouster_blackbox_fini(ouster_blackbox_t *bb);
+
+/** Request an incident capture.
+ * Only sets a flag, which makes it safe to call from signal handlers and other threads.
+ * The capture is started by the next ouster_blackbox_push() or ouster_blackbox_flush().
+ *
+ * @param bb The black-box recorder
+ */
+void ouster_blackbox_trigger(ouster_blackbox_t *bb);
+
+/** Store a packet in the ring buffer.
+ * While an incident capture is ongoing a bounded part of the backlog is written per call.
+ *
+ * @param bb The black-box recorder
+ * @param cap The capture buffer
+ * @param t Monotonic time in nanoseconds, see ouster_os_clock_ns()
+ * @return Returns 0 on ok otherwise error code, the packet is not stored and counted in ouster_blackbox_t::dropped
+ */
+int ouster_blackbox_push(ouster_blackbox_t *bb, ouster_udpcap_t const *cap, int64_t t);
+
+/** Write backlog of an ongoing incident capture, e.g. when the receive loop is idle
+ *
+ * @param bb The black-box recorder
+ * @param max_bytes Max number of bytes to write, -1 writes all
+ * @param t Monotonic time in nanoseconds, see ouster_os_clock_ns()
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_blackbox_flush(ouster_blackbox_t *bb, int64_t max_bytes, int64_t t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_BLACKBOX_H
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,105 @@
+/**
+ * @defgroup broadcast Frame broadcast
+ * @brief Single producer multiple consumer ring of reference counted frames
+ *
+ * The receive thread publishes every completed frame of a @ref frame pool, each consumer reads them in order
+ * at its own pace without copies. A consumer that falls more than the ring capacity behind loses the oldest frames,
+ * it never blocks the producer or the other consumers. Frames go back to the pool on the producer thread once
+ * the ring and every consumer let go of them.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_BROADCAST_H
+#define OUSTER_BROADCAST_H
+
+#include <stdint.h>
+
+#include "ouster_clib/ouster_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	/** (seq + 1) << 16 | frame index, zero when nothing was published in the slot */
+	uint64_t *slots;
+	/** Capacity - 1, capacity is a power of two */
+	uint64_t mask;
+	/** Sequence number of the next frame to publish */
+	uint64_t head;
+	/** References of every pool frame, one for the ring and one per consumer holding it */
+	int *refs;
+	/** Non zero when the frame was published and not yet given back to the pool, producer only */
+	char *held;
+	ouster_frame_pool_t *pool;
+} ouster_broadcast_t;
+
+/** Read position of one consumer, owned by the consumer thread */
+typedef struct
+{
+	/** Sequence number of the next frame to read */
+	uint64_t next;
+	/** Number of frames read */
+	int64_t received;
+	/** Number of frames overwritten before this consumer read them */
+	int64_t dropped;
+} ouster_broadcast_reader_t;
+
+/** Allocates the ring
+ *
+ * The pool needs at least capacity + 2 frames plus one for every frame the consumers hold at the same time,
+ * otherwise the pool drops frames instead of the ring.
+ *
+ * @param b The broadcast ring
+ * @param pool Frame pool of the producer, must outlive the ring
+ * @param capacity Number of recent frames kept for lagging consumers, rounded up to a power of two
+ */
+void ouster_broadcast_init(ouster_broadcast_t *b, ouster_frame_pool_t *pool, int capacity);
+
+/** Gives all published frames back to the pool and frees the ring, no consumer may hold a frame
+ *
+ * @param b The broadcast ring
+ */
+void ouster_broadcast_fini(ouster_broadcast_t *b);
+
+/** Publishes a frame and gives frames no longer referenced back to the pool.
+ * Call from the producer thread only, the same thread that calls ouster_frame_pool_push().
+ *
+ * @param b The broadcast ring
+ * @param frame Completed frame from ouster_frame_pool_push(), the ring owns it now
+ */
+void ouster_broadcast_publish(ouster_broadcast_t *b, ouster_frame_t *frame);
+
+/** Starts reading at the next published frame
+ *
+ * @param b The broadcast ring
+ * @param r Read position of the consumer
+ */
+void ouster_broadcast_reader_init(ouster_broadcast_t *b, ouster_broadcast_reader_t *r);
+
+/** Takes a reference to the next frame of this consumer, lock-free.
+ * Frames overwritten since the last call are skipped and counted in ouster_broadcast_reader_t::dropped.
+ *
+ * @param b The broadcast ring
+ * @param r Read position of the consumer
+ * @return The frame which must be given back with ouster_broadcast_release(), NULL when no new frame is published
+ */
+ouster_frame_t *ouster_broadcast_acquire(ouster_broadcast_t *b, ouster_broadcast_reader_t *r);
+
+/** Drops the reference taken by ouster_broadcast_acquire(), lock-free
+ *
+ * @param b The broadcast ring
+ * @param frame Frame from ouster_broadcast_acquire()
+ */
+void ouster_broadcast_release(ouster_broadcast_t *b, ouster_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_BROADCAST_H
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,86 @@
+/**
+ * @defgroup codec Lossless field codec
+ * @brief Compresses fields by predicting each pixel from its neighbours and entropy coding the residual
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_CODEC_H
+#define OUSTER_CODEC_H
+
+#include "ouster_clib/ouster_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** First four bytes of an encoded field */
+#define OUSTER_CODEC_MAGIC 0x4344434F
+
+typedef enum {
+	OUSTER_CODEC_OK,
+	OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL,
+	OUSTER_CODEC_ERROR_MAGIC,
+	OUSTER_CODEC_ERROR_SHAPE,
+	OUSTER_CODEC_ERROR_CORRUPT,
+} ouster_codec_error_t;
+
+typedef enum {
+	/** Prediction residuals in Golomb-Rice codes */
+	OUSTER_CODEC_METHOD_RICE,
+	/** Pixels stored little endian without coding, used when the field does not compress */
+	OUSTER_CODEC_METHOD_RAW,
+} ouster_codec_method_t;
+
+/** Header in front of an encoded field.
+ * All values are little endian in the encoded field, as are raw pixels. */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t rows;
+	uint16_t cols;
+	uint8_t depth;
+	/** ouster_codec_method_t */
+	uint8_t method;
+	uint8_t reserved[2];
+	/** Size of the data following the header */
+	uint32_t size;
+} ouster_codec_header_t;
+
+/** Returns the worst case encoded size of a field
+ *
+ * @param field The field
+ * @return Max number of bytes ouster_codec_encode() writes
+ */
+int ouster_codec_bound(ouster_field_t const *field);
+
+/** Encodes a field.
+ * Each pixel is predicted from its left, upper and upper left neighbour (MED predictor)
+ * and the residual is written with adaptive Golomb-Rice codes.
+ * Fields that do not compress are stored raw, the output is never larger than ouster_codec_bound().
+ *
+ * @param field The field to encode, depth 1, 2 or 4
+ * @param dst Destination buffer
+ * @param capacity Size of the destination buffer, ouster_codec_bound() is always enough
+ * @param size Number of bytes written to dst
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_codec_encode(ouster_field_t const *field, void *dst, int capacity, int *size);
+
+/** Decodes a field
+ *
+ * @param field Destination field, rows, cols and depth must match the encoded field
+ * @param src Encoded field
+ * @param size Size of src in bytes
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_codec_decode(ouster_field_t *field, void const *src, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_CODEC_H
+
+/** @} */
\ No newline at end of file
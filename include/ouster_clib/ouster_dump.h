@@ -23,6 +23,9 @@ void ouster_dump_column(FILE * f, ouster_column_t const *column);
 
 void ouster_dump_meta(FILE *f, ouster_meta_t const *meta);
 
+/** Prints count, mean, percentiles and max of every profile stage in microseconds */
+void ouster_dump_profile(FILE *f);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,19 @@ void ouster_field_init(ouster_field_t fields[], int count, ouster_meta_t *meta);
 void ouster_field_fini(ouster_field_t fields[], int count);
 void ouster_destagger(void *data, int cols, int rows, int depth, int rowsize, int pixel_shift_by_row[]);
 void ouster_field_destagger(ouster_field_t fields[], int count, ouster_meta_t *meta);
+
+/** Destaggers src into dst, the source is only read so it can keep being filled by the receiver */
+void ouster_destagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[]);
+
+/** Inverse of ouster_destagger_cpy(), converts destaggered data back to measurement order */
+void ouster_restagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[]);
+
+/** Destaggers fields into other fields of the same size, see ouster_destagger_cpy() */
+void ouster_field_destagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta);
+
+/** Restaggers fields into other fields of the same size, see ouster_restagger_cpy() */
+void ouster_field_restagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta);
+
 void ouster_field_apply_mask_u32(ouster_field_t *field, ouster_meta_t *meta);
 void ouster_field_zero(ouster_field_t fields[], int count);
 void ouster_field_cpy(ouster_field_t dst[], ouster_field_t src[], int count);
@@ -0,0 +1,103 @@
+/**
+ * @defgroup frame Frame pool
+ * @brief Recycled frame buffers that only clear the columns that need it
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_FRAME_H
+#define OUSTER_FRAME_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ouster_clib/ouster_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of 64 bit words in a column bitmap */
+#define OUSTER_FRAME_BITMAP_WORDS(cols) (((cols) + 63) / 64)
+
+/** Non zero when column col was received in the frame */
+#define OUSTER_FRAME_COL_VALID(frame, col) (((frame)->valid_cols[(col) / 64] >> ((col) % 64)) & 1)
+
+typedef struct
+{
+	int frame_id;
+	/** Staggered fields with the quantities and depths given to ouster_frame_pool_init() */
+	ouster_field_t *fields;
+	int fcount;
+	/** Bit c is set when column c was received, columns not received are zero */
+	uint64_t *valid_cols;
+	/** Number of columns received */
+	int valid_count;
+	/** Packet decoding state, mid_loss and num_valid_pixels of the frame */
+	ouster_lidar_t lidar;
+	/** Columns holding data from the previous use of the buffer */
+	uint64_t *stale_cols;
+	/** ouster_os_clock_ns() at the first packet and at completion, only set when OUSTER_ENABLE_PROFILE or OUSTER_ENABLE_TRACE is defined */
+	int64_t first_ns;
+	int64_t complete_ns;
+} ouster_frame_t;
+
+typedef struct
+{
+	ouster_meta_t *meta;
+	int count;
+	ouster_frame_t *frames;
+	/** The frame being filled by ouster_frame_pool_push() */
+	ouster_frame_t *current;
+	/** The frame the last packet was decoded into, it may be complete already. Valid until the next push */
+	ouster_frame_t *last;
+	/** Free frames, protected by lock */
+	ouster_frame_t **free;
+	int free_count;
+	pthread_mutex_t lock;
+	/** Completed frames dropped because consumers held all other frames */
+	int64_t dropped;
+} ouster_frame_pool_t;
+
+/** Allocates count frame buffers
+ *
+ * @param pool The frame pool
+ * @param meta meta configuration, must outlive the pool
+ * @param fields Quantity and depth of every field, data is not used
+ * @param fcount Number of fields
+ * @param count Number of frames, one is always being filled
+ */
+void ouster_frame_pool_init(ouster_frame_pool_t *pool, ouster_meta_t *meta, ouster_field_t const fields[], int fcount, int count);
+
+/** Frees all frames, none may be held by consumers
+ *
+ * @param pool The frame pool
+ */
+void ouster_frame_pool_fini(ouster_frame_pool_t *pool);
+
+/** Decodes a lidar packet into the current frame.
+ * A frame is complete at its last column or when a packet of the next frame arrives.
+ * Instead of zeroing the whole frame only the columns that held data before and were not received again are cleared.
+ * Call from one thread only.
+ *
+ * @param pool The frame pool
+ * @param buf Lidar packet of meta::lidar_packet_size bytes
+ * @return The completed frame which must be given back with ouster_frame_pool_release(), otherwise NULL
+ */
+ouster_frame_t *ouster_frame_pool_push(ouster_frame_pool_t *pool, char const *buf);
+
+/** Gives a frame back to the pool, can be called from any thread
+ *
+ * @param pool The frame pool
+ * @param frame Frame from ouster_frame_pool_push()
+ */
+void ouster_frame_pool_release(ouster_frame_pool_t *pool, ouster_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_FRAME_H
+
+/** @} */
\ No newline at end of file
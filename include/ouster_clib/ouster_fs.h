@@ -26,7 +26,7 @@ int ouster_fs_readfile_failed_reason(char const *filename, char *buf, int len);
 /** Prints current working directory */
 void ouster_fs_pwd();
 
-/** Read whole file and allocates memory
+/** Read whole file and allocates memory, free it with ouster_os_free()
  *
  * @param path filename to read
  */
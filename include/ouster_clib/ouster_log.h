@@ -16,20 +16,72 @@ extern "C" {
 #endif
 
 
+/** Log levels, messages with a level above ouster_os_api_t::log_level_ are skipped */
+#define OUSTER_LOG_LEVEL_ERROR -3
+#define OUSTER_LOG_LEVEL_WARN -2
+#define OUSTER_LOG_LEVEL_INFO 0
+#define OUSTER_LOG_LEVEL_DEBUG 1
+
+#ifndef OUSTER_LOG_MAX_LEVEL
+#define OUSTER_LOG_MAX_LEVEL OUSTER_LOG_LEVEL_DEBUG
+#endif
+
+/** Max number of living threads that can log while the asynchronous logger runs, a thread gives its ring back when it exits */
+#define OUSTER_LOG_ASYNC_THREADS 32
+
+/** Size of the record ring of every logging thread */
+#define OUSTER_LOG_ASYNC_RING_SIZE (64 * 1024)
+
 int32_t ouster_log_set_level(int32_t level);
 
+/** Starts a background thread that formats and writes log messages.
+ * Until ouster_log_async_stop() every log call only copies the format pointer and its arguments
+ * into a lock-free ring of the calling thread, it never blocks, allocates or formats.
+ * String arguments are copied, up to OUSTER_LOG_ASYNC_STRING_MAX bytes each.
+ * Messages are dropped when the ring is full, see ouster_log_async_dropped().
+ * The format string must be a literal or otherwise outlive the logger.
+ *
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_log_async_start(void);
+
+/** Writes all pending messages and stops the background thread, logging is synchronous again.
+ * Other threads must not log while this is called.
+ */
+void ouster_log_async_stop(void);
+
+/** Number of messages dropped because a ring was full or too many threads logged */
+int64_t ouster_log_async_dropped(void);
+
+/** Strings are truncated to this many bytes in asynchronous mode */
+#define OUSTER_LOG_ASYNC_STRING_MAX 128
+
 /** Logging */
 #ifdef OUSTER_ENABLE_LOG
 void ouster_log_(int32_t level, char const * file, int32_t line, char const *fmt, ...);
 void ouster_log_m4_(double const a[16]);
 void ouster_log_m3_(double const a[9]);
 void ouster_log_v3_(double const a[3]);
-#define ouster_log(...) ouster_log_(0, __FILE__, __LINE__, __VA_ARGS__)
+/* The level is a constant so calls above OUSTER_LOG_MAX_LEVEL are removed by the compiler */
+#define ouster_log_level(level, ...)                                  \
+	do {                                                              \
+		if ((level) <= OUSTER_LOG_MAX_LEVEL) {                        \
+			ouster_log_((level), __FILE__, __LINE__, __VA_ARGS__);    \
+		}                                                             \
+	} while (0)
+#define ouster_log(...) ouster_log_level(OUSTER_LOG_LEVEL_INFO, __VA_ARGS__)
+#define ouster_log_error(...) ouster_log_level(OUSTER_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define ouster_log_warn(...) ouster_log_level(OUSTER_LOG_LEVEL_WARN, __VA_ARGS__)
+#define ouster_log_debug(...) ouster_log_level(OUSTER_LOG_LEVEL_DEBUG, __VA_ARGS__)
 #define ouster_log_m4(...) ouster_log_m4_(__VA_ARGS__)
 #define ouster_log_m3(...) ouster_log_m3_(__VA_ARGS__)
 #define ouster_log_v3(...) ouster_log_v3_(__VA_ARGS__)
 #else
+#define ouster_log_level(...)
 #define ouster_log(...)
+#define ouster_log_error(...)
+#define ouster_log_warn(...)
+#define ouster_log_debug(...)
 #define ouster_log_m4(...)
 #define ouster_log_m3(...)
 #define ouster_log_v3(...)
@@ -2,6 +2,11 @@
  * @defgroup lut XYZ vector field lookup table
  * @brief Provides a vector field that converts image to pointcloud
  *
+ * The LUT is in staggered order, the same order as the fields from ouster_lidar_get_fields().
+ * Convert the raw fields to pointcloud before or independent of ouster_field_destagger(),
+ * a destaggered range image gives wrong points. Use ouster_lut_cartesian_f32_destagger()
+ * to get the destaggered range image and a pointcloud in the same pixel order in one pass.
+ *
  * \ingroup c
  * @{
  */
@@ -10,6 +15,7 @@
 #define OUSTER_LUT_H
 
 #include "ouster_clib/ouster_types.h"
+#include "ouster_clib/ouster_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +37,49 @@ void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta);
  */
 void ouster_lut_fini(ouster_lut_t *lut);
 
+/** Hash of the meta fields that ouster_lut_init() depends on
+ *
+ * @param meta meta configuration
+ * @return 64 bit FNV-1a hash
+ */
+uint64_t ouster_lut_meta_hash(ouster_meta_t const *meta);
+
+/** Writes a LUT from ouster_lut_init() to a binary cache file.
+ * The file is written to a temporary name and renamed so readers never see a partial file.
+ *
+ * @param lut The xyz lut table, a transform from ouster_lut_set_transform() is not saved
+ * @param meta meta configuration the LUT was made from
+ * @param path Cache file
+ * @return Returns 0 on ok otherwise -1 and errno is set
+ */
+int ouster_lut_save(ouster_lut_t const *lut, ouster_meta_t const *meta, char const *path);
+
+/** Maps a LUT cache file written by ouster_lut_save().
+ * The mapping is private, modifying the tables e.g. by ouster_lut_set_transform() does not change the file.
+ *
+ * @param lut The xyz lut table
+ * @param meta meta configuration, the cache is rejected if its hash does not match
+ * @param path Cache file
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_lut_load(ouster_lut_t *lut, ouster_meta_t const *meta, char const *path);
+
+/** Unmaps a LUT loaded by ouster_lut_load(), also called by ouster_lut_fini()
+ *
+ * @param lut The xyz lut table
+ */
+void ouster_lut_unmap(ouster_lut_t *lut);
+
+/** Loads the LUT from the cache directory or inits and saves it there.
+ * The cache file name is ouster_lut_<hash>.bin
+ *
+ * @param lut The xyz lut table
+ * @param meta meta configuration
+ * @param dir Cache directory
+ * @return Returns 1 when loaded from cache, 0 when computed
+ */
+int ouster_lut_init_cached(ouster_lut_t *lut, ouster_meta_t const *meta, char const *dir);
+
 /** Converts 2D hightmap to pointcloud
  *
  * @param lut Input LUT unit vector direction field
@@ -47,6 +96,59 @@ void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, vo
  */
 void ouster_lut_cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride);
 
+/** Converts a staggered 2D hightmap to a pointcloud in destaggered pixel order and optionally
+ * writes the destaggered range image in the same pass, so the point of image pixel (row, col) is out[row * w + col].
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param meta meta configuration with pixel_shift_by_row
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap, staggered
+ * @param range_out Optional output destaggered RANGE field, must not be range
+ * @param out Output Image pointcloud, destaggered
+ * @param out_stride Bytes between pixels in out
+ */
+void ouster_lut_cartesian_f32_destagger(ouster_lut_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride);
+
+/** Converts 2D hightmap to pointcloud, rows are split across the workers of a thread pool.
+ * The LUT is only read, the same LUT can be used by several pools at once.
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param out Output Image pointcloud
+ * @param out_stride Bytes between pixels in out
+ * @param pool Thread pool, see ouster_pool_init()
+ */
+void ouster_lut_cartesian_f64_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool);
+
+/** Converts 2D hightmap to float pointcloud on a thread pool, see ouster_lut_cartesian_f64_parallel()
+ */
+void ouster_lut_cartesian_f32_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool);
+
+/** Converts a range of columns of a 2D hightmap to pointcloud, e.g. the columns of the last packet
+ * so the pointcloud is ready as soon as the last packet of a frame has arrived
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param out Output Image pointcloud of the whole frame
+ * @param out_stride Bytes between pixels in out
+ * @param col0 First column, e.g. ouster_lidar_t::packet_mid0 - ouster_meta_t::mid0
+ * @param col1 Last column, e.g. ouster_lidar_t::packet_mid1 - ouster_meta_t::mid0
+ */
+void ouster_lut_cartesian_f64_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1);
+
+/** Converts a range of columns of a 2D hightmap to pointcloud, see ouster_lut_cartesian_f64_columns()
+ */
+void ouster_lut_cartesian_f32_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1);
+
+/** Folds a user transform, e.g. sensor to vehicle extrinsic, into the LUT so points come out transformed.
+ * Applied on top of lidar_to_sensor_transform. Only multiplies the tables, the trigonometry is not recomputed,
+ * so it is cheap to call again when the transform changes. Each call replaces the previous transform.
+ * Derived LUTs such as ouster_lut_f32_t must be converted again.
+ *
+ * @param lut The xyz lut table
+ * @param transform Row major 4x4 matrix, translation in meters
+ */
+void ouster_lut_set_transform(ouster_lut_t *lut, double const transform[16]);
+
 void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y, float mag, float *out);
 
 /** Allocates size for xyz pointcloud
@@ -55,6 +157,112 @@ void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y,
  */
 double *ouster_lut_alloc(ouster_lut_t const *lut);
 
+/** Converts a LUT to float32 structure of arrays
+ *
+ * @param dst The float32 LUT
+ * @param src The LUT from ouster_lut_init()
+ */
+void ouster_lut_f32_init(ouster_lut_f32_t *dst, ouster_lut_t const *src);
+
+/** Frees memory of float32 LUT
+ *
+ * @param lut The float32 LUT
+ */
+void ouster_lut_f32_fini(ouster_lut_f32_t *lut);
+
+/** Converts 2D hightmap to pointcloud planes, uses AVX2 or SSE2 when available
+ *
+ * @param lut Input float32 LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param x Output x plane, w*h floats
+ * @param y Output y plane, w*h floats
+ * @param z Output z plane, w*h floats
+ */
+void ouster_lut_f32_cartesian_soa(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z);
+
+/** Converts 2D hightmap to interleaved pointcloud, uses AVX2 or SSE2 when available
+ *
+ * @param lut Input float32 LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param out Output x,y,z floats per pixel
+ * @param out_stride Bytes between pixels in out
+ */
+void ouster_lut_f32_cartesian_aos(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride);
+
+/** Converts 2D hightmap to interleaved pointcloud on a thread pool, see ouster_lut_cartesian_f64_parallel()
+ */
+void ouster_lut_f32_cartesian_aos_parallel(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool);
+
+/** Converts a staggered 2D hightmap to interleaved pointcloud in destaggered pixel order,
+ * see ouster_lut_cartesian_f32_destagger()
+ */
+void ouster_lut_f32_cartesian_aos_destagger(ouster_lut_f32_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride);
+
+/** Converts a range of columns to pointcloud planes, see ouster_lut_cartesian_f64_columns()
+ */
+void ouster_lut_f32_cartesian_soa_columns(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z, int col0, int col1);
+
+/** Converts a range of columns to interleaved pointcloud, see ouster_lut_cartesian_f64_columns()
+ */
+void ouster_lut_f32_cartesian_aos_columns(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1);
+
+/** Converts the pixels with range in [min_range, max_range] to a dense interleaved pointcloud.
+ * Pixels without return have range 0, use min_range 1 to skip them. Uses AVX2 left-packing when available.
+ *
+ * @param lut Input float32 LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param min_range Smallest range to keep in mm
+ * @param max_range Largest range to keep in mm
+ * @param out Output x,y,z floats per point, w*h points is always enough
+ * @param out_stride Bytes between points in out
+ * @param indices Optional output, pixel index of every point to gather other fields
+ * @return Number of points written
+ */
+int ouster_lut_f32_cartesian_compact(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices);
+
+/** Converts the pixels of a range of columns with range in [min_range, max_range] to a dense pointcloud,
+ * see ouster_lut_f32_cartesian_compact() and ouster_lut_cartesian_f64_columns().
+ * Points are written from the start of out, append per packet by offsetting out and indices with the count so far.
+ */
+int ouster_lut_f32_cartesian_compact_columns(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices, int col0, int col1);
+
+/** Converts a LUT to fixed-point for integer xyz output
+ *
+ * @param dst The fixed-point LUT
+ * @param src The LUT from ouster_lut_init()
+ * @param unit_mm Output unit in mm, e.g. 1 for millimetre or 4 for 4 mm quantized coordinates
+ */
+void ouster_lut_fixed_init(ouster_lut_fixed_t *dst, ouster_lut_t const *src, int unit_mm);
+
+/** Frees memory of fixed-point LUT
+ *
+ * @param lut The fixed-point LUT
+ */
+void ouster_lut_fixed_fini(ouster_lut_fixed_t *lut);
+
+/** Converts 2D hightmap to interleaved int32 pointcloud in units of ouster_lut_fixed_t::unit_mm.
+ * Only integer math is used, coordinates are within one unit of the rounded float result.
+ * Uses AVX2 when available.
+ *
+ * @param lut Input fixed-point LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap, at most 20 bits
+ * @param out Output x,y,z int32 per pixel
+ * @param out_stride Bytes between pixels in out
+ */
+void ouster_lut_cartesian_i32(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride);
+
+/** Converts 2D hightmap to interleaved int16 pointcloud, see ouster_lut_cartesian_i32().
+ * Coordinates outside the int16 range saturate, that is +-32 m with 1 mm unit and +-131 m with 4 mm unit.
+ */
+void ouster_lut_cartesian_i16(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride);
+
+/** Checks all LUT conversions against a reference implementation for every lidar mode,
+ * 512, 1024 and 2048 columns with 16, 32, 64 and 128 rows, using synthetic meta.
+ *
+ * @return Returns 1 when all conversions are within tolerance
+ */
+int test_ouster_lut();
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,9 @@
 #define OUSTER_NET_FLAGS_BIND 0x0100
 #define OUSTER_NET_FLAGS_CONNECT 0x0200
 
+/** Max number of messages handed to the kernel in one sendmmsg() call */
+#define OUSTER_NET_SENDMMSG_MAX 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -44,6 +47,14 @@ typedef struct
 	char data[OUSTER_NET_ADDRSTRLEN];
 } ouster_net_addr_t;
 
+/** One datagram of a batched send */
+typedef struct
+{
+	char *buf;
+	int size;
+	ouster_net_addr_t *addr;
+} ouster_net_msg_t;
+
 /** Set a IPv4 address
  *
  * @param addr The address
@@ -70,6 +81,19 @@ void ouster_net_addr_set_port(ouster_net_addr_t *addr, int port);
  */
 int ouster_net_sendto(int sock, char *buf, int size, int flags, ouster_net_addr_t *addr);
 
+/**
+ * @brief Send multiple datagrams from a socket using as few system calls as possible
+ *
+ * Uses sendmmsg() when compiled with _GNU_SOURCE, otherwise falls back to one sendto() per message.
+ *
+ * @param sock The source socket filedescriptor
+ * @param msgs Datagrams to send
+ * @param n Number of datagrams
+ * @param flags
+ * @return Returns the number of datagrams sent, or -1 for errors.
+ */
+int ouster_net_sendmmsg(int sock, ouster_net_msg_t msgs[], int n, int flags);
+
 int ouster_net_create(ouster_net_sock_desc_t *desc);
 
 int64_t ouster_net_read(int sock, char *buf, int len);
@@ -52,6 +52,35 @@ extern int64_t ouster_os_api_realloc_count;
 extern int64_t ouster_os_api_calloc_count;
 extern int64_t ouster_os_api_free_count;
 
+/** Subsystem an allocation is counted under, see ouster_os_mem_tag_set() */
+typedef enum {
+	OUSTER_OS_MEM_TAG_OTHER,
+	OUSTER_OS_MEM_TAG_LUT,
+	OUSTER_OS_MEM_TAG_FIELD,
+	OUSTER_OS_MEM_TAG_HTTP,
+	OUSTER_OS_MEM_TAG_LOG,
+	OUSTER_OS_MEM_TAG_COUNT
+} ouster_os_mem_tag_t;
+
+/** Snapshot of the allocation statistics, see ouster_os_mem_stats() */
+typedef struct
+{
+	int64_t malloc_count;
+	int64_t realloc_count;
+	int64_t calloc_count;
+	int64_t free_count;
+	/** Sum of malloc_count, realloc_count and calloc_count. Compare two snapshots to assert that a frame did not allocate */
+	int64_t allocs;
+	/** Requested bytes currently allocated */
+	int64_t bytes;
+	/** Highest value bytes has had */
+	int64_t bytes_peak;
+	/** Requested bytes currently allocated per ouster_os_mem_tag_t */
+	int64_t tag_bytes[OUSTER_OS_MEM_TAG_COUNT];
+	/** Number of allocations per ouster_os_mem_tag_t */
+	int64_t tag_allocs[OUSTER_OS_MEM_TAG_COUNT];
+} ouster_os_mem_stats_t;
+
 #ifndef ouster_os_malloc
 #define ouster_os_malloc(size) ouster_os_api.malloc_(size)
 #endif
@@ -74,6 +103,40 @@ extern int64_t ouster_os_api_free_count;
 
 void ouster_os_set_api_defaults(void);
 
+/** Sets the subsystem that following allocations of the calling thread are counted under.
+ * A free is counted under the tag of the allocation, also from another thread.
+ *
+ * @param tag One of ouster_os_mem_tag_t
+ * @return Returns the previous tag so it can be restored
+ */
+int ouster_os_mem_tag_set(int tag);
+
+/** Counts an allocation, for allocators installed in ouster_os_api
+ *
+ * @param size Requested size in bytes
+ * @return Returns the tag of the calling thread, store it with the block and pass it to ouster_os_mem_count_free()
+ */
+int ouster_os_mem_count_alloc(size_t size);
+
+/** Counts a free or the old size of a realloc, for allocators installed in ouster_os_api
+ *
+ * @param tag Tag returned by ouster_os_mem_count_alloc()
+ * @param size Requested size in bytes given to ouster_os_mem_count_alloc()
+ */
+void ouster_os_mem_count_free(int tag, size_t size);
+
+/** Reads all allocation statistics, every counter is read atomically
+ *
+ * @param stats Snapshot output
+ */
+void ouster_os_mem_stats(ouster_os_mem_stats_t *stats);
+
+/** Monotonic clock
+ *
+ * @return Nanoseconds since an unspecified starting point
+ */
+int64_t ouster_os_clock_ns(void);
+
 #ifdef __cplusplus
 }
 #endif
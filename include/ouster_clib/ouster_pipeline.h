@@ -0,0 +1,162 @@
+/**
+ * @defgroup pipeline Staged pipeline
+ * @brief Receives, decodes, destaggers and converts frames on one thread per stage
+ *
+ * Every stage runs on its own thread, optionally pinned to a CPU, and hands its work to the next stage through a
+ * bounded @ref queue. A full queue either makes the stage wait, which pushes back up to the socket receive buffer,
+ * or drops the packet or frame. The cartesian stage can fan out on a @ref pool. Stage times are recorded in
+ * the @ref profile histograms when built with OUSTER_ENABLE_PROFILE.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_PIPELINE_H
+#define OUSTER_PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ouster_clib/ouster_types.h"
+#include "ouster_clib/ouster_pool.h"
+#include "ouster_clib/ouster_queue.h"
+#include "ouster_clib/ouster_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	/** Reads lidar packets from the socket */
+	OUSTER_PIPELINE_RECEIVE,
+	/** Decodes packets into frames of a frame pool */
+	OUSTER_PIPELINE_DECODE,
+	/** Copies the fields to destaggered fields */
+	OUSTER_PIPELINE_DESTAGGER,
+	/** Converts the range field to xyz */
+	OUSTER_PIPELINE_CARTESIAN,
+	/** Calls the user callback */
+	OUSTER_PIPELINE_CALLBACK,
+	OUSTER_PIPELINE_COUNT
+} ouster_pipeline_stage_t;
+
+typedef enum {
+	/** The producing stage waits until the queue has room */
+	OUSTER_PIPELINE_WAIT,
+	/** The newest packet or frame is dropped when the queue is full */
+	OUSTER_PIPELINE_DROP,
+} ouster_pipeline_policy_t;
+
+typedef struct
+{
+	/** Staggered fields in the order of ouster_pipeline_desc_t::fields, frame_id and mid_loss are in frame->lidar */
+	ouster_frame_t *frame;
+	/** Destaggered copies of the fields. NULL when ouster_pipeline_desc_t::destagger is zero */
+	ouster_field_t *destaggered;
+	/** Pointcloud in staggered pixel order, x,y,z doubles per pixel. NULL when no lut is given */
+	double *xyz;
+} ouster_pipeline_frame_t;
+
+/** Frame callback, called in frame order from the callback stage thread
+ *
+ * @param arg User argument
+ * @param frame The frame, only valid during the call
+ */
+typedef void (*ouster_pipeline_fn_t)(void *arg, ouster_pipeline_frame_t const *frame);
+
+typedef struct
+{
+	ouster_meta_t *meta;
+	/** Optional, converts the OUSTER_QUANTITY_RANGE field to xyz */
+	ouster_lut_t const *lut;
+	/** Quantity and depth of the fields to decode, like ouster_field_init() */
+	ouster_field_t const *fields;
+	int fcount;
+	/** Non zero also delivers destaggered copies of the fields */
+	int destagger;
+	/** Lidar UDP socket, e.g. from ouster_sock_create_udp_lidar(), not closed by the pipeline */
+	int sock;
+	/** Capacity of the packet queue, 0 uses 1024 */
+	int packets;
+	/** Capacity of every frame queue, 0 uses 2 */
+	int frames;
+	/** What happens when the queue into a stage is full, the receive entry is not used */
+	ouster_pipeline_policy_t policy[OUSTER_PIPELINE_COUNT];
+	/** Non zero pins every stage thread to its ouster_pipeline_desc_t::cpu */
+	int pin;
+	/** CPU of each stage thread when pinned, a negative value lets the scheduler decide */
+	int cpu[OUSTER_PIPELINE_COUNT];
+	/** Optional, the cartesian stage splits its work on this pool. Only used by the pipeline while it runs */
+	ouster_pool_t *workers;
+	ouster_pipeline_fn_t fn;
+	void *arg;
+} ouster_pipeline_desc_t;
+
+typedef struct
+{
+	ouster_pipeline_desc_t desc;
+	pthread_t threads[OUSTER_PIPELINE_COUNT];
+	/** Packets to decode and free packet buffers handed back to the receive stage */
+	ouster_spsc_t packets;
+	ouster_spsc_t packets_free;
+	char *packet_buf;
+	int packet_size;
+	/** Owned by the decode stage */
+	ouster_frame_pool_t pool;
+	/** Outputs of every pool frame */
+	ouster_pipeline_frame_t *outputs;
+	int range_index;
+	/** Frames into each stage from the stage before */
+	ouster_spsc_t queues[OUSTER_PIPELINE_COUNT];
+	/** Frames that stage is done with, released by the decode stage */
+	ouster_spsc_t returns[OUSTER_PIPELINE_COUNT];
+	/** Packets or frames finished by each stage, read with ouster_pipeline_stats() */
+	int64_t processed[OUSTER_PIPELINE_COUNT];
+	/** Packets or frames dropped because the queue into each stage was full */
+	int64_t dropped[OUSTER_PIPELINE_COUNT];
+	int quit;
+} ouster_pipeline_t;
+
+/** Per stage counters */
+typedef struct
+{
+	int64_t processed;
+	int64_t dropped;
+} ouster_pipeline_stats_t;
+
+/** Allocates the queues and frames and starts one thread per stage
+ *
+ * @param p The pipeline
+ * @param desc What to decode and where to deliver it, copied
+ * @return Returns 0 on ok otherwise -1 when a thread could not be started
+ */
+int ouster_pipeline_start(ouster_pipeline_t *p, ouster_pipeline_desc_t const *desc);
+
+/** Stops and joins the stage threads and frees everything, frames still queued are discarded
+ *
+ * @param p The pipeline
+ */
+void ouster_pipeline_stop(ouster_pipeline_t *p);
+
+/** Reads the counters of a stage, can be called from any thread
+ *
+ * @param p The pipeline
+ * @param stage The stage
+ * @param stats Counters
+ */
+void ouster_pipeline_stats(ouster_pipeline_t *p, ouster_pipeline_stage_t stage, ouster_pipeline_stats_t *stats);
+
+/** Returns the name of a stage
+ *
+ * @param stage The stage
+ * @return Stage name
+ */
+char const *ouster_pipeline_stage_str(ouster_pipeline_stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_PIPELINE_H
+
+/** @} */
\ No newline at end of file
@@ -0,0 +1,81 @@
+/**
+ * @defgroup pool Thread pool
+ * @brief Runs a parallel for loop on a fixed set of threads
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_POOL_H
+#define OUSTER_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Job function
+ *
+ * @param arg User argument given to ouster_pool_run()
+ * @param index Job index from 0 to count-1
+ * @param worker Index of the executing worker from 0 to ouster_pool_t::count-1, use it to index per-worker buffers
+ */
+typedef void (*ouster_pool_fn_t)(void *arg, int index, int worker);
+
+typedef struct
+{
+	/** Number of workers including the thread calling ouster_pool_run() */
+	int count;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	ouster_pool_fn_t fn;
+	void *arg;
+	/** Number of jobs in the current run */
+	int jobs;
+	/** Next job to hand out */
+	int next;
+	/** Number of jobs finished */
+	int finished;
+	/** Incremented for every run, wakes the workers */
+	uint64_t generation;
+	int quit;
+	/** Number of threads that have picked their worker index */
+	int started;
+} ouster_pool_t;
+
+/** Returns the number of online CPUs */
+int ouster_pool_cpu_count(void);
+
+/** Starts count-1 worker threads, the caller of ouster_pool_run() is the last worker
+ *
+ * @param pool The pool
+ * @param count Number of workers, 0 or less uses ouster_pool_cpu_count()
+ */
+void ouster_pool_init(ouster_pool_t *pool, int count);
+
+/** Stops and joins the worker threads
+ *
+ * @param pool The pool
+ */
+void ouster_pool_fini(ouster_pool_t *pool);
+
+/** Calls fn(arg, index, worker) for index 0 to count-1 and returns when all calls have finished
+ *
+ * @param pool The pool
+ * @param fn Job function
+ * @param arg User argument
+ * @param count Number of jobs
+ */
+void ouster_pool_run(ouster_pool_t *pool, ouster_pool_fn_t fn, void *arg, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_POOL_H
+
+/** @} */
\ No newline at end of file
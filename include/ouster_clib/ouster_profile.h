@@ -0,0 +1,113 @@
+/**
+ * @defgroup profile Stage profiling
+ * @brief Latency histograms of the pipeline stages
+ *
+ * The library records the stages it runs itself: receive in ouster_net_read(), decode in ouster_lidar_get_fields(),
+ * frame from first packet to completion in ouster_frame_pool_push(), destagger in ouster_field_destagger() and
+ * cartesian in the ouster_lut_cartesian and ouster_lut_f32_cartesian functions.
+ * Applications record OUSTER_STAGE_HANDOFF where a consumer takes over the result.
+ *
+ * Instrumentation is only compiled in when OUSTER_ENABLE_PROFILE or OUSTER_ENABLE_TRACE is defined,
+ * otherwise ouster_profile_begin() and ouster_profile_end() expand to nothing and all counts stay zero.
+ * With OUSTER_ENABLE_TRACE every stage is also recorded as an event of @ref trace.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_PROFILE_H
+#define OUSTER_PROFILE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	OUSTER_STAGE_RECEIVE,
+	OUSTER_STAGE_DECODE,
+	OUSTER_STAGE_FRAME,
+	OUSTER_STAGE_DESTAGGER,
+	OUSTER_STAGE_CARTESIAN,
+	OUSTER_STAGE_HANDOFF,
+	OUSTER_STAGE_COUNT
+} ouster_stage_t;
+
+/** Every power of two is split in 1 << OUSTER_PROFILE_SUB_BITS buckets, the error of a value is at most 1/16 */
+#define OUSTER_PROFILE_SUB_BITS 4
+
+/** Values from 2^OUSTER_PROFILE_MAX_BITS ns (about 18 minutes) go into the last bucket */
+#define OUSTER_PROFILE_MAX_BITS 40
+
+#define OUSTER_PROFILE_BUCKETS ((OUSTER_PROFILE_MAX_BITS - OUSTER_PROFILE_SUB_BITS + 1) << OUSTER_PROFILE_SUB_BITS)
+
+typedef struct
+{
+	int64_t count;
+	int64_t sum_ns;
+	int64_t min_ns;
+	int64_t max_ns;
+	int64_t mean_ns;
+	/** Percentiles are the upper bound of their bucket */
+	int64_t p50_ns;
+	int64_t p90_ns;
+	int64_t p99_ns;
+	int64_t p999_ns;
+} ouster_profile_stats_t;
+
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+#define ouster_profile_begin(t) int64_t t = ouster_os_clock_ns()
+#define ouster_profile_end(t, stage) ouster_profile_span((stage), (t), ouster_os_clock_ns())
+#else
+#define ouster_profile_begin(t)
+#define ouster_profile_end(t, stage)
+#endif
+
+/** Adds one latency sample, safe to call from any thread
+ *
+ * @param stage One of ouster_stage_t
+ * @param ns Latency in nanoseconds
+ */
+void ouster_profile_record(int stage, int64_t ns);
+
+/** Records a stage that ran from begin_ns to end_ns in the histogram with OUSTER_ENABLE_PROFILE
+ * and as a trace event with OUSTER_ENABLE_TRACE
+ *
+ * @param stage One of ouster_stage_t
+ * @param begin_ns ouster_os_clock_ns() at begin
+ * @param end_ns ouster_os_clock_ns() at end
+ */
+void ouster_profile_span(int stage, int64_t begin_ns, int64_t end_ns);
+
+/** Reads count, min, max, mean and percentiles of a stage
+ *
+ * @param stage One of ouster_stage_t
+ * @param stats Output
+ */
+void ouster_profile_stats(int stage, ouster_profile_stats_t *stats);
+
+/** Latency below which a fraction q of the samples are
+ *
+ * @param stage One of ouster_stage_t
+ * @param q Fraction from 0 to 1
+ * @return Returns the upper bound of the bucket in nanoseconds but at most the max, 0 without samples
+ */
+int64_t ouster_profile_percentile(int stage, double q);
+
+/** Name of a stage
+ *
+ * @param stage One of ouster_stage_t
+ */
+char const *ouster_profile_stage_str(int stage);
+
+/** Clears all stages, samples recorded at the same time may be lost */
+void ouster_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_PROFILE_H
+
+/** @} */
\ No newline at end of file
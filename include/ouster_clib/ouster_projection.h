@@ -0,0 +1,80 @@
+/**
+ * @defgroup projection Inverse projection
+ * @brief Maps 3D points in the sensor frame to pixels of the destaggered range image
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_PROJECTION_H
+#define OUSTER_PROJECTION_H
+
+#include "ouster_clib/ouster_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of the altitude edge table, power of two larger than OUSTER_MAX_ROWS */
+#define OUSTER_PROJECTION_EDGES (OUSTER_MAX_ROWS * 2)
+
+typedef struct
+{
+	int w;
+	int h;
+	int mid0;
+	int columns_per_frame;
+	/** Sensor frame in meters to lidar frame in mm, rows of a 3x4 matrix */
+	float sensor_to_lidar[12];
+	/** Beam origin offsets in mm */
+	float beam_x;
+	float beam_z;
+	/** Altitude in radians between beam k-1 and k sorted from top to bottom, padded with -inf */
+	float edge[OUSTER_PROJECTION_EDGES];
+	/** First step of the binary search over edge */
+	int search_step;
+	/** Row of beam k sorted from top to bottom */
+	int32_t edge_row[OUSTER_MAX_ROWS];
+	/** Per row sin and cos of the beam azimuth offset */
+	float azimuth_sin[OUSTER_MAX_ROWS];
+	float azimuth_cos[OUSTER_MAX_ROWS];
+	/** Per row destagger shift in [0, w) */
+	int32_t shift[OUSTER_MAX_ROWS];
+} ouster_projection_t;
+
+/** Precomputes the inverse of ouster_lut_init() from meta configuration
+ *
+ * @param proj The projection
+ * @param meta meta configuration
+ */
+void ouster_projection_init(ouster_projection_t *proj, ouster_meta_t const *meta);
+
+/** Finds the pixel of the destaggered range image that a point was measured by.
+ * The row is found by binary search over the beam altitudes, the column from the azimuth.
+ *
+ * @param proj The projection
+ * @param xyz Point in the sensor frame in meters, as given by ouster_lut_cartesian_f32()
+ * @param row Output row
+ * @param col Output column in the destaggered image
+ * @return Returns 1 if the point is inside the field of view and column window otherwise 0
+ */
+int ouster_projection_pixel(ouster_projection_t const *proj, float const xyz[3], int *row, int *col);
+
+/** Maps many points to pixels of the destaggered range image, uses AVX2 when available.
+ * Gives the same pixels as ouster_projection_pixel().
+ *
+ * @param proj The projection
+ * @param xyz Points in the sensor frame in meters
+ * @param xyz_stride Bytes between points in xyz
+ * @param n Number of points
+ * @param pixels Output pixel index row * w + col per point, -1 when outside
+ */
+void ouster_projection_pixels(ouster_projection_t const *proj, void const *xyz, int xyz_stride, int n, int32_t *pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_PROJECTION_H
+
+/** @} */
\ No newline at end of file
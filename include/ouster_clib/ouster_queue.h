@@ -0,0 +1,98 @@
+/**
+ * @defgroup queue Lock-free handoff
+ * @brief Single producer single consumer queue and latest item mailbox
+ *
+ * Typical use with @ref frame: the receive thread puts completed frames in a mailbox, the consumer takes the newest
+ * and pushes it on a queue back to the receive thread when done, which then returns it to the frame pool.
+ * Nothing is copied and neither side ever waits for the other.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_QUEUE_H
+#define OUSTER_QUEUE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Producer and consumer indices are kept this far apart so they do not share a cache line */
+#define OUSTER_QUEUE_CACHELINE 64
+
+typedef struct
+{
+	void **items;
+	/** Capacity - 1, capacity is a power of two */
+	uint64_t mask;
+	char pad0[OUSTER_QUEUE_CACHELINE];
+	/** Next slot to push, written by the producer */
+	uint64_t head;
+	/** Last tail seen by the producer */
+	uint64_t tail_cache;
+	char pad1[OUSTER_QUEUE_CACHELINE];
+	/** Next slot to pop, written by the consumer */
+	uint64_t tail;
+	/** Last head seen by the consumer */
+	uint64_t head_cache;
+	char pad2[OUSTER_QUEUE_CACHELINE];
+} ouster_spsc_t;
+
+/** Holds at most one item, a new item replaces the one not taken yet */
+typedef struct
+{
+	void *item;
+} ouster_mailbox_t;
+
+/** Allocates a queue
+ *
+ * @param q The queue
+ * @param capacity Max number of items, rounded up to a power of two
+ */
+void ouster_spsc_init(ouster_spsc_t *q, int capacity);
+
+/** Frees the queue
+ *
+ * @param q The queue
+ */
+void ouster_spsc_fini(ouster_spsc_t *q);
+
+/** Adds an item, only call from the producer thread
+ *
+ * @param q The queue
+ * @param item Item, not NULL
+ * @return Returns 0 on ok otherwise -1 when the queue is full
+ */
+int ouster_spsc_push(ouster_spsc_t *q, void *item);
+
+/** Removes the oldest item, only call from the consumer thread
+ *
+ * @param q The queue
+ * @return Returns the item or NULL when the queue is empty
+ */
+void *ouster_spsc_pop(ouster_spsc_t *q);
+
+/** Puts an item in the mailbox, wait-free
+ *
+ * @param mb The mailbox
+ * @param item Item, not NULL
+ * @return Returns the previous item when the consumer did not take it, the caller owns it again
+ */
+void *ouster_mailbox_put(ouster_mailbox_t *mb, void *item);
+
+/** Takes the newest item from the mailbox, wait-free
+ *
+ * @param mb The mailbox
+ * @return Returns the item or NULL when nothing new was put
+ */
+void *ouster_mailbox_take(ouster_mailbox_t *mb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_QUEUE_H
+
+/** @} */
\ No newline at end of file
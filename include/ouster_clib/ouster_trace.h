@@ -0,0 +1,76 @@
+/**
+ * @defgroup trace Event tracing
+ * @brief Records begin and end of every stage per thread and writes Chrome trace-event JSON
+ *
+ * Open the output in chrome://tracing or https://ui.perfetto.dev to see how receive, decode and
+ * worker threads overlap. Events go into one lock-free ring, the oldest are overwritten when it is full.
+ *
+ * The library records the stages of @ref profile, the jobs of the thread pool and the capture reads and writes,
+ * but only when compiled with OUSTER_ENABLE_TRACE. Applications can always call ouster_trace_record().
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_TRACE_H
+#define OUSTER_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Max number of threads that get a name in the output */
+#define OUSTER_TRACE_MAX_THREADS 256
+
+#ifdef OUSTER_ENABLE_TRACE
+#define ouster_trace_begin(t) int64_t t = ouster_os_clock_ns()
+#define ouster_trace_end(t, name, arg) ouster_trace_record((name), (t), ouster_os_clock_ns(), (arg))
+#define ouster_trace_thread_name(name) ouster_trace_thread_name_(name)
+#else
+#define ouster_trace_begin(t)
+#define ouster_trace_end(t, name, arg)
+#define ouster_trace_thread_name(name)
+#endif
+
+/** Allocates the ring and starts recording
+ *
+ * @param capacity Number of events kept
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_trace_start(int capacity);
+
+/** Stops recording and frees the ring, no other thread may record at the same time */
+void ouster_trace_stop(void);
+
+/** Adds a complete event, safe to call from any thread and does nothing when not started
+ *
+ * @param name Name of the event, must be a string literal or otherwise outlive the trace, no JSON escaping is done
+ * @param begin_ns ouster_os_clock_ns() at begin
+ * @param end_ns ouster_os_clock_ns() at end
+ * @param arg Shown as args.arg, for example a frame id, negative values are left out
+ */
+void ouster_trace_record(char const *name, int64_t begin_ns, int64_t end_ns, int64_t arg);
+
+/** Names the calling thread in the output
+ *
+ * @param name Thread name, must be a string literal or otherwise outlive the trace
+ */
+void ouster_trace_thread_name_(char const *name);
+
+/** Writes the events in the ring as Chrome trace-event JSON, can be called while recording
+ *
+ * @param f Output file
+ * @return Returns the number of events written
+ */
+int ouster_trace_dump(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_TRACE_H
+
+/** @} */
\ No newline at end of file
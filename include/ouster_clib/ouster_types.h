@@ -203,6 +203,12 @@ typedef struct
 	int last_mid;
 	int mid_loss;
 	int num_valid_pixels;
+	/* First and last valid mid of the last packet, -1 when the packet had no valid columns */
+	int packet_mid0;
+	int packet_mid1;
+	/* Optional bitmap owned by the caller with one bit per column of the fields,
+	 * bit (mid - mid0) is set for every valid column copied. See ouster_frame_pool_t */
+	uint64_t *valid_cols;
 } ouster_lidar_t;
 
 typedef struct
@@ -258,8 +264,49 @@ typedef struct
 	int h;
 	double *direction;
 	double *offset;
+	/* User transform folded into direction and offset, row major, translation in meters */
+	double transform[16];
+	/* direction and offset without user transform, allocated by the first ouster_lut_set_transform() */
+	double *direction_base;
+	double *offset_base;
+	/* Memory map of a LUT cache file that holds direction and offset, see ouster_lut_load() */
+	void *map;
+	int64_t map_size;
 } ouster_lut_t;
 
+/* Float32 structure of arrays LUT, each plane is 64 byte aligned */
+typedef struct
+{
+	int w;
+	int h;
+	float *dx;
+	float *dy;
+	float *dz;
+	float *ox;
+	float *oy;
+	float *oz;
+	/* Allocation that holds all planes */
+	void *memory;
+} ouster_lut_f32_t;
+
+/* Fixed-point LUT for integer xyz output.
+ * direction planes are Q20 output units per mm, offset planes are Q10 output units */
+typedef struct
+{
+	int w;
+	int h;
+	/* Output unit in mm, e.g. 1 or 4 */
+	int unit_mm;
+	int32_t *dx;
+	int32_t *dy;
+	int32_t *dz;
+	int32_t *ox;
+	int32_t *oy;
+	int32_t *oz;
+	/* Allocation that holds all planes */
+	void *memory;
+} ouster_lut_fixed_t;
+
 /*
 https://static.ouster.dev/sensor-docs/image_route1/image_route2/sensor_data/sensor-data.html#single-return-profile
 RRRR Y0SS NN00
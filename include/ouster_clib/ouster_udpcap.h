@@ -24,8 +24,22 @@ typedef enum {
 	OUSTER_UDPCAP_ERROR_FREAD,
 	OUSTER_UDPCAP_ERROR_FWRITE,
 	OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL,
+	OUSTER_UDPCAP_ERROR_FOPEN,
+	OUSTER_UDPCAP_ERROR_EOF,
 } ouster_udpcap_error_t;
 
+/** Port of the footer record that closes a capture segment */
+#define OUSTER_UDPCAP_PORT_FOOTER UINT32_C(0xFFFFFFFF)
+
+/** Identifies a footer record, "OUCF" */
+#define OUSTER_UDPCAP_FOOTER_MAGIC UINT32_C(0x4643554F)
+
+/** Max length of capture file paths */
+#define OUSTER_UDPCAP_PATH_MAX 1024
+
+/** Segmented captures are named <path>.<segment> */
+#define OUSTER_UDPCAP_SEGMENT_FORMAT "%s.%06i"
+
 typedef struct
 {
 	uint32_t port;
@@ -33,6 +47,56 @@ typedef struct
 	char buf[];
 } ouster_udpcap_t;
 
+/** Payload of the footer record written when a segment is closed.
+ * All values are little endian in the file. */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t segment;
+	/** Number of records in the segment, footer excluded */
+	uint64_t records;
+	/** Number of bytes in the segment, footer excluded */
+	uint64_t bytes;
+	/** Monotonic time in nanoseconds when the segment was opened */
+	uint64_t t_open;
+	/** Monotonic time in nanoseconds when the segment was closed */
+	uint64_t t_close;
+} ouster_udpcap_footer_t;
+
+/** Writes capture records and rotates to a new segment file at size or time limits */
+typedef struct
+{
+	char path[OUSTER_UDPCAP_PATH_MAX];
+	/** Rotate before a segment grows beyond this many bytes, 0 = no limit */
+	int64_t max_bytes;
+	/** Rotate when a segment has been open this many nanoseconds, 0 = no limit */
+	int64_t max_ns;
+	FILE *file;
+	int segmented;
+	int segment;
+	int64_t bytes;
+	int64_t records;
+	int64_t t_open;
+	int64_t t_flush;
+} ouster_udpcap_writer_t;
+
+/** Reads a plain capture file or all segments of a segmented capture as one stream */
+typedef struct
+{
+	char path[OUSTER_UDPCAP_PATH_MAX];
+	FILE *file;
+	int segmented;
+	int segment;
+	/** Last segment found when the capture was opened */
+	int last;
+	/** Number of segments that ended with an incomplete record */
+	int truncated;
+	/** Number of segments between the first and last segment that could not be opened */
+	int missing;
+	/** Footer of the most recently finished segment */
+	ouster_udpcap_footer_t footer;
+} ouster_udpcap_reader_t;
+
 /** Read file into capture buffer
  *
  * @param cap The capture buffer.
@@ -50,6 +114,18 @@ int ouster_udpcap_read(ouster_udpcap_t *cap, FILE *f);
  */
 int ouster_udpcap_sendto(ouster_udpcap_t *cap, int sock, ouster_net_addr_t *addr);
 
+/** Send multiple capture buffers from sock to addr in batches
+ *
+ * Each capture buffer is sent to the port stored in the capture buffer.
+ *
+ * @param caps The capture buffers.
+ * @param n Number of capture buffers
+ * @param sock The source socket filedescriptor
+ * @param addr The destination address
+ * @return Returns the number of capture buffers sent, or -1 for errors
+ */
+int ouster_udpcap_sendmmsg(ouster_udpcap_t *caps[], int n, int sock, ouster_net_addr_t *addr);
+
 /** Find header in request.
  *
  * @param cap The capture buffer.
@@ -59,6 +135,84 @@ int ouster_udpcap_sendto(ouster_udpcap_t *cap, int sock, ouster_net_addr_t *addr
  */
 int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f);
 
+/** Receive one UDP packet into the capture buffer
+ *
+ * @param cap The capture buffer, cap->size is the buffer capacity.
+ * @param sock The socket filedescriptor
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_recv(ouster_udpcap_t *cap, int sock);
+
+/** Write the capture buffer as one record
+ *
+ * @param cap The capture buffer.
+ * @param f Destination file
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_write(ouster_udpcap_t const *cap, FILE *f);
+
+/** Truncates an incomplete record at the end of a capture file and appends a footer
+ *
+ * @param filename The capture file
+ * @param segment Segment number stored in a new footer
+ * @param footer Optional output of the footer that was found or written
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_recover(char const *filename, int segment, ouster_udpcap_footer_t *footer);
+
+/** Open a capture writer.
+ * Without any limits a single plain capture file is written to path,
+ * otherwise segments are written to path.000000, path.000001, ...
+ * continuing after the last existing segment.
+ *
+ * @param w The writer
+ * @param path Capture file path
+ * @param max_bytes Segment size limit in bytes, 0 = no limit
+ * @param max_ns Segment duration limit in nanoseconds, 0 = no limit
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_writer_open(ouster_udpcap_writer_t *w, char const *path, int64_t max_bytes, int64_t max_ns);
+
+/** Write a capture record, rotates segment when a limit is reached
+ *
+ * @param w The writer
+ * @param cap The capture buffer.
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_writer_write(ouster_udpcap_writer_t *w, ouster_udpcap_t const *cap);
+
+/** Write footer, sync and close the current segment
+ *
+ * @param w The writer
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_writer_close(ouster_udpcap_writer_t *w);
+
+/** Open a capture reader.
+ * Opens path as a plain capture file if it exists, otherwise as a segmented capture.
+ *
+ * @param r The reader
+ * @param path Capture file path
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_reader_open(ouster_udpcap_reader_t *r, char const *path);
+
+/** Read the next record, footers are skipped and segments are stitched together.
+ * A truncated segment ends at its last complete record.
+ * Segments that are missing are skipped and counted in r->missing.
+ *
+ * @param r The reader
+ * @param cap The capture buffer, cap->size is the buffer capacity.
+ * @return Returns 0 on ok, OUSTER_UDPCAP_ERROR_EOF at the end of the capture, otherwise error code
+ */
+int ouster_udpcap_reader_read(ouster_udpcap_reader_t *r, ouster_udpcap_t *cap);
+
+/** Close the capture reader
+ *
+ * @param r The reader
+ */
+void ouster_udpcap_reader_close(ouster_udpcap_reader_t *r);
+
 /** Set the UDP port of the capture buffer.
  *
  * @param cap The capture buffer.
@@ -66,6 +220,14 @@ int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f);
  */
 void ouster_udpcap_set_port(ouster_udpcap_t *cap, int port);
 
+/** Writes a segmented capture to path, removes a segment in the middle and reads it back.
+ * The segment files are removed afterwards.
+ *
+ * @param path Capture file path
+ * @return Returns 1 when all records of the remaining segments are read and the gap is counted
+ */
+int test_ouster_udpcap(char const *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -664,6 +664,306 @@ jsmntok_t *json_parse_string(char const *json, jsmntok_t *t, char const *path[],
 	return t;
 }
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Transparent huge page size on x86_64 and aarch64 with 4 kB pages */
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+#define ARENA_PAGE 4096
+
+/* Size classes are 16 << k bytes including the block header, the largest is 16 MB */
+#define ARENA_CLASS_MIN_SHIFT 4
+#define ARENA_CLASS_COUNT 21
+
+/* Free blocks a thread keeps per class before half of them go back to the shared lists */
+#define ARENA_CACHE_MAX 64
+
+/* Class of blocks from the system allocator */
+#define ARENA_CLASS_SYSTEM UINT16_C(0xFFFF)
+#define ARENA_MAGIC UINT32_C(0x4E455241)
+
+typedef struct
+{
+	uint16_t cls;
+	/** Subsystem from ouster_os_mem_count_alloc() */
+	uint16_t tag;
+	uint32_t magic;
+	/** Requested size */
+	uint64_t size;
+} arena_header_t;
+
+typedef struct arena_block_t
+{
+	struct arena_block_t *next;
+} arena_block_t;
+
+typedef struct
+{
+	arena_block_t *head[ARENA_CLASS_COUNT];
+	int count[ARENA_CLASS_COUNT];
+	int registered;
+} arena_cache_t;
+
+static ouster_arena_t arena_memory;
+static arena_block_t *arena_shared[ARENA_CLASS_COUNT];
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static __thread arena_cache_t arena_cache;
+
+int ouster_arena_init(ouster_arena_t *arena, size_t capacity)
+{
+	ouster_assert_notnull(arena);
+	memset(arena, 0, sizeof(ouster_arena_t));
+	capacity = (capacity + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+	// Map one extra huge page so the base can be aligned for the kernel to use huge pages
+	size_t map_size = capacity + ARENA_HUGE_PAGE;
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	arena->map = map;
+	arena->map_size = map_size;
+	arena->base = (char *)(((uintptr_t)map + ARENA_HUGE_PAGE - 1) & ~(uintptr_t)(ARENA_HUGE_PAGE - 1));
+	arena->capacity = capacity;
+	arena->used = 0;
+#ifdef MADV_HUGEPAGE
+	// Only a hint, the arena works with normal pages when transparent huge pages are disabled
+	madvise(arena->base, capacity, MADV_HUGEPAGE);
+#endif
+	return 0;
+}
+
+void ouster_arena_fini(ouster_arena_t *arena)
+{
+	ouster_assert_notnull(arena);
+	if (arena->map) {
+		munmap(arena->map, arena->map_size);
+	}
+	memset(arena, 0, sizeof(ouster_arena_t));
+}
+
+void ouster_arena_prefault(ouster_arena_t *arena)
+{
+	ouster_assert_notnull(arena);
+	for (size_t i = 0; i < arena->capacity; i += ARENA_PAGE) {
+		((volatile char *)arena->base)[i] = 0;
+	}
+}
+
+void *ouster_arena_alloc(ouster_arena_t *arena, size_t size)
+{
+	ouster_assert_notnull(arena);
+	size = (size + OUSTER_ARENA_ALIGN - 1) & ~(size_t)(OUSTER_ARENA_ALIGN - 1);
+	size_t offset = __atomic_fetch_add(&arena->used, size, __ATOMIC_RELAXED);
+	if ((offset + size) > arena->capacity) {
+		return NULL;
+	}
+	return arena->base + offset;
+}
+
+void ouster_arena_reset(ouster_arena_t *arena)
+{
+	ouster_assert_notnull(arena);
+	__atomic_store_n(&arena->used, 0, __ATOMIC_RELAXED);
+}
+
+/* Smallest class holding size bytes plus header, ARENA_CLASS_COUNT when too large */
+static int arena_class(size_t size)
+{
+	uint64_t total = (uint64_t)size + sizeof(arena_header_t);
+	if (total > ((uint64_t)1 << (ARENA_CLASS_MIN_SHIFT + ARENA_CLASS_COUNT - 1))) {
+		return ARENA_CLASS_COUNT;
+	}
+	// Number of bits of total - 1 is log2 of the next power of two, total is at least 16
+	int bits = 64 - __builtin_clzll(total - 1);
+	return bits > ARENA_CLASS_MIN_SHIFT ? (bits - ARENA_CLASS_MIN_SHIFT) : 0;
+}
+
+/* Returns the blocks cached by an exiting thread to the shared lists */
+static void arena_cache_flush(void *arg)
+{
+	arena_cache_t *cache = arg;
+	pthread_mutex_lock(&arena_lock);
+	for (int k = 0; k < ARENA_CLASS_COUNT; ++k) {
+		while (cache->head[k]) {
+			arena_block_t *b = cache->head[k];
+			cache->head[k] = b->next;
+			b->next = arena_shared[k];
+			arena_shared[k] = b;
+		}
+		cache->count[k] = 0;
+	}
+	pthread_mutex_unlock(&arena_lock);
+}
+
+static void arena_key_create(void)
+{
+	pthread_key_create(&arena_key, arena_cache_flush);
+}
+
+static arena_cache_t *arena_cache_get(void)
+{
+	arena_cache_t *cache = &arena_cache;
+	if (cache->registered == 0) {
+		pthread_once(&arena_key_once, arena_key_create);
+		pthread_setspecific(arena_key, cache);
+		cache->registered = 1;
+	}
+	return cache;
+}
+
+static void *arena_system_alloc(size_t size)
+{
+	arena_header_t *h = malloc(sizeof(arena_header_t) + size);
+	if (h == NULL) {
+		return NULL;
+	}
+	h->cls = ARENA_CLASS_SYSTEM;
+	h->tag = (uint16_t)ouster_os_mem_count_alloc(size);
+	h->magic = ARENA_MAGIC;
+	h->size = size;
+	return h + 1;
+}
+
+static void *arena_alloc(size_t size)
+{
+	int k = arena_class(size);
+	if (k >= ARENA_CLASS_COUNT) {
+		return arena_system_alloc(size);
+	}
+	arena_cache_t *cache = arena_cache_get();
+	if (cache->head[k] == NULL) {
+		// Take half a cache worth of blocks from the shared list
+		pthread_mutex_lock(&arena_lock);
+		while (arena_shared[k] && (cache->count[k] < (ARENA_CACHE_MAX / 2))) {
+			arena_block_t *b = arena_shared[k];
+			arena_shared[k] = b->next;
+			b->next = cache->head[k];
+			cache->head[k] = b;
+			cache->count[k]++;
+		}
+		pthread_mutex_unlock(&arena_lock);
+	}
+	arena_header_t *h;
+	if (cache->head[k]) {
+		arena_block_t *b = cache->head[k];
+		cache->head[k] = b->next;
+		cache->count[k]--;
+		h = (arena_header_t *)b;
+	} else {
+		h = ouster_arena_alloc(&arena_memory, (size_t)1 << (ARENA_CLASS_MIN_SHIFT + k));
+		if (h == NULL) {
+			return arena_system_alloc(size);
+		}
+	}
+	h->cls = (uint16_t)k;
+	h->tag = (uint16_t)ouster_os_mem_count_alloc(size);
+	h->magic = ARENA_MAGIC;
+	h->size = size;
+	return h + 1;
+}
+
+static size_t arena_usable(arena_header_t const *h)
+{
+	if (h->cls == ARENA_CLASS_SYSTEM) {
+		return h->size;
+	}
+	return ((size_t)1 << (ARENA_CLASS_MIN_SHIFT + h->cls)) - sizeof(arena_header_t);
+}
+
+static void arena_free(void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	arena_header_t *h = (arena_header_t *)ptr - 1;
+	ouster_assert(h->magic == ARENA_MAGIC, "Not allocated by the arena allocator");
+	ouster_os_mem_count_free(h->tag, h->size);
+	if (h->cls == ARENA_CLASS_SYSTEM) {
+		free(h);
+		return;
+	}
+	int k = (int)h->cls;
+	arena_cache_t *cache = arena_cache_get();
+	arena_block_t *b = (arena_block_t *)h;
+	b->next = cache->head[k];
+	cache->head[k] = b;
+	cache->count[k]++;
+	if (cache->count[k] > ARENA_CACHE_MAX) {
+		pthread_mutex_lock(&arena_lock);
+		while (cache->count[k] > (ARENA_CACHE_MAX / 2)) {
+			b = cache->head[k];
+			cache->head[k] = b->next;
+			b->next = arena_shared[k];
+			arena_shared[k] = b;
+			cache->count[k]--;
+		}
+		pthread_mutex_unlock(&arena_lock);
+	}
+}
+
+static void *ouster_os_arena_malloc(size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_malloc_count, 1, __ATOMIC_RELAXED);
+	return arena_alloc(size);
+}
+
+static void *ouster_os_arena_calloc(size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_calloc_count, 1, __ATOMIC_RELAXED);
+	void *ptr = arena_alloc(size);
+	if (ptr) {
+		// Recycled blocks are not zero
+		memset(ptr, 0, size);
+	}
+	return ptr;
+}
+
+static void ouster_os_arena_free(void *ptr)
+{
+	__atomic_fetch_add(&ouster_os_api_free_count, 1, __ATOMIC_RELAXED);
+	arena_free(ptr);
+}
+
+static void *ouster_os_arena_realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_realloc_count, 1, __ATOMIC_RELAXED);
+	if (ptr == NULL) {
+		return arena_alloc(size);
+	}
+	arena_header_t *h = (arena_header_t *)ptr - 1;
+	ouster_assert(h->magic == ARENA_MAGIC, "Not allocated by the arena allocator");
+	size_t usable = arena_usable(h);
+	if ((h->cls != ARENA_CLASS_SYSTEM) && (size <= usable)) {
+		ouster_os_mem_count_free(h->tag, h->size);
+		h->tag = (uint16_t)ouster_os_mem_count_alloc(size);
+		h->size = size;
+		return ptr;
+	}
+	void *dst = arena_alloc(size);
+	if (dst) {
+		memcpy(dst, ptr, usable < size ? usable : size);
+		arena_free(ptr);
+	}
+	return dst;
+}
+
+int ouster_os_set_api_arena(size_t capacity)
+{
+	ouster_os_set_api_defaults();
+	if (ouster_arena_init(&arena_memory, capacity) != 0) {
+		return -1;
+	}
+	ouster_os_api.malloc_ = ouster_os_arena_malloc;
+	ouster_os_api.free_ = ouster_os_arena_free;
+	ouster_os_api.realloc_ = ouster_os_arena_realloc;
+	ouster_os_api.calloc_ = ouster_os_arena_calloc;
+	return 0;
+}
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -699,1451 +999,5706 @@ int ouster_assert_(
 	fflush(stderr);
 	return r;
 }
+
 #include <string.h>
 
-void ouster_dump_lidar_header(FILE *f, ouster_lidar_header_t const *p)
+typedef struct
 {
-	ouster_assert_notnull(f);
-	ouster_assert_notnull(p);
-	fprintf(f, "type=%ji, frame=%ji, init=%ji, prod=%ji, countdown_thermal_shutdown=%ji, countdown_shot_limiting=%ji, thermal_shutdown=%ji, shot_limiting=%ji\n",
-	        (intmax_t)p->packet_type,
-	        (intmax_t)p->frame_id,
-	        (intmax_t)p->init_id,
-	        (intmax_t)p->prod_sn,
-	        (intmax_t)p->countdown_thermal_shutdown,
-	        (intmax_t)p->countdown_shot_limiting,
-	        (intmax_t)p->thermal_shutdown,
-	        (intmax_t)p->shot_limiting);
-}
-
-void ouster_dump_column(FILE *f, ouster_column_t const *column)
+	ouster_batch_frame_t frame;
+	/** Raw lidar packets of the frame, lidar_packet_size each */
+	char *buf;
+	int cap;
+	int range_index;
+} batch_slot_t;
+
+typedef struct
 {
-	ouster_assert_notnull(f);
-	ouster_assert_notnull(column);
-	fprintf(f, "ts=%ji, status=%ji, mid=%ji\n", (intmax_t)column->ts, (intmax_t)column->status, (intmax_t)column->mid);
-}
+	ouster_batch_desc_t const *desc;
+	batch_slot_t *slots;
+} batch_t;
 
-void ouster_dump_meta(FILE * f, ouster_meta_t const *meta)
+static void slot_init(batch_slot_t *slot, ouster_batch_desc_t const *desc)
 {
-	ouster_assert_notnull(f);
-	ouster_assert_notnull(meta);
-	fprintf(f, "ouster_meta_t dump:\n");
-	fprintf(f, "%40s: %i\n", "(Azimuth columns start) mid0", meta->mid0);
-	fprintf(f, "%40s: %i\n", "(Azimuth columns end) mid1", meta->mid1);
-	fprintf(f, "%40s: %i\n", "(Azimuth columns width) midw", meta->midw);
-	fprintf(f, "%40s: %i\n", "udp_port_lidar", meta->udp_port_lidar);
-	fprintf(f, "%40s: %i\n", "udp_port_imu", meta->udp_port_imu);
-	fprintf(f, "%40s: %i\n", "columns_per_frame", meta->columns_per_frame);
-	fprintf(f, "%40s: %i\n", "columns_per_packet", meta->columns_per_packet);
-	fprintf(f, "%40s: %i\n", "pixels_per_column", meta->pixels_per_column);
-	fprintf(f, "%40s: %iB\n", "channel_data_size", meta->channel_data_size);
-	fprintf(f, "%40s: %i\n", "profile", meta->profile);
-	fprintf(f, "%40s: %i\n", "channel_data_size", meta->channel_data_size);
-	fprintf(f, "%40s: %iB\n", "col_size", meta->col_size);
-	fprintf(f, "%40s: %iB\n", "lidar_packet_size", meta->lidar_packet_size);
-} 
-
-#include <string.h>
+	memset(slot, 0, sizeof(batch_slot_t));
+	slot->range_index = -1;
+	slot->frame.fcount = desc->fcount;
+	slot->frame.fields = ouster_os_calloc(sizeof(ouster_field_t) * desc->fcount);
+	ouster_assert_notnull(slot->frame.fields);
+	for (int i = 0; i < desc->fcount; ++i) {
+		slot->frame.fields[i].quantity = desc->fields[i].quantity;
+		slot->frame.fields[i].depth = desc->fields[i].depth;
+		if ((desc->fields[i].quantity == OUSTER_QUANTITY_RANGE) && (desc->fields[i].depth == 4)) {
+			slot->range_index = i;
+		}
+	}
+	ouster_field_init(slot->frame.fields, desc->fcount, desc->meta);
+	if (desc->lut) {
+		ouster_assert(slot->range_index >= 0, "A 4 byte OUSTER_QUANTITY_RANGE field is needed for xyz");
+		slot->frame.xyz = ouster_lut_alloc(desc->lut);
+	}
+}
 
-void ouster_field_init(ouster_field_t fields[], int count, ouster_meta_t *meta)
+static void slot_fini(batch_slot_t *slot)
 {
-	ouster_assert_notnull(fields);
-	ouster_assert_notnull(meta);
-	ouster_field_t *f = fields;
-	for (int i = 0; i < count; ++i, f++) {
-		ouster_assert(f->depth > 0, "");
-		f->rows = meta->pixels_per_column;
-		f->cols = meta->midw;
-		f->rowsize = f->cols * f->depth;
-		f->size = f->rows * f->cols * f->depth;
-		f->data = ouster_os_calloc(f->size);
+	for (int i = 0; i < slot->frame.fcount; ++i) {
+		ouster_os_free(slot->frame.fields[i].data);
 	}
+	ouster_os_free(slot->frame.fields);
+	ouster_os_free(slot->frame.xyz);
+	ouster_os_free(slot->buf);
 }
 
-void ouster_field_fini(ouster_field_t fields[], int count)
+static void slot_append(batch_slot_t *slot, char const *packet, int size)
 {
-	ouster_assert_notnull(fields);
-	ouster_field_t *f = fields;
-	for (int i = 0; i < count; ++i, f++) {
-		ouster_os_free(f->data);
-		memset(f->data, 0, sizeof(ouster_field_t));
+	int need = (slot->frame.packets + 1) * size;
+	if (need > slot->cap) {
+		slot->cap = need * 2;
+		slot->buf = ouster_os_realloc(slot->buf, slot->cap);
+		ouster_assert_notnull(slot->buf);
 	}
+	memcpy(slot->buf + slot->frame.packets * size, packet, size);
+	slot->frame.packets++;
 }
 
-void ouster_field_cpy(ouster_field_t dst[], ouster_field_t src[], int count)
+/* Returns the reader result, other packets such as IMU are skipped */
+static int read_lidar_packet(ouster_udpcap_reader_t *reader, ouster_udpcap_t *cap, int size)
 {
-	ouster_assert_notnull(dst);
-	ouster_assert_notnull(src);
-	// memcpy(dst, src, sizeof(ouster_field_t) * count);
-	for (int i = 0; i < count; ++i, ++dst, ++src) {
-		memcpy(dst->data, src->data, src->size);
-	}
+	do {
+		cap->size = OUSTER_NET_UDP_MAX_SIZE;
+		int rc = ouster_udpcap_reader_read(reader, cap);
+		if (rc != OUSTER_UDPCAP_OK) {
+			return rc;
+		}
+	} while ((int)cap->size != size);
+	return OUSTER_UDPCAP_OK;
 }
 
-/*
-https://static.ouster.dev/sdk-docs/reference/lidar-scan.html#staggering-and-destaggering
-*/
-void ouster_destagger(void *data, int cols, int rows, int depth, int rowsize, int pixel_shift_by_row[])
+static int packet_frame_id(ouster_udpcap_t const *cap)
 {
-	ouster_assert_notnull(data);
-	ouster_assert_notnull(pixel_shift_by_row);
-	char *row = data;
-	for (int irow = 0; irow < rows; ++irow, row += rowsize) {
-		int offset = (pixel_shift_by_row[irow] + cols) % cols;
-		memmove(row + depth * offset, row, depth * (cols - offset));
-		memmove(row, row + depth * (cols - offset), depth * offset);
-	}
+	ouster_lidar_header_t header;
+	ouster_lidar_header_get(cap->buf, &header);
+	return (int)header.frame_id;
 }
 
-void ouster_field_destagger(ouster_field_t fields[], int count, ouster_meta_t *meta)
+static void decode(void *arg, int index, int worker)
 {
-	ouster_assert_notnull(fields);
-	ouster_assert_notnull(meta);
-	for (int i = 0; i < count; ++i, ++fields) {
-		ouster_destagger(fields->data, fields->cols, fields->rows, fields->depth, fields->rowsize, meta->pixel_shift_by_row);
+	ouster_unused(worker);
+	batch_t *batch = arg;
+	ouster_batch_desc_t const *desc = batch->desc;
+	batch_slot_t *slot = batch->slots + index;
+	ouster_batch_frame_t *frame = &slot->frame;
+	int size = desc->meta->lidar_packet_size;
+
+	ouster_trace_begin(t);
+	ouster_field_zero(frame->fields, frame->fcount);
+	memset(&frame->lidar, 0, sizeof(ouster_lidar_t));
+	frame->lidar.frame_id = -1;
+	for (int i = 0; i < frame->packets; ++i) {
+		ouster_lidar_get_fields(&frame->lidar, desc->meta, slot->buf + i * size, frame->fields, frame->fcount);
+	}
+	ouster_trace_end(t, "batch_decode", frame->lidar.frame_id);
+	if (desc->lut) {
+		ouster_lut_cartesian_f64(desc->lut, frame->fields[slot->range_index].data, frame->xyz, 3 * sizeof(double));
 	}
 }
 
-void ouster_field_apply_mask_u32(ouster_field_t *field, ouster_meta_t *meta)
+int ouster_batch_run(ouster_batch_desc_t const *desc, char const *path, ouster_batch_stats_t *stats)
 {
-	ouster_assert_notnull(field);
-	ouster_assert_notnull(meta);
-	ouster_extract_t const *extract = meta->extract + field->quantity;
-	uint32_t mask = extract->mask;
-	if (mask == 0xFFFFFFFF) {
-		return;
+	ouster_assert_notnull(desc);
+	ouster_assert_notnull(desc->meta);
+	ouster_assert_notnull(desc->fn);
+	ouster_assert_notnull(path);
+	ouster_assert(desc->fields || (desc->fcount == 0), "");
+
+	if (stats) {
+		memset(stats, 0, sizeof(ouster_batch_stats_t));
 	}
-	int rows = field->rows;
-	int cols = field->cols;
-	int cells = rows * cols;
 
-	ouster_assert(field->depth == 4, "Destination data depth other than 4 is not supported");
-	switch (field->depth) {
-	case 1: {
-		ouster_assert(mask <= UINT8_MAX, "Mask is too big");
-		uint8_t *data8 = (uint8_t *)field->data;
-		for (int i = 0; i < cells; ++i) {
-			uint16_t value = data8[i];
-			value &= (uint16_t)mask;
-			data8[i] = value;
-		}
-	} break;
-	case 2: {
-		ouster_assert(mask <= UINT16_MAX, "Mask is too big");
-		uint16_t *data16 = (uint16_t *)field->data;
-		for (int i = 0; i < cells; ++i) {
-			uint16_t value = data16[i];
-			value &= (uint16_t)mask;
-			data16[i] = value;
+	ouster_udpcap_reader_t reader;
+	int rc = ouster_udpcap_reader_open(&reader, path);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+
+	ouster_pool_t pool;
+	ouster_pool_init(&pool, desc->threads);
+	int nslots = pool.count * (desc->frames_per_thread > 0 ? desc->frames_per_thread : 2);
+	batch_t batch = {desc, ouster_os_calloc(sizeof(batch_slot_t) * nslots)};
+	ouster_assert_notnull(batch.slots);
+	for (int i = 0; i < nslots; ++i) {
+		slot_init(batch.slots + i, desc);
+	}
+
+	int size = desc->meta->lidar_packet_size;
+	ouster_udpcap_t *cap = ouster_os_calloc(sizeof(ouster_udpcap_t) + OUSTER_NET_UDP_MAX_SIZE);
+	ouster_assert_notnull(cap);
+	int index = 0;
+	// cap always holds the next lidar packet
+	rc = read_lidar_packet(&reader, cap, size);
+	int more = (rc == OUSTER_UDPCAP_OK);
+	while (more) {
+		int n = 0;
+		while (more && (n < nslots)) {
+			batch_slot_t *slot = batch.slots + n++;
+			slot->frame.packets = 0;
+			slot->frame.index = index++;
+			int frame_id = packet_frame_id(cap);
+			do {
+				slot_append(slot, cap->buf, size);
+				rc = read_lidar_packet(&reader, cap, size);
+				more = (rc == OUSTER_UDPCAP_OK);
+			} while (more && (packet_frame_id(cap) == frame_id));
 		}
-	} break;
-	case 4: {
-		ouster_assert(mask <= UINT32_MAX, "Mask is too big");
-		uint32_t *data32 = (uint32_t *)field->data;
-		for (int i = 0; i < cells; ++i) {
-			uint32_t value = data32[i];
-			value &= mask;
-			data32[i] = value;
+		ouster_pool_run(&pool, decode, &batch, n);
+		for (int i = 0; i < n; ++i) {
+			desc->fn(desc->arg, &batch.slots[i].frame);
 		}
-	} break;
 	}
-}
 
-void ouster_field_zero(ouster_field_t fields[], int count)
-{
-	ouster_assert_notnull(fields);
-	for (int i = 0; i < count; ++i, ++fields) {
-		memset(fields->data, 0, fields->size);
+	if (rc == OUSTER_UDPCAP_ERROR_EOF) {
+		rc = OUSTER_UDPCAP_OK;
+	} else {
+		ouster_log_error("%s: reading frame %i failed, error %i\n", path, index, rc);
 	}
+	if (reader.truncated || reader.missing) {
+		ouster_log_warn("%s: %i truncated and %i missing segments\n", path, reader.truncated, reader.missing);
+	}
+	if (stats) {
+		stats->frames = index;
+		stats->truncated = reader.truncated;
+		stats->missing = reader.missing;
+	}
+
+	ouster_os_free(cap);
+	for (int i = 0; i < nslots; ++i) {
+		slot_fini(batch.slots + i);
+	}
+	ouster_os_free(batch.slots);
+	ouster_pool_fini(&pool);
+	ouster_udpcap_reader_close(&reader);
+	return rc;
 }
 
-#include <errno.h>
-#include <stdint.h>
-#include <stdio.h>
 #include <string.h>
-#include <unistd.h>
 
-#define COLOR_FILENAME "\033[38;2;150;150;255m" // Blue
-#define COLOR_CWD "\033[38;2;150;150;255m"      // Blue
-#define COLOR_ERROR "\033[38;2;255;50;50m"      // Red
-#define COLOR_RST "\033[0m"
+/* Marks unused space at the end of the ring */
+#define BLACKBOX_PORT_PAD UINT32_C(0xFFFFFFFE)
 
-int ouster_fs_readfile_failed_reason(char const *filename, char *buf, int len)
+/* Backlog written per pushed byte while an incident capture is ongoing */
+#define BLACKBOX_FLUSH_FACTOR 4
+
+/* Ring records are 8 byte aligned: [int64_t t][ouster_udpcap_t][payload] */
+#define BLACKBOX_RECORD_HEADER_SIZE (sizeof(int64_t) + sizeof(ouster_udpcap_t))
+#define BLACKBOX_RECORD_SIZE(size) ((BLACKBOX_RECORD_HEADER_SIZE + (size) + 7) & ~(int64_t)7)
+
+static int64_t record_t(ouster_blackbox_t const *bb, int64_t offset)
 {
-	char const *e = strerror(errno);
-	char cwd[1024] = {0};
-	char *rc = getcwd(cwd, sizeof(cwd));
-	rc = rc ? rc : "";
-	int n = snprintf(buf, len, "cwd:%s%s%s path:%s%s%s error:%s%s%s",
-	                 COLOR_CWD, rc, COLOR_RST,
-	                 COLOR_FILENAME, filename, COLOR_RST,
-	                 COLOR_ERROR, e, COLOR_RST);
-	return n;
+	int64_t t;
+	memcpy(&t, bb->data + offset, sizeof(int64_t));
+	return t;
 }
 
-void ouster_fs_pwd()
+static ouster_udpcap_t *record_cap(ouster_blackbox_t const *bb, int64_t offset)
 {
-	char cwd[1024] = {0};
-	char *rc = getcwd(cwd, sizeof(cwd));
-	if (rc == NULL) {
-		ouster_log("getcwd error: %s\n", strerror(errno));
-		return;
-	}
-	printf("Current working directory: %s%s%s\n", COLOR_CWD, cwd, COLOR_RST);
+	return (void *)(bb->data + offset + sizeof(int64_t));
 }
 
-char *ouster_fs_readfile(char const *path)
+/* Returns the number of padding bytes at offset, 0 if a record starts there */
+static int64_t padding_at(ouster_blackbox_t const *bb, int64_t offset)
 {
-	ouster_assert_notnull(path);
-	char *content = NULL;
-
-	FILE *file = fopen(path, "r");
-	if (file == NULL) {
-		goto error;
-	}
-
-	fseek(file, 0, SEEK_END);
-	int32_t size = (int32_t)ftell(file);
-
-	if (size == -1) {
-		goto error;
+	int64_t rest = bb->capacity - offset;
+	if ((rest < (int64_t)BLACKBOX_RECORD_HEADER_SIZE) || (record_cap(bb, offset)->port == BLACKBOX_PORT_PAD)) {
+		return rest;
 	}
-	rewind(file);
+	return 0;
+}
 
-	content = ouster_os_malloc(size + 1);
-	content[size] = '\0';
-	size_t n = fread(content, size, 1, file);
-	if (n != 1) {
-		ouster_log("%s: could not read wholef file %d bytes\n", path, size);
-		goto error;
+/* Moves tail and dump past padding, returns non zero if tail moved */
+static int skip_padding(ouster_blackbox_t *bb)
+{
+	int moved = 0;
+	if (bb->used > 0) {
+		int64_t pad = padding_at(bb, bb->tail);
+		if (pad) {
+			bb->used -= pad;
+			bb->tail = 0;
+			moved = 1;
+		}
 	}
-	ouster_assert(content[size] == '\0', "Expected null terminator");
-	fclose(file);
-	return content;
-error:
-	if (content) {
-		ouster_os_free(content);
+	if (bb->dump_used > 0) {
+		int64_t pad = padding_at(bb, bb->dump);
+		if (pad) {
+			bb->dump_used -= pad;
+			bb->dump = 0;
+		}
 	}
-	return NULL;
+	return moved;
 }
 
-#include <fcntl.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/socket.h>
-#include <unistd.h>
-
-#define HTTP_EOL "\r\n\r\n"
-
-void ouster_http_request(int sock, char const *host, char const *path, ouster_vec_t *v)
+/* The oldest record has not been written to the incident capture yet */
+static int oldest_undumped(ouster_blackbox_t const *bb)
 {
-	ouster_assert_notnull(host);
-	ouster_assert_notnull(path);
-	ouster_assert_notnull(v);
-	ouster_assert(v->esize == 1, "");
-	{
-		char buf[1024] = {0};
-		int n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: %s\r\nAccept: */*" HTTP_EOL, path, host);
-		ouster_log("REQ START:\n%s\nREQ END\n", buf);
-		ssize_t written = write(sock, buf, n);
-		if(n != written) {
-			ouster_log("write failed: %s\n", buf);
-			return;
-		}
-	}
+	return (bb->dump_used > 0) && (bb->dump == bb->tail);
+}
 
-	while (1) {
-		char buf[1024] = {0};
-		ssize_t n = recv(sock, buf, sizeof(buf), 0);
-		if (n <= 0) {
-			break;
-		}
-		ouster_vec_append(v, buf, n, 1.5f);
+static int dump_start(ouster_blackbox_t *bb, int64_t t)
+{
+	bb->trigger_t = t;
+	if (bb->dumping) {
+		// Extend the ongoing incident
+		bb->dump_closing = 0;
+		return OUSTER_UDPCAP_OK;
 	}
-	{
-		char *e = OUSTER_OFFSET(v->data, v->esize * v->count);
-		e[0] = '\0';
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	snprintf(filename, sizeof(filename), OUSTER_BLACKBOX_FILE_FORMAT, bb->path, bb->incidents);
+	ouster_log("Black-box incident capture '%s'\n", filename);
+	int rc = ouster_udpcap_writer_open(&bb->writer, filename, 0, 0);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
 	}
+	bb->incidents++;
+	bb->dumping = 1;
+	bb->dump_closing = 0;
+	bb->dump = bb->tail;
+	bb->dump_used = bb->used;
+	return OUSTER_UDPCAP_OK;
+}
 
-	char *json = strstr(v->data, HTTP_EOL);
-	if (json) {
-		json += strlen(HTTP_EOL);
-		size_t n = strlen(json);
-		memcpy(v->data, json, n);
-		v->count = n;
-		char *e = OUSTER_OFFSET(v->data, v->esize * v->count);
-		e[0] = '\0';
+/* Writes the oldest record not yet written to the incident capture */
+static int dump_one(ouster_blackbox_t *bb)
+{
+	skip_padding(bb);
+	if (bb->dump_used == 0) {
+		return OUSTER_UDPCAP_OK;
 	}
+	ouster_udpcap_t const *cap = record_cap(bb, bb->dump);
+	int64_t size = BLACKBOX_RECORD_SIZE(cap->size);
+	int rc = ouster_udpcap_writer_write(&bb->writer, cap);
+	bb->dump = (bb->dump + size) % bb->capacity;
+	bb->dump_used -= size;
+	return rc;
 }
-#include <string.h>
 
-void ouster_lidar_header_get1(char const *buf, void *dst, int type)
+static int dump_finish(ouster_blackbox_t *bb)
 {
-	ouster_assert_notnull(buf);
-	ouster_assert_notnull(dst);
-	switch (type) {
-	case ouster_id(ouster_packet_type_t):
-		memcpy(dst, buf + 0, sizeof(ouster_packet_type_t));
-		break;
-	case ouster_id(ouster_frame_id_t):
-		memcpy(dst, buf + 2, sizeof(ouster_frame_id_t));
-		break;
-	case ouster_id(ouster_init_id_t):
-		memcpy(dst, buf + 4, sizeof(ouster_init_id_t));
-		*((ouster_init_id_t *)dst) &= UINT32_C(0x00ffffff);
-		break;
-	case ouster_id(ouster_prod_sn_t):
-		memcpy(dst, buf + 7, sizeof(ouster_prod_sn_t));
-		*((ouster_prod_sn_t *)dst) &= UINT64_C(0x000000ffffffffff);
-		break;
-	case ouster_id(ouster_countdown_thermal_shutdown_t):
-		memcpy(dst, buf + 16, sizeof(ouster_countdown_thermal_shutdown_t));
-		break;
-	case ouster_id(ouster_countdown_shot_limiting_t):
-		memcpy(dst, buf + 17, sizeof(ouster_countdown_shot_limiting_t));
-		break;
-	case ouster_id(ouster_thermal_shutdown_t):
-		memcpy(dst, buf + 18, sizeof(ouster_thermal_shutdown_t));
-		break;
-	case ouster_id(ouster_shot_limiting_t):
-		memcpy(dst, buf + 19, sizeof(ouster_shot_limiting_t));
-		break;
-	default:
-		ouster_assert(0, "");
-		break;
-	}
+	bb->dumping = 0;
+	bb->dump_closing = 0;
+	bb->dump_used = 0;
+	return ouster_udpcap_writer_close(&bb->writer);
 }
 
-void ouster_lidar_header_get(char const *buf, ouster_lidar_header_t *dst)
+/* Removes the oldest record, it is written first if it is part of an incident */
+static int pop(ouster_blackbox_t *bb)
 {
-	ouster_assert_notnull(buf);
-	ouster_assert_notnull(dst);
-	ouster_lidar_header_get1(buf, &dst->packet_type, ouster_id(ouster_packet_type_t));
-	ouster_lidar_header_get1(buf, &dst->frame_id, ouster_id(ouster_frame_id_t));
-	ouster_lidar_header_get1(buf, &dst->init_id, ouster_id(ouster_init_id_t));
-	ouster_lidar_header_get1(buf, &dst->prod_sn, ouster_id(ouster_prod_sn_t));
-	ouster_lidar_header_get1(buf, &dst->countdown_thermal_shutdown, ouster_id(ouster_countdown_thermal_shutdown_t));
-	ouster_lidar_header_get1(buf, &dst->countdown_shot_limiting, ouster_id(ouster_countdown_shot_limiting_t));
-	ouster_lidar_header_get1(buf, &dst->thermal_shutdown, ouster_id(ouster_thermal_shutdown_t));
-	ouster_lidar_header_get1(buf, &dst->shot_limiting, ouster_id(ouster_shot_limiting_t));
+	int rc = OUSTER_UDPCAP_OK;
+	skip_padding(bb);
+	if (bb->used == 0) {
+		return rc;
+	}
+	if (oldest_undumped(bb)) {
+		rc = dump_one(bb);
+	}
+	int64_t size = BLACKBOX_RECORD_SIZE(record_cap(bb, bb->tail)->size);
+	bb->tail = (bb->tail + size) % bb->capacity;
+	bb->used -= size;
+	return rc;
 }
 
-void ouster_column_get1(char const *colbuf, void *dst, int type)
+/* Makes room for a record of size bytes at head */
+static int make_room(ouster_blackbox_t *bb, int64_t size)
 {
-	ouster_assert_notnull(colbuf);
-	ouster_assert_notnull(dst);
-	switch (type) {
-	case ouster_id(ouster_timestamp_t):
-		memcpy(dst, colbuf + 0, sizeof(ouster_timestamp_t));
-		break;
-	case ouster_id(ouster_measurment_id_t):
-		memcpy(dst, colbuf + 8, sizeof(ouster_measurment_id_t));
-		break;
-	case ouster_id(ouster_status_t):
-		memcpy(dst, colbuf + 10, sizeof(ouster_status_t));
-		*((ouster_status_t *)dst) &= 0xffff;
-		break;
-	default:
-		ouster_assert(0, "");
-		break;
+	int rc = OUSTER_UDPCAP_OK;
+	while (rc == OUSTER_UDPCAP_OK) {
+		if (bb->used == 0) {
+			bb->head = 0;
+			bb->tail = 0;
+			bb->dump = 0;
+		}
+		if ((bb->head > bb->tail) || (bb->used == 0)) {
+			int64_t rest = bb->capacity - bb->head;
+			if (rest >= size) {
+				break;
+			}
+			// Not enough room at the end, wrap around to the start
+			if (rest >= (int64_t)BLACKBOX_RECORD_HEADER_SIZE) {
+				record_cap(bb, bb->head)->port = BLACKBOX_PORT_PAD;
+			}
+			bb->used += rest;
+			bb->dump_used += (bb->dumping && !bb->dump_closing) ? rest : 0;
+			bb->head = 0;
+		} else if ((bb->tail - bb->head) >= size) {
+			break;
+		} else if (skip_padding(bb) == 0) {
+			bb->overwritten += !oldest_undumped(bb);
+			rc = pop(bb);
+		}
 	}
+	return rc;
 }
 
-void ouster_column_get(char const *colbuf, ouster_column_t *dst)
+void ouster_blackbox_init(ouster_blackbox_t *bb, char const *path, int64_t capacity, int64_t window_ns, int64_t post_ns)
 {
-	ouster_assert_notnull(colbuf);
-	ouster_assert_notnull(dst);
-	ouster_column_get1(colbuf, &dst->ts, ouster_id(ouster_timestamp_t));
-	ouster_column_get1(colbuf, &dst->status, ouster_id(ouster_status_t));
-	ouster_column_get1(colbuf, &dst->mid, ouster_id(ouster_measurment_id_t));
+	ouster_assert_notnull(bb);
+	ouster_assert_notnull(path);
+	ouster_assert(capacity > 0, "");
+	ouster_assert(window_ns >= 0, "");
+	ouster_assert(post_ns >= 0, "");
+
+	memset(bb, 0, sizeof(ouster_blackbox_t));
+	snprintf(bb->path, sizeof(bb->path), "%s", path);
+	bb->capacity = capacity & ~(int64_t)7;
+	bb->window_ns = window_ns;
+	bb->post_ns = post_ns;
+	bb->data = ouster_os_malloc(bb->capacity);
+	ouster_assert_notnull(bb->data);
+	// Touch every page now instead of page faulting on the receive thread
+	memset(bb->data, 0, bb->capacity);
 }
 
-void pxcpy(char *dst, int dst_inc, char const *src, int src_inc, int n, int esize)
+void ouster_blackbox_fini(ouster_blackbox_t *bb)
 {
-	ouster_assert_notnull(dst);
-	ouster_assert_notnull(src);
-	char *d = dst;
-	char const *s = src;
-	for (int i = 0; i < n; i++, d += dst_inc, s += src_inc) {
-		memcpy(d, s, esize);
+	ouster_assert_notnull(bb);
+	if (bb->dumping) {
+		while (bb->dump_used > 0) {
+			dump_one(bb);
+		}
+		dump_finish(bb);
 	}
+	ouster_os_free(bb->data);
+	bb->data = NULL;
 }
 
-void field_copy(ouster_field_t *field, ouster_meta_t *meta, int mid, char const *pxbuf)
+void ouster_blackbox_trigger(ouster_blackbox_t *bb)
 {
-	ouster_assert_notnull(field);
-	ouster_assert_notnull(meta);
-	ouster_assert_notnull(pxbuf);
-	// Row major - each row is continuous memory
-	char *data = field->data;
-	ouster_extract_t *extract = meta->extract + field->quantity;
-	int depth = extract->depth;
-	int offset = extract->offset;
-	int rowsize = field->rowsize;
-	int rows = meta->pixels_per_column;
-	int mid0 = meta->mid0;
-	int mid1 = meta->mid1;
-	ouster_assert(mid <= mid1, "Incorrect mid=%i (Column Measurement Id) not in range %i to %i", mid, mid0, mid1);
-	char *dst = data + (mid - mid0) * field->depth;
-	pxcpy(dst, rowsize, pxbuf + offset, meta->channel_data_size, rows, depth);
+	ouster_assert_notnull(bb);
+	__atomic_store_n(&bb->trigger_request, 1, __ATOMIC_RELEASE);
 }
 
-void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char const *buf, ouster_field_t *fields, int fcount)
+int ouster_blackbox_flush(ouster_blackbox_t *bb, int64_t max_bytes, int64_t t)
 {
-	ouster_assert_notnull(lidar);
-	ouster_assert_notnull(buf);
-	ouster_assert(fields || ((fields == NULL) && (fcount == 0)), "");
-
-	char const *colbuf = buf + OUSTER_PACKET_HEADER_SIZE;
-	ouster_lidar_header_t header = {0};
-	ouster_column_t column = {0};
-	ouster_lidar_header_get(buf, &header);
-	// ouster_lidar_header_dump(&header);
-	ouster_column_get(colbuf, &column);
+	ouster_assert_notnull(bb);
 
-	if (lidar->frame_id != (int)header.frame_id) {
-		// ouster_log("New Frame!\n");
-		lidar->frame_id = (int)header.frame_id;
-		// lidar->last_mid = 0;
-		lidar->last_mid = column.mid - 1;
-		lidar->mid_loss = 0;
-		lidar->num_valid_pixels = 0;
+	int rc = OUSTER_UDPCAP_OK;
+	if (__atomic_exchange_n(&bb->trigger_request, 0, __ATOMIC_ACQUIRE)) {
+		rc = dump_start(bb, t);
+	}
+	if (bb->dumping == 0) {
+		return rc;
+	}
+	if ((t - bb->trigger_t) >= bb->post_ns) {
+		bb->dump_closing = 1;
+	}
+	int64_t written = 0;
+	while ((rc == OUSTER_UDPCAP_OK) && (bb->dump_used > 0) && ((max_bytes < 0) || (written < max_bytes))) {
+		int64_t before = bb->dump_used;
+		rc = dump_one(bb);
+		written += before - bb->dump_used;
 	}
+	if (bb->dump_closing && (bb->dump_used == 0)) {
+		int rc2 = dump_finish(bb);
+		rc = (rc == OUSTER_UDPCAP_OK) ? rc2 : rc;
+	}
+	return rc;
+}
 
-	int mid_delta = column.mid - lidar->last_mid;
-	// ouster_log("mid_delta %i\n", mid_delta);
-	lidar->mid_loss += (mid_delta - 1);
+int ouster_blackbox_push(ouster_blackbox_t *bb, ouster_udpcap_t const *cap, int64_t t)
+{
+	ouster_assert_notnull(bb);
+	ouster_assert_notnull(cap);
 
-	// col_size = 1584
-	for (int icol = 0; icol < meta->columns_per_packet; icol++, colbuf += meta->col_size) {
-		ouster_column_get(colbuf, &column);
-		// ouster_dump_column(stdout, &column);
+	int64_t size = BLACKBOX_RECORD_SIZE(cap->size);
+	if (size > bb->capacity) {
+		return OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL;
+	}
 
-		if ((column.status & 0x01) == 0) {
-			continue;
-		}
-		char const *pxbuf = colbuf + OUSTER_COLUMN_HEADER_SIZE;
+	int rc = ouster_blackbox_flush(bb, 0, t);
 
-		for (int j = 0; j < fcount; ++j) {
-			ouster_assert(fields[j].cols > 0, "");
-			ouster_assert(fields[j].rows > 0, "");
-			ouster_assert(fields[j].depth > 0, "");
-			field_copy(fields + j, meta, column.mid, pxbuf);
-			lidar->num_valid_pixels += meta->pixels_per_column;
+	// Forget packets older than the window unless they still belong to an incident
+	while ((rc == OUSTER_UDPCAP_OK) && (bb->used > 0)) {
+		skip_padding(bb);
+		if ((bb->used == 0) || oldest_undumped(bb) || ((t - record_t(bb, bb->tail)) < bb->window_ns)) {
+			break;
 		}
-		lidar->last_mid = column.mid;
+		rc = pop(bb);
 	}
 
-	for (int j = 0; j < fcount; ++j) {
-		// TODO: Refactor this mask procedure
-		ouster_field_apply_mask_u32(fields + j, meta);
+	if (rc == OUSTER_UDPCAP_OK) {
+		rc = make_room(bb, size);
+	}
+	if (rc != OUSTER_UDPCAP_OK) {
+		// Writing the incident failed, there may be no room for the packet
+		bb->dropped++;
+		return rc;
 	}
 
-	for (int j = 0; j < fcount; ++j) {
-		ouster_assert_notnull(fields[j].data);
-		ouster_assert(fields[j].cols > 0, "");
-		ouster_assert(fields[j].rows > 0, "");
-		ouster_assert(fields[j].depth > 0, "");
+	memcpy(bb->data + bb->head, &t, sizeof(int64_t));
+	ouster_udpcap_t *dst = record_cap(bb, bb->head);
+	dst->port = cap->port;
+	dst->size = cap->size;
+	memcpy(dst->buf, cap->buf, cap->size);
+	bb->head += size;
+	bb->used += size;
+
+	if (bb->dumping) {
+		bb->dump_used += bb->dump_closing ? 0 : size;
+		int rc2 = ouster_blackbox_flush(bb, size * BLACKBOX_FLUSH_FACTOR, t);
+		rc = (rc == OUSTER_UDPCAP_OK) ? rc2 : rc;
 	}
+
+	return rc;
 }
-/**
- * @defgroup math Math
- * @brief Functionality for math
- *
- * \ingroup c
- * @{
- */
 
-#ifndef OUSTER_MATH_H
-#define OUSTER_MATH_H
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#define OUSTER_M4(i, j) ((i) * 4 + (j))
-#define OUSTER_M3(i, j) ((i) * 3 + (j))
+#include <string.h>
 
-#define OUSTER_REAL_FORMAT "%+20.10f"
+#define SLOT_INDEX_BITS 16
+#define SLOT_INDEX_MASK ((1 << SLOT_INDEX_BITS) - 1)
 
-#define OUSTER_V3_ARGS(x) (x)[0], (x)[1], (x)[2]
-#define OUSTER_V4_ARGS(x) (x)[0], (x)[1], (x)[2], (x)[3]
+static inline uint64_t slot_state(uint64_t seq, int index)
+{
+	return ((seq + 1) << SLOT_INDEX_BITS) | (uint64_t)index;
+}
 
-#define OUSTER_V3_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT "\n"
-#define OUSTER_V4_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT "\n"
+/* Gives frames that nobody references anymore back to the pool */
+static void broadcast_collect(ouster_broadcast_t *b)
+{
+	for (int i = 0; i < b->pool->count; ++i) {
+		if (b->held[i] && (__atomic_load_n(b->refs + i, __ATOMIC_ACQUIRE) == 0)) {
+			b->held[i] = 0;
+			ouster_frame_pool_release(b->pool, b->pool->frames + i);
+		}
+	}
+}
 
-#define OUSTER_V3_DOT(a, b) ((a)[0] * (b)[0] + (a)[1] * (b)[1] + (a)[2] * (b)[2])
-#define OUSTER_V4_DOT(a, b) ((a)[0] * (b)[0] + (a)[1] * (b)[1] + (a)[2] * (b)[2] + (a)[3] * (b)[3])
+void ouster_broadcast_init(ouster_broadcast_t *b, ouster_frame_pool_t *pool, int capacity)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(pool);
+	ouster_assert(capacity > 0, "");
+	ouster_assert(pool->count <= SLOT_INDEX_MASK, "Too many frames to index");
+	uint64_t n = 1;
+	while (n < (uint64_t)capacity) {
+		n <<= 1;
+	}
+	memset(b, 0, sizeof(ouster_broadcast_t));
+	b->pool = pool;
+	b->mask = n - 1;
+	b->slots = ouster_os_calloc(n * sizeof(uint64_t));
+	b->refs = ouster_os_calloc(pool->count * sizeof(int));
+	b->held = ouster_os_calloc(pool->count);
+	ouster_assert_notnull(b->slots);
+	ouster_assert_notnull(b->refs);
+	ouster_assert_notnull(b->held);
+}
 
-#define OUSTER_M3_ARGS_1(x) (x)[0], (x)[1], (x)[2], (x)[3], (x)[4], (x)[5], (x)[6], (x)[7], (x)[8]
-#define OUSTER_M3_ARGS_2(x) (x)[0], (x)[3], (x)[6], (x)[1], (x)[4], (x)[7], (x)[2], (x)[5], (x)[8]
-#define OUSTER_M4_ARGS_1(x) (x)[0], (x)[1], (x)[2], (x)[3], (x)[4], (x)[5], (x)[6], (x)[7], (x)[8], (x)[9], (x)[10], (x)[11], (x)[12], (x)[13], (x)[14], (x)[15]
-#define OUSTER_M4_ARGS_2(x) (x)[0], (x)[4], (x)[8], (x)[12], (x)[1], (x)[5], (x)[9], (x)[13], (x)[2], (x)[6], (x)[10], (x)[14], (x)[3], (x)[7], (x)[11], (x)[15]
+void ouster_broadcast_fini(ouster_broadcast_t *b)
+{
+	ouster_assert_notnull(b);
+	for (uint64_t i = 0; i <= b->mask; ++i) {
+		uint64_t state = b->slots[i];
+		if (state) {
+			b->refs[state & SLOT_INDEX_MASK]--;
+		}
+	}
+	broadcast_collect(b);
+	for (int i = 0; i < b->pool->count; ++i) {
+		ouster_assert(b->held[i] == 0, "A consumer still holds a frame");
+	}
+	ouster_os_free(b->slots);
+	ouster_os_free(b->refs);
+	ouster_os_free(b->held);
+	memset(b, 0, sizeof(ouster_broadcast_t));
+}
 
-#define OUSTER_M3_FORMAT OUSTER_V3_FORMAT OUSTER_V3_FORMAT OUSTER_V3_FORMAT
-#define OUSTER_M4_FORMAT OUSTER_V4_FORMAT OUSTER_V4_FORMAT OUSTER_V4_FORMAT OUSTER_V4_FORMAT
+void ouster_broadcast_publish(ouster_broadcast_t *b, ouster_frame_t *frame)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(frame);
+	int index = frame - b->pool->frames;
+	ouster_assert(index >= 0 && index < b->pool->count, "Frame is not from the pool");
+	ouster_assert(b->held[index] == 0, "Frame published twice");
+
+	// Added instead of stored, a consumer may still be undoing a reference taken on an overwritten slot
+	__atomic_add_fetch(b->refs + index, 1, __ATOMIC_SEQ_CST);
+	b->held[index] = 1;
+
+	uint64_t seq = b->head;
+	uint64_t *slot = b->slots + (seq & b->mask);
+	uint64_t old = *slot;
+	__atomic_store_n(slot, slot_state(seq, index), __ATOMIC_SEQ_CST);
+	if (old) {
+		// Consumers that still read the old frame hold their own reference
+		__atomic_sub_fetch(b->refs + (old & SLOT_INDEX_MASK), 1, __ATOMIC_SEQ_CST);
+	}
+	__atomic_store_n(&b->head, seq + 1, __ATOMIC_RELEASE);
 
-void ouster_m3f64_mul(double r[9], double const a[9], double const x[9]);
+	broadcast_collect(b);
+}
 
-void ouster_m4_print(double const a[16]);
+void ouster_broadcast_reader_init(ouster_broadcast_t *b, ouster_broadcast_reader_t *r)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(r);
+	memset(r, 0, sizeof(ouster_broadcast_reader_t));
+	r->next = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+}
 
-void ouster_m3_print(double const a[9]);
+ouster_frame_t *ouster_broadcast_acquire(ouster_broadcast_t *b, ouster_broadcast_reader_t *r)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(r);
+	uint64_t capacity = b->mask + 1;
+	while (1) {
+		uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+		if (r->next == head) {
+			return NULL;
+		}
+		if ((head - r->next) > capacity) {
+			// The oldest frames of this consumer were overwritten
+			r->dropped += (head - capacity) - r->next;
+			r->next = head - capacity;
+		}
+		uint64_t *slot = b->slots + (r->next & b->mask);
+		uint64_t state = __atomic_load_n(slot, __ATOMIC_SEQ_CST);
+		if (state != slot_state(r->next, state & SLOT_INDEX_MASK)) {
+			// Overwritten after head was read, skip ahead
+			continue;
+		}
+		int index = state & SLOT_INDEX_MASK;
+		__atomic_add_fetch(b->refs + index, 1, __ATOMIC_SEQ_CST);
+		// The ring holds its reference until the slot changes, so if it did not change the frame is ours
+		if (__atomic_load_n(slot, __ATOMIC_SEQ_CST) != state) {
+			__atomic_sub_fetch(b->refs + index, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		r->next++;
+		r->received++;
+		return b->pool->frames + index;
+	}
+}
 
-void ouster_v3_print(double const a[3]);
+void ouster_broadcast_release(ouster_broadcast_t *b, ouster_frame_t *frame)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(frame);
+	int index = frame - b->pool->frames;
+	ouster_assert(index >= 0 && index < b->pool->count, "Frame is not from the pool");
+	int refs = __atomic_sub_fetch(b->refs + index, 1, __ATOMIC_ACQ_REL);
+	ouster_assert(refs >= 0, "Frame released twice");
+	ouster_unused(refs);
+}
 
+#include <endian.h>
+#include <string.h>
 
-#ifdef __cplusplus
-}
-#endif
+/* Residuals with a larger unary part are escaped and written raw */
+#define CODEC_UNARY_LIMIT 24
 
-#endif // OUSTER_MATH_H
+/* Adaptive statistics are halved after this many samples */
+#define CODEC_RESET 64
 
-/** @} */
+/* Contexts are selected by bit length of the local gradient */
+#define CODEC_CONTEXTS 34
 
-#include <stdarg.h>
-#include <stdio.h>
+typedef struct
+{
+	uint32_t a[CODEC_CONTEXTS];
+	uint32_t n[CODEC_CONTEXTS];
+} codec_state_t;
 
-int32_t ouster_log_set_level(int32_t level)
+typedef struct
+{
+	uint8_t *data;
+	int capacity;
+	int pos;
+	uint64_t acc;
+	int nbits;
+} bit_writer_t;
+
+typedef struct
 {
-    int prev = level;
-    ouster_os_api.log_level_ = level;
-    return prev;
+	uint8_t const *data;
+	int size;
+	int pos;
+	uint64_t acc;
+	int nbits;
+} bit_reader_t;
+
+static void state_init(codec_state_t *s)
+{
+	for (int i = 0; i < CODEC_CONTEXTS; ++i) {
+		s->a[i] = 4;
+		s->n[i] = 1;
+	}
 }
 
-static char *ouster_vasprintf_malloc(const char *fmt, va_list args)
+static int bitlen(uint64_t x)
 {
-	size_t size = 0;
-	char *result = NULL;
-	va_list tmpa;
-
-	va_copy(tmpa, args);
-
-	size = vsnprintf(result, 0, fmt, tmpa);
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
 
-	va_end(tmpa);
+/* Bit length of the local gradient, flat areas and edges get different statistics */
+static int context(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint64_t da = a > c ? a - c : c - a;
+	uint64_t db = b > c ? b - c : c - b;
+	int ctx = bitlen(da + db);
+	return ctx < CODEC_CONTEXTS ? ctx : CODEC_CONTEXTS - 1;
+}
 
-	if ((int32_t)size < 0) {
-		return NULL;
+/* Median edge detector from LOCO-I */
+static uint32_t predict(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t mn = a < b ? a : b;
+	uint32_t mx = a < b ? b : a;
+	if (c >= mx) {
+		return mn;
 	}
+	if (c <= mn) {
+		return mx;
+	}
+	return a + b - c;
+}
 
-	result = (char *)ouster_os_malloc(size + 1);
+static int rice_k(codec_state_t const *s, int ctx, int bits)
+{
+	uint64_t n = s->n[ctx];
+	uint64_t a = s->a[ctx];
+	int k = 0;
+	while (((n << k) < a) && (k < (bits - 1))) {
+		k++;
+	}
+	return k;
+}
 
-	if (!result) {
-		return NULL;
+static void state_update(codec_state_t *s, int ctx, uint32_t zz)
+{
+	s->a[ctx] += zz;
+	s->n[ctx]++;
+	if ((s->n[ctx] >= CODEC_RESET) || (s->a[ctx] >= UINT32_C(0x80000000))) {
+		s->a[ctx] = (s->a[ctx] + 1) >> 1;
+		s->n[ctx] = (s->n[ctx] + 1) >> 1;
 	}
+}
 
-	vsprintf(result, fmt, args);
+static uint32_t get_pixel(void const *row, int depth, int col)
+{
+	switch (depth) {
+	case 1:
+		return ((uint8_t const *)row)[col];
+	case 2:
+		return ((uint16_t const *)row)[col];
+	default:
+		return ((uint32_t const *)row)[col];
+	}
+}
 
-	return result;
+static void set_pixel(void *row, int depth, int col, uint32_t value)
+{
+	switch (depth) {
+	case 1:
+		((uint8_t *)row)[col] = (uint8_t)value;
+		break;
+	case 2:
+		((uint16_t *)row)[col] = (uint16_t)value;
+		break;
+	default:
+		((uint32_t *)row)[col] = value;
+		break;
+	}
 }
 
-void ouster_log_(int32_t level, char const *file, int32_t line, char const *fmt, ...)
+/* Left, upper and upper left neighbour, missing neighbours are replaced by existing ones */
+static void neighbours(void const *row, void const *up, int depth, int col, uint32_t *a, uint32_t *b, uint32_t *c)
 {
-	ouster_assert_notnull(fmt);
+	if (up == NULL) {
+		*a = col ? get_pixel(row, depth, col - 1) : 0;
+		*b = *a;
+		*c = *a;
+		return;
+	}
+	*b = get_pixel(up, depth, col);
+	*a = col ? get_pixel(row, depth, col - 1) : *b;
+	*c = col ? get_pixel(up, depth, col - 1) : *b;
+}
 
-    if (level > ouster_os_api.log_level_) {
-        return;
-    }
+/* Writes up to 32 bits, LSB first */
+static int put_bits(bit_writer_t *w, uint32_t value, int n)
+{
+	w->acc |= (uint64_t)value << w->nbits;
+	w->nbits += n;
+	if (w->nbits >= 32) {
+		if ((w->pos + 4) > w->capacity) {
+			return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+		}
+		for (int i = 0; i < 4; ++i) {
+			w->data[w->pos++] = (uint8_t)(w->acc >> (i * 8));
+		}
+		w->acc >>= 32;
+		w->nbits -= 32;
+	}
+	return OUSTER_CODEC_OK;
+}
 
-	va_list args;
-	va_start(args, fmt);
+static int flush_bits(bit_writer_t *w)
+{
+	while (w->nbits > 0) {
+		if (w->pos >= w->capacity) {
+			return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+		}
+		w->data[w->pos++] = (uint8_t)w->acc;
+		w->acc >>= 8;
+		w->nbits -= 8;
+	}
+	w->nbits = 0;
+	return OUSTER_CODEC_OK;
+}
 
-	char *msg = ouster_vasprintf_malloc(fmt, args);
-	ouster_assert_notnull(msg);
-	ouster_os_api.log_(0, file, line, msg);
-	ouster_os_free(msg);
+/* Makes sure at least 57 bits are buffered, missing bytes past the end read as zero */
+static void refill(bit_reader_t *r)
+{
+	while (r->nbits <= 56) {
+		uint64_t byte = (r->pos < r->size) ? r->data[r->pos] : 0;
+		r->acc |= byte << r->nbits;
+		r->pos++;
+		r->nbits += 8;
+	}
+}
 
-	va_end(args);
+static uint32_t get_bits(bit_reader_t *r, int n)
+{
+	uint32_t value = (uint32_t)(r->acc & ((UINT64_C(1) << n) - 1));
+	r->acc >>= n;
+	r->nbits -= n;
+	return value;
 }
 
+static int put_residual(bit_writer_t *w, uint32_t zz, int k, int bits)
+{
+	uint32_t q = zz >> k;
+	if (q >= CODEC_UNARY_LIMIT) {
+		int rc = put_bits(w, UINT32_C(1) << CODEC_UNARY_LIMIT, CODEC_UNARY_LIMIT + 1);
+		return rc ? rc : put_bits(w, zz, bits);
+	}
+	int rc = put_bits(w, UINT32_C(1) << q, q + 1);
+	if (rc || (k == 0)) {
+		return rc;
+	}
+	return put_bits(w, zz & (uint32_t)((UINT64_C(1) << k) - 1), k);
+}
 
-void ouster_log_m4_(double const a[16])
+static int get_residual(bit_reader_t *r, int k, int bits, uint32_t *zz)
 {
-	ouster_log(OUSTER_M4_FORMAT, OUSTER_M4_ARGS_1(a));
+	refill(r);
+	if (r->acc == 0) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
+	}
+	int q = __builtin_ctzll(r->acc);
+	if (q > CODEC_UNARY_LIMIT) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
+	}
+	get_bits(r, q + 1);
+	refill(r);
+	if (q == CODEC_UNARY_LIMIT) {
+		*zz = get_bits(r, bits);
+	} else {
+		*zz = ((uint32_t)q << k) | (k ? get_bits(r, k) : 0);
+	}
+	return OUSTER_CODEC_OK;
 }
 
-void ouster_log_m3_(double const a[9])
+static uint32_t depth_mask(int depth)
 {
-	ouster_log(OUSTER_M3_FORMAT, OUSTER_M3_ARGS_1(a));
+	return (uint32_t)((UINT64_C(1) << (depth * 8)) - 1);
 }
 
-void ouster_log_v3_(double const a[3])
+static void header_write(ouster_codec_header_t const *header, void *dst)
 {
-	ouster_log(OUSTER_V3_FORMAT, OUSTER_V3_ARGS(a));
+	ouster_codec_header_t le = *header;
+	le.magic = htole32(header->magic);
+	le.rows = htole16(header->rows);
+	le.cols = htole16(header->cols);
+	le.size = htole32(header->size);
+	memcpy(dst, &le, sizeof(ouster_codec_header_t));
 }
 
-//#define _USE_MATH_DEFINES
-#include <math.h>
-#include <stdio.h>
+static void header_read(ouster_codec_header_t *header, void const *src)
+{
+	memcpy(header, src, sizeof(ouster_codec_header_t));
+	header->magic = le32toh(header->magic);
+	header->rows = le16toh(header->rows);
+	header->cols = le16toh(header->cols);
+	header->size = le32toh(header->size);
+}
 
+static int encode_raw(ouster_field_t const *field, void *dst, int capacity, int *size)
+{
+	int hsize = (int)sizeof(ouster_codec_header_t);
+	int rowsize = field->cols * field->depth;
+	if (capacity < (hsize + field->rows * rowsize)) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
+	ouster_codec_header_t header = {0};
+	header.magic = OUSTER_CODEC_MAGIC;
+	header.rows = (uint16_t)field->rows;
+	header.cols = (uint16_t)field->cols;
+	header.depth = (uint8_t)field->depth;
+	header.method = OUSTER_CODEC_METHOD_RAW;
+	header.size = (uint32_t)(field->rows * rowsize);
+	header_write(&header, dst);
+	// Pixels are stored little endian, byte by byte
+	uint8_t *out = (uint8_t *)dst + hsize;
+	for (int r = 0; r < field->rows; ++r) {
+		char const *row = (char const *)field->data + r * field->rowsize;
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t value = get_pixel(row, field->depth, c);
+			for (int b = 0; b < field->depth; ++b) {
+				*out++ = (uint8_t)(value >> (b * 8));
+			}
+		}
+	}
+	*size = hsize + (int)header.size;
+	return OUSTER_CODEC_OK;
+}
 
-void ouster_lut_fini(ouster_lut_t *lut)
+static int decode_raw(ouster_field_t *field, char const *src)
 {
-	ouster_os_free(lut->direction);
-	ouster_os_free(lut->offset);
-	lut->direction = NULL;
-	lut->offset = NULL;
+	uint8_t const *in = (uint8_t const *)src;
+	for (int r = 0; r < field->rows; ++r) {
+		char *row = (char *)field->data + r * field->rowsize;
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t value = 0;
+			for (int b = 0; b < field->depth; ++b) {
+				value |= (uint32_t)*in++ << (b * 8);
+			}
+			set_pixel(row, field->depth, c, value);
+		}
+	}
+	return OUSTER_CODEC_OK;
 }
 
-/*
-https://static.ouster.dev/sensor-docs/image_route1/image_route3/sensor_data/sensor-data.html?highlight=cartesian#lidar-range-to-xyz
+int ouster_codec_bound(ouster_field_t const *field)
+{
+	ouster_assert_notnull(field);
+	return (int)sizeof(ouster_codec_header_t) + field->rows * field->cols * field->depth;
+}
 
-*/
-void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta)
+int ouster_codec_encode(ouster_field_t const *field, void *dst, int capacity, int *size)
 {
-	ouster_assert_notnull(lut);
-	ouster_assert_notnull(meta);
+	ouster_assert_notnull(field);
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(size);
+	ouster_assert(field->depth == 1 || field->depth == 2 || field->depth == 4, "");
+	ouster_assert(field->rows <= UINT16_MAX && field->cols <= UINT16_MAX, "");
+
+	*size = 0;
+	int hsize = (int)sizeof(ouster_codec_header_t);
+	if (capacity < hsize) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
 
-	int w = meta->midw;
-	int h = meta->pixels_per_column;
-	ouster_assert(w >= 0, "");
-	ouster_assert(w <= 1024, "");
-	ouster_assert(h >= 0, "");
-	ouster_assert(h <= 128, "");
+	int depth = field->depth;
+	int bits = depth * 8;
+	uint32_t mask = depth_mask(depth);
+	uint32_t sign = UINT32_C(1) << (bits - 1);
+	int raw_size = field->rows * field->cols * depth;
+	codec_state_t state;
+	state_init(&state);
+	// Give up as soon as the bitstream gets larger than the raw pixels
+	bit_writer_t w = {(uint8_t *)dst + hsize, (capacity - hsize) < raw_size ? (capacity - hsize) : raw_size, 0, 0, 0};
+
+	char const *row = field->data;
+	char const *up = NULL;
+	int rc = OUSTER_CODEC_OK;
+	for (int r = 0; r < field->rows; ++r, up = row, row += field->rowsize) {
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t a, b, d;
+			neighbours(row, up, depth, c, &a, &b, &d);
+			int ctx = context(a, b, d);
+			int k = rice_k(&state, ctx, bits);
+			uint32_t e = (get_pixel(row, depth, c) - predict(a, b, d)) & mask;
+			uint32_t zz = (e & sign) ? (((~e & mask) << 1) | 1) : (e << 1);
+			rc = put_residual(&w, zz, k, bits);
+			if (rc) {
+				return encode_raw(field, dst, capacity, size);
+			}
+			state_update(&state, ctx, zz);
+		}
+	}
+	rc = flush_bits(&w);
+	if (rc) {
+		return encode_raw(field, dst, capacity, size);
+	}
 
-	double *encoder = ouster_os_calloc(w * h * sizeof(double));  // theta_e
-	double *azimuth = ouster_os_calloc(w * h * sizeof(double));  // theta_a
-	double *altitude = ouster_os_calloc(w * h * sizeof(double)); // phi
-	double *direction = ouster_os_calloc(w * h * 3 * sizeof(double));
-	double *offset = ouster_os_calloc(w * h * 3 * sizeof(double));
-	ouster_assert_notnull(encoder);
-	ouster_assert_notnull(azimuth);
-	ouster_assert_notnull(altitude);
-	ouster_assert_notnull(direction);
-	ouster_assert_notnull(offset);
+	ouster_codec_header_t header = {0};
+	header.magic = OUSTER_CODEC_MAGIC;
+	header.rows = (uint16_t)field->rows;
+	header.cols = (uint16_t)field->cols;
+	header.depth = (uint8_t)depth;
+	header.method = OUSTER_CODEC_METHOD_RICE;
+	header.size = (uint32_t)w.pos;
+	header_write(&header, dst);
+	*size = hsize + w.pos;
+	return OUSTER_CODEC_OK;
+}
 
-	float beam_to_lidar_transform_03 = meta->beam_to_lidar_transform[OUSTER_M4(0, 3)];
-	float beam_to_lidar_transform_23 = meta->beam_to_lidar_transform[OUSTER_M4(2, 3)];
-	ouster_log_m4(meta->lidar_to_sensor_transform);
+int ouster_codec_decode(ouster_field_t *field, void const *src, int size)
+{
+	ouster_assert_notnull(field);
+	ouster_assert_notnull(src);
 
-	// This represent a column measurement angle:
-	double azimuth_radians = OUSTER_M_PI * 2.0 / meta->columns_per_frame;
+	ouster_codec_header_t header;
+	int hsize = (int)sizeof(ouster_codec_header_t);
+	if (size < hsize) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
+	header_read(&header, src);
+	if (header.magic != OUSTER_CODEC_MAGIC) {
+		return OUSTER_CODEC_ERROR_MAGIC;
+	}
+	if ((header.rows != field->rows) || (header.cols != field->cols) || (header.depth != field->depth)) {
+		return OUSTER_CODEC_ERROR_SHAPE;
+	}
+	if (header.size > (uint32_t)(size - hsize)) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
 
-	// OS sensor - populate angles for each pixel
-	for (int c = 0; c < w; c++) {
-		for (int r = 0; r < h; r++) {
-			// Row major - each row is continuous memory
-			int mid = meta->mid0 + c;
-			ouster_assert(mid >= meta->mid0, "");
-			ouster_assert(mid <= meta->mid1, "");
-			int i = r * w + c;
-			encoder[i] = 2.0 * OUSTER_M_PI - (mid * azimuth_radians);
-			azimuth[i] = -meta->beam_azimuth_angles[r] * OUSTER_M_PI / 180.0;
-			altitude[i] = meta->beam_altitude_angles[r] * OUSTER_M_PI / 180.0;
+	if (header.method == OUSTER_CODEC_METHOD_RAW) {
+		if (header.size != (uint32_t)(field->rows * field->cols * field->depth)) {
+			return OUSTER_CODEC_ERROR_CORRUPT;
 		}
+		return decode_raw(field, (char const *)src + hsize);
 	}
-
-	// unit vectors for each pixel
-	for (int i = 0; i < w * h; i++) {
-		direction[i * 3 + 0] = cos(encoder[i] + azimuth[i]) * cos(altitude[i]);
-		direction[i * 3 + 1] = sin(encoder[i] + azimuth[i]) * cos(altitude[i]);
-		direction[i * 3 + 2] = sin(altitude[i]);
+	if (header.method != OUSTER_CODEC_METHOD_RICE) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
 	}
 
-	for (int i = 0; i < w * h; i++) {
-		offset[i * 3 + 0] = cos(encoder[i]) * beam_to_lidar_transform_03 - direction[i * 3 + 0] * meta->lidar_origin_to_beam_origin_mm;
-		offset[i * 3 + 1] = sin(encoder[i]) * beam_to_lidar_transform_03 - direction[i * 3 + 1] * meta->lidar_origin_to_beam_origin_mm;
-		offset[i * 3 + 2] = beam_to_lidar_transform_23 - direction[i * 3 + 2] * meta->lidar_origin_to_beam_origin_mm;
+	int depth = field->depth;
+	int bits = depth * 8;
+	uint32_t mask = depth_mask(depth);
+	codec_state_t state;
+	state_init(&state);
+	bit_reader_t rd = {(uint8_t const *)src + hsize, (int)header.size, 0, 0, 0};
+
+	char *row = field->data;
+	char *up = NULL;
+	for (int r = 0; r < field->rows; ++r, up = row, row += field->rowsize) {
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t a, b, d;
+			neighbours(row, up, depth, c, &a, &b, &d);
+			int ctx = context(a, b, d);
+			int k = rice_k(&state, ctx, bits);
+			uint32_t zz;
+			int rc = get_residual(&rd, k, bits, &zz);
+			if (rc) {
+				return rc;
+			}
+			uint32_t e = (zz & 1) ? (~(zz >> 1) & mask) : (zz >> 1);
+			set_pixel(row, depth, c, (predict(a, b, d) + e) & mask);
+			state_update(&state, ctx, zz);
+		}
 	}
 
-	// Extract the rotation matrix from transform
-	double rotation[9] = {
-	    [OUSTER_M3(0, 0)] = meta->lidar_to_sensor_transform[OUSTER_M4(0, 0)],
-	    [OUSTER_M3(1, 0)] = meta->lidar_to_sensor_transform[OUSTER_M4(0, 1)],
-	    [OUSTER_M3(2, 0)] = meta->lidar_to_sensor_transform[OUSTER_M4(0, 2)],
-	    [OUSTER_M3(0, 1)] = meta->lidar_to_sensor_transform[OUSTER_M4(1, 0)],
-	    [OUSTER_M3(1, 1)] = meta->lidar_to_sensor_transform[OUSTER_M4(1, 1)],
-	    [OUSTER_M3(2, 1)] = meta->lidar_to_sensor_transform[OUSTER_M4(1, 2)],
-	    [OUSTER_M3(0, 2)] = meta->lidar_to_sensor_transform[OUSTER_M4(2, 0)],
-	    [OUSTER_M3(1, 2)] = meta->lidar_to_sensor_transform[OUSTER_M4(2, 1)],
-	    [OUSTER_M3(2, 2)] = meta->lidar_to_sensor_transform[OUSTER_M4(2, 2)],
-	};
-
-	// Extract the translation vector from transform
-	float translation[3] =
-	    {
-	        meta->lidar_to_sensor_transform[0 * 4 + 3],
-	        meta->lidar_to_sensor_transform[1 * 4 + 3],
-	        meta->lidar_to_sensor_transform[2 * 4 + 3],
-	    };
-
-	for (int i = 0; i < w * h; ++i) {
-		double *d = direction + i * 3;
-		double *o = offset + i * 3;
-		ouster_m3f64_mul(d, rotation, d);
-		ouster_m3f64_mul(o, rotation, o);
-		o[0] += translation[0];
-		o[1] += translation[1];
-		o[2] += translation[2];
+	// Bits consumed must not go past the end of the bitstream
+	if (((int64_t)rd.pos * 8 - rd.nbits) > ((int64_t)header.size * 8)) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
 	}
+	return OUSTER_CODEC_OK;
+}
+#include <string.h>
 
-	ouster_os_free(encoder);
-	ouster_os_free(azimuth);
-	ouster_os_free(altitude);
-
-	for (int i = 0; i < w * h; ++i) {
-		double range_unit = 0.001f;
-		//double range_unit = 1.0f;
-		double *d = direction + i * 3;
-		double *o = offset + i * 3;
-		d[0] *= range_unit;
-		d[1] *= range_unit;
-		d[2] *= range_unit;
-		o[0] *= range_unit;
-		o[1] *= range_unit;
-		o[2] *= range_unit;
-	}
+void ouster_dump_lidar_header(FILE *f, ouster_lidar_header_t const *p)
+{
+	ouster_assert_notnull(f);
+	ouster_assert_notnull(p);
+	fprintf(f, "type=%ji, frame=%ji, init=%ji, prod=%ji, countdown_thermal_shutdown=%ji, countdown_shot_limiting=%ji, thermal_shutdown=%ji, shot_limiting=%ji\n",
+	        (intmax_t)p->packet_type,
+	        (intmax_t)p->frame_id,
+	        (intmax_t)p->init_id,
+	        (intmax_t)p->prod_sn,
+	        (intmax_t)p->countdown_thermal_shutdown,
+	        (intmax_t)p->countdown_shot_limiting,
+	        (intmax_t)p->thermal_shutdown,
+	        (intmax_t)p->shot_limiting);
+}
 
-	lut->direction = direction;
-	lut->offset = offset;
-	lut->w = w;
-	lut->h = h;
+void ouster_dump_column(FILE *f, ouster_column_t const *column)
+{
+	ouster_assert_notnull(f);
+	ouster_assert_notnull(column);
+	fprintf(f, "ts=%ji, status=%ji, mid=%ji\n", (intmax_t)column->ts, (intmax_t)column->status, (intmax_t)column->mid);
+}
 
-	/*
-	for (int i = 0; i < w * h; ++i) {
-	    double *d = direction + i * 3;
-	    double *o = offset + i * 3;
-	    printf("%+f %+f %+f %+f %+f %+f, %+f\n", o[0], o[1], o[2], d[0], d[1], d[2], sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+void ouster_dump_meta(FILE * f, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(f);
+	ouster_assert_notnull(meta);
+	fprintf(f, "ouster_meta_t dump:\n");
+	fprintf(f, "%40s: %i\n", "(Azimuth columns start) mid0", meta->mid0);
+	fprintf(f, "%40s: %i\n", "(Azimuth columns end) mid1", meta->mid1);
+	fprintf(f, "%40s: %i\n", "(Azimuth columns width) midw", meta->midw);
+	fprintf(f, "%40s: %i\n", "udp_port_lidar", meta->udp_port_lidar);
+	fprintf(f, "%40s: %i\n", "udp_port_imu", meta->udp_port_imu);
+	fprintf(f, "%40s: %i\n", "columns_per_frame", meta->columns_per_frame);
+	fprintf(f, "%40s: %i\n", "columns_per_packet", meta->columns_per_packet);
+	fprintf(f, "%40s: %i\n", "pixels_per_column", meta->pixels_per_column);
+	fprintf(f, "%40s: %iB\n", "channel_data_size", meta->channel_data_size);
+	fprintf(f, "%40s: %i\n", "profile", meta->profile);
+	fprintf(f, "%40s: %i\n", "channel_data_size", meta->channel_data_size);
+	fprintf(f, "%40s: %iB\n", "col_size", meta->col_size);
+	fprintf(f, "%40s: %iB\n", "lidar_packet_size", meta->lidar_packet_size);
+} 
+
+void ouster_dump_profile(FILE *f)
+{
+	ouster_assert_notnull(f);
+	fprintf(f, "%-10s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "mean_us", "p50_us", "p99_us", "p999_us", "max_us");
+	for (int i = 0; i < OUSTER_STAGE_COUNT; ++i) {
+		ouster_profile_stats_t s;
+		ouster_profile_stats(i, &s);
+		fprintf(f, "%-10s %10ji %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		        ouster_profile_stage_str(i),
+		        (intmax_t)s.count,
+		        s.mean_ns / 1000.0,
+		        s.p50_ns / 1000.0,
+		        s.p99_ns / 1000.0,
+		        s.p999_ns / 1000.0,
+		        s.max_ns / 1000.0);
 	}
-	*/
 }
 
-void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
-{
-	ouster_assert_notnull(lut);
-	ouster_assert_notnull(range);
-	ouster_assert_notnull(out);
+#include <string.h>
 
-	double const *d = lut->direction;
-	double const *o = lut->offset;
-	char *out8 = out;
+void ouster_field_init(ouster_field_t fields[], int count, ouster_meta_t *meta)
+{
+	ouster_assert_notnull(fields);
+	ouster_assert_notnull(meta);
+	ouster_field_t *f = fields;
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_FIELD);
+	for (int i = 0; i < count; ++i, f++) {
+		ouster_assert(f->depth > 0, "");
+		f->rows = meta->pixels_per_column;
+		f->cols = meta->midw;
+		f->rowsize = f->cols * f->depth;
+		f->size = f->rows * f->cols * f->depth;
+		f->data = ouster_os_calloc(f->size);
+	}
+	ouster_os_mem_tag_set(tag);
+}
 
-	for (int i = 0; i < (lut->w * lut->h); ++i, out8 += out_stride, d += 3, o += 3) {
-		double mag = range[i];
-		double *outd = (double *)out8;
-		outd[0] = (float)(mag * d[0] + o[0]);
-		outd[1] = (float)(mag * d[1] + o[1]);
-		outd[2] = (float)(mag * d[2] + o[2]);
-		// printf("%+f %+f\n", mag, sqrt(OUSTER_V3_DOT(out_xyz, out_xyz)));
+void ouster_field_fini(ouster_field_t fields[], int count)
+{
+	ouster_assert_notnull(fields);
+	ouster_field_t *f = fields;
+	for (int i = 0; i < count; ++i, f++) {
+		ouster_os_free(f->data);
+		memset(f->data, 0, sizeof(ouster_field_t));
 	}
 }
 
-void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y, float mag, float *out)
+void ouster_field_cpy(ouster_field_t dst[], ouster_field_t src[], int count)
 {
-	ouster_assert_notnull(lut);
-	ouster_assert_notnull(out);
-	int i = round(y) * lut->w + round(x);
-	ouster_assert(i >= 0, "");
-	ouster_assert(i < lut->w * lut->h, "");
-	double const *d = lut->direction + i;
-	double const *o = lut->offset + i;
-	out[0] = (float)(mag * d[0] + o[0]);
-	out[1] = (float)(mag * d[1] + o[1]);
-	out[2] = (float)(mag * d[2] + o[2]);
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	// memcpy(dst, src, sizeof(ouster_field_t) * count);
+	for (int i = 0; i < count; ++i, ++dst, ++src) {
+		memcpy(dst->data, src->data, src->size);
+	}
 }
 
-void ouster_lut_cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
+/* Reverses the order of n pixels of depth bytes */
+static void reverse_pixels(char *p, int n, int depth)
 {
-	ouster_assert_notnull(lut);
-	ouster_assert_notnull(range);
-	ouster_assert_notnull(out);
+	char *a = p;
+	char *b = p + (n - 1) * depth;
+	for (; a < b; a += depth, b -= depth) {
+		for (int k = 0; k < depth; ++k) {
+			char t = a[k];
+			a[k] = b[k];
+			b[k] = t;
+		}
+	}
+}
 
-	double const *d = lut->direction;
-	double const *o = lut->offset;
-	char *out8 = out;
+/* Staggered column c goes to destaggered column (c + shift) % cols */
+static int destagger_shift(int shift, int cols)
+{
+	return ((shift % cols) + cols) % cols;
+}
 
-	for (int i = 0; i < (lut->w * lut->h); ++i, out8 += out_stride, d += 3, o += 3) {
-		double mag = range[i];
-		float *outf = (float *)out8;
-		outf[0] = (float)(mag * d[0] + o[0]);
-		outf[1] = (float)(mag * d[1] + o[1]);
-		outf[2] = (float)(mag * d[2] + o[2]);
-		// printf("%+f %+f\n", mag, sqrt(OUSTER_V3_DOT(out_xyz, out_xyz)));
+/*
+https://static.ouster.dev/sdk-docs/reference/lidar-scan.html#staggering-and-destaggering
+*/
+void ouster_destagger(void *data, int cols, int rows, int depth, int rowsize, int pixel_shift_by_row[])
+{
+	ouster_assert_notnull(data);
+	ouster_assert_notnull(pixel_shift_by_row);
+	char *row = data;
+	for (int irow = 0; irow < rows; ++irow, row += rowsize) {
+		int offset = destagger_shift(pixel_shift_by_row[irow], cols);
+		// Rotate right by offset in place: reverse the whole row then both parts
+		reverse_pixels(row, cols, depth);
+		reverse_pixels(row, offset, depth);
+		reverse_pixels(row + depth * offset, cols - offset, depth);
 	}
 }
 
-double *ouster_lut_alloc(ouster_lut_t const *lut)
+void ouster_destagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[])
 {
-	ouster_assert_notnull(lut);
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(pixel_shift_by_row);
+	ouster_assert(dst != src, "Use ouster_destagger() in place");
+	char *d = dst;
+	char const *s = src;
+	for (int irow = 0; irow < rows; ++irow, d += rowsize, s += rowsize) {
+		int offset = destagger_shift(pixel_shift_by_row[irow], cols);
+		// Two contiguous chunks per row, memcpy picks the widest aligned vector stores
+		memcpy(d + depth * offset, s, depth * (cols - offset));
+		memcpy(d, s + depth * (cols - offset), depth * offset);
+	}
+}
 
-	int n = lut->w * lut->h;
-	int size = n * sizeof(double) * 3;
-	void *memory = ouster_os_calloc(size);
-	return memory;
+void ouster_restagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[])
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(pixel_shift_by_row);
+	ouster_assert(dst != src, "");
+	char *d = dst;
+	char const *s = src;
+	for (int irow = 0; irow < rows; ++irow, d += rowsize, s += rowsize) {
+		int offset = destagger_shift(pixel_shift_by_row[irow], cols);
+		memcpy(d, s + depth * offset, depth * (cols - offset));
+		memcpy(d + depth * (cols - offset), s, depth * offset);
+	}
 }
 
+void ouster_field_destagger(ouster_field_t fields[], int count, ouster_meta_t *meta)
+{
+	ouster_assert_notnull(fields);
+	ouster_assert_notnull(meta);
+	ouster_profile_begin(t);
+	for (int i = 0; i < count; ++i, ++fields) {
+		ouster_destagger(fields->data, fields->cols, fields->rows, fields->depth, fields->rowsize, meta->pixel_shift_by_row);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_DESTAGGER);
+}
 
-void ouster_m3f64_mul(double r[9], double const a[9], double const x[9])
+void ouster_field_destagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta)
 {
-	ouster_assert_notnull(r);
-	ouster_assert_notnull(a);
-	ouster_assert_notnull(x);
-	double temp[3];
-	temp[0] = (a[OUSTER_M3(0, 0)] * x[0]) + (a[OUSTER_M3(1, 0)] * x[1]) + (a[OUSTER_M3(2, 0)] * x[2]);
-	temp[1] = (a[OUSTER_M3(0, 1)] * x[0]) + (a[OUSTER_M3(1, 1)] * x[1]) + (a[OUSTER_M3(2, 1)] * x[2]);
-	temp[2] = (a[OUSTER_M3(0, 2)] * x[0]) + (a[OUSTER_M3(1, 2)] * x[1]) + (a[OUSTER_M3(2, 2)] * x[2]);
-	r[0] = temp[0];
-	r[1] = temp[1];
-	r[2] = temp[2];
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(meta);
+	ouster_profile_begin(t);
+	for (int i = 0; i < count; ++i, ++dst, ++src) {
+		ouster_assert(dst->size == src->size, "");
+		ouster_destagger_cpy(dst->data, src->data, src->cols, src->rows, src->depth, src->rowsize, meta->pixel_shift_by_row);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_DESTAGGER);
 }
 
-#define JSMN_HEADER
-#include <stdlib.h>
-#include <string.h>
+void ouster_field_restagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(meta);
+	for (int i = 0; i < count; ++i, ++dst, ++src) {
+		ouster_assert(dst->size == src->size, "");
+		ouster_restagger_cpy(dst->data, src->data, src->cols, src->rows, src->depth, src->rowsize, meta->pixel_shift_by_row);
+	}
+}
 
-#define TOK_COUNT 1024
+void ouster_field_apply_mask_u32(ouster_field_t *field, ouster_meta_t *meta)
+{
+	ouster_assert_notnull(field);
+	ouster_assert_notnull(meta);
+	ouster_extract_t const *extract = meta->extract + field->quantity;
+	uint32_t mask = extract->mask;
+	if (mask == 0xFFFFFFFF) {
+		return;
+	}
+	int rows = field->rows;
+	int cols = field->cols;
+	int cells = rows * cols;
 
-#define MAX(a, b) (((a) > (b)) ? a : b)
-#define MIN(a, b) (((a) < (b)) ? a : b)
+	ouster_assert(field->depth == 4, "Destination data depth other than 4 is not supported");
+	switch (field->depth) {
+	case 1: {
+		ouster_assert(mask <= UINT8_MAX, "Mask is too big");
+		uint8_t *data8 = (uint8_t *)field->data;
+		for (int i = 0; i < cells; ++i) {
+			uint16_t value = data8[i];
+			value &= (uint16_t)mask;
+			data8[i] = value;
+		}
+	} break;
+	case 2: {
+		ouster_assert(mask <= UINT16_MAX, "Mask is too big");
+		uint16_t *data16 = (uint16_t *)field->data;
+		for (int i = 0; i < cells; ++i) {
+			uint16_t value = data16[i];
+			value &= (uint16_t)mask;
+			data16[i] = value;
+		}
+	} break;
+	case 4: {
+		ouster_assert(mask <= UINT32_MAX, "Mask is too big");
+		uint32_t *data32 = (uint32_t *)field->data;
+		for (int i = 0; i < cells; ++i) {
+			uint32_t value = data32[i];
+			value &= mask;
+			data32[i] = value;
+		}
+	} break;
+	}
+}
 
-char *jsmn_strerror(int r)
+void ouster_field_zero(ouster_field_t fields[], int count)
 {
-	switch (r) {
-	case JSMN_ERROR_NOMEM:
-		return "JSMN_ERROR_NOMEM";
-	case JSMN_ERROR_INVAL:
-		return "JSMN_ERROR_INVAL";
-	case JSMN_ERROR_PART:
-		return "JSMN_ERROR_PART";
-	default:
-		return "JSMN_ERROR_?";
+	ouster_assert_notnull(fields);
+	for (int i = 0; i < count; ++i, ++fields) {
+		memset(fields->data, 0, fields->size);
 	}
 }
 
-#define STRING_BUF_SIZE 128
 
-/*
+#include <string.h>
 
-static const Table<ChanField, FieldInfo, 8> legacy_field_info{{
-    {ChanField::RANGE, {UINT32, 0, 0x000fffff, 0}},
-    {ChanField::FLAGS, {UINT8, 3, 0, 4}},
-    {ChanField::REFLECTIVITY, {UINT16, 4, 0, 0}},
-    {ChanField::SIGNAL, {UINT16, 6, 0, 0}},
-    {ChanField::NEAR_IR, {UINT16, 8, 0, 0}},
-    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
-    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
-    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
-}};
+/* Sets all fields of columns [c0, c1) to zero */
+static void clear_columns(ouster_frame_t *frame, int c0, int c1)
+{
+	for (int j = 0; j < frame->fcount; ++j) {
+		ouster_field_t *f = frame->fields + j;
+		char *row = (char *)f->data + c0 * f->depth;
+		for (int r = 0; r < f->rows; ++r, row += f->rowsize) {
+			memset(row, 0, (c1 - c0) * f->depth);
+		}
+	}
+}
 
-static const Table<ChanField, FieldInfo, 5> lb_field_info{{
-    {ChanField::RANGE, {UINT16, 0, 0x7fff, -3}},
-    {ChanField::FLAGS, {UINT8, 1, 0b10000000, 7}},
-    {ChanField::REFLECTIVITY, {UINT8, 2, 0, 0}},
-    {ChanField::NEAR_IR, {UINT8, 3, 0, -4}},
-    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
-}};
+/* Clears the stale columns that were not received again */
+static void clear_stale(ouster_frame_t *frame, int cols)
+{
+	int words = OUSTER_FRAME_BITMAP_WORDS(cols);
+	int c0 = -1;
+	for (int k = 0; k < words; ++k) {
+		uint64_t clear = frame->stale_cols[k] & ~frame->valid_cols[k];
+		if ((clear == 0) && (c0 < 0)) {
+			continue;
+		}
+		for (int b = 0; b < 64; ++b) {
+			int c = k * 64 + b;
+			int set = (c < cols) && ((clear >> b) & 1);
+			if (set && (c0 < 0)) {
+				c0 = c;
+			} else if (!set && (c0 >= 0)) {
+				clear_columns(frame, c0, c);
+				c0 = -1;
+			}
+		}
+	}
+	if (c0 >= 0) {
+		clear_columns(frame, c0, cols);
+	}
+}
 
-static const Table<ChanField, FieldInfo, 13> dual_field_info{{
-    {ChanField::RANGE, {UINT32, 0, 0x0007ffff, 0}},
-    {ChanField::FLAGS, {UINT8, 2, 0b11111000, 3}},
-    {ChanField::REFLECTIVITY, {UINT8, 3, 0, 0}},
-    {ChanField::RANGE2, {UINT32, 4, 0x0007ffff, 0}},
-    {ChanField::FLAGS2, {UINT8, 6, 0b11111000, 3}},
-    {ChanField::REFLECTIVITY2, {UINT8, 7, 0, 0}},
-    {ChanField::SIGNAL, {UINT16, 8, 0, 0}},
-    {ChanField::SIGNAL2, {UINT16, 10, 0, 0}},
-    {ChanField::NEAR_IR, {UINT16, 12, 0, 0}},
-    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
-    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
-    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
-    {ChanField::RAW32_WORD4, {UINT32, 12, 0, 0}},
-}};
+static int bitmap_count(uint64_t const *bitmap, int words)
+{
+	int n = 0;
+	for (int k = 0; k < words; ++k) {
+		n += __builtin_popcountll(bitmap[k]);
+	}
+	return n;
+}
 
-static const Table<ChanField, FieldInfo, 8> single_field_info{{
-    {ChanField::RANGE, {UINT32, 0, 0x0007ffff, 0}},
-    {ChanField::FLAGS, {UINT8, 2, 0b11111000, 3}},
-    {ChanField::REFLECTIVITY, {UINT8, 4, 0, 0}},
-    {ChanField::SIGNAL, {UINT16, 6, 0, 0}},
-    {ChanField::NEAR_IR, {UINT16, 8, 0, 0}},
-    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
-    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
-    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
-}};
+/* Prepares a frame for filling, the columns received last time become stale */
+static void frame_start(ouster_frame_t *frame)
+{
+	uint64_t *stale = frame->stale_cols;
+	frame->stale_cols = frame->valid_cols;
+	frame->valid_cols = stale;
+	frame->valid_count = 0;
+	frame->frame_id = -1;
+	memset(&frame->lidar, 0, sizeof(ouster_lidar_t));
+	frame->lidar.frame_id = -1;
+	frame->lidar.valid_cols = frame->valid_cols;
+}
 
-static const Table<ChanField, FieldInfo, 14> five_word_pixel_info{{
-    {ChanField::RANGE, {UINT32, 0, 0x0007ffff, 0}},
-    {ChanField::FLAGS, {UINT8, 2, 0b11111000, 3}},
-    {ChanField::REFLECTIVITY, {UINT8, 3, 0, 0}},
-    {ChanField::RANGE2, {UINT32, 4, 0x0007ffff, 0}},
-    {ChanField::FLAGS2, {UINT8, 6, 0b11111000, 3}},
-    {ChanField::REFLECTIVITY2, {UINT8, 7, 0, 0}},
-    {ChanField::SIGNAL, {UINT16, 8, 0, 0}},
-    {ChanField::SIGNAL2, {UINT16, 10, 0, 0}},
-    {ChanField::NEAR_IR, {UINT16, 12, 0, 0}},
-    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
-    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
-    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
-    {ChanField::RAW32_WORD4, {UINT32, 12, 0, 0}},
-    {ChanField::RAW32_WORD5, {UINT32, 16, 0, 0}},
-}};
+/* Completes the current frame, returns NULL when it was dropped */
+static ouster_frame_t *frame_finish(ouster_frame_pool_t *pool)
+{
+	ouster_frame_t *frame = pool->current;
+	int cols = pool->meta->midw;
+	clear_stale(frame, cols);
+	memset(frame->stale_cols, 0, OUSTER_FRAME_BITMAP_WORDS(cols) * sizeof(uint64_t));
+	frame->valid_count = bitmap_count(frame->valid_cols, OUSTER_FRAME_BITMAP_WORDS(cols));
+	frame->frame_id = frame->lidar.frame_id;
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+	frame->complete_ns = ouster_os_clock_ns();
+	ouster_profile_span(OUSTER_STAGE_FRAME, frame->first_ns, frame->complete_ns);
+#endif
 
-*/
+	ouster_frame_t *next = NULL;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->free_count > 0) {
+		next = pool->free[--pool->free_count];
+	}
+	pthread_mutex_unlock(&pool->lock);
 
-#define COMBINE(p, q) (((p) << 0) | ((q) << 8))
+	if (next == NULL) {
+		// Consumers hold every other frame, fill this one again
+		pool->dropped++;
+		frame_start(frame);
+		return NULL;
+	}
+	frame_start(next);
+	pool->current = next;
+	return frame;
+}
 
-void ouster_extract_init(ouster_extract_t *f, ouster_profile_t profile, ouster_quantity_t quantity)
+void ouster_frame_pool_init(ouster_frame_pool_t *pool, ouster_meta_t *meta, ouster_field_t const fields[], int fcount, int count)
 {
-	ouster_assert_notnull(f);
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(meta);
+	ouster_assert(fields || (fcount == 0), "");
+	ouster_assert(count >= 2, "One frame is filled while others are held by consumers");
+
+	memset(pool, 0, sizeof(ouster_frame_pool_t));
+	pool->meta = meta;
+	pool->count = count;
+	// Frame buffers are counted as field memory
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_FIELD);
+	pool->frames = ouster_os_calloc(count * sizeof(ouster_frame_t));
+	pool->free = ouster_os_calloc(count * sizeof(ouster_frame_t *));
+	ouster_assert_notnull(pool->frames);
+	ouster_assert_notnull(pool->free);
+	pthread_mutex_init(&pool->lock, NULL);
+
+	int words = OUSTER_FRAME_BITMAP_WORDS(meta->midw);
+	for (int i = 0; i < count; ++i) {
+		ouster_frame_t *frame = pool->frames + i;
+		frame->fcount = fcount;
+		frame->fields = ouster_os_calloc((fcount > 0 ? fcount : 1) * sizeof(ouster_field_t));
+		frame->valid_cols = ouster_os_calloc(words * sizeof(uint64_t));
+		frame->stale_cols = ouster_os_calloc(words * sizeof(uint64_t));
+		ouster_assert_notnull(frame->fields);
+		ouster_assert_notnull(frame->valid_cols);
+		ouster_assert_notnull(frame->stale_cols);
+		for (int j = 0; j < fcount; ++j) {
+			frame->fields[j].quantity = fields[j].quantity;
+			frame->fields[j].depth = fields[j].depth;
+		}
+		ouster_field_init(frame->fields, fcount, meta);
+		if (i > 0) {
+			pool->free[pool->free_count++] = frame;
+		}
+	}
+	ouster_os_mem_tag_set(tag);
+	pool->current = pool->frames;
+	frame_start(pool->current);
+}
 
-	switch (COMBINE(profile, quantity)) {
-	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_RANGE):
-		f->mask = UINT32_C(0x0007ffff);
-		f->offset = 0;
-		f->depth = 4;
-		break;
-	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_REFLECTIVITY):
-		f->mask = UINT32_C(0xFFFFFFFF);
-		f->offset = 4;
-		f->depth = 1;
-		break;
-	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_SIGNAL):
-		f->mask = UINT32_C(0xFFFFFFFF);
-		f->offset = 6;
-		f->depth = 2;
-		break;
-	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_NEAR_IR):
-		f->mask = UINT32_C(0xFFFFFFFF);
-		f->offset = 8;
-		f->depth = 2;
-		break;
-		/*
-		Range [15 bit unsigned int] - Range scaled down by a factor of 8 mm, for a maximum range of (2^15*8) = 262 mm in 15 bits. Note The range value will be set to 0 if out of range or if no detection is made.
-		Shift by minus 3 is a left shift. That will multiply by a factor 2^3 = 8.
-		{ChanField::RANGE, {UINT16, 0, 0x7fff, -3}},
-		*/
-	case COMBINE(OUSTER_PROFILE_RNG15_RFL8_NIR8, OUSTER_QUANTITY_RANGE):
-		f->mask = UINT32_C(0x7fff);
-		f->offset = 0;
-		f->depth = 2;
-		break;
-	case COMBINE(OUSTER_PROFILE_RNG15_RFL8_NIR8, OUSTER_QUANTITY_REFLECTIVITY):
-		f->mask = UINT32_C(0xFFFFFFFF);
-		f->offset = 2;
-		f->depth = 1;
-		break;
-	case COMBINE(OUSTER_PROFILE_RNG15_RFL8_NIR8, OUSTER_QUANTITY_NEAR_IR):
-		f->mask = UINT32_C(0xFFFFFFFF);
-		f->offset = 3;
-		f->depth = 1;
-		break;
-	default:
-		break;
+void ouster_frame_pool_fini(ouster_frame_pool_t *pool)
+{
+	ouster_assert_notnull(pool);
+	for (int i = 0; i < pool->count; ++i) {
+		ouster_frame_t *frame = pool->frames + i;
+		for (int j = 0; j < frame->fcount; ++j) {
+			ouster_os_free(frame->fields[j].data);
+		}
+		ouster_os_free(frame->fields);
+		ouster_os_free(frame->valid_cols);
+		ouster_os_free(frame->stale_cols);
 	}
+	ouster_os_free(pool->frames);
+	ouster_os_free(pool->free);
+	pthread_mutex_destroy(&pool->lock);
+	memset(pool, 0, sizeof(ouster_frame_pool_t));
 }
 
-void ouster_meta_parse(char const *json, ouster_meta_t *out)
+ouster_frame_t *ouster_frame_pool_push(ouster_frame_pool_t *pool, char const *buf)
 {
-	ouster_assert_notnull(json);
-	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(buf);
 
-	jsmn_parser p;
-	jsmn_init(&p);
-	jsmntok_t tokens[TOK_COUNT];
-	int r = jsmn_parse(&p, json, strlen(json), tokens, TOK_COUNT);
-	if (r < 1) {
-		ouster_log("jsmn error: %s\n", jsmn_strerror(r));
+	ouster_frame_t *done = NULL;
+	ouster_lidar_header_t header;
+	ouster_lidar_header_get(buf, &header);
+	if ((pool->current->lidar.frame_id >= 0) && (pool->current->lidar.frame_id != (int)header.frame_id)) {
+		// The last packet of the current frame was lost
+		done = frame_finish(pool);
+	}
+
+	ouster_frame_t *frame = pool->current;
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+	if (frame->lidar.frame_id < 0) {
+		frame->first_ns = ouster_os_clock_ns();
+	}
+#endif
+	ouster_lidar_get_fields(&frame->lidar, pool->meta, buf, frame->fields, frame->fcount);
+	pool->last = frame;
+	if (frame->lidar.last_mid == pool->meta->mid1) {
+		if (done) {
+			// Only possible with one packet per frame, keep the newest
+			ouster_frame_pool_release(pool, done);
+			pool->dropped++;
+		}
+		done = frame_finish(pool);
+	}
+	return done;
+}
+
+void ouster_frame_pool_release(ouster_frame_pool_t *pool, ouster_frame_t *frame)
+{
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(frame);
+	pthread_mutex_lock(&pool->lock);
+	ouster_assert(pool->free_count < pool->count, "Frame released twice");
+	pool->free[pool->free_count++] = frame;
+	pthread_mutex_unlock(&pool->lock);
+}
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COLOR_FILENAME "\033[38;2;150;150;255m" // Blue
+#define COLOR_CWD "\033[38;2;150;150;255m"      // Blue
+#define COLOR_ERROR "\033[38;2;255;50;50m"      // Red
+#define COLOR_RST "\033[0m"
+
+int ouster_fs_readfile_failed_reason(char const *filename, char *buf, int len)
+{
+	char const *e = strerror(errno);
+	char cwd[1024] = {0};
+	char *rc = getcwd(cwd, sizeof(cwd));
+	rc = rc ? rc : "";
+	int n = snprintf(buf, len, "cwd:%s%s%s path:%s%s%s error:%s%s%s",
+	                 COLOR_CWD, rc, COLOR_RST,
+	                 COLOR_FILENAME, filename, COLOR_RST,
+	                 COLOR_ERROR, e, COLOR_RST);
+	return n;
+}
+
+void ouster_fs_pwd()
+{
+	char cwd[1024] = {0};
+	char *rc = getcwd(cwd, sizeof(cwd));
+	if (rc == NULL) {
+		ouster_log("getcwd error: %s\n", strerror(errno));
 		return;
 	}
-	ouster_assert(tokens[0].type == JSMN_OBJECT, "Expected JSMN_OBJECT");
+	printf("Current working directory: %s%s%s\n", COLOR_CWD, cwd, COLOR_RST);
+}
 
-	int column_window[2];
-	json_parse_value(json, tokens, (char const *[]){"config_params", "udp_port_lidar", NULL}, &out->udp_port_lidar, JSON_TYPE_INT);
-	json_parse_value(json, tokens, (char const *[]){"config_params", "udp_port_imu", NULL}, &out->udp_port_imu, JSON_TYPE_INT);
-	json_parse_value(json, tokens, (char const *[]){"lidar_data_format", "columns_per_frame", NULL}, &out->columns_per_frame, JSON_TYPE_INT);
-	json_parse_value(json, tokens, (char const *[]){"lidar_data_format", "columns_per_packet", NULL}, &out->columns_per_packet, JSON_TYPE_INT);
-	json_parse_value(json, tokens, (char const *[]){"lidar_data_format", "pixels_per_column", NULL}, &out->pixels_per_column, JSON_TYPE_INT);
-	json_parse_vector(json, tokens, (char const *[]){"lidar_data_format", "column_window", NULL}, column_window, 2, JSON_TYPE_INT);
-	ouster_assert(out->pixels_per_column > 0, "Not in range pixels_per_column");
-	ouster_assert(out->pixels_per_column <= 128, "Not in range pixels_per_column");
-	json_parse_vector(json, tokens, (char const *[]){"lidar_data_format", "pixel_shift_by_row", NULL}, out->pixel_shift_by_row, out->pixels_per_column, JSON_TYPE_INT);
+char *ouster_fs_readfile(char const *path)
+{
+	ouster_assert_notnull(path);
+	char *content = NULL;
 
-	json_parse_value(json, tokens, (char const *[]){"beam_intrinsics", "lidar_origin_to_beam_origin_mm", NULL}, &out->lidar_origin_to_beam_origin_mm, JSON_TYPE_F64);
-	json_parse_vector(json, tokens, (char const *[]){"beam_intrinsics", "beam_altitude_angles", NULL}, out->beam_altitude_angles, out->pixels_per_column, JSON_TYPE_F64);
-	json_parse_vector(json, tokens, (char const *[]){"beam_intrinsics", "beam_azimuth_angles", NULL}, out->beam_azimuth_angles, out->pixels_per_column, JSON_TYPE_F64);
-	json_parse_vector(json, tokens, (char const *[]){"beam_intrinsics", "beam_to_lidar_transform", NULL}, out->beam_to_lidar_transform, 16, JSON_TYPE_F64);
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		goto error;
+	}
 
-	json_parse_vector(json, tokens, (char const *[]){"lidar_intrinsics", "lidar_to_sensor_transform", NULL}, out->lidar_to_sensor_transform, 16, JSON_TYPE_F64);
+	fseek(file, 0, SEEK_END);
+	int32_t size = (int32_t)ftell(file);
 
-	char buf[STRING_BUF_SIZE];
-	json_parse_string(json, tokens, (char const *[]){"lidar_data_format", "udp_profile_lidar", NULL}, buf, STRING_BUF_SIZE);
+	if (size == -1) {
+		goto error;
+	}
+	rewind(file);
 
-	if (strcmp(buf, "LIDAR_LEGACY") == 0) {
-		out->profile = OUSTER_PROFILE_LIDAR_LEGACY;
-		out->channel_data_size = 12;
-	} else if (strcmp(buf, "RNG19_RFL8_SIG16_NIR16_DUAL") == 0) {
-		out->profile = OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL;
-		out->channel_data_size = 16;
-	} else if (strcmp(buf, "RNG19_RFL8_SIG16_NIR16") == 0) {
-		out->profile = OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16;
-		out->channel_data_size = 12;
-	} else if (strcmp(buf, "RNG15_RFL8_NIR8") == 0) {
-		out->profile = OUSTER_PROFILE_RNG15_RFL8_NIR8;
-		out->channel_data_size = 4;
-	} else if (strcmp(buf, "FIVE_WORD_PIXEL") == 0) {
-		out->profile = OUSTER_PROFILE_FIVE_WORDS_PER_PIXEL;
-		out->channel_data_size = 20;
-	} else {
-		ouster_assert(0, "Profile not found");
+	content = ouster_os_malloc(size + 1);
+	content[size] = '\0';
+	size_t n = fread(content, size, 1, file);
+	if (n != 1) {
+		ouster_log("%s: could not read wholef file %d bytes\n", path, size);
+		goto error;
+	}
+	ouster_assert(content[size] == '\0', "Expected null terminator");
+	fclose(file);
+	return content;
+error:
+	if (content) {
+		ouster_os_free(content);
+	}
+	return NULL;
+}
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HTTP_EOL "\r\n\r\n"
+
+void ouster_http_request(int sock, char const *host, char const *path, ouster_vec_t *v)
+{
+	ouster_assert_notnull(host);
+	ouster_assert_notnull(path);
+	ouster_assert_notnull(v);
+	ouster_assert(v->esize == 1, "");
+	{
+		char buf[1024] = {0};
+		int n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: %s\r\nAccept: */*" HTTP_EOL, path, host);
+		ouster_log("REQ START:\n%s\nREQ END\n", buf);
+		ssize_t written = write(sock, buf, n);
+		if(n != written) {
+			ouster_log("write failed: %s\n", buf);
+			return;
+		}
+	}
+
+	while (1) {
+		char buf[1024] = {0};
+		ssize_t n = recv(sock, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			break;
+		}
+		int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_HTTP);
+		ouster_vec_append(v, buf, n, 1.5f);
+		ouster_os_mem_tag_set(tag);
+	}
+	{
+		char *e = OUSTER_OFFSET(v->data, v->esize * v->count);
+		e[0] = '\0';
+	}
+
+	char *json = strstr(v->data, HTTP_EOL);
+	if (json) {
+		json += strlen(HTTP_EOL);
+		size_t n = strlen(json);
+		memcpy(v->data, json, n);
+		v->count = n;
+		char *e = OUSTER_OFFSET(v->data, v->esize * v->count);
+		e[0] = '\0';
+	}
+}
+#include <string.h>
+
+void ouster_lidar_header_get1(char const *buf, void *dst, int type)
+{
+	ouster_assert_notnull(buf);
+	ouster_assert_notnull(dst);
+	switch (type) {
+	case ouster_id(ouster_packet_type_t):
+		memcpy(dst, buf + 0, sizeof(ouster_packet_type_t));
+		break;
+	case ouster_id(ouster_frame_id_t):
+		memcpy(dst, buf + 2, sizeof(ouster_frame_id_t));
+		break;
+	case ouster_id(ouster_init_id_t):
+		memcpy(dst, buf + 4, sizeof(ouster_init_id_t));
+		*((ouster_init_id_t *)dst) &= UINT32_C(0x00ffffff);
+		break;
+	case ouster_id(ouster_prod_sn_t):
+		memcpy(dst, buf + 7, sizeof(ouster_prod_sn_t));
+		*((ouster_prod_sn_t *)dst) &= UINT64_C(0x000000ffffffffff);
+		break;
+	case ouster_id(ouster_countdown_thermal_shutdown_t):
+		memcpy(dst, buf + 16, sizeof(ouster_countdown_thermal_shutdown_t));
+		break;
+	case ouster_id(ouster_countdown_shot_limiting_t):
+		memcpy(dst, buf + 17, sizeof(ouster_countdown_shot_limiting_t));
+		break;
+	case ouster_id(ouster_thermal_shutdown_t):
+		memcpy(dst, buf + 18, sizeof(ouster_thermal_shutdown_t));
+		break;
+	case ouster_id(ouster_shot_limiting_t):
+		memcpy(dst, buf + 19, sizeof(ouster_shot_limiting_t));
+		break;
+	default:
+		ouster_assert(0, "");
+		break;
+	}
+}
+
+void ouster_lidar_header_get(char const *buf, ouster_lidar_header_t *dst)
+{
+	ouster_assert_notnull(buf);
+	ouster_assert_notnull(dst);
+	ouster_lidar_header_get1(buf, &dst->packet_type, ouster_id(ouster_packet_type_t));
+	ouster_lidar_header_get1(buf, &dst->frame_id, ouster_id(ouster_frame_id_t));
+	ouster_lidar_header_get1(buf, &dst->init_id, ouster_id(ouster_init_id_t));
+	ouster_lidar_header_get1(buf, &dst->prod_sn, ouster_id(ouster_prod_sn_t));
+	ouster_lidar_header_get1(buf, &dst->countdown_thermal_shutdown, ouster_id(ouster_countdown_thermal_shutdown_t));
+	ouster_lidar_header_get1(buf, &dst->countdown_shot_limiting, ouster_id(ouster_countdown_shot_limiting_t));
+	ouster_lidar_header_get1(buf, &dst->thermal_shutdown, ouster_id(ouster_thermal_shutdown_t));
+	ouster_lidar_header_get1(buf, &dst->shot_limiting, ouster_id(ouster_shot_limiting_t));
+}
+
+void ouster_column_get1(char const *colbuf, void *dst, int type)
+{
+	ouster_assert_notnull(colbuf);
+	ouster_assert_notnull(dst);
+	switch (type) {
+	case ouster_id(ouster_timestamp_t):
+		memcpy(dst, colbuf + 0, sizeof(ouster_timestamp_t));
+		break;
+	case ouster_id(ouster_measurment_id_t):
+		memcpy(dst, colbuf + 8, sizeof(ouster_measurment_id_t));
+		break;
+	case ouster_id(ouster_status_t):
+		memcpy(dst, colbuf + 10, sizeof(ouster_status_t));
+		*((ouster_status_t *)dst) &= 0xffff;
+		break;
+	default:
+		ouster_assert(0, "");
+		break;
+	}
+}
+
+void ouster_column_get(char const *colbuf, ouster_column_t *dst)
+{
+	ouster_assert_notnull(colbuf);
+	ouster_assert_notnull(dst);
+	ouster_column_get1(colbuf, &dst->ts, ouster_id(ouster_timestamp_t));
+	ouster_column_get1(colbuf, &dst->status, ouster_id(ouster_status_t));
+	ouster_column_get1(colbuf, &dst->mid, ouster_id(ouster_measurment_id_t));
+}
+
+void pxcpy(char *dst, int dst_inc, char const *src, int src_inc, int n, int esize)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	char *d = dst;
+	char const *s = src;
+	for (int i = 0; i < n; i++, d += dst_inc, s += src_inc) {
+		memcpy(d, s, esize);
+	}
+}
+
+void field_copy(ouster_field_t *field, ouster_meta_t *meta, int mid, char const *pxbuf)
+{
+	ouster_assert_notnull(field);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(pxbuf);
+	// Row major - each row is continuous memory
+	char *data = field->data;
+	ouster_extract_t *extract = meta->extract + field->quantity;
+	int depth = extract->depth;
+	int offset = extract->offset;
+	int rowsize = field->rowsize;
+	int rows = meta->pixels_per_column;
+	int mid0 = meta->mid0;
+	int mid1 = meta->mid1;
+	ouster_assert(mid <= mid1, "Incorrect mid=%i (Column Measurement Id) not in range %i to %i", mid, mid0, mid1);
+	char *dst = data + (mid - mid0) * field->depth;
+	pxcpy(dst, rowsize, pxbuf + offset, meta->channel_data_size, rows, depth);
+}
+
+void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char const *buf, ouster_field_t *fields, int fcount)
+{
+	ouster_assert_notnull(lidar);
+	ouster_assert_notnull(buf);
+	ouster_assert(fields || ((fields == NULL) && (fcount == 0)), "");
+	ouster_profile_begin(t);
+
+	char const *colbuf = buf + OUSTER_PACKET_HEADER_SIZE;
+	ouster_lidar_header_t header = {0};
+	ouster_column_t column = {0};
+	ouster_lidar_header_get(buf, &header);
+	// ouster_lidar_header_dump(&header);
+	ouster_column_get(colbuf, &column);
+
+	if (lidar->frame_id != (int)header.frame_id) {
+		// ouster_log("New Frame!\n");
+		lidar->frame_id = (int)header.frame_id;
+		// lidar->last_mid = 0;
+		lidar->last_mid = column.mid - 1;
+		lidar->mid_loss = 0;
+		lidar->num_valid_pixels = 0;
+	}
+
+	int mid_delta = column.mid - lidar->last_mid;
+	// ouster_log("mid_delta %i\n", mid_delta);
+	lidar->mid_loss += (mid_delta - 1);
+
+	lidar->packet_mid0 = -1;
+	lidar->packet_mid1 = -1;
+
+	// col_size = 1584
+	for (int icol = 0; icol < meta->columns_per_packet; icol++, colbuf += meta->col_size) {
+		ouster_column_get(colbuf, &column);
+		// ouster_dump_column(stdout, &column);
+
+		if ((column.status & 0x01) == 0) {
+			continue;
+		}
+		char const *pxbuf = colbuf + OUSTER_COLUMN_HEADER_SIZE;
+
+		for (int j = 0; j < fcount; ++j) {
+			ouster_assert(fields[j].cols > 0, "");
+			ouster_assert(fields[j].rows > 0, "");
+			ouster_assert(fields[j].depth > 0, "");
+			field_copy(fields + j, meta, column.mid, pxbuf);
+			lidar->num_valid_pixels += meta->pixels_per_column;
+		}
+		lidar->last_mid = column.mid;
+		if (lidar->valid_cols) {
+			int col = column.mid - meta->mid0;
+			lidar->valid_cols[col / 64] |= UINT64_C(1) << (col % 64);
+		}
+		if (lidar->packet_mid0 < 0) {
+			lidar->packet_mid0 = column.mid;
+		}
+		lidar->packet_mid1 = column.mid;
+	}
+
+	for (int j = 0; j < fcount; ++j) {
+		// TODO: Refactor this mask procedure
+		ouster_field_apply_mask_u32(fields + j, meta);
+	}
+
+	for (int j = 0; j < fcount; ++j) {
+		ouster_assert_notnull(fields[j].data);
+		ouster_assert(fields[j].cols > 0, "");
+		ouster_assert(fields[j].rows > 0, "");
+		ouster_assert(fields[j].depth > 0, "");
+	}
+	ouster_profile_end(t, OUSTER_STAGE_DECODE);
+}
+/**
+ * @defgroup math Math
+ * @brief Functionality for math
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_MATH_H
+#define OUSTER_MATH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUSTER_M4(i, j) ((i) * 4 + (j))
+#define OUSTER_M3(i, j) ((i) * 3 + (j))
+
+#define OUSTER_REAL_FORMAT "%+20.10f"
+
+#define OUSTER_V3_ARGS(x) (x)[0], (x)[1], (x)[2]
+#define OUSTER_V4_ARGS(x) (x)[0], (x)[1], (x)[2], (x)[3]
+
+#define OUSTER_V3_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT "\n"
+#define OUSTER_V4_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT OUSTER_REAL_FORMAT "\n"
+
+#define OUSTER_V3_DOT(a, b) ((a)[0] * (b)[0] + (a)[1] * (b)[1] + (a)[2] * (b)[2])
+#define OUSTER_V4_DOT(a, b) ((a)[0] * (b)[0] + (a)[1] * (b)[1] + (a)[2] * (b)[2] + (a)[3] * (b)[3])
+
+#define OUSTER_M3_ARGS_1(x) (x)[0], (x)[1], (x)[2], (x)[3], (x)[4], (x)[5], (x)[6], (x)[7], (x)[8]
+#define OUSTER_M3_ARGS_2(x) (x)[0], (x)[3], (x)[6], (x)[1], (x)[4], (x)[7], (x)[2], (x)[5], (x)[8]
+#define OUSTER_M4_ARGS_1(x) (x)[0], (x)[1], (x)[2], (x)[3], (x)[4], (x)[5], (x)[6], (x)[7], (x)[8], (x)[9], (x)[10], (x)[11], (x)[12], (x)[13], (x)[14], (x)[15]
+#define OUSTER_M4_ARGS_2(x) (x)[0], (x)[4], (x)[8], (x)[12], (x)[1], (x)[5], (x)[9], (x)[13], (x)[2], (x)[6], (x)[10], (x)[14], (x)[3], (x)[7], (x)[11], (x)[15]
+
+#define OUSTER_M3_FORMAT OUSTER_V3_FORMAT OUSTER_V3_FORMAT OUSTER_V3_FORMAT
+#define OUSTER_M4_FORMAT OUSTER_V4_FORMAT OUSTER_V4_FORMAT OUSTER_V4_FORMAT OUSTER_V4_FORMAT
+
+void ouster_m3f64_mul(double r[9], double const a[9], double const x[9]);
+
+void ouster_m4_print(double const a[16]);
+
+void ouster_m3_print(double const a[9]);
+
+void ouster_v3_print(double const a[3]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_MATH_H
+
+/** @} */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Messages up to this size are formatted on the stack */
+#define LOG_STACK_MSG 256
+
+/* Largest asynchronous record, arguments that do not fit are dropped with the message */
+#define LOG_RECORD_MAX 1024
+
+/* Background thread sleeps this long when all rings are empty */
+#define LOG_IDLE_NS 1000000
+
+typedef enum {
+	LOG_ARG_NONE,
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_INTMAX,
+	LOG_ARG_PTRDIFF,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LDOUBLE,
+	LOG_ARG_STRING,
+	LOG_ARG_POINTER,
+} log_arg_t;
+
+/* One conversion specification of a printf format */
+typedef struct
+{
+	log_arg_t arg;
+	int star_width;
+	int star_precision;
+	/* Length of the specification including % */
+	int length;
+} log_spec_t;
+
+typedef struct
+{
+	uint32_t size;
+	int32_t level;
+	int32_t line;
+	int32_t reserved;
+	char const *fmt;
+	char const *file;
+} log_record_t;
+
+/* Single producer single consumer byte ring, records never wrap, a record of size 0 pads to the end */
+typedef struct
+{
+	char *data;
+	uint64_t head;
+	uint64_t tail;
+	/* Non zero while a thread logs into the ring */
+	int owned;
+} log_ring_t;
+
+typedef struct
+{
+	log_ring_t rings[OUSTER_LOG_ASYNC_THREADS];
+	char *memory;
+	/* Highest ring ever claimed plus one, the background thread drains rings below it */
+	int ring_count;
+	int generation;
+	int running;
+	int quit;
+	int64_t dropped;
+	pthread_t thread;
+} log_async_t;
+
+static log_async_t log_async;
+static __thread log_ring_t *log_thread_ring;
+static __thread int log_thread_generation;
+static pthread_key_t log_key;
+static pthread_once_t log_key_once = PTHREAD_ONCE_INIT;
+
+int32_t ouster_log_set_level(int32_t level)
+{
+	int prev = ouster_os_api.log_level_;
+	ouster_os_api.log_level_ = level;
+	return prev;
+}
+
+/* Parses the conversion specification at p, which points to % */
+static void log_spec_parse(char const *p, log_spec_t *spec)
+{
+	char const *s = p + 1;
+	memset(spec, 0, sizeof(log_spec_t));
+	while (*s && strchr("-+ #0", *s)) {
+		s++;
+	}
+	if (*s == '*') {
+		spec->star_width = 1;
+		s++;
+	}
+	while ((*s >= '0') && (*s <= '9')) {
+		s++;
+	}
+	if (*s == '.') {
+		s++;
+		if (*s == '*') {
+			spec->star_precision = 1;
+			s++;
+		}
+		while ((*s >= '0') && (*s <= '9')) {
+			s++;
+		}
+	}
+	log_arg_t integer = LOG_ARG_INT;
+	int ldouble = 0;
+	if ((s[0] == 'h') && (s[1] == 'h')) {
+		s += 2;
+	} else if (s[0] == 'h') {
+		s += 1;
+	} else if ((s[0] == 'l') && (s[1] == 'l')) {
+		integer = LOG_ARG_LLONG;
+		s += 2;
+	} else if (s[0] == 'l') {
+		integer = LOG_ARG_LONG;
+		s += 1;
+	} else if (s[0] == 'z') {
+		integer = LOG_ARG_SIZE;
+		s += 1;
+	} else if (s[0] == 'j') {
+		integer = LOG_ARG_INTMAX;
+		s += 1;
+	} else if (s[0] == 't') {
+		integer = LOG_ARG_PTRDIFF;
+		s += 1;
+	} else if (s[0] == 'L') {
+		ldouble = 1;
+		s += 1;
+	}
+	switch (*s) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		spec->arg = integer;
+		break;
+	case 'c':
+		spec->arg = LOG_ARG_INT;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->arg = ldouble ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+		break;
+	case 's':
+		spec->arg = LOG_ARG_STRING;
+		break;
+	case 'p':
+		spec->arg = LOG_ARG_POINTER;
+		break;
+	default:
+		// %% and unsupported conversions take no argument
+		spec->arg = LOG_ARG_NONE;
+		break;
+	}
+	spec->length = (int)(s - p) + (*s ? 1 : 0);
+}
+
+/* Appends n bytes to the record, returns 0 when the record is full */
+static int log_put(char *rec, uint32_t *size, void const *src, uint32_t n)
+{
+	uint32_t aligned = (n + 7) & ~(uint32_t)7;
+	if ((*size + aligned) > LOG_RECORD_MAX) {
+		return 0;
+	}
+	memcpy(rec + *size, src, n);
+	*size += aligned;
+	return 1;
+}
+
+/* Copies the arguments of fmt into a record, returns the record size or 0 when it does not fit */
+static uint32_t log_encode(char *rec, int32_t level, char const *file, int32_t line, char const *fmt, va_list args)
+{
+	log_record_t header = {0, level, line, 0, fmt, file};
+	uint32_t size = sizeof(log_record_t);
+	int ok = 1;
+	for (char const *p = fmt; ok && *p; ++p) {
+		if (*p != '%') {
+			continue;
+		}
+		log_spec_t spec;
+		log_spec_parse(p, &spec);
+		p += spec.length - 1;
+		if (spec.star_width) {
+			int v = va_arg(args, int);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		}
+		if (spec.star_precision) {
+			int v = va_arg(args, int);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		}
+		switch (spec.arg) {
+		case LOG_ARG_NONE:
+			break;
+		case LOG_ARG_INT: {
+			int v = va_arg(args, int);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_LONG: {
+			long v = va_arg(args, long);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_LLONG: {
+			long long v = va_arg(args, long long);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_SIZE: {
+			size_t v = va_arg(args, size_t);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_INTMAX: {
+			intmax_t v = va_arg(args, intmax_t);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_PTRDIFF: {
+			ptrdiff_t v = va_arg(args, ptrdiff_t);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_DOUBLE: {
+			double v = va_arg(args, double);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_LDOUBLE: {
+			long double v = va_arg(args, long double);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_POINTER: {
+			void *v = va_arg(args, void *);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_STRING: {
+			char const *v = va_arg(args, char const *);
+			char buf[OUSTER_LOG_ASYNC_STRING_MAX + 1];
+			snprintf(buf, sizeof(buf), "%s", v ? v : "(null)");
+			ok = ok && log_put(rec, &size, buf, (uint32_t)strlen(buf) + 1);
+		} break;
+		}
+	}
+	if (!ok) {
+		return 0;
+	}
+	header.size = size;
+	memcpy(rec, &header, sizeof(log_record_t));
+	return size;
+}
+
+/* Takes the next value of n bytes from a record */
+static char const *log_get(char const **cursor, uint32_t n)
+{
+	char const *v = *cursor;
+	*cursor += (n + 7) & ~(uint32_t)7;
+	return v;
+}
+
+/* Formats a record the same way vsnprintf would have */
+static void log_decode(char const *rec, char *out, int capacity)
+{
+	log_record_t header;
+	memcpy(&header, rec, sizeof(log_record_t));
+	char const *cursor = rec + sizeof(log_record_t);
+	int n = 0;
+	for (char const *p = header.fmt; *p && (n < (capacity - 1)); ++p) {
+		if (*p != '%') {
+			out[n++] = *p;
+			continue;
+		}
+		log_spec_t spec;
+		log_spec_parse(p, &spec);
+		// Copy the specification, star arguments become numbers and L is removed
+		char f[64];
+		int fn = 0;
+		for (int i = 0; (i < spec.length) && (fn < (int)sizeof(f) - 16); ++i) {
+			if (p[i] == '*') {
+				int v;
+				memcpy(&v, log_get(&cursor, sizeof(int)), sizeof(int));
+				fn += snprintf(f + fn, sizeof(f) - fn, "%i", v);
+			} else if (p[i] != 'L') {
+				f[fn++] = p[i];
+			}
+		}
+		f[fn] = '\0';
+		p += spec.length - 1;
+		int rest = capacity - n;
+		int w = 0;
+		switch (spec.arg) {
+		case LOG_ARG_NONE:
+			w = snprintf(out + n, rest, f, 0);
+			break;
+		case LOG_ARG_INT: {
+			int v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_LONG: {
+			long v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_LLONG: {
+			long long v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_SIZE: {
+			size_t v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_INTMAX: {
+			intmax_t v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_PTRDIFF: {
+			ptrdiff_t v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_DOUBLE: {
+			double v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_LDOUBLE: {
+			long double v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, (double)v);
+		} break;
+		case LOG_ARG_POINTER: {
+			void *v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_STRING: {
+			char const *v = cursor;
+			log_get(&cursor, (uint32_t)strlen(v) + 1);
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		}
+		n += (w < 0) ? 0 : (w < rest ? w : rest - 1);
+	}
+	out[n] = '\0';
+}
+
+/* Gives the ring back when its thread exits, records not written yet stay in it for the next owner */
+static void log_ring_release(void *arg)
+{
+	log_ring_t *ring = arg;
+	// A ring from before the last ouster_log_async_start() may belong to another thread now
+	if (log_thread_generation == __atomic_load_n(&log_async.generation, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+	}
+}
+
+static void log_key_create(void)
+{
+	pthread_key_create(&log_key, log_ring_release);
+}
+
+/* Claims a ring no living thread owns, NULL when all are taken */
+static log_ring_t *log_ring_claim(void)
+{
+	for (int i = 0; i < OUSTER_LOG_ASYNC_THREADS; ++i) {
+		log_ring_t *ring = log_async.rings + i;
+		int expected = 0;
+		if (__atomic_load_n(&ring->owned, __ATOMIC_RELAXED) || !__atomic_compare_exchange_n(&ring->owned, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			continue;
+		}
+		int count = __atomic_load_n(&log_async.ring_count, __ATOMIC_RELAXED);
+		while ((count <= i) && !__atomic_compare_exchange_n(&log_async.ring_count, &count, i + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		}
+		pthread_once(&log_key_once, log_key_create);
+		pthread_setspecific(log_key, ring);
+		return ring;
+	}
+	return NULL;
+}
+
+/* Returns the ring of the calling thread, NULL when all rings are taken */
+static log_ring_t *log_ring_get(void)
+{
+	int generation = __atomic_load_n(&log_async.generation, __ATOMIC_ACQUIRE);
+	if ((log_thread_ring == NULL) || (log_thread_generation != generation)) {
+		log_thread_ring = log_ring_claim();
+		log_thread_generation = generation;
+	}
+	return log_thread_ring;
+}
+
+/* Producer side, never blocks */
+static void log_async_push(int32_t level, char const *file, int32_t line, char const *fmt, va_list args)
+{
+	log_ring_t *ring = log_ring_get();
+	char rec[LOG_RECORD_MAX];
+	uint32_t size = ring ? log_encode(rec, level, file, line, fmt, args) : 0;
+	if (size == 0) {
+		__atomic_fetch_add(&log_async.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	uint64_t offset = head % OUSTER_LOG_ASYNC_RING_SIZE;
+	uint64_t pad = ((offset + size) > OUSTER_LOG_ASYNC_RING_SIZE) ? (OUSTER_LOG_ASYNC_RING_SIZE - offset) : 0;
+	if ((head + pad + size - tail) > OUSTER_LOG_ASYNC_RING_SIZE) {
+		__atomic_fetch_add(&log_async.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	if (pad) {
+		// A zero size tells the consumer to continue at the start of the ring
+		memset(ring->data + offset, 0, sizeof(uint32_t));
+		head += pad;
+		offset = 0;
+	}
+	memcpy(ring->data + offset, rec, size);
+	__atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+}
+
+/* Consumer side, returns number of records written */
+static int log_async_drain(log_ring_t *ring)
+{
+	int count = 0;
+	uint64_t tail = ring->tail;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	while (tail != head) {
+		uint64_t offset = tail % OUSTER_LOG_ASYNC_RING_SIZE;
+		uint32_t size = 0;
+		if ((OUSTER_LOG_ASYNC_RING_SIZE - offset) >= sizeof(uint32_t)) {
+			memcpy(&size, ring->data + offset, sizeof(uint32_t));
+		}
+		if (size == 0) {
+			tail += OUSTER_LOG_ASYNC_RING_SIZE - offset;
+			continue;
+		}
+		log_record_t header;
+		memcpy(&header, ring->data + offset, sizeof(log_record_t));
+		char msg[LOG_STACK_MSG * 4];
+		log_decode(ring->data + offset, msg, sizeof(msg));
+		ouster_os_api.log_(header.level, header.file, header.line, msg);
+		tail += size;
+		count++;
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return count;
+}
+
+static void *log_async_thread(void *arg)
+{
+	ouster_unused(arg);
+	while (1) {
+		int quit = __atomic_load_n(&log_async.quit, __ATOMIC_ACQUIRE);
+		int count = 0;
+		int rings = __atomic_load_n(&log_async.ring_count, __ATOMIC_RELAXED);
+		rings = rings < OUSTER_LOG_ASYNC_THREADS ? rings : OUSTER_LOG_ASYNC_THREADS;
+		for (int i = 0; i < rings; ++i) {
+			count += log_async_drain(log_async.rings + i);
+		}
+		if (quit && (count == 0)) {
+			break;
+		}
+		if (count == 0) {
+			struct timespec ts = {0, LOG_IDLE_NS};
+			nanosleep(&ts, NULL);
+		}
+	}
+	return NULL;
+}
+
+int ouster_log_async_start(void)
+{
+	if (log_async.running) {
+		return 0;
+	}
+	int generation = log_async.generation;
+	memset(&log_async, 0, sizeof(log_async_t));
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LOG);
+	log_async.memory = ouster_os_calloc(OUSTER_LOG_ASYNC_THREADS * OUSTER_LOG_ASYNC_RING_SIZE);
+	ouster_os_mem_tag_set(tag);
+	if (log_async.memory == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < OUSTER_LOG_ASYNC_THREADS; ++i) {
+		log_async.rings[i].data = log_async.memory + i * OUSTER_LOG_ASYNC_RING_SIZE;
+	}
+	// Threads pick a new ring when the generation changes
+	__atomic_store_n(&log_async.generation, generation + 1, __ATOMIC_RELEASE);
+	if (pthread_create(&log_async.thread, NULL, log_async_thread, NULL) != 0) {
+		ouster_os_free(log_async.memory);
+		log_async.memory = NULL;
+		return -1;
+	}
+	__atomic_store_n(&log_async.running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void ouster_log_async_stop(void)
+{
+	if (!log_async.running) {
+		return;
+	}
+	// New messages are written synchronously from now on, the thread drains what is left
+	__atomic_store_n(&log_async.running, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&log_async.quit, 1, __ATOMIC_RELEASE);
+	pthread_join(log_async.thread, NULL);
+	ouster_os_free(log_async.memory);
+	log_async.memory = NULL;
+}
+
+int64_t ouster_log_async_dropped(void)
+{
+	return __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+}
+
+void ouster_log_(int32_t level, char const *file, int32_t line, char const *fmt, ...)
+{
+	ouster_assert_notnull(fmt);
+
+	if (level > ouster_os_api.log_level_) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, fmt);
+
+	if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+		log_async_push(level, file, line, fmt, args);
+		va_end(args);
+		return;
+	}
+
+	// Short messages are formatted on the stack, only long ones allocate
+	char buf[LOG_STACK_MSG];
+	va_list tmpa;
+	va_copy(tmpa, args);
+	int size = vsnprintf(buf, sizeof(buf), fmt, tmpa);
+	va_end(tmpa);
+	if (size < 0) {
+		va_end(args);
+		return;
+	}
+	if (size < (int)sizeof(buf)) {
+		ouster_os_api.log_(level, file, line, buf);
+	} else {
+		int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LOG);
+		char *msg = ouster_os_malloc(size + 1);
+		ouster_os_mem_tag_set(tag);
+		ouster_assert_notnull(msg);
+		vsnprintf(msg, size + 1, fmt, args);
+		ouster_os_api.log_(level, file, line, msg);
+		ouster_os_free(msg);
+	}
+
+	va_end(args);
+}
+
+
+void ouster_log_m4_(double const a[16])
+{
+	ouster_log(OUSTER_M4_FORMAT, OUSTER_M4_ARGS_1(a));
+}
+
+void ouster_log_m3_(double const a[9])
+{
+	ouster_log(OUSTER_M3_FORMAT, OUSTER_M3_ARGS_1(a));
+}
+
+void ouster_log_v3_(double const a[3])
+{
+	ouster_log(OUSTER_V3_FORMAT, OUSTER_V3_ARGS(a));
+}
+#ifndef OUSTER_LUT_JOB_H
+#define OUSTER_LUT_JOB_H
+
+
+#include <stdint.h>
+
+/* Rows are split in this many jobs per worker to even out scheduling noise */
+#define LUT_JOBS_PER_WORKER 4
+
+/* Number of jobs a LUT of h rows is split into on the pool */
+static inline int lut_job_count(ouster_pool_t const *pool, int h)
+{
+	int jobs = pool->count * LUT_JOBS_PER_WORKER;
+	return jobs < h ? jobs : h;
+}
+
+/* Pixel range [i0, i1) of a job, whole rows */
+static inline void lut_job_range(int w, int h, int jobs, int index, int *i0, int *i1)
+{
+	*i0 = (int)((int64_t)h * index / jobs) * w;
+	*i1 = (int)((int64_t)h * (index + 1) / jobs) * w;
+}
+
+#endif // OUSTER_LUT_JOB_H
+
+//#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+
+void ouster_lut_fini(ouster_lut_t *lut)
+{
+	if (lut->map) {
+		ouster_lut_unmap(lut);
+	} else {
+		ouster_os_free(lut->direction);
+		ouster_os_free(lut->offset);
+	}
+	ouster_os_free(lut->direction_base);
+	ouster_os_free(lut->offset_base);
+	lut->direction = NULL;
+	lut->offset = NULL;
+	lut->direction_base = NULL;
+	lut->offset_base = NULL;
+}
+
+/*
+https://static.ouster.dev/sensor-docs/image_route1/image_route3/sensor_data/sensor-data.html?highlight=cartesian#lidar-range-to-xyz
+
+*/
+void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+
+	int w = meta->midw;
+	int h = meta->pixels_per_column;
+	// Any width, the tables are allocated from w and h. Rows are limited by the beam arrays in meta.
+	ouster_assert(w > 0, "");
+	ouster_assert(h > 0, "");
+	ouster_assert(h <= OUSTER_MAX_ROWS, "");
+
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+	double *encoder = ouster_os_calloc(w * h * sizeof(double));  // theta_e
+	double *azimuth = ouster_os_calloc(w * h * sizeof(double));  // theta_a
+	double *altitude = ouster_os_calloc(w * h * sizeof(double)); // phi
+	double *direction = ouster_os_calloc(w * h * 3 * sizeof(double));
+	double *offset = ouster_os_calloc(w * h * 3 * sizeof(double));
+	ouster_os_mem_tag_set(tag);
+	ouster_assert_notnull(encoder);
+	ouster_assert_notnull(azimuth);
+	ouster_assert_notnull(altitude);
+	ouster_assert_notnull(direction);
+	ouster_assert_notnull(offset);
+
+	float beam_to_lidar_transform_03 = meta->beam_to_lidar_transform[OUSTER_M4(0, 3)];
+	float beam_to_lidar_transform_23 = meta->beam_to_lidar_transform[OUSTER_M4(2, 3)];
+	ouster_log_m4(meta->lidar_to_sensor_transform);
+
+	// This represent a column measurement angle:
+	double azimuth_radians = OUSTER_M_PI * 2.0 / meta->columns_per_frame;
+
+	// OS sensor - populate angles for each pixel
+	for (int c = 0; c < w; c++) {
+		for (int r = 0; r < h; r++) {
+			// Row major - each row is continuous memory
+			int mid = meta->mid0 + c;
+			ouster_assert(mid >= meta->mid0, "");
+			ouster_assert(mid <= meta->mid1, "");
+			int i = r * w + c;
+			encoder[i] = 2.0 * OUSTER_M_PI - (mid * azimuth_radians);
+			azimuth[i] = -meta->beam_azimuth_angles[r] * OUSTER_M_PI / 180.0;
+			altitude[i] = meta->beam_altitude_angles[r] * OUSTER_M_PI / 180.0;
+		}
+	}
+
+	// unit vectors for each pixel
+	for (int i = 0; i < w * h; i++) {
+		direction[i * 3 + 0] = cos(encoder[i] + azimuth[i]) * cos(altitude[i]);
+		direction[i * 3 + 1] = sin(encoder[i] + azimuth[i]) * cos(altitude[i]);
+		direction[i * 3 + 2] = sin(altitude[i]);
+	}
+
+	for (int i = 0; i < w * h; i++) {
+		offset[i * 3 + 0] = cos(encoder[i]) * beam_to_lidar_transform_03 - direction[i * 3 + 0] * meta->lidar_origin_to_beam_origin_mm;
+		offset[i * 3 + 1] = sin(encoder[i]) * beam_to_lidar_transform_03 - direction[i * 3 + 1] * meta->lidar_origin_to_beam_origin_mm;
+		offset[i * 3 + 2] = beam_to_lidar_transform_23 - direction[i * 3 + 2] * meta->lidar_origin_to_beam_origin_mm;
+	}
+
+	// Extract the rotation matrix from transform
+	double rotation[9] = {
+	    [OUSTER_M3(0, 0)] = meta->lidar_to_sensor_transform[OUSTER_M4(0, 0)],
+	    [OUSTER_M3(1, 0)] = meta->lidar_to_sensor_transform[OUSTER_M4(0, 1)],
+	    [OUSTER_M3(2, 0)] = meta->lidar_to_sensor_transform[OUSTER_M4(0, 2)],
+	    [OUSTER_M3(0, 1)] = meta->lidar_to_sensor_transform[OUSTER_M4(1, 0)],
+	    [OUSTER_M3(1, 1)] = meta->lidar_to_sensor_transform[OUSTER_M4(1, 1)],
+	    [OUSTER_M3(2, 1)] = meta->lidar_to_sensor_transform[OUSTER_M4(1, 2)],
+	    [OUSTER_M3(0, 2)] = meta->lidar_to_sensor_transform[OUSTER_M4(2, 0)],
+	    [OUSTER_M3(1, 2)] = meta->lidar_to_sensor_transform[OUSTER_M4(2, 1)],
+	    [OUSTER_M3(2, 2)] = meta->lidar_to_sensor_transform[OUSTER_M4(2, 2)],
+	};
+
+	// Extract the translation vector from transform
+	float translation[3] =
+	    {
+	        meta->lidar_to_sensor_transform[0 * 4 + 3],
+	        meta->lidar_to_sensor_transform[1 * 4 + 3],
+	        meta->lidar_to_sensor_transform[2 * 4 + 3],
+	    };
+
+	for (int i = 0; i < w * h; ++i) {
+		double *d = direction + i * 3;
+		double *o = offset + i * 3;
+		ouster_m3f64_mul(d, rotation, d);
+		ouster_m3f64_mul(o, rotation, o);
+		o[0] += translation[0];
+		o[1] += translation[1];
+		o[2] += translation[2];
+	}
+
+	ouster_os_free(encoder);
+	ouster_os_free(azimuth);
+	ouster_os_free(altitude);
+
+	for (int i = 0; i < w * h; ++i) {
+		double range_unit = 0.001f;
+		//double range_unit = 1.0f;
+		double *d = direction + i * 3;
+		double *o = offset + i * 3;
+		d[0] *= range_unit;
+		d[1] *= range_unit;
+		d[2] *= range_unit;
+		o[0] *= range_unit;
+		o[1] *= range_unit;
+		o[2] *= range_unit;
+	}
+
+	lut->direction = direction;
+	lut->offset = offset;
+	lut->w = w;
+	lut->h = h;
+	lut->direction_base = NULL;
+	lut->offset_base = NULL;
+	lut->map = NULL;
+	lut->map_size = 0;
+	memset(lut->transform, 0, sizeof(lut->transform));
+	lut->transform[OUSTER_M4(0, 0)] = 1.0;
+	lut->transform[OUSTER_M4(1, 1)] = 1.0;
+	lut->transform[OUSTER_M4(2, 2)] = 1.0;
+	lut->transform[OUSTER_M4(3, 3)] = 1.0;
+
+	/*
+	for (int i = 0; i < w * h; ++i) {
+	    double *d = direction + i * 3;
+	    double *o = offset + i * 3;
+	    printf("%+f %+f %+f %+f %+f %+f, %+f\n", o[0], o[1], o[2], d[0], d[1], d[2], sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+	}
+	*/
+}
+
+/* Converts pixel i0 to i1-1, out points to the whole frame */
+static void cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int i0, int i1)
+{
+	double const *d = lut->direction + i0 * 3;
+	double const *o = lut->offset + i0 * 3;
+	char *out8 = (char *)out + i0 * out_stride;
+
+	for (int i = i0; i < i1; ++i, out8 += out_stride, d += 3, o += 3) {
+		double mag = range[i];
+		double *outd = (double *)out8;
+		outd[0] = (float)(mag * d[0] + o[0]);
+		outd[1] = (float)(mag * d[1] + o[1]);
+		outd[2] = (float)(mag * d[2] + o[2]);
+		// printf("%+f %+f\n", mag, sqrt(OUSTER_V3_DOT(out_xyz, out_xyz)));
+	}
+}
+
+/* Converts pixel i0 to i1-1, out points to the whole frame */
+static void cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int i0, int i1)
+{
+	double const *d = lut->direction + i0 * 3;
+	double const *o = lut->offset + i0 * 3;
+	char *out8 = (char *)out + i0 * out_stride;
+
+	for (int i = i0; i < i1; ++i, out8 += out_stride, d += 3, o += 3) {
+		double mag = range[i];
+		float *outf = (float *)out8;
+		outf[0] = (float)(mag * d[0] + o[0]);
+		outf[1] = (float)(mag * d[1] + o[1]);
+		outf[2] = (float)(mag * d[2] + o[2]);
+	}
+}
+
+void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_profile_begin(t);
+	cartesian_f64(lut, range, out, out_stride, 0, lut->w * lut->h);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+typedef struct
+{
+	ouster_lut_t const *lut;
+	uint32_t const *range;
+	void *out;
+	int out_stride;
+	int jobs;
+} lut_parallel_t;
+
+static void job_f64(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	lut_parallel_t const *p = arg;
+	int i0, i1;
+	lut_job_range(p->lut->w, p->lut->h, p->jobs, index, &i0, &i1);
+	cartesian_f64(p->lut, p->range, p->out, p->out_stride, i0, i1);
+}
+
+static void job_f32(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	lut_parallel_t const *p = arg;
+	int i0, i1;
+	lut_job_range(p->lut->w, p->lut->h, p->jobs, index, &i0, &i1);
+	cartesian_f32(p->lut, p->range, p->out, p->out_stride, i0, i1);
+}
+
+void ouster_lut_cartesian_f64_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	lut_parallel_t p = {lut, range, out, out_stride, lut_job_count(pool, lut->h)};
+	ouster_profile_begin(t);
+	ouster_pool_run(pool, job_f64, &p, p.jobs);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_f32_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	lut_parallel_t p = {lut, range, out, out_stride, lut_job_count(pool, lut->h)};
+	ouster_profile_begin(t);
+	ouster_pool_run(pool, job_f32, &p, p.jobs);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+/* Converts staggered pixel i0 to i1-1 and writes them starting at destaggered pixel j0 */
+static void cartesian_f32_destagger(ouster_lut_t const *lut, uint32_t const *range, uint32_t *range_out, char *out, int out_stride, int i0, int i1, int j0)
+{
+	double const *d = lut->direction + i0 * 3;
+	double const *o = lut->offset + i0 * 3;
+	char *out8 = out + j0 * out_stride;
+	for (int i = i0, j = j0; i < i1; ++i, ++j, out8 += out_stride, d += 3, o += 3) {
+		double mag = range[i];
+		float *outf = (float *)out8;
+		outf[0] = (float)(mag * d[0] + o[0]);
+		outf[1] = (float)(mag * d[1] + o[1]);
+		outf[2] = (float)(mag * d[2] + o[2]);
+		if (range_out) {
+			range_out[j] = range[i];
+		}
+	}
+}
+
+void ouster_lut_cartesian_f32_destagger(ouster_lut_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(range != range_out, "Destagger in place is not supported");
+	ouster_profile_begin(t);
+	int w = lut->w;
+	for (int row = 0; row < lut->h; ++row) {
+		// Same shift as ouster_destagger(), staggered column c goes to (c + shift) % w
+		int shift = ((meta->pixel_shift_by_row[row] % w) + w) % w;
+		int i = row * w;
+		cartesian_f32_destagger(lut, range, range_out, out, out_stride, i, i + w - shift, i + shift);
+		cartesian_f32_destagger(lut, range, range_out, out, out_stride, i + w - shift, i + w, i);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_f64_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	for (int row = 0; row < lut->h; ++row) {
+		int i = row * lut->w;
+		cartesian_f64(lut, range, out, out_stride, i + col0, i + col1 + 1);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_f32_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	for (int row = 0; row < lut->h; ++row) {
+		int i = row * lut->w;
+		cartesian_f32(lut, range, out, out_stride, i + col0, i + col1 + 1);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_set_transform(ouster_lut_t *lut, double const transform[16])
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(transform);
+	int n = lut->w * lut->h;
+
+	// Keep the untransformed tables so every update starts from them and no error accumulates
+	if (lut->direction_base == NULL) {
+		int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+		lut->direction_base = ouster_os_malloc(n * 3 * sizeof(double));
+		lut->offset_base = ouster_os_malloc(n * 3 * sizeof(double));
+		ouster_os_mem_tag_set(tag);
+		ouster_assert_notnull(lut->direction_base);
+		ouster_assert_notnull(lut->offset_base);
+		memcpy(lut->direction_base, lut->direction, n * 3 * sizeof(double));
+		memcpy(lut->offset_base, lut->offset, n * 3 * sizeof(double));
+	}
+
+	double const *t = transform;
+	for (int i = 0; i < n; ++i) {
+		double const *d = lut->direction_base + i * 3;
+		double const *o = lut->offset_base + i * 3;
+		double *dd = lut->direction + i * 3;
+		double *oo = lut->offset + i * 3;
+		for (int j = 0; j < 3; ++j) {
+			dd[j] = t[OUSTER_M4(j, 0)] * d[0] + t[OUSTER_M4(j, 1)] * d[1] + t[OUSTER_M4(j, 2)] * d[2];
+			oo[j] = t[OUSTER_M4(j, 0)] * o[0] + t[OUSTER_M4(j, 1)] * o[1] + t[OUSTER_M4(j, 2)] * o[2] + t[OUSTER_M4(j, 3)];
+		}
+	}
+	memcpy(lut->transform, transform, sizeof(lut->transform));
+}
+
+void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y, float mag, float *out)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(out);
+	int i = round(y) * lut->w + round(x);
+	ouster_assert(i >= 0, "");
+	ouster_assert(i < lut->w * lut->h, "");
+	double const *d = lut->direction + i * 3;
+	double const *o = lut->offset + i * 3;
+	out[0] = (float)(mag * d[0] + o[0]);
+	out[1] = (float)(mag * d[1] + o[1]);
+	out[2] = (float)(mag * d[2] + o[2]);
+}
+
+void ouster_lut_cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_profile_begin(t);
+	cartesian_f32(lut, range, out, out_stride, 0, lut->w * lut->h);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+double *ouster_lut_alloc(ouster_lut_t const *lut)
+{
+	ouster_assert_notnull(lut);
+
+	int n = lut->w * lut->h;
+	int size = n * sizeof(double) * 3;
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+	void *memory = ouster_os_calloc(size);
+	ouster_os_mem_tag_set(tag);
+	return memory;
+}
+
+/* Synthetic meta of a full width lidar mode, angles roughly like an OS1 */
+static void test_meta(ouster_meta_t *meta, int w, int h)
+{
+	memset(meta, 0, sizeof(ouster_meta_t));
+	meta->columns_per_frame = w;
+	meta->pixels_per_column = h;
+	meta->mid0 = 0;
+	meta->mid1 = w - 1;
+	meta->midw = w;
+	meta->lidar_origin_to_beam_origin_mm = 15.806;
+	for (int r = 0; r < h; ++r) {
+		meta->beam_altitude_angles[r] = 22.5 - (45.0 * r) / h;
+		meta->beam_azimuth_angles[r] = ((r % 4) - 1.5) * 2.8;
+	}
+	meta->beam_to_lidar_transform[OUSTER_M4(0, 0)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(1, 1)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(2, 2)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(3, 3)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(0, 3)] = 15.806;
+	meta->beam_to_lidar_transform[OUSTER_M4(2, 3)] = 1.5;
+	// Rotation of 30 degrees around z, not symmetric so a transposed rotation is caught
+	double c = cos(OUSTER_M_PI / 6.0);
+	double s = sin(OUSTER_M_PI / 6.0);
+	meta->lidar_to_sensor_transform[OUSTER_M4(0, 0)] = c;
+	meta->lidar_to_sensor_transform[OUSTER_M4(0, 1)] = -s;
+	meta->lidar_to_sensor_transform[OUSTER_M4(1, 0)] = s;
+	meta->lidar_to_sensor_transform[OUSTER_M4(1, 1)] = c;
+	meta->lidar_to_sensor_transform[OUSTER_M4(2, 2)] = 1.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(3, 3)] = 1.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(0, 3)] = 3.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(1, 3)] = -2.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(2, 3)] = 36.18;
+}
+
+/* Reference point of pixel (r, c) in meters, straight from the sensor documentation */
+static void test_reference(ouster_meta_t const *meta, int r, int c, double range, double out[3])
+{
+	double n = meta->lidar_origin_to_beam_origin_mm;
+	double encoder = 2.0 * OUSTER_M_PI * (1.0 - (double)(meta->mid0 + c) / meta->columns_per_frame);
+	double azimuth = -2.0 * OUSTER_M_PI * meta->beam_azimuth_angles[r] / 360.0;
+	double altitude = 2.0 * OUSTER_M_PI * meta->beam_altitude_angles[r] / 360.0;
+	double p[3] = {
+	    (range - n) * cos(encoder + azimuth) * cos(altitude) + meta->beam_to_lidar_transform[OUSTER_M4(0, 3)] * cos(encoder),
+	    (range - n) * sin(encoder + azimuth) * cos(altitude) + meta->beam_to_lidar_transform[OUSTER_M4(0, 3)] * sin(encoder),
+	    (range - n) * sin(altitude) + meta->beam_to_lidar_transform[OUSTER_M4(2, 3)],
+	};
+	double const *t = meta->lidar_to_sensor_transform;
+	for (int j = 0; j < 3; ++j) {
+		out[j] = (t[OUSTER_M4(j, 0)] * p[0] + t[OUSTER_M4(j, 1)] * p[1] + t[OUSTER_M4(j, 2)] * p[2] + t[OUSTER_M4(j, 3)]) * 0.001;
+	}
+}
+
+/* Largest distance in meters between the reference and xyz of all pixels */
+static double test_error(ouster_meta_t const *meta, double const *ref, float const *xyz)
+{
+	double e = 0;
+	for (int i = 0; i < meta->midw * meta->pixels_per_column; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			double d = fabs(ref[i * 3 + j] - xyz[i * 3 + j]);
+			e = d > e ? d : e;
+		}
+	}
+	return e;
+}
+
+int test_ouster_lut()
+{
+	int const widths[] = {512, 1024, 2048};
+	int const heights[] = {16, 32, 64, 128};
+	// Float keeps 24 bits, that is 8 um at 100 m. Fixed-point is within 1 mm.
+	double const tolerance_float = 0.0001;
+	double const tolerance_fixed = 0.0015;
+	int ok = 1;
+
+	for (int wi = 0; wi < 3; ++wi) {
+		for (int hi = 0; hi < 4; ++hi) {
+			int w = widths[wi];
+			int h = heights[hi];
+			int n = w * h;
+			ouster_meta_t meta;
+			test_meta(&meta, w, h);
+
+			uint32_t *range = ouster_os_malloc(n * sizeof(uint32_t));
+			double *ref = ouster_os_malloc(n * 3 * sizeof(double));
+			double *out64 = ouster_os_malloc(n * 3 * sizeof(double));
+			float *out32 = ouster_os_malloc(n * 3 * sizeof(float));
+			int32_t *outi = ouster_os_malloc(n * 3 * sizeof(int32_t));
+			ouster_assert_notnull(range);
+			ouster_assert_notnull(ref);
+			ouster_assert_notnull(out64);
+			ouster_assert_notnull(out32);
+			ouster_assert_notnull(outi);
+
+			for (int r = 0; r < h; ++r) {
+				for (int c = 0; c < w; ++c) {
+					int i = r * w + c;
+					// Deterministic ranges up to 200 m, every 97th pixel has no return
+					range[i] = (i % 97) ? (uint32_t)((i * 7919u) % 200000u) : 0;
+					test_reference(&meta, r, c, range[i], ref + i * 3);
+				}
+			}
+
+			ouster_lut_t lut;
+			ouster_lut_f32_t lut32;
+			ouster_lut_fixed_t lutfixed;
+			ouster_lut_init(&lut, &meta);
+			ouster_lut_f32_init(&lut32, &lut);
+			ouster_lut_fixed_init(&lutfixed, &lut, 1);
+
+			double e[5];
+			ouster_lut_cartesian_f64(&lut, range, out64, sizeof(double) * 3);
+			for (int i = 0; i < n * 3; ++i) {
+				out32[i] = (float)out64[i];
+			}
+			e[0] = test_error(&meta, ref, out32);
+
+			ouster_lut_cartesian_f32(&lut, range, out32, sizeof(float) * 3);
+			e[1] = test_error(&meta, ref, out32);
+
+			ouster_lut_f32_cartesian_aos(&lut32, range, out32, sizeof(float) * 3);
+			e[2] = test_error(&meta, ref, out32);
+
+			for (int i = 0; i < n; ++i) {
+				ouster_lut_cartesian_f32_single(&lut, i % w, i / w, range[i], out32 + i * 3);
+			}
+			e[3] = test_error(&meta, ref, out32);
+
+			ouster_lut_cartesian_i32(&lutfixed, range, outi, sizeof(int32_t) * 3);
+			for (int i = 0; i < n * 3; ++i) {
+				out32[i] = (float)(outi[i] * 0.001);
+			}
+			e[4] = test_error(&meta, ref, out32);
+
+			int pass = (e[0] < tolerance_float) && (e[1] < tolerance_float) && (e[2] < tolerance_float) && (e[3] < tolerance_float) && (e[4] < tolerance_fixed);
+			if (!pass) {
+				ouster_log("LUT %ix%i error f64=%g f32=%g f32_lut=%g single=%g i32=%g\n", w, h, e[0], e[1], e[2], e[3], e[4]);
+				ok = 0;
+			}
+
+			ouster_lut_fixed_fini(&lutfixed);
+			ouster_lut_f32_fini(&lut32);
+			ouster_lut_fini(&lut);
+			ouster_os_free(range);
+			ouster_os_free(ref);
+			ouster_os_free(out64);
+			ouster_os_free(out32);
+			ouster_os_free(outi);
+		}
+	}
+	return ok;
+}
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LUT_CACHE_MAGIC 0x54554C4F
+#define LUT_CACHE_VERSION 1
+
+#define FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+/* 64 bytes so the tables that follow are cache line aligned in the mapping */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t hash;
+	int32_t w;
+	int32_t h;
+	uint8_t reserved[40];
+} lut_cache_header_t;
+
+static uint64_t fnv1a(uint64_t h, void const *data, int size)
+{
+	uint8_t const *p = data;
+	for (int i = 0; i < size; ++i) {
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+uint64_t ouster_lut_meta_hash(ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(meta);
+	int h = meta->pixels_per_column;
+	ouster_assert(h >= 0, "");
+	ouster_assert(h <= OUSTER_MAX_ROWS, "");
+	uint32_t version = LUT_CACHE_VERSION;
+	uint64_t hash = FNV_OFFSET;
+	hash = fnv1a(hash, &version, sizeof(version));
+	hash = fnv1a(hash, &meta->columns_per_frame, sizeof(meta->columns_per_frame));
+	hash = fnv1a(hash, &meta->pixels_per_column, sizeof(meta->pixels_per_column));
+	hash = fnv1a(hash, &meta->mid0, sizeof(meta->mid0));
+	hash = fnv1a(hash, &meta->mid1, sizeof(meta->mid1));
+	hash = fnv1a(hash, &meta->midw, sizeof(meta->midw));
+	hash = fnv1a(hash, meta->beam_altitude_angles, h * sizeof(double));
+	hash = fnv1a(hash, meta->beam_azimuth_angles, h * sizeof(double));
+	hash = fnv1a(hash, meta->beam_to_lidar_transform, sizeof(meta->beam_to_lidar_transform));
+	hash = fnv1a(hash, &meta->lidar_origin_to_beam_origin_mm, sizeof(meta->lidar_origin_to_beam_origin_mm));
+	hash = fnv1a(hash, meta->lidar_to_sensor_transform, sizeof(meta->lidar_to_sensor_transform));
+	return hash;
+}
+
+static int write_all(int fd, void const *data, size_t size)
+{
+	char const *p = data;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+int ouster_lut_save(ouster_lut_t const *lut, ouster_meta_t const *meta, char const *path)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(path);
+
+	lut_cache_header_t header = {0};
+	header.magic = LUT_CACHE_MAGIC;
+	header.version = LUT_CACHE_VERSION;
+	header.hash = ouster_lut_meta_hash(meta);
+	header.w = lut->w;
+	header.h = lut->h;
+	size_t table_size = (size_t)lut->w * lut->h * 3 * sizeof(double);
+
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.%i.tmp", path, (int)getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	// The cache is keyed by meta only, store the tables from before ouster_lut_set_transform()
+	double const *direction = lut->direction_base ? lut->direction_base : lut->direction;
+	double const *offset = lut->offset_base ? lut->offset_base : lut->offset;
+	int rc = write_all(fd, &header, sizeof(header));
+	rc = rc ? rc : write_all(fd, direction, table_size);
+	rc = rc ? rc : write_all(fd, offset, table_size);
+	rc = rc ? rc : fsync(fd);
+	int e = errno;
+	close(fd);
+	if ((rc == 0) && (rename(tmp, path) == 0)) {
+		return 0;
+	}
+	e = rc ? e : errno;
+	unlink(tmp);
+	errno = e;
+	return -1;
+}
+
+int ouster_lut_load(ouster_lut_t *lut, ouster_meta_t const *meta, char const *path)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(path);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	int w = meta->midw;
+	int h = meta->pixels_per_column;
+	size_t table_size = (size_t)w * h * 3 * sizeof(double);
+	size_t size = sizeof(lut_cache_header_t) + 2 * table_size;
+	if ((size_t)st.st_size != size) {
+		close(fd);
+		return -1;
+	}
+
+	// Private so the tables can be modified in memory, e.g. by ouster_lut_set_transform()
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	lut_cache_header_t const *header = map;
+	if ((header->magic != LUT_CACHE_MAGIC) || (header->version != LUT_CACHE_VERSION) || (header->hash != ouster_lut_meta_hash(meta)) || (header->w != w) || (header->h != h)) {
+		munmap(map, size);
+		return -1;
+	}
+
+	char *tables = (char *)map + sizeof(lut_cache_header_t);
+	memset(lut, 0, sizeof(ouster_lut_t));
+	lut->w = w;
+	lut->h = h;
+	lut->direction = (double *)tables;
+	lut->offset = (double *)(tables + table_size);
+	lut->transform[OUSTER_M4(0, 0)] = 1.0;
+	lut->transform[OUSTER_M4(1, 1)] = 1.0;
+	lut->transform[OUSTER_M4(2, 2)] = 1.0;
+	lut->transform[OUSTER_M4(3, 3)] = 1.0;
+	lut->map = map;
+	lut->map_size = (int64_t)size;
+	return 0;
+}
+
+void ouster_lut_unmap(ouster_lut_t *lut)
+{
+	ouster_assert_notnull(lut);
+	if (lut->map) {
+		munmap(lut->map, (size_t)lut->map_size);
+	}
+	lut->map = NULL;
+	lut->map_size = 0;
+	lut->direction = NULL;
+	lut->offset = NULL;
+}
+
+int ouster_lut_init_cached(ouster_lut_t *lut, ouster_meta_t const *meta, char const *dir)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(dir);
+
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/ouster_lut_%016jx.bin", dir, (uintmax_t)ouster_lut_meta_hash(meta));
+	if (ouster_lut_load(lut, meta, path) == 0) {
+		return 1;
+	}
+	ouster_lut_init(lut, meta);
+	if (ouster_lut_save(lut, meta, path) != 0) {
+		ouster_log("Could not write LUT cache '%s': %s\n", path, strerror(errno));
+	}
+	return 0;
+}
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OUSTER_LUT_X86
+#include <immintrin.h>
+#endif
+
+#define LUT_ALIGN 64
+
+/* Number of pixels converted per block in the interleaved kernels */
+#define LUT_BLOCK 256
+
+typedef void (*lut_kernel_t)(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z);
+
+typedef void (*lut_block_t)(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride);
+
+typedef int (*lut_compact_t)(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, uint32_t min_range, uint32_t max_range, char *out, int out_stride, int32_t *indices);
+
+static inline void interleave(float const *x, float const *y, float const *z, int n, float *out)
+{
+	int i = 0;
+#if defined(OUSTER_LUT_X86) && defined(__SSE2__)
+	for (; (i + 4) <= n; i += 4) {
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vy = _mm_loadu_ps(y + i);
+		__m128 vz = _mm_loadu_ps(z + i);
+		__m128 xy_lo = _mm_unpacklo_ps(vx, vy);
+		__m128 xy_hi = _mm_unpackhi_ps(vx, vy);
+		__m128 zx = _mm_shuffle_ps(vz, vx, _MM_SHUFFLE(1, 1, 0, 0));
+		__m128 yz1 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 zx3 = _mm_shuffle_ps(vz, xy_hi, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 yz3 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(3, 3, 3, 3));
+		// x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+		_mm_storeu_ps(out + i * 3 + 0, _mm_shuffle_ps(xy_lo, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out + i * 3 + 4, _mm_shuffle_ps(yz1, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+		_mm_storeu_ps(out + i * 3 + 8, _mm_shuffle_ps(zx3, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+#endif
+	for (; i < n; ++i) {
+		out[i * 3 + 0] = x[i];
+		out[i * 3 + 1] = y[i];
+		out[i * 3 + 2] = z[i];
+	}
+}
+
+static inline void store_aos(float const *x, float const *y, float const *z, int n, char *out, int out_stride)
+{
+	if (out_stride == (3 * sizeof(float))) {
+		interleave(x, y, z, n, (float *)out);
+		return;
+	}
+	for (int i = 0; i < n; ++i, out += out_stride) {
+		float *outf = (float *)out;
+		outf[0] = x[i];
+		outf[1] = y[i];
+		outf[2] = z[i];
+	}
+}
+
+static inline void kernel_scalar(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z)
+{
+	for (int i = i0; i < i1; ++i) {
+		float r = (float)range[i];
+		x[i - i0] = r * lut->dx[i] + lut->ox[i];
+		y[i - i0] = r * lut->dy[i] + lut->oy[i];
+		z[i - i0] = r * lut->dz[i] + lut->oz[i];
+	}
+}
+
+#ifdef OUSTER_LUT_X86
+
+#ifdef __SSE2__
+static inline void kernel_sse2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z)
+{
+	int i = i0;
+	for (; (i + 4) <= i1; i += 4) {
+		__m128 r = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i const *)(range + i)));
+		_mm_storeu_ps(x + i - i0, _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(lut->dx + i)), _mm_loadu_ps(lut->ox + i)));
+		_mm_storeu_ps(y + i - i0, _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(lut->dy + i)), _mm_loadu_ps(lut->oy + i)));
+		_mm_storeu_ps(z + i - i0, _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(lut->dz + i)), _mm_loadu_ps(lut->oz + i)));
+	}
+	kernel_scalar(lut, range, i, i1, x + i - i0, y + i - i0, z + i - i0);
+}
+#endif
+
+__attribute__((target("avx2"))) static inline void kernel_avx2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z)
+{
+	int i = i0;
+	for (; (i + 8) <= i1; i += 8) {
+		__m256 r = _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i const *)(range + i)));
+		_mm256_storeu_ps(x + i - i0, _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dx + i)), _mm256_loadu_ps(lut->ox + i)));
+		_mm256_storeu_ps(y + i - i0, _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dy + i)), _mm256_loadu_ps(lut->oy + i)));
+		_mm256_storeu_ps(z + i - i0, _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dz + i)), _mm256_loadu_ps(lut->oz + i)));
+	}
+	kernel_scalar(lut, range, i, i1, x + i - i0, y + i - i0, z + i - i0);
+}
+
+#endif
+
+/* Converts a block to planes on the stack then interleaves. Each ISA gets its own
+ * block function so the kernel and interleave are inlined with the same encoding,
+ * mixing VEX and legacy SSE code is slow on some CPUs. */
+static void block_scalar(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	kernel_scalar(lut, range, i0, i1, x, y, z);
+	store_aos(x, y, z, i1 - i0, out, out_stride);
+}
+
+#ifdef OUSTER_LUT_X86
+#ifdef __SSE2__
+static void block_sse2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	kernel_sse2(lut, range, i0, i1, x, y, z);
+	store_aos(x, y, z, i1 - i0, out, out_stride);
+}
+#endif
+
+__attribute__((target("avx2"))) static void block_avx2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	kernel_avx2(lut, range, i0, i1, x, y, z);
+	store_aos(x, y, z, i1 - i0, out, out_stride);
+}
+#endif
+
+static lut_block_t block_select(void)
+{
+#ifdef OUSTER_LUT_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return block_avx2;
+	}
+#ifdef __SSE2__
+	return block_sse2;
+#endif
+#endif
+	return block_scalar;
+}
+
+/* Writes the pixels with range in [min_range, max_range] densely, returns number of points written */
+static int compact_scalar(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, uint32_t min_range, uint32_t max_range, char *out, int out_stride, int32_t *indices)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	int32_t index[LUT_BLOCK];
+	int n = 0;
+	for (int i = i0; i < i1; ++i) {
+		// Branchless, always write and only advance on valid pixels
+		float r = (float)range[i];
+		x[n] = r * lut->dx[i] + lut->ox[i];
+		y[n] = r * lut->dy[i] + lut->oy[i];
+		z[n] = r * lut->dz[i] + lut->oz[i];
+		index[n] = i;
+		n += (range[i] >= min_range) & (range[i] <= max_range);
+	}
+	store_aos(x, y, z, n, out, out_stride);
+	if (indices) {
+		memcpy(indices, index, n * sizeof(int32_t));
+	}
+	return n;
+}
+
+#ifdef OUSTER_LUT_X86
+
+/* Left-pack permutations for every 8 bit lane mask, 3 bit lane index per destination lane */
+static const uint32_t compact_perm[256] = {
+	0x000000, 0x000000, 0x000001, 0x000008, 0x000002, 0x000010, 0x000011, 0x000088,
+	0x000003, 0x000018, 0x000019, 0x0000C8, 0x00001A, 0x0000D0, 0x0000D1, 0x000688,
+	0x000004, 0x000020, 0x000021, 0x000108, 0x000022, 0x000110, 0x000111, 0x000888,
+	0x000023, 0x000118, 0x000119, 0x0008C8, 0x00011A, 0x0008D0, 0x0008D1, 0x004688,
+	0x000005, 0x000028, 0x000029, 0x000148, 0x00002A, 0x000150, 0x000151, 0x000A88,
+	0x00002B, 0x000158, 0x000159, 0x000AC8, 0x00015A, 0x000AD0, 0x000AD1, 0x005688,
+	0x00002C, 0x000160, 0x000161, 0x000B08, 0x000162, 0x000B10, 0x000B11, 0x005888,
+	0x000163, 0x000B18, 0x000B19, 0x0058C8, 0x000B1A, 0x0058D0, 0x0058D1, 0x02C688,
+	0x000006, 0x000030, 0x000031, 0x000188, 0x000032, 0x000190, 0x000191, 0x000C88,
+	0x000033, 0x000198, 0x000199, 0x000CC8, 0x00019A, 0x000CD0, 0x000CD1, 0x006688,
+	0x000034, 0x0001A0, 0x0001A1, 0x000D08, 0x0001A2, 0x000D10, 0x000D11, 0x006888,
+	0x0001A3, 0x000D18, 0x000D19, 0x0068C8, 0x000D1A, 0x0068D0, 0x0068D1, 0x034688,
+	0x000035, 0x0001A8, 0x0001A9, 0x000D48, 0x0001AA, 0x000D50, 0x000D51, 0x006A88,
+	0x0001AB, 0x000D58, 0x000D59, 0x006AC8, 0x000D5A, 0x006AD0, 0x006AD1, 0x035688,
+	0x0001AC, 0x000D60, 0x000D61, 0x006B08, 0x000D62, 0x006B10, 0x006B11, 0x035888,
+	0x000D63, 0x006B18, 0x006B19, 0x0358C8, 0x006B1A, 0x0358D0, 0x0358D1, 0x1AC688,
+	0x000007, 0x000038, 0x000039, 0x0001C8, 0x00003A, 0x0001D0, 0x0001D1, 0x000E88,
+	0x00003B, 0x0001D8, 0x0001D9, 0x000EC8, 0x0001DA, 0x000ED0, 0x000ED1, 0x007688,
+	0x00003C, 0x0001E0, 0x0001E1, 0x000F08, 0x0001E2, 0x000F10, 0x000F11, 0x007888,
+	0x0001E3, 0x000F18, 0x000F19, 0x0078C8, 0x000F1A, 0x0078D0, 0x0078D1, 0x03C688,
+	0x00003D, 0x0001E8, 0x0001E9, 0x000F48, 0x0001EA, 0x000F50, 0x000F51, 0x007A88,
+	0x0001EB, 0x000F58, 0x000F59, 0x007AC8, 0x000F5A, 0x007AD0, 0x007AD1, 0x03D688,
+	0x0001EC, 0x000F60, 0x000F61, 0x007B08, 0x000F62, 0x007B10, 0x007B11, 0x03D888,
+	0x000F63, 0x007B18, 0x007B19, 0x03D8C8, 0x007B1A, 0x03D8D0, 0x03D8D1, 0x1EC688,
+	0x00003E, 0x0001F0, 0x0001F1, 0x000F88, 0x0001F2, 0x000F90, 0x000F91, 0x007C88,
+	0x0001F3, 0x000F98, 0x000F99, 0x007CC8, 0x000F9A, 0x007CD0, 0x007CD1, 0x03E688,
+	0x0001F4, 0x000FA0, 0x000FA1, 0x007D08, 0x000FA2, 0x007D10, 0x007D11, 0x03E888,
+	0x000FA3, 0x007D18, 0x007D19, 0x03E8C8, 0x007D1A, 0x03E8D0, 0x03E8D1, 0x1F4688,
+	0x0001F5, 0x000FA8, 0x000FA9, 0x007D48, 0x000FAA, 0x007D50, 0x007D51, 0x03EA88,
+	0x000FAB, 0x007D58, 0x007D59, 0x03EAC8, 0x007D5A, 0x03EAD0, 0x03EAD1, 0x1F5688,
+	0x000FAC, 0x007D60, 0x007D61, 0x03EB08, 0x007D62, 0x03EB10, 0x03EB11, 0x1F5888,
+	0x007D63, 0x03EB18, 0x03EB19, 0x1F58C8, 0x03EB1A, 0x1F58D0, 0x1F58D1, 0xFAC688,
+};
+
+__attribute__((target("avx2"))) static int compact_avx2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, uint32_t min_range, uint32_t max_range, char *out, int out_stride, int32_t *indices)
+{
+	// One vector of slack for the full width stores at the end of the packed data
+	float x[LUT_BLOCK + 8];
+	float y[LUT_BLOCK + 8];
+	float z[LUT_BLOCK + 8];
+	int32_t index[LUT_BLOCK + 8];
+	// Ranges are at most 20 bits so signed compares work after clamping the band
+	__m256i vmin = _mm256_set1_epi32((int32_t)(min_range < INT32_MAX ? min_range : INT32_MAX));
+	__m256i vmax = _mm256_set1_epi32((int32_t)(max_range < INT32_MAX ? max_range : INT32_MAX));
+	__m256i shift = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	__m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	int n = 0;
+	int i = i0;
+	for (; (i + 8) <= i1; i += 8) {
+		__m256i ri = _mm256_loadu_si256((__m256i const *)(range + i));
+		__m256i invalid = _mm256_or_si256(_mm256_cmpgt_epi32(vmin, ri), _mm256_cmpgt_epi32(ri, vmax));
+		int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(invalid)) & 0xFF;
+		__m256i perm = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int32_t)compact_perm[mask]), shift), _mm256_set1_epi32(7));
+		__m256 r = _mm256_cvtepi32_ps(ri);
+		__m256 vx = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dx + i)), _mm256_loadu_ps(lut->ox + i));
+		__m256 vy = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dy + i)), _mm256_loadu_ps(lut->oy + i));
+		__m256 vz = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dz + i)), _mm256_loadu_ps(lut->oz + i));
+		__m256i vi = _mm256_add_epi32(_mm256_set1_epi32(i), iota);
+		_mm256_storeu_ps(x + n, _mm256_permutevar8x32_ps(vx, perm));
+		_mm256_storeu_ps(y + n, _mm256_permutevar8x32_ps(vy, perm));
+		_mm256_storeu_ps(z + n, _mm256_permutevar8x32_ps(vz, perm));
+		_mm256_storeu_si256((__m256i *)(index + n), _mm256_permutevar8x32_epi32(vi, perm));
+		n += __builtin_popcount(mask);
+	}
+	for (; i < i1; ++i) {
+		float r = (float)range[i];
+		x[n] = r * lut->dx[i] + lut->ox[i];
+		y[n] = r * lut->dy[i] + lut->oy[i];
+		z[n] = r * lut->dz[i] + lut->oz[i];
+		index[n] = i;
+		n += (range[i] >= min_range) & (range[i] <= max_range);
+	}
+	store_aos(x, y, z, n, out, out_stride);
+	if (indices) {
+		memcpy(indices, index, n * sizeof(int32_t));
+	}
+	return n;
+}
+
+#endif
+
+static lut_compact_t compact_select(void)
+{
+#ifdef OUSTER_LUT_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return compact_avx2;
+	}
+#endif
+	return compact_scalar;
+}
+
+/* Picks the widest kernel the CPU supports */
+static lut_kernel_t kernel_select(void)
+{
+#ifdef OUSTER_LUT_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return kernel_avx2;
+	}
+#ifdef __SSE2__
+	return kernel_sse2;
+#endif
+#endif
+	return kernel_scalar;
+}
+
+void ouster_lut_f32_init(ouster_lut_f32_t *dst, ouster_lut_t const *src)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	int n = src->w * src->h;
+	// Round each plane up to a multiple of 64 bytes so every plane stays aligned
+	int plane = (n + (LUT_ALIGN / sizeof(float)) - 1) & ~(int)((LUT_ALIGN / sizeof(float)) - 1);
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+	dst->memory = ouster_os_calloc(plane * 6 * sizeof(float) + LUT_ALIGN);
+	ouster_os_mem_tag_set(tag);
+	ouster_assert_notnull(dst->memory);
+	float *base = (float *)(((uintptr_t)dst->memory + LUT_ALIGN - 1) & ~(uintptr_t)(LUT_ALIGN - 1));
+	dst->w = src->w;
+	dst->h = src->h;
+	dst->dx = base + plane * 0;
+	dst->dy = base + plane * 1;
+	dst->dz = base + plane * 2;
+	dst->ox = base + plane * 3;
+	dst->oy = base + plane * 4;
+	dst->oz = base + plane * 5;
+	for (int i = 0; i < n; ++i) {
+		dst->dx[i] = (float)src->direction[i * 3 + 0];
+		dst->dy[i] = (float)src->direction[i * 3 + 1];
+		dst->dz[i] = (float)src->direction[i * 3 + 2];
+		dst->ox[i] = (float)src->offset[i * 3 + 0];
+		dst->oy[i] = (float)src->offset[i * 3 + 1];
+		dst->oz[i] = (float)src->offset[i * 3 + 2];
+	}
+}
+
+void ouster_lut_f32_fini(ouster_lut_f32_t *lut)
+{
+	ouster_assert_notnull(lut);
+	ouster_os_free(lut->memory);
+	memset(lut, 0, sizeof(ouster_lut_f32_t));
+}
+
+void ouster_lut_f32_cartesian_soa(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(x);
+	ouster_assert_notnull(y);
+	ouster_assert_notnull(z);
+	ouster_profile_begin(t);
+	kernel_select()(lut, range, 0, lut->w * lut->h, x, y, z);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_soa_columns(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(x);
+	ouster_assert_notnull(y);
+	ouster_assert_notnull(z);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	lut_kernel_t kernel = kernel_select();
+	for (int row = 0; row < lut->h; ++row) {
+		int i0 = row * lut->w + col0;
+		kernel(lut, range, i0, i0 + col1 - col0 + 1, x + i0, y + i0, z + i0);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_aos(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_profile_begin(t);
+	lut_block_t block = block_select();
+	int n = lut->w * lut->h;
+	char *out8 = out;
+	for (int i0 = 0; i0 < n; i0 += LUT_BLOCK, out8 += LUT_BLOCK * out_stride) {
+		int i1 = (i0 + LUT_BLOCK) < n ? (i0 + LUT_BLOCK) : n;
+		block(lut, range, i0, i1, out8, out_stride);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_aos_columns(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	lut_block_t block = block_select();
+	for (int row = 0; row < lut->h; ++row) {
+		int end = row * lut->w + col1 + 1;
+		for (int i0 = row * lut->w + col0; i0 < end; i0 += LUT_BLOCK) {
+			int i1 = (i0 + LUT_BLOCK) < end ? (i0 + LUT_BLOCK) : end;
+			block(lut, range, i0, i1, (char *)out + i0 * out_stride, out_stride);
+		}
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+int ouster_lut_f32_cartesian_compact_columns(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	lut_compact_t compact = compact_select();
+	char *out8 = out;
+	int count = 0;
+	for (int row = 0; row < lut->h; ++row) {
+		int end = row * lut->w + col1 + 1;
+		for (int i0 = row * lut->w + col0; i0 < end; i0 += LUT_BLOCK) {
+			int i1 = (i0 + LUT_BLOCK) < end ? (i0 + LUT_BLOCK) : end;
+			int n = compact(lut, range, i0, i1, min_range, max_range, out8 + count * out_stride, out_stride, indices ? indices + count : NULL);
+			count += n;
+		}
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+	return count;
+}
+
+int ouster_lut_f32_cartesian_compact(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices)
+{
+	ouster_assert_notnull(lut);
+	return ouster_lut_f32_cartesian_compact_columns(lut, range, min_range, max_range, out, out_stride, indices, 0, lut->w - 1);
+}
+
+typedef struct
+{
+	ouster_lut_f32_t const *lut;
+	uint32_t const *range;
+	char *out;
+	int out_stride;
+	int jobs;
+	lut_block_t block;
+} lut_f32_parallel_t;
+
+static void job_aos(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	lut_f32_parallel_t const *p = arg;
+	int begin, end;
+	lut_job_range(p->lut->w, p->lut->h, p->jobs, index, &begin, &end);
+	for (int i0 = begin; i0 < end; i0 += LUT_BLOCK) {
+		int i1 = (i0 + LUT_BLOCK) < end ? (i0 + LUT_BLOCK) : end;
+		p->block(p->lut, p->range, i0, i1, p->out + i0 * p->out_stride, p->out_stride);
+	}
+}
+
+void ouster_lut_f32_cartesian_aos_parallel(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	ouster_profile_begin(t);
+	lut_f32_parallel_t p = {lut, range, out, out_stride, lut_job_count(pool, lut->h), block_select()};
+	ouster_pool_run(pool, job_aos, &p, p.jobs);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_aos_destagger(ouster_lut_f32_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(range != range_out, "Destagger in place is not supported");
+	ouster_profile_begin(t);
+	lut_block_t block = block_select();
+	char *out8 = out;
+	int w = lut->w;
+	for (int row = 0; row < lut->h; ++row) {
+		int shift = ((meta->pixel_shift_by_row[row] % w) + w) % w;
+		int i = row * w;
+		// Two runs per row: [0, w - shift) moves right by shift, [w - shift, w) wraps to the start
+		int src[2] = {i, i + w - shift};
+		int end[2] = {i + w - shift, i + w};
+		int dst[2] = {i + shift, i};
+		for (int k = 0; k < 2; ++k) {
+			for (int i0 = src[k]; i0 < end[k]; i0 += LUT_BLOCK) {
+				int i1 = (i0 + LUT_BLOCK) < end[k] ? (i0 + LUT_BLOCK) : end[k];
+				int j0 = dst[k] + (i0 - src[k]);
+				block(lut, range, i0, i1, out8 + j0 * out_stride, out_stride);
+			}
+			if (range_out) {
+				memcpy(range_out + dst[k], range + src[k], (end[k] - src[k]) * sizeof(uint32_t));
+			}
+		}
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OUSTER_LUT_X86
+#include <immintrin.h>
+#endif
+
+#define FIXED_ALIGN 64
+
+/* Number of pixels converted per block */
+#define FIXED_BLOCK 256
+
+/* Ranges are split in high and low 10 bits so every product fits in int32 */
+#define FIXED_RANGE_SPLIT 10
+#define FIXED_RANGE_MAX ((1 << 20) - 1)
+#define FIXED_DIRECTION_Q 20
+#define FIXED_OFFSET_Q (FIXED_DIRECTION_Q - FIXED_RANGE_SPLIT)
+
+typedef void (*fixed_block_t)(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride);
+
+/*
+r * d / 2^20 = (rh * 2^10 * d + rl * d) / 2^20 = (rh * d + ((rl * d) >> 10)) / 2^10
+with |d| <= 2^20 and rh, rl < 2^10 every term stays below 2^31.
+*/
+static inline int32_t fixed_mul(int32_t rh, int32_t rl, int32_t d, int32_t o)
+{
+	return (rh * d + ((rl * d) >> FIXED_RANGE_SPLIT) + o + (1 << (FIXED_OFFSET_Q - 1))) >> FIXED_OFFSET_Q;
+}
+
+static inline void fixed_kernel_scalar(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, int32_t *x, int32_t *y, int32_t *z)
+{
+	for (int i = i0; i < i1; ++i) {
+		int32_t r = (int32_t)(range[i] < FIXED_RANGE_MAX ? range[i] : FIXED_RANGE_MAX);
+		int32_t rh = r >> FIXED_RANGE_SPLIT;
+		int32_t rl = r & ((1 << FIXED_RANGE_SPLIT) - 1);
+		x[i - i0] = fixed_mul(rh, rl, lut->dx[i], lut->ox[i]);
+		y[i - i0] = fixed_mul(rh, rl, lut->dy[i], lut->oy[i]);
+		z[i - i0] = fixed_mul(rh, rl, lut->dz[i], lut->oz[i]);
+	}
+}
+
+static inline int16_t saturate_i16(int32_t v)
+{
+	return (int16_t)(v < INT16_MIN ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v));
+}
+
+static inline void store_i32(int32_t const *x, int32_t const *y, int32_t const *z, int n, char *out, int out_stride)
+{
+	int i = 0;
+#if defined(OUSTER_LUT_X86) && defined(__SSE2__)
+	if (out_stride == (3 * sizeof(int32_t))) {
+		// x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+		for (; (i + 4) <= n; i += 4, out += 4 * out_stride) {
+			__m128 vx = _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(x + i)));
+			__m128 vy = _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(y + i)));
+			__m128 vz = _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(z + i)));
+			__m128 xy_lo = _mm_unpacklo_ps(vx, vy);
+			__m128 xy_hi = _mm_unpackhi_ps(vx, vy);
+			__m128 zx = _mm_shuffle_ps(vz, vx, _MM_SHUFFLE(1, 1, 0, 0));
+			__m128 yz1 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(1, 1, 1, 1));
+			__m128 zx3 = _mm_shuffle_ps(vz, xy_hi, _MM_SHUFFLE(2, 2, 2, 2));
+			__m128 yz3 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(3, 3, 3, 3));
+			_mm_storeu_ps((float *)out + 0, _mm_shuffle_ps(xy_lo, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+			_mm_storeu_ps((float *)out + 4, _mm_shuffle_ps(yz1, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+			_mm_storeu_ps((float *)out + 8, _mm_shuffle_ps(zx3, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+		}
+	}
+#endif
+	for (; i < n; ++i, out += out_stride) {
+		int32_t *o = (int32_t *)out;
+		o[0] = x[i];
+		o[1] = y[i];
+		o[2] = z[i];
+	}
+}
+
+static inline void store_i16(int32_t const *x, int32_t const *y, int32_t const *z, int n, char *out, int out_stride)
+{
+	int i = 0;
+#if defined(OUSTER_LUT_X86) && defined(__SSE2__)
+	// Saturate 8 pixels at a time, then interleave
+	for (; (i + 8) <= n; i += 8) {
+		int16_t sx[8];
+		int16_t sy[8];
+		int16_t sz[8];
+		_mm_storeu_si128((__m128i *)sx, _mm_packs_epi32(_mm_loadu_si128((__m128i const *)(x + i)), _mm_loadu_si128((__m128i const *)(x + i + 4))));
+		_mm_storeu_si128((__m128i *)sy, _mm_packs_epi32(_mm_loadu_si128((__m128i const *)(y + i)), _mm_loadu_si128((__m128i const *)(y + i + 4))));
+		_mm_storeu_si128((__m128i *)sz, _mm_packs_epi32(_mm_loadu_si128((__m128i const *)(z + i)), _mm_loadu_si128((__m128i const *)(z + i + 4))));
+		for (int k = 0; k < 8; ++k, out += out_stride) {
+			int16_t *o = (int16_t *)out;
+			o[0] = sx[k];
+			o[1] = sy[k];
+			o[2] = sz[k];
+		}
+	}
+#endif
+	for (; i < n; ++i, out += out_stride) {
+		int16_t *o = (int16_t *)out;
+		o[0] = saturate_i16(x[i]);
+		o[1] = saturate_i16(y[i]);
+		o[2] = saturate_i16(z[i]);
+	}
+}
+
+static void fixed_block_i32_scalar(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_scalar(lut, range, i0, i1, x, y, z);
+	store_i32(x, y, z, i1 - i0, out, out_stride);
+}
+
+static void fixed_block_i16_scalar(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_scalar(lut, range, i0, i1, x, y, z);
+	store_i16(x, y, z, i1 - i0, out, out_stride);
+}
+
+#ifdef OUSTER_LUT_X86
+
+__attribute__((target("avx2"))) static inline __m256i fixed_mul_avx2(__m256i rh, __m256i rl, int32_t const *d, int32_t const *o)
+{
+	__m256i vd = _mm256_loadu_si256((__m256i const *)d);
+	__m256i vo = _mm256_loadu_si256((__m256i const *)o);
+	__m256i t = _mm256_add_epi32(_mm256_mullo_epi32(rh, vd), _mm256_srai_epi32(_mm256_mullo_epi32(rl, vd), FIXED_RANGE_SPLIT));
+	t = _mm256_add_epi32(t, _mm256_add_epi32(vo, _mm256_set1_epi32(1 << (FIXED_OFFSET_Q - 1))));
+	return _mm256_srai_epi32(t, FIXED_OFFSET_Q);
+}
+
+__attribute__((target("avx2"))) static inline void fixed_kernel_avx2(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, int32_t *x, int32_t *y, int32_t *z)
+{
+	__m256i rmax = _mm256_set1_epi32(FIXED_RANGE_MAX);
+	__m256i lo = _mm256_set1_epi32((1 << FIXED_RANGE_SPLIT) - 1);
+	int i = i0;
+	for (; (i + 8) <= i1; i += 8) {
+		__m256i r = _mm256_min_epu32(_mm256_loadu_si256((__m256i const *)(range + i)), rmax);
+		__m256i rh = _mm256_srli_epi32(r, FIXED_RANGE_SPLIT);
+		__m256i rl = _mm256_and_si256(r, lo);
+		_mm256_storeu_si256((__m256i *)(x + i - i0), fixed_mul_avx2(rh, rl, lut->dx + i, lut->ox + i));
+		_mm256_storeu_si256((__m256i *)(y + i - i0), fixed_mul_avx2(rh, rl, lut->dy + i, lut->oy + i));
+		_mm256_storeu_si256((__m256i *)(z + i - i0), fixed_mul_avx2(rh, rl, lut->dz + i, lut->oz + i));
+	}
+	fixed_kernel_scalar(lut, range, i, i1, x + i - i0, y + i - i0, z + i - i0);
+}
+
+__attribute__((target("avx2"))) static void fixed_block_i32_avx2(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_avx2(lut, range, i0, i1, x, y, z);
+	store_i32(x, y, z, i1 - i0, out, out_stride);
+}
+
+__attribute__((target("avx2"))) static void fixed_block_i16_avx2(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_avx2(lut, range, i0, i1, x, y, z);
+	store_i16(x, y, z, i1 - i0, out, out_stride);
+}
+
+#endif
+
+static int fixed_has_avx2(void)
+{
+#ifdef OUSTER_LUT_X86
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+static void fixed_run_blocks(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride, fixed_block_t block)
+{
+	int n = lut->w * lut->h;
+	char *out8 = out;
+	for (int i0 = 0; i0 < n; i0 += FIXED_BLOCK, out8 += FIXED_BLOCK * out_stride) {
+		int i1 = (i0 + FIXED_BLOCK) < n ? (i0 + FIXED_BLOCK) : n;
+		block(lut, range, i0, i1, out8, out_stride);
+	}
+}
+
+void ouster_lut_fixed_init(ouster_lut_fixed_t *dst, ouster_lut_t const *src, int unit_mm)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert(unit_mm > 0, "");
+	int n = src->w * src->h;
+	// Round each plane up to a multiple of 64 bytes so every plane stays aligned
+	int plane = (n + (FIXED_ALIGN / sizeof(int32_t)) - 1) & ~(int)((FIXED_ALIGN / sizeof(int32_t)) - 1);
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+	dst->memory = ouster_os_calloc(plane * 6 * sizeof(int32_t) + FIXED_ALIGN);
+	ouster_os_mem_tag_set(tag);
+	ouster_assert_notnull(dst->memory);
+	int32_t *base = (int32_t *)(((uintptr_t)dst->memory + FIXED_ALIGN - 1) & ~(uintptr_t)(FIXED_ALIGN - 1));
+	dst->w = src->w;
+	dst->h = src->h;
+	dst->unit_mm = unit_mm;
+	dst->dx = base + plane * 0;
+	dst->dy = base + plane * 1;
+	dst->dz = base + plane * 2;
+	dst->ox = base + plane * 3;
+	dst->oy = base + plane * 4;
+	dst->oz = base + plane * 5;
+	// The LUT is in meters per mm, convert to output units per mm and output units
+	double d_scale = 1000.0 * (1 << FIXED_DIRECTION_Q) / unit_mm;
+	double o_scale = 1000.0 * (1 << FIXED_OFFSET_Q) / unit_mm;
+	for (int i = 0; i < n; ++i) {
+		dst->dx[i] = (int32_t)lround(src->direction[i * 3 + 0] * d_scale);
+		dst->dy[i] = (int32_t)lround(src->direction[i * 3 + 1] * d_scale);
+		dst->dz[i] = (int32_t)lround(src->direction[i * 3 + 2] * d_scale);
+		dst->ox[i] = (int32_t)lround(src->offset[i * 3 + 0] * o_scale);
+		dst->oy[i] = (int32_t)lround(src->offset[i * 3 + 1] * o_scale);
+		dst->oz[i] = (int32_t)lround(src->offset[i * 3 + 2] * o_scale);
+	}
+}
+
+void ouster_lut_fixed_fini(ouster_lut_fixed_t *lut)
+{
+	ouster_assert_notnull(lut);
+	ouster_os_free(lut->memory);
+	memset(lut, 0, sizeof(ouster_lut_fixed_t));
+}
+
+void ouster_lut_cartesian_i32(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	fixed_block_t block = fixed_block_i32_scalar;
+#ifdef OUSTER_LUT_X86
+	if (fixed_has_avx2()) {
+		block = fixed_block_i32_avx2;
+	}
+#endif
+	ouster_profile_begin(t);
+	fixed_run_blocks(lut, range, out, out_stride, block);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_i16(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	fixed_block_t block = fixed_block_i16_scalar;
+#ifdef OUSTER_LUT_X86
+	if (fixed_has_avx2()) {
+		block = fixed_block_i16_avx2;
+	}
+#endif
+	ouster_profile_begin(t);
+	fixed_run_blocks(lut, range, out, out_stride, block);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+
+void ouster_m3f64_mul(double r[9], double const a[9], double const x[9])
+{
+	ouster_assert_notnull(r);
+	ouster_assert_notnull(a);
+	ouster_assert_notnull(x);
+	double temp[3];
+	temp[0] = (a[OUSTER_M3(0, 0)] * x[0]) + (a[OUSTER_M3(1, 0)] * x[1]) + (a[OUSTER_M3(2, 0)] * x[2]);
+	temp[1] = (a[OUSTER_M3(0, 1)] * x[0]) + (a[OUSTER_M3(1, 1)] * x[1]) + (a[OUSTER_M3(2, 1)] * x[2]);
+	temp[2] = (a[OUSTER_M3(0, 2)] * x[0]) + (a[OUSTER_M3(1, 2)] * x[1]) + (a[OUSTER_M3(2, 2)] * x[2]);
+	r[0] = temp[0];
+	r[1] = temp[1];
+	r[2] = temp[2];
+}
+
+#define JSMN_HEADER
+#include <stdlib.h>
+#include <string.h>
+
+#define TOK_COUNT 1024
+
+#define MAX(a, b) (((a) > (b)) ? a : b)
+#define MIN(a, b) (((a) < (b)) ? a : b)
+
+char *jsmn_strerror(int r)
+{
+	switch (r) {
+	case JSMN_ERROR_NOMEM:
+		return "JSMN_ERROR_NOMEM";
+	case JSMN_ERROR_INVAL:
+		return "JSMN_ERROR_INVAL";
+	case JSMN_ERROR_PART:
+		return "JSMN_ERROR_PART";
+	default:
+		return "JSMN_ERROR_?";
+	}
+}
+
+#define STRING_BUF_SIZE 128
+
+/*
+
+static const Table<ChanField, FieldInfo, 8> legacy_field_info{{
+    {ChanField::RANGE, {UINT32, 0, 0x000fffff, 0}},
+    {ChanField::FLAGS, {UINT8, 3, 0, 4}},
+    {ChanField::REFLECTIVITY, {UINT16, 4, 0, 0}},
+    {ChanField::SIGNAL, {UINT16, 6, 0, 0}},
+    {ChanField::NEAR_IR, {UINT16, 8, 0, 0}},
+    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
+    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
+    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
+}};
+
+static const Table<ChanField, FieldInfo, 5> lb_field_info{{
+    {ChanField::RANGE, {UINT16, 0, 0x7fff, -3}},
+    {ChanField::FLAGS, {UINT8, 1, 0b10000000, 7}},
+    {ChanField::REFLECTIVITY, {UINT8, 2, 0, 0}},
+    {ChanField::NEAR_IR, {UINT8, 3, 0, -4}},
+    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
+}};
+
+static const Table<ChanField, FieldInfo, 13> dual_field_info{{
+    {ChanField::RANGE, {UINT32, 0, 0x0007ffff, 0}},
+    {ChanField::FLAGS, {UINT8, 2, 0b11111000, 3}},
+    {ChanField::REFLECTIVITY, {UINT8, 3, 0, 0}},
+    {ChanField::RANGE2, {UINT32, 4, 0x0007ffff, 0}},
+    {ChanField::FLAGS2, {UINT8, 6, 0b11111000, 3}},
+    {ChanField::REFLECTIVITY2, {UINT8, 7, 0, 0}},
+    {ChanField::SIGNAL, {UINT16, 8, 0, 0}},
+    {ChanField::SIGNAL2, {UINT16, 10, 0, 0}},
+    {ChanField::NEAR_IR, {UINT16, 12, 0, 0}},
+    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
+    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
+    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
+    {ChanField::RAW32_WORD4, {UINT32, 12, 0, 0}},
+}};
+
+static const Table<ChanField, FieldInfo, 8> single_field_info{{
+    {ChanField::RANGE, {UINT32, 0, 0x0007ffff, 0}},
+    {ChanField::FLAGS, {UINT8, 2, 0b11111000, 3}},
+    {ChanField::REFLECTIVITY, {UINT8, 4, 0, 0}},
+    {ChanField::SIGNAL, {UINT16, 6, 0, 0}},
+    {ChanField::NEAR_IR, {UINT16, 8, 0, 0}},
+    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
+    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
+    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
+}};
+
+static const Table<ChanField, FieldInfo, 14> five_word_pixel_info{{
+    {ChanField::RANGE, {UINT32, 0, 0x0007ffff, 0}},
+    {ChanField::FLAGS, {UINT8, 2, 0b11111000, 3}},
+    {ChanField::REFLECTIVITY, {UINT8, 3, 0, 0}},
+    {ChanField::RANGE2, {UINT32, 4, 0x0007ffff, 0}},
+    {ChanField::FLAGS2, {UINT8, 6, 0b11111000, 3}},
+    {ChanField::REFLECTIVITY2, {UINT8, 7, 0, 0}},
+    {ChanField::SIGNAL, {UINT16, 8, 0, 0}},
+    {ChanField::SIGNAL2, {UINT16, 10, 0, 0}},
+    {ChanField::NEAR_IR, {UINT16, 12, 0, 0}},
+    {ChanField::RAW32_WORD1, {UINT32, 0, 0, 0}},
+    {ChanField::RAW32_WORD2, {UINT32, 4, 0, 0}},
+    {ChanField::RAW32_WORD3, {UINT32, 8, 0, 0}},
+    {ChanField::RAW32_WORD4, {UINT32, 12, 0, 0}},
+    {ChanField::RAW32_WORD5, {UINT32, 16, 0, 0}},
+}};
+
+*/
+
+#define COMBINE(p, q) (((p) << 0) | ((q) << 8))
+
+void ouster_extract_init(ouster_extract_t *f, ouster_profile_t profile, ouster_quantity_t quantity)
+{
+	ouster_assert_notnull(f);
+
+	switch (COMBINE(profile, quantity)) {
+	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_RANGE):
+		f->mask = UINT32_C(0x0007ffff);
+		f->offset = 0;
+		f->depth = 4;
+		break;
+	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_REFLECTIVITY):
+		f->mask = UINT32_C(0xFFFFFFFF);
+		f->offset = 4;
+		f->depth = 1;
+		break;
+	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_SIGNAL):
+		f->mask = UINT32_C(0xFFFFFFFF);
+		f->offset = 6;
+		f->depth = 2;
+		break;
+	case COMBINE(OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16, OUSTER_QUANTITY_NEAR_IR):
+		f->mask = UINT32_C(0xFFFFFFFF);
+		f->offset = 8;
+		f->depth = 2;
+		break;
+		/*
+		Range [15 bit unsigned int] - Range scaled down by a factor of 8 mm, for a maximum range of (2^15*8) = 262 mm in 15 bits. Note The range value will be set to 0 if out of range or if no detection is made.
+		Shift by minus 3 is a left shift. That will multiply by a factor 2^3 = 8.
+		{ChanField::RANGE, {UINT16, 0, 0x7fff, -3}},
+		*/
+	case COMBINE(OUSTER_PROFILE_RNG15_RFL8_NIR8, OUSTER_QUANTITY_RANGE):
+		f->mask = UINT32_C(0x7fff);
+		f->offset = 0;
+		f->depth = 2;
+		break;
+	case COMBINE(OUSTER_PROFILE_RNG15_RFL8_NIR8, OUSTER_QUANTITY_REFLECTIVITY):
+		f->mask = UINT32_C(0xFFFFFFFF);
+		f->offset = 2;
+		f->depth = 1;
+		break;
+	case COMBINE(OUSTER_PROFILE_RNG15_RFL8_NIR8, OUSTER_QUANTITY_NEAR_IR):
+		f->mask = UINT32_C(0xFFFFFFFF);
+		f->offset = 3;
+		f->depth = 1;
+		break;
+	default:
+		break;
+	}
+}
+
+void ouster_meta_parse(char const *json, ouster_meta_t *out)
+{
+	ouster_assert_notnull(json);
+	ouster_assert_notnull(out);
+
+	jsmn_parser p;
+	jsmn_init(&p);
+	jsmntok_t tokens[TOK_COUNT];
+	int r = jsmn_parse(&p, json, strlen(json), tokens, TOK_COUNT);
+	if (r < 1) {
+		ouster_log("jsmn error: %s\n", jsmn_strerror(r));
+		return;
+	}
+	ouster_assert(tokens[0].type == JSMN_OBJECT, "Expected JSMN_OBJECT");
+
+	int column_window[2];
+	json_parse_value(json, tokens, (char const *[]){"config_params", "udp_port_lidar", NULL}, &out->udp_port_lidar, JSON_TYPE_INT);
+	json_parse_value(json, tokens, (char const *[]){"config_params", "udp_port_imu", NULL}, &out->udp_port_imu, JSON_TYPE_INT);
+	json_parse_value(json, tokens, (char const *[]){"lidar_data_format", "columns_per_frame", NULL}, &out->columns_per_frame, JSON_TYPE_INT);
+	json_parse_value(json, tokens, (char const *[]){"lidar_data_format", "columns_per_packet", NULL}, &out->columns_per_packet, JSON_TYPE_INT);
+	json_parse_value(json, tokens, (char const *[]){"lidar_data_format", "pixels_per_column", NULL}, &out->pixels_per_column, JSON_TYPE_INT);
+	json_parse_vector(json, tokens, (char const *[]){"lidar_data_format", "column_window", NULL}, column_window, 2, JSON_TYPE_INT);
+	ouster_assert(out->pixels_per_column > 0, "Not in range pixels_per_column");
+	ouster_assert(out->pixels_per_column <= 128, "Not in range pixels_per_column");
+	json_parse_vector(json, tokens, (char const *[]){"lidar_data_format", "pixel_shift_by_row", NULL}, out->pixel_shift_by_row, out->pixels_per_column, JSON_TYPE_INT);
+
+	json_parse_value(json, tokens, (char const *[]){"beam_intrinsics", "lidar_origin_to_beam_origin_mm", NULL}, &out->lidar_origin_to_beam_origin_mm, JSON_TYPE_F64);
+	json_parse_vector(json, tokens, (char const *[]){"beam_intrinsics", "beam_altitude_angles", NULL}, out->beam_altitude_angles, out->pixels_per_column, JSON_TYPE_F64);
+	json_parse_vector(json, tokens, (char const *[]){"beam_intrinsics", "beam_azimuth_angles", NULL}, out->beam_azimuth_angles, out->pixels_per_column, JSON_TYPE_F64);
+	json_parse_vector(json, tokens, (char const *[]){"beam_intrinsics", "beam_to_lidar_transform", NULL}, out->beam_to_lidar_transform, 16, JSON_TYPE_F64);
+
+	json_parse_vector(json, tokens, (char const *[]){"lidar_intrinsics", "lidar_to_sensor_transform", NULL}, out->lidar_to_sensor_transform, 16, JSON_TYPE_F64);
+
+	char buf[STRING_BUF_SIZE];
+	json_parse_string(json, tokens, (char const *[]){"lidar_data_format", "udp_profile_lidar", NULL}, buf, STRING_BUF_SIZE);
+
+	if (strcmp(buf, "LIDAR_LEGACY") == 0) {
+		out->profile = OUSTER_PROFILE_LIDAR_LEGACY;
+		out->channel_data_size = 12;
+	} else if (strcmp(buf, "RNG19_RFL8_SIG16_NIR16_DUAL") == 0) {
+		out->profile = OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16_DUAL;
+		out->channel_data_size = 16;
+	} else if (strcmp(buf, "RNG19_RFL8_SIG16_NIR16") == 0) {
+		out->profile = OUSTER_PROFILE_RNG19_RFL8_SIG16_NIR16;
+		out->channel_data_size = 12;
+	} else if (strcmp(buf, "RNG15_RFL8_NIR8") == 0) {
+		out->profile = OUSTER_PROFILE_RNG15_RFL8_NIR8;
+		out->channel_data_size = 4;
+	} else if (strcmp(buf, "FIVE_WORD_PIXEL") == 0) {
+		out->profile = OUSTER_PROFILE_FIVE_WORDS_PER_PIXEL;
+		out->channel_data_size = 20;
+	} else {
+		ouster_assert(0, "Profile not found");
+	}
+
+	/*
+	  https://github.com/ouster-lidar/ouster_example/blob/9d0971107f6f9c95e16afd727fa2534d01a0fe4e/ouster_client/src/parsing.cpp#L155
+
+	  col_size = col_header_size + pixels_per_column * channel_data_size +
+	              col_footer_size;
+
+	        lidar_packet_size = packet_header_size + columns_per_packet * col_size +
+	                            packet_footer_size;
+
+	*/
+	out->col_size = OUSTER_COLUMN_HEADER_SIZE + out->pixels_per_column * out->channel_data_size + OUSTER_COLUMN_FOOTER_SIZE;
+	out->lidar_packet_size = OUSTER_PACKET_HEADER_SIZE + out->columns_per_packet * out->col_size + OUSTER_PACKET_FOOTER_SIZE;
+
+	out->mid0 = MIN(column_window[0], column_window[1]);
+	out->mid1 = MAX(column_window[0], column_window[1]);
+	out->midw = abs(column_window[0] - column_window[1]) + 1;
+
+	for (ouster_quantity_t quantity = 0; quantity < OUSTER_QUANTITY_CHAN_FIELD_MAX; ++quantity) {
+		ouster_extract_t *e = out->extract + quantity;
+		ouster_extract_init(e, out->profile, quantity);
+		int rows = out->pixels_per_column;
+		int cols = out->midw;
+		ouster_assert(rows >= 0, "");
+		ouster_assert(cols >= 0, "");
+	}
+
+	ouster_assert(out->mid0 < out->mid1, "");
+	ouster_assert(out->midw > 0, "");
+	ouster_assert(out->channel_data_size > 0, "");
+}
+
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+void ouster_net_addr_set_ip4(ouster_net_addr_t *addr, char const *ip)
+{
+	struct sockaddr_in *addr4 = (void *)addr;
+	addr4->sin_family = AF_INET;
+	addr4->sin_addr.s_addr = inet_addr(ip);
+}
+
+void net_addr_set_ip6(ouster_net_addr_t *addr, char const *ip)
+{
+	struct sockaddr_in6 *addr6 = (void *)addr;
+	addr6->sin6_family = AF_INET6;
+	// TODO: Set ip
+}
+
+void ouster_net_addr_set_port(ouster_net_addr_t *addr, int port)
+{
+	struct sockaddr *sa = (void *)addr;
+	switch (sa->sa_family) {
+	case AF_INET: {
+		struct sockaddr_in *addr4 = (void *)addr;
+		addr4->sin_port = htons(port);
+		break;
+	}
+
+	case AF_INET6: {
+		struct sockaddr_in6 *addr6 = (void *)addr;
+		addr6->sin6_port = htons(port);
+		break;
+	}
+	}
+}
+
+int ouster_net_sendto(int sock, char *buf, int size, int flags, ouster_net_addr_t *addr)
+{
+	struct sockaddr *sa = (void *)addr;
+	ssize_t rc;
+	switch (sa->sa_family) {
+	case AF_INET:
+		rc = sendto(sock, buf, size, flags, sa, sizeof(struct sockaddr_in));
+		break;
+
+	case AF_INET6:
+		rc = sendto(sock, buf, size, flags, sa, sizeof(struct sockaddr_in6));
+		break;
+	}
+	return rc;
+}
+
+static socklen_t ouster_net_addr_len(ouster_net_addr_t *addr)
+{
+	struct sockaddr *sa = (void *)addr;
+	switch (sa->sa_family) {
+	case AF_INET:
+		return sizeof(struct sockaddr_in);
+	case AF_INET6:
+		return sizeof(struct sockaddr_in6);
+	}
+	return 0;
+}
+
+int ouster_net_sendmmsg(int sock, ouster_net_msg_t msgs[], int n, int flags)
+{
+	ouster_assert(sock >= 0, "");
+	ouster_assert_notnull(msgs);
+	ouster_assert(n >= 0, "");
+
+	int sent = 0;
+#ifdef _GNU_SOURCE
+	struct mmsghdr hdrs[OUSTER_NET_SENDMMSG_MAX];
+	struct iovec iovs[OUSTER_NET_SENDMMSG_MAX];
+	while (sent < n) {
+		int count = n - sent;
+		count = (count > OUSTER_NET_SENDMMSG_MAX) ? OUSTER_NET_SENDMMSG_MAX : count;
+		memset(hdrs, 0, sizeof(struct mmsghdr) * count);
+		for (int i = 0; i < count; ++i) {
+			ouster_net_msg_t *m = msgs + sent + i;
+			iovs[i].iov_base = m->buf;
+			iovs[i].iov_len = m->size;
+			hdrs[i].msg_hdr.msg_iov = iovs + i;
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+			hdrs[i].msg_hdr.msg_name = m->addr;
+			hdrs[i].msg_hdr.msg_namelen = ouster_net_addr_len(m->addr);
+		}
+		int rc = sendmmsg(sock, hdrs, count, flags);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return sent ? sent : -1;
+		}
+		sent += rc;
+		if (rc < count) {
+			// The socket buffer is full, let the caller decide when to retry
+			break;
+		}
+	}
+#else
+	for (; sent < n; ++sent) {
+		ouster_net_msg_t *m = msgs + sent;
+		ssize_t rc = sendto(sock, m->buf, m->size, flags, (void *)m->addr, ouster_net_addr_len(m->addr));
+		if (rc < 0) {
+			return sent ? sent : -1;
+		}
+	}
+#endif
+	return sent;
+}
+
+int32_t ouster_net_get_port(int sock)
+{
+	ouster_assert(sock >= 0, "Socket not in range");
+
+	struct sockaddr_storage ss;
+	socklen_t addrlen = sizeof(ss);
+	getsockname(sock, (struct sockaddr *)&ss, &addrlen);
+	in_port_t port;
+	switch (ss.ss_family) {
+	case AF_INET:
+		port = ((struct sockaddr_in *)&ss)->sin_port;
+		break;
+	case AF_INET6:
+		port = ((struct sockaddr_in6 *)&ss)->sin6_port;
+		break;
+	}
+	return ntohs(port);
+}
+
+void inet_ntop_addrinfo(struct addrinfo *ai, char *buf, socklen_t len)
+{
+	ouster_assert_notnull(ai);
+	ouster_assert_notnull(buf);
+
+	void *addr = NULL;
+	switch (ai->ai_family) {
+	case AF_INET:
+		addr = &(((struct sockaddr_in *)ai->ai_addr)->sin_addr);
+		break;
+	case AF_INET6:
+		addr = &(((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr);
+		break;
+	}
+	inet_ntop(ai->ai_family, addr, buf, len);
+}
+
+int try_create_socket(ouster_net_sock_desc_t *desc, struct addrinfo *ai)
+{
+	ouster_assert_notnull(desc);
+	ouster_assert_notnull(ai);
+
+	int s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (s < 0) {
+		ouster_log("socket(): error\n");
+		goto error;
+	}
+
+	if (desc->flags & OUSTER_NET_FLAGS_CONNECT) {
+		int rc = connect(s, ai->ai_addr, (socklen_t)ai->ai_addrlen);
+		if (rc) {
+			ouster_log("connect(): error: %s\n", strerror(errno));
+			goto error;
+		}
+	}
+
+	if (desc->rcvtimeout_sec) {
+		struct timeval tv;
+		tv.tv_sec = desc->rcvtimeout_sec;
+		tv.tv_usec = 0;
+		int rc = setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv);
+		if (rc == -1) {
+			ouster_log("fcntl(): error\n");
+			goto error;
+		}
+	}
+
+	if (desc->flags & OUSTER_NET_FLAGS_IPV6ONLY) {
+		int off = 0;
+		int rc = setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, (char *)&off, sizeof(off));
+		if (rc) {
+			ouster_log("setsockopt(): error\n");
+			goto error;
+		}
+	}
+
+	if (desc->flags & OUSTER_NET_FLAGS_REUSE) {
+		int option = 1;
+		int rc = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char *)&option, sizeof(option));
+		if (rc) {
+			ouster_log("setsockopt(): error\n");
+			goto error;
+		}
+	}
+
+	if (desc->flags & OUSTER_NET_FLAGS_BIND) {
+
+		int rc = bind(s, ai->ai_addr, (socklen_t)ai->ai_addrlen);
+		if (rc) {
+			ouster_log("bind(): error: %s\n", strerror(errno));
+			goto error;
+		}
+	}
+
+	// https://gist.github.com/hostilefork/f7cae3dc33e7416f2dd25a402857b6c6
+	if (desc->group) {
+#ifdef _GNU_SOURCE
+		int rc;
+		struct ip_mreq mreq; // IPv4
+		rc = inet_pton(AF_INET, desc->group, &(mreq.imr_multiaddr.s_addr));
+		if (rc != 1) {
+			ouster_log("inet_pton(): error\n");
+			goto error;
+		}
+		if (IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr)) == 0) {
+			ouster_log("Not multicast\n");
+			goto error;
+		}
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		rc = setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *)&mreq, sizeof(mreq));
+		if (rc < 0) {
+			ouster_log("setsockopt(): error\n");
+			goto error;
+		}
+		ouster_log("IP_ADD_MEMBERSHIP(): %s\n", desc->group);
+#else
+		ouster_log("ip_mreq requires #define _GNU_SOURCE. Compile with -D_GNU_SOURCE or --std=gnu99\n");
+#endif
+	}
+
+	if (desc->flags & OUSTER_NET_FLAGS_NONBLOCK) {
+		int flags = fcntl(s, F_GETFL, 0);
+		if (flags == -1) {
+			ouster_log("fcntl(): error\n");
+			goto error;
+		}
+		int rc = fcntl(s, F_SETFL, flags | O_NONBLOCK);
+		if (rc == -1) {
+			ouster_log("fcntl(): error\n");
+			goto error;
+		}
+	}
+	if (desc->rcvbuf_size) {
+		int rc = setsockopt(s, SOL_SOCKET, SO_RCVBUF, (char *)&desc->rcvbuf_size, sizeof(desc->rcvbuf_size));
+		if (rc) {
+			ouster_log("setsockopt(): error\n");
+			goto error;
+		}
+	}
+	return s;
+error:
+	if (s >= 0) {
+		close(s);
+	}
+	return -1;
+}
+
+struct addrinfo *get_addrinfo(ouster_net_sock_desc_t *desc)
+{
+	ouster_assert_notnull(desc);
+
+	char hint_service_buf[128];
+	char const *hint_service = desc->hint_service;
+
+	if (hint_service == NULL) {
+		snprintf(hint_service_buf, 128, "%i", desc->port);
+		hint_service = hint_service_buf;
+	}
+
+	struct addrinfo *info = NULL;
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	if (desc->flags & OUSTER_NET_FLAGS_IPV4) {
+		hints.ai_family = AF_INET;
+	}
+	if (desc->flags & OUSTER_NET_FLAGS_IPV6) {
+		hints.ai_family = AF_INET6;
+	}
+	if (desc->flags & OUSTER_NET_FLAGS_UDP) {
+		hints.ai_socktype = SOCK_DGRAM;
+		hints.ai_flags = AI_PASSIVE;
+	}
+	if (desc->flags & OUSTER_NET_FLAGS_TCP) {
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_NUMERICHOST;
+	}
+	int ret = getaddrinfo(desc->hint_name, hint_service, &hints, &info);
+	if (ret != 0) {
+		hints.ai_flags = 0;
+		ret = getaddrinfo(desc->hint_name, hint_service, &hints, &info);
+		if (ret != 0) {
+			ouster_log("getaddrinfo(): %s\n", gai_strerror(ret));
+			goto error;
+		}
+	}
+	if (info == NULL) {
+		ouster_log("getaddrinfo(): empty result\n");
+		goto error;
+	}
+	return info;
+
+error:
+	if (info) {
+		ouster_log("freeaddrinfo()\n");
+		freeaddrinfo(info);
+	}
+	return NULL;
+}
+
+int ouster_net_create(ouster_net_sock_desc_t *desc)
+{
+	ouster_assert_notnull(desc);
+
+	struct addrinfo *info = get_addrinfo(desc);
+	if (info == NULL) {
+		ouster_log("get_addrinfo(): error\n");
+		goto error;
+	}
+	struct addrinfo *ai;
+	int s = -1;
+	for (ai = info; ai != NULL; ai = ai->ai_next) {
+		char buf[INET6_ADDRSTRLEN];
+		inet_ntop_addrinfo(ai, buf, INET6_ADDRSTRLEN);
+		ouster_log("get_addrinfo: %s\n", buf);
+	}
+	for (ai = info; ai != NULL; ai = ai->ai_next) {
+		char buf[INET6_ADDRSTRLEN];
+		inet_ntop_addrinfo(ai, buf, INET6_ADDRSTRLEN);
+		s = try_create_socket(desc, ai);
+		ouster_log("try_create_socket: %s:%i %s%s, socket=%i\n", buf, ouster_net_get_port(s),
+		           (desc->flags & OUSTER_NET_FLAGS_TCP) ? "TCP" : "",
+		           (desc->flags & OUSTER_NET_FLAGS_UDP) ? "UDP" : "",
+		           s);
+		if (s >= 0) {
+			break;
+		}
+	}
+
+	if (s < 0) {
+		ouster_log("try_create_socket(): error\n");
+		goto error;
+	}
+
+	freeaddrinfo(info);
+	return s;
+
+error:
+	if (info) {
+		ouster_log("freeaddrinfo()\n");
+		freeaddrinfo(info);
+	}
+	if (s >= 0) {
+		ouster_log("close() socket\n");
+		close(s);
+	}
+	return -1;
+}
+
+int64_t ouster_net_read(int sock, char *buf, int len)
+{
+	ouster_assert(sock >= 0, "");
+	ouster_assert_notnull(buf);
+
+	ouster_profile_begin(t);
+	int64_t bytes_read = recv(sock, (char *)buf, len, 0);
+	ouster_profile_end(t, OUSTER_STAGE_RECEIVE);
+	return bytes_read;
+}
+
+int64_t net_write(int sock, char *buf, int len)
+{
+	ouster_assert(sock >= 0, "");
+	ouster_assert_notnull(buf);
+
+	int64_t bytes_read = recv(sock, (char *)buf, len, 0);
+	return bytes_read;
+}
+
+/*
+https://stackoverflow.com/questions/5647503/with-a-single-file-descriptor-is-there-any-performance-difference-between-selec
+*/
+uint64_t ouster_net_select(int socks[], int n, const int timeout_sec, const int timeout_usec)
+{
+	ouster_assert_notnull(socks);
+
+	fd_set rfds;
+	FD_ZERO(&rfds);
+	for (int i = 0; i < n; ++i) {
+		ouster_assert(socks[i] >= 0, "Socket not in range");
+		FD_SET(socks[i], &rfds);
+	}
+
+	int max = 0;
+	for (int i = 0; i < n; ++i) {
+		if (socks[i] > max) {
+			max = socks[i];
+		}
+	}
+
+	uint64_t result = 0;
+	struct timeval tv;
+	tv.tv_sec = timeout_sec;
+	tv.tv_usec = timeout_usec;
+
+	int rc = select((int)max + 1, &rfds, NULL, NULL, &tv);
+	if (rc == -1) {
+		ouster_log("select(): error\n");
+		return 0;
+	}
+	for (int i = 0; i < n; ++i) {
+		if (FD_ISSET(socks[i], &rfds)) {
+			result |= (1 << i);
+		}
 	}
 
-	/*
-	  https://github.com/ouster-lidar/ouster_example/blob/9d0971107f6f9c95e16afd727fa2534d01a0fe4e/ouster_client/src/parsing.cpp#L155
+	return result;
+}
 
-	  col_size = col_header_size + pixels_per_column * channel_data_size +
-	              col_footer_size;
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-	        lidar_packet_size = packet_header_size + columns_per_packet * col_size +
-	                            packet_footer_size;
+#define OS_API_MAGIC UINT32_C(0x434F4C4C)
 
-	*/
-	out->col_size = OUSTER_COLUMN_HEADER_SIZE + out->pixels_per_column * out->channel_data_size + OUSTER_COLUMN_FOOTER_SIZE;
-	out->lidar_packet_size = OUSTER_PACKET_HEADER_SIZE + out->columns_per_packet * out->col_size + OUSTER_PACKET_FOOTER_SIZE;
+/* Every block of the default allocator starts with this header, it keeps the 16 byte alignment of malloc */
+typedef struct
+{
+	uint64_t size;
+	uint32_t tag;
+	uint32_t magic;
+} os_api_header_t;
 
-	out->mid0 = MIN(column_window[0], column_window[1]);
-	out->mid1 = MAX(column_window[0], column_window[1]);
-	out->midw = abs(column_window[0] - column_window[1]) + 1;
+ouster_os_api_t ouster_os_api;
+int64_t ouster_os_api_malloc_count = 0;
+int64_t ouster_os_api_realloc_count = 0;
+int64_t ouster_os_api_calloc_count = 0;
+int64_t ouster_os_api_free_count = 0;
 
-	for (ouster_quantity_t quantity = 0; quantity < OUSTER_QUANTITY_CHAN_FIELD_MAX; ++quantity) {
-		ouster_extract_t *e = out->extract + quantity;
-		ouster_extract_init(e, out->profile, quantity);
-		int rows = out->pixels_per_column;
-		int cols = out->midw;
-		ouster_assert(rows >= 0, "");
-		ouster_assert(cols >= 0, "");
+static int64_t os_api_bytes;
+static int64_t os_api_bytes_peak;
+static int64_t os_api_tag_bytes[OUSTER_OS_MEM_TAG_COUNT];
+static int64_t os_api_tag_allocs[OUSTER_OS_MEM_TAG_COUNT];
+static __thread int os_api_tag;
+
+int ouster_os_mem_tag_set(int tag)
+{
+	ouster_assert((tag >= 0) && (tag < OUSTER_OS_MEM_TAG_COUNT), "");
+	int prev = os_api_tag;
+	os_api_tag = tag;
+	return prev;
+}
+
+int ouster_os_mem_count_alloc(size_t size)
+{
+	int tag = os_api_tag;
+	int64_t bytes = __atomic_add_fetch(&os_api_bytes, (int64_t)size, __ATOMIC_RELAXED);
+	int64_t peak = __atomic_load_n(&os_api_bytes_peak, __ATOMIC_RELAXED);
+	while ((bytes > peak) && !__atomic_compare_exchange_n(&os_api_bytes_peak, &peak, bytes, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
 	}
+	__atomic_fetch_add(os_api_tag_bytes + tag, (int64_t)size, __ATOMIC_RELAXED);
+	__atomic_fetch_add(os_api_tag_allocs + tag, 1, __ATOMIC_RELAXED);
+	return tag;
+}
 
-	ouster_assert(out->mid0 < out->mid1, "");
-	ouster_assert(out->midw > 0, "");
-	ouster_assert(out->channel_data_size > 0, "");
+void ouster_os_mem_count_free(int tag, size_t size)
+{
+	ouster_assert((tag >= 0) && (tag < OUSTER_OS_MEM_TAG_COUNT), "");
+	__atomic_fetch_sub(&os_api_bytes, (int64_t)size, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(os_api_tag_bytes + tag, (int64_t)size, __ATOMIC_RELAXED);
 }
 
+void ouster_os_mem_stats(ouster_os_mem_stats_t *stats)
+{
+	ouster_assert_notnull(stats);
+	stats->malloc_count = __atomic_load_n(&ouster_os_api_malloc_count, __ATOMIC_RELAXED);
+	stats->realloc_count = __atomic_load_n(&ouster_os_api_realloc_count, __ATOMIC_RELAXED);
+	stats->calloc_count = __atomic_load_n(&ouster_os_api_calloc_count, __ATOMIC_RELAXED);
+	stats->free_count = __atomic_load_n(&ouster_os_api_free_count, __ATOMIC_RELAXED);
+	stats->allocs = stats->malloc_count + stats->realloc_count + stats->calloc_count;
+	stats->bytes = __atomic_load_n(&os_api_bytes, __ATOMIC_RELAXED);
+	stats->bytes_peak = __atomic_load_n(&os_api_bytes_peak, __ATOMIC_RELAXED);
+	for (int i = 0; i < OUSTER_OS_MEM_TAG_COUNT; ++i) {
+		stats->tag_bytes[i] = __atomic_load_n(os_api_tag_bytes + i, __ATOMIC_RELAXED);
+		stats->tag_allocs[i] = __atomic_load_n(os_api_tag_allocs + i, __ATOMIC_RELAXED);
+	}
+}
 
-#include <arpa/inet.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/select.h>
-#include <sys/socket.h>
-#include <sys/time.h>
-#include <sys/types.h>
-#include <unistd.h>
+static void *os_api_block(os_api_header_t *h, size_t size)
+{
+	if (h == NULL) {
+		return NULL;
+	}
+	h->size = size;
+	h->tag = (uint32_t)ouster_os_mem_count_alloc(size);
+	h->magic = OS_API_MAGIC;
+	return h + 1;
+}
 
-void ouster_net_addr_set_ip4(ouster_net_addr_t *addr, char const *ip)
+static os_api_header_t *os_api_header(void *ptr)
 {
-	struct sockaddr_in *addr4 = (void *)addr;
-	addr4->sin_family = AF_INET;
-	addr4->sin_addr.s_addr = inet_addr(ip);
+	os_api_header_t *h = (os_api_header_t *)ptr - 1;
+	ouster_assert(h->magic == OS_API_MAGIC, "Not allocated by ouster_os_malloc");
+	return h;
 }
 
-void net_addr_set_ip6(ouster_net_addr_t *addr, char const *ip)
+static void *ouster_os_api_calloc(size_t size)
 {
-	struct sockaddr_in6 *addr6 = (void *)addr;
-	addr6->sin6_family = AF_INET6;
-	// TODO: Set ip
+	__atomic_fetch_add(&ouster_os_api_calloc_count, 1, __ATOMIC_RELAXED);
+	return os_api_block(calloc(1, sizeof(os_api_header_t) + size), size);
 }
 
-void ouster_net_addr_set_port(ouster_net_addr_t *addr, int port)
+static void *ouster_os_api_malloc(size_t size)
 {
-	struct sockaddr *sa = (void *)addr;
-	switch (sa->sa_family) {
-	case AF_INET: {
-		struct sockaddr_in *addr4 = (void *)addr;
-		addr4->sin_port = htons(port);
-		break;
+	__atomic_fetch_add(&ouster_os_api_malloc_count, 1, __ATOMIC_RELAXED);
+	return os_api_block(malloc(sizeof(os_api_header_t) + size), size);
+}
+
+static void ouster_os_api_free(void *ptr)
+{
+	__atomic_fetch_add(&ouster_os_api_free_count, 1, __ATOMIC_RELAXED);
+	if (ptr == NULL) {
+		return;
 	}
+	os_api_header_t *h = os_api_header(ptr);
+	ouster_os_mem_count_free((int)h->tag, h->size);
+	h->magic = 0;
+	free(h);
+}
 
-	case AF_INET6: {
-		struct sockaddr_in6 *addr6 = (void *)addr;
-		addr6->sin6_port = htons(port);
-		break;
+static void *ouster_os_api_realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_realloc_count, 1, __ATOMIC_RELAXED);
+	if (ptr == NULL) {
+		return os_api_block(malloc(sizeof(os_api_header_t) + size), size);
 	}
+	os_api_header_t *h = os_api_header(ptr);
+	os_api_header_t old = *h;
+	h = realloc(h, sizeof(os_api_header_t) + size);
+	if (h == NULL) {
+		return NULL;
 	}
+	ouster_os_mem_count_free((int)old.tag, old.size);
+	return os_api_block(h, size);
 }
 
-int ouster_net_sendto(int sock, char *buf, int size, int flags, ouster_net_addr_t *addr)
+static void ouster_log_msg(int32_t level, const char *file, int32_t line, const char *msg)
 {
-	struct sockaddr *sa = (void *)addr;
-	ssize_t rc;
-	switch (sa->sa_family) {
-	case AF_INET:
-		rc = sendto(sock, buf, size, flags, sa, sizeof(struct sockaddr_in));
-		break;
-
-	case AF_INET6:
-		rc = sendto(sock, buf, size, flags, sa, sizeof(struct sockaddr_in6));
-		break;
+	FILE *stream;
+	if (level >= 0) {
+		stream = stdout;
+	} else {
+		stream = stderr;
 	}
-	return rc;
+	fputs(msg, stream);
+	//fputs("\n", stream);
 }
 
-int32_t ouster_net_get_port(int sock)
+void ouster_os_set_api_defaults(void)
 {
-	ouster_assert(sock >= 0, "Socket not in range");
+	/* Memory management */
+	ouster_os_api.malloc_ = ouster_os_api_malloc;
+	ouster_os_api.free_ = ouster_os_api_free;
+	ouster_os_api.realloc_ = ouster_os_api_realloc;
+	ouster_os_api.calloc_ = ouster_os_api_calloc;
 
-	struct sockaddr_storage ss;
-	socklen_t addrlen = sizeof(ss);
-	getsockname(sock, (struct sockaddr *)&ss, &addrlen);
-	in_port_t port;
-	switch (ss.ss_family) {
-	case AF_INET:
-		port = ((struct sockaddr_in *)&ss)->sin_port;
-		break;
-	case AF_INET6:
-		port = ((struct sockaddr_in6 *)&ss)->sin6_port;
-		break;
-	}
-	return ntohs(port);
+	/* Logging */
+	ouster_os_api.log_level_ = -1;
+	ouster_os_api.log_ = ouster_log_msg;
+
+	ouster_os_api.abort_ = abort;
 }
 
-void inet_ntop_addrinfo(struct addrinfo *ai, char *buf, socklen_t len)
+int64_t ouster_os_clock_ns(void)
 {
-	ouster_assert_notnull(ai);
-	ouster_assert_notnull(buf);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * INT64_C(1000000000) + (int64_t)ts.tv_nsec;
+}
 
-	void *addr = NULL;
-	switch (ai->ai_family) {
-	case AF_INET:
-		addr = &(((struct sockaddr_in *)ai->ai_addr)->sin_addr);
-		break;
-	case AF_INET6:
-		addr = &(((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr);
-		break;
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#define PIPELINE_PACKETS_DEFAULT 1024
+#define PIPELINE_FRAMES_DEFAULT 2
+#define PIPELINE_SPINS 64
+#define PIPELINE_IDLE_NS 50000
+#define PIPELINE_SELECT_USEC 100000
+
+static int pipeline_quit(ouster_pipeline_t *p)
+{
+	return __atomic_load_n(&p->quit, __ATOMIC_ACQUIRE);
+}
+
+/* Yields a few times then sleeps, idle stages do not burn a whole CPU */
+static void pipeline_idle(int *idle)
+{
+	if (*idle < PIPELINE_SPINS) {
+		(*idle)++;
+		sched_yield();
+		return;
 	}
-	inet_ntop(ai->ai_family, addr, buf, len);
+	struct timespec ts = {0, PIPELINE_IDLE_NS};
+	nanosleep(&ts, NULL);
 }
 
-int try_create_socket(ouster_net_sock_desc_t *desc, struct addrinfo *ai)
+static void pipeline_count(int64_t *counter)
 {
-	ouster_assert_notnull(desc);
-	ouster_assert_notnull(ai);
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
 
-	int s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-	if (s < 0) {
-		ouster_log("socket(): error\n");
-		goto error;
+static void pipeline_setup(ouster_pipeline_t *p, int stage, char const *name)
+{
+	ouster_trace_thread_name(name);
+	int cpu = p->desc.cpu[stage];
+	if (!p->desc.pin || (cpu < 0)) {
+		return;
 	}
-
-	if (desc->flags & OUSTER_NET_FLAGS_CONNECT) {
-		int rc = connect(s, ai->ai_addr, (socklen_t)ai->ai_addrlen);
-		if (rc) {
-			ouster_log("connect(): error: %s\n", strerror(errno));
-			goto error;
-		}
+#ifdef _GNU_SOURCE
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	if (rc != 0) {
+		ouster_log_warn("Could not pin %s to CPU %i: %s\n", name, cpu, strerror(rc));
 	}
+#else
+	ouster_log_warn("Pinning %s requires #define _GNU_SOURCE. Compile with -D_GNU_SOURCE or --std=gnu99\n", name);
+#endif
+}
 
-	if (desc->rcvtimeout_sec) {
-		struct timeval tv;
-		tv.tv_sec = desc->rcvtimeout_sec;
-		tv.tv_usec = 0;
-		int rc = setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv);
-		if (rc == -1) {
-			ouster_log("fcntl(): error\n");
-			goto error;
+/* Pushes a frame to the queue into stage, returns -1 when it was dropped */
+static int pipeline_push(ouster_pipeline_t *p, int stage, ouster_pipeline_frame_t *out)
+{
+	int idle = 0;
+	while (ouster_spsc_push(p->queues + stage, out) != 0) {
+		if (p->desc.policy[stage] == OUSTER_PIPELINE_DROP) {
+			pipeline_count(p->dropped + stage);
+			return -1;
 		}
-	}
-
-	if (desc->flags & OUSTER_NET_FLAGS_IPV6ONLY) {
-		int off = 0;
-		int rc = setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, (char *)&off, sizeof(off));
-		if (rc) {
-			ouster_log("setsockopt(): error\n");
-			goto error;
+		if (pipeline_quit(p)) {
+			return -1;
 		}
+		pipeline_idle(&idle);
 	}
+	return 0;
+}
 
-	if (desc->flags & OUSTER_NET_FLAGS_REUSE) {
-		int option = 1;
-		int rc = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char *)&option, sizeof(option));
-		if (rc) {
-			ouster_log("setsockopt(): error\n");
-			goto error;
-		}
+/* Passes a frame on to the next stage or back to the decode stage when it was dropped */
+static void pipeline_forward(ouster_pipeline_t *p, int stage, ouster_pipeline_frame_t *out)
+{
+	pipeline_count(p->processed + stage);
+	if (pipeline_push(p, stage + 1, out) != 0) {
+		// Can not fail, the queue holds every frame of the pool
+		ouster_spsc_push(p->returns + stage, out->frame);
 	}
+}
 
-	if (desc->flags & OUSTER_NET_FLAGS_BIND) {
-
-		int rc = bind(s, ai->ai_addr, (socklen_t)ai->ai_addrlen);
-		if (rc) {
-			ouster_log("bind(): error: %s\n", strerror(errno));
-			goto error;
+/* Waits for the next frame into stage, returns NULL when quitting */
+static ouster_pipeline_frame_t *pipeline_pop(ouster_pipeline_t *p, int stage)
+{
+	int idle = 0;
+	while (!pipeline_quit(p)) {
+		ouster_pipeline_frame_t *out = ouster_spsc_pop(p->queues + stage);
+		if (out) {
+			return out;
 		}
+		pipeline_idle(&idle);
 	}
+	return NULL;
+}
 
-	// https://gist.github.com/hostilefork/f7cae3dc33e7416f2dd25a402857b6c6
-	if (desc->group) {
-#ifdef _GNU_SOURCE
-		int rc;
-		struct ip_mreq mreq; // IPv4
-		rc = inet_pton(AF_INET, desc->group, &(mreq.imr_multiaddr.s_addr));
-		if (rc != 1) {
-			ouster_log("inet_pton(): error\n");
-			goto error;
+static void *pipeline_receive(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_RECEIVE, "pipeline receive");
+	int sock = p->desc.sock;
+	int size = p->desc.meta->lidar_packet_size;
+	char *buf = NULL;
+	int idle = 0;
+	while (!pipeline_quit(p)) {
+		if (buf == NULL) {
+			buf = ouster_spsc_pop(&p->packets_free);
 		}
-		if (IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr)) == 0) {
-			ouster_log("Not multicast\n");
-			goto error;
+		if ((buf == NULL) && (p->desc.policy[OUSTER_PIPELINE_DECODE] == OUSTER_PIPELINE_WAIT)) {
+			// Every buffer waits for decode, packets queue up in the socket receive buffer meanwhile
+			pipeline_idle(&idle);
+			continue;
 		}
-		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
-		rc = setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *)&mreq, sizeof(mreq));
-		if (rc < 0) {
-			ouster_log("setsockopt(): error\n");
-			goto error;
+		idle = 0;
+		if (ouster_net_select(&sock, 1, 0, PIPELINE_SELECT_USEC) == 0) {
+			continue;
 		}
-		ouster_log("IP_ADD_MEMBERSHIP(): %s\n", desc->group);
-#endif
-		ouster_log("ip_mreq requires #define _GNU_SOURCE. Compile with -D_GNU_SOURCE or --std=gnu99\n");
+		if (buf == NULL) {
+			// Read the packet anyway so the socket does not fill up with stale packets
+			char drop[OUSTER_NET_UDP_MAX_SIZE];
+			ouster_net_read(sock, drop, sizeof(drop));
+			pipeline_count(p->dropped + OUSTER_PIPELINE_DECODE);
+			continue;
+		}
+		// One byte more than a lidar packet to tell longer packets apart
+		int64_t n = ouster_net_read(sock, buf, p->packet_size);
+		if (n != size) {
+			ouster_log_debug("Bytes received (%ji) does not match lidar_packet_size (%ji)\n", (intmax_t)n, (intmax_t)size);
+			continue;
+		}
+		pipeline_count(p->processed + OUSTER_PIPELINE_RECEIVE);
+		// Can not fail, the queue holds every packet buffer
+		ouster_spsc_push(&p->packets, buf);
+		buf = NULL;
 	}
+	return NULL;
+}
 
-	if (desc->flags & OUSTER_NET_FLAGS_NONBLOCK) {
-		int flags = fcntl(s, F_GETFL, 0);
-		if (flags == -1) {
-			ouster_log("fcntl(): error\n");
-			goto error;
+static void *pipeline_decode(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_DECODE, "pipeline decode");
+	int idle = 0;
+	while (!pipeline_quit(p)) {
+		// The pool is only touched by this thread, the later stages hand frames back through queues
+		for (int i = OUSTER_PIPELINE_DESTAGGER; i < OUSTER_PIPELINE_COUNT; ++i) {
+			ouster_frame_t *frame;
+			while ((frame = ouster_spsc_pop(p->returns + i)) != NULL) {
+				ouster_frame_pool_release(&p->pool, frame);
+			}
 		}
-		int rc = fcntl(s, F_SETFL, flags | O_NONBLOCK);
-		if (rc == -1) {
-			ouster_log("fcntl(): error\n");
-			goto error;
+		char *buf = ouster_spsc_pop(&p->packets);
+		if (buf == NULL) {
+			pipeline_idle(&idle);
+			continue;
+		}
+		idle = 0;
+		ouster_frame_t *done = ouster_frame_pool_push(&p->pool, buf);
+		ouster_spsc_push(&p->packets_free, buf);
+		pipeline_count(p->processed + OUSTER_PIPELINE_DECODE);
+		if (done == NULL) {
+			continue;
+		}
+		ouster_pipeline_frame_t *out = p->outputs + (done - p->pool.frames);
+		if (pipeline_push(p, OUSTER_PIPELINE_DESTAGGER, out) != 0) {
+			ouster_frame_pool_release(&p->pool, done);
 		}
 	}
-	if (desc->rcvbuf_size) {
-		int rc = setsockopt(s, SOL_SOCKET, SO_RCVBUF, (char *)&desc->rcvbuf_size, sizeof(desc->rcvbuf_size));
-		if (rc) {
-			ouster_log("setsockopt(): error\n");
-			goto error;
+	return NULL;
+}
+
+static void *pipeline_destagger(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_DESTAGGER, "pipeline destagger");
+	ouster_pipeline_frame_t *out;
+	while ((out = pipeline_pop(p, OUSTER_PIPELINE_DESTAGGER)) != NULL) {
+		if (out->destaggered) {
+			ouster_field_destagger_cpy(out->destaggered, out->frame->fields, out->frame->fcount, p->desc.meta);
 		}
+		pipeline_forward(p, OUSTER_PIPELINE_DESTAGGER, out);
 	}
-	return s;
-error:
-	if (s >= 0) {
-		close(s);
+	return NULL;
+}
+
+static void *pipeline_cartesian(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_CARTESIAN, "pipeline cartesian");
+	ouster_pipeline_frame_t *out;
+	while ((out = pipeline_pop(p, OUSTER_PIPELINE_CARTESIAN)) != NULL) {
+		if (out->xyz) {
+			uint32_t const *range = out->frame->fields[p->range_index].data;
+			if (p->desc.workers) {
+				ouster_lut_cartesian_f64_parallel(p->desc.lut, range, out->xyz, sizeof(double) * 3, p->desc.workers);
+			} else {
+				ouster_lut_cartesian_f64(p->desc.lut, range, out->xyz, sizeof(double) * 3);
+			}
+		}
+		pipeline_forward(p, OUSTER_PIPELINE_CARTESIAN, out);
 	}
-	return -1;
+	return NULL;
 }
 
-struct addrinfo *get_addrinfo(ouster_net_sock_desc_t *desc)
+static void *pipeline_callback(void *arg)
 {
-	ouster_assert_notnull(desc);
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_CALLBACK, "pipeline callback");
+	ouster_pipeline_frame_t *out;
+	while ((out = pipeline_pop(p, OUSTER_PIPELINE_CALLBACK)) != NULL) {
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+		ouster_profile_span(OUSTER_STAGE_HANDOFF, out->frame->complete_ns, ouster_os_clock_ns());
+#endif
+		if (p->desc.fn) {
+			p->desc.fn(p->desc.arg, out);
+		}
+		pipeline_count(p->processed + OUSTER_PIPELINE_CALLBACK);
+		ouster_spsc_push(p->returns + OUSTER_PIPELINE_CALLBACK, out->frame);
+	}
+	return NULL;
+}
 
-	char hint_service_buf[128];
-	char const *hint_service = desc->hint_service;
+static void *(*const pipeline_threads[OUSTER_PIPELINE_COUNT])(void *) = {
+    [OUSTER_PIPELINE_RECEIVE] = pipeline_receive,
+    [OUSTER_PIPELINE_DECODE] = pipeline_decode,
+    [OUSTER_PIPELINE_DESTAGGER] = pipeline_destagger,
+    [OUSTER_PIPELINE_CARTESIAN] = pipeline_cartesian,
+    [OUSTER_PIPELINE_CALLBACK] = pipeline_callback,
+};
 
-	if (hint_service == NULL) {
-		snprintf(hint_service_buf, 128, "%i", desc->port);
-		hint_service = hint_service_buf;
+static void pipeline_free(ouster_pipeline_t *p)
+{
+	for (int i = 0; i < p->pool.count; ++i) {
+		ouster_pipeline_frame_t *out = p->outputs + i;
+		if (out->destaggered) {
+			for (int j = 0; j < p->desc.fcount; ++j) {
+				ouster_os_free(out->destaggered[j].data);
+			}
+			ouster_os_free(out->destaggered);
+		}
+		ouster_os_free(out->xyz);
+	}
+	ouster_os_free(p->outputs);
+	ouster_frame_pool_fini(&p->pool);
+	for (int i = 0; i < OUSTER_PIPELINE_COUNT; ++i) {
+		if (p->queues[i].items) {
+			ouster_spsc_fini(p->queues + i);
+		}
+		if (p->returns[i].items) {
+			ouster_spsc_fini(p->returns + i);
+		}
 	}
+	ouster_spsc_fini(&p->packets);
+	ouster_spsc_fini(&p->packets_free);
+	ouster_os_free(p->packet_buf);
+	memset(p, 0, sizeof(ouster_pipeline_t));
+}
 
-	struct addrinfo *info = NULL;
-	struct addrinfo hints;
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_UNSPEC;
-	if (desc->flags & OUSTER_NET_FLAGS_IPV4) {
-		hints.ai_family = AF_INET;
+int ouster_pipeline_start(ouster_pipeline_t *p, ouster_pipeline_desc_t const *desc)
+{
+	ouster_assert_notnull(p);
+	ouster_assert_notnull(desc);
+	ouster_assert_notnull(desc->meta);
+	ouster_assert(desc->fields || (desc->fcount == 0), "");
+
+	memset(p, 0, sizeof(ouster_pipeline_t));
+	p->desc = *desc;
+	ouster_meta_t *meta = desc->meta;
+	int packets = desc->packets > 0 ? desc->packets : PIPELINE_PACKETS_DEFAULT;
+	int frames = desc->frames > 0 ? desc->frames : PIPELINE_FRAMES_DEFAULT;
+
+	// Packet buffers are either in one of the two queues or held by the receive or decode stage
+	ouster_spsc_init(&p->packets, packets);
+	int buffers = p->packets.mask + 1;
+	ouster_spsc_init(&p->packets_free, buffers);
+	p->packet_size = meta->lidar_packet_size + 1;
+	p->packet_buf = ouster_os_malloc(buffers * p->packet_size);
+	ouster_assert_notnull(p->packet_buf);
+	for (int i = 0; i < buffers; ++i) {
+		ouster_spsc_push(&p->packets_free, p->packet_buf + i * p->packet_size);
 	}
-	if (desc->flags & OUSTER_NET_FLAGS_IPV6) {
-		hints.ai_family = AF_INET6;
+
+	// One frame being filled, one completed frame waiting in decode, the frame queues full and one frame in each later stage.
+	// The pool never runs dry, a full pipeline waits or drops at the queues instead.
+	int count = 2;
+	for (int i = OUSTER_PIPELINE_DESTAGGER; i < OUSTER_PIPELINE_COUNT; ++i) {
+		ouster_spsc_init(p->queues + i, frames);
+		count += p->queues[i].mask + 2;
 	}
-	if (desc->flags & OUSTER_NET_FLAGS_UDP) {
-		hints.ai_socktype = SOCK_DGRAM;
-		hints.ai_flags = AI_PASSIVE;
+	for (int i = OUSTER_PIPELINE_DESTAGGER; i < OUSTER_PIPELINE_COUNT; ++i) {
+		ouster_spsc_init(p->returns + i, count);
 	}
-	if (desc->flags & OUSTER_NET_FLAGS_TCP) {
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_flags = AI_NUMERICHOST;
+	ouster_frame_pool_init(&p->pool, meta, desc->fields, desc->fcount, count);
+
+	p->range_index = -1;
+	for (int j = 0; j < desc->fcount; ++j) {
+		if ((desc->fields[j].quantity == OUSTER_QUANTITY_RANGE) && (desc->fields[j].depth == 4)) {
+			p->range_index = j;
+		}
 	}
-	int ret = getaddrinfo(desc->hint_name, hint_service, &hints, &info);
-	if (ret != 0) {
-		hints.ai_flags = 0;
-		ret = getaddrinfo(desc->hint_name, hint_service, &hints, &info);
-		if (ret != 0) {
-			ouster_log("getaddrinfo(): %s\n", gai_strerror(ret));
-			goto error;
+	ouster_assert((desc->lut == NULL) || (p->range_index >= 0), "A 4 byte OUSTER_QUANTITY_RANGE field is needed for xyz");
+
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_FIELD);
+	p->outputs = ouster_os_calloc(count * sizeof(ouster_pipeline_frame_t));
+	ouster_assert_notnull(p->outputs);
+	for (int i = 0; i < count; ++i) {
+		ouster_pipeline_frame_t *out = p->outputs + i;
+		out->frame = p->pool.frames + i;
+		if (desc->destagger && (desc->fcount > 0)) {
+			out->destaggered = ouster_os_calloc(desc->fcount * sizeof(ouster_field_t));
+			ouster_assert_notnull(out->destaggered);
+			for (int j = 0; j < desc->fcount; ++j) {
+				out->destaggered[j].quantity = desc->fields[j].quantity;
+				out->destaggered[j].depth = desc->fields[j].depth;
+			}
+			ouster_field_init(out->destaggered, desc->fcount, meta);
+		}
+		if (desc->lut) {
+			out->xyz = ouster_lut_alloc(desc->lut);
 		}
 	}
-	if (info == NULL) {
-		ouster_log("getaddrinfo(): empty result\n");
-		goto error;
+	ouster_os_mem_tag_set(tag);
+
+	for (int i = 0; i < OUSTER_PIPELINE_COUNT; ++i) {
+		int rc = pthread_create(p->threads + i, NULL, pipeline_threads[i], p);
+		if (rc != 0) {
+			ouster_log_error("pthread_create: %s\n", strerror(rc));
+			__atomic_store_n(&p->quit, 1, __ATOMIC_RELEASE);
+			for (int j = 0; j < i; ++j) {
+				pthread_join(p->threads[j], NULL);
+			}
+			pipeline_free(p);
+			return -1;
+		}
 	}
-	return info;
+	return 0;
+}
 
-error:
-	if (info) {
-		ouster_log("freeaddrinfo()\n");
-		freeaddrinfo(info);
+void ouster_pipeline_stop(ouster_pipeline_t *p)
+{
+	ouster_assert_notnull(p);
+	__atomic_store_n(&p->quit, 1, __ATOMIC_RELEASE);
+	for (int i = 0; i < OUSTER_PIPELINE_COUNT; ++i) {
+		pthread_join(p->threads[i], NULL);
 	}
-	return NULL;
+	pipeline_free(p);
 }
 
-int ouster_net_create(ouster_net_sock_desc_t *desc)
+void ouster_pipeline_stats(ouster_pipeline_t *p, ouster_pipeline_stage_t stage, ouster_pipeline_stats_t *stats)
 {
-	ouster_assert_notnull(desc);
+	ouster_assert_notnull(p);
+	ouster_assert_notnull(stats);
+	ouster_assert((stage >= 0) && (stage < OUSTER_PIPELINE_COUNT), "");
+	stats->processed = __atomic_load_n(p->processed + stage, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(p->dropped + stage, __ATOMIC_RELAXED);
+}
 
-	struct addrinfo *info = get_addrinfo(desc);
-	if (info == NULL) {
-		ouster_log("get_addrinfo(): error\n");
-		goto error;
+char const *ouster_pipeline_stage_str(ouster_pipeline_stage_t stage)
+{
+	switch (stage) {
+	case OUSTER_PIPELINE_RECEIVE:
+		return "receive";
+	case OUSTER_PIPELINE_DECODE:
+		return "decode";
+	case OUSTER_PIPELINE_DESTAGGER:
+		return "destagger";
+	case OUSTER_PIPELINE_CARTESIAN:
+		return "cartesian";
+	case OUSTER_PIPELINE_CALLBACK:
+		return "callback";
+	default:
+		return "unknown";
 	}
-	struct addrinfo *ai;
-	int s = -1;
-	for (ai = info; ai != NULL; ai = ai->ai_next) {
-		char buf[INET6_ADDRSTRLEN];
-		inet_ntop_addrinfo(ai, buf, INET6_ADDRSTRLEN);
-		ouster_log("get_addrinfo: %s\n", buf);
+}
+
+#include <unistd.h>
+
+/* Runs jobs of the current generation until there are none left, lock must be held */
+static void work(ouster_pool_t *pool, int worker)
+{
+	while (pool->next < pool->jobs) {
+		int index = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		ouster_trace_begin(t);
+		pool->fn(pool->arg, index, worker);
+		ouster_trace_end(t, "pool_job", index);
+		pthread_mutex_lock(&pool->lock);
+		pool->finished++;
+		if (pool->finished == pool->jobs) {
+			pthread_cond_broadcast(&pool->done);
+		}
 	}
-	for (ai = info; ai != NULL; ai = ai->ai_next) {
-		char buf[INET6_ADDRSTRLEN];
-		inet_ntop_addrinfo(ai, buf, INET6_ADDRSTRLEN);
-		s = try_create_socket(desc, ai);
-		ouster_log("try_create_socket: %s:%i %s%s, socket=%i\n", buf, ouster_net_get_port(s),
-		           (desc->flags & OUSTER_NET_FLAGS_TCP) ? "TCP" : "",
-		           (desc->flags & OUSTER_NET_FLAGS_UDP) ? "UDP" : "",
-		           s);
-		if (s >= 0) {
+}
+
+static void *pool_thread(void *arg)
+{
+	ouster_pool_t *pool = arg;
+	uint64_t generation = 0;
+	ouster_trace_thread_name("pool worker");
+	pthread_mutex_lock(&pool->lock);
+	int worker = pool->started++;
+	while (1) {
+		while ((pool->quit == 0) && (pool->generation == generation)) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->quit) {
 			break;
 		}
+		generation = pool->generation;
+		work(pool, worker);
 	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
 
-	if (s < 0) {
-		ouster_log("try_create_socket(): error\n");
-		goto error;
+int ouster_pool_cpu_count(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+void ouster_pool_init(ouster_pool_t *pool, int count)
+{
+	ouster_assert_notnull(pool);
+	if (count <= 0) {
+		count = ouster_pool_cpu_count();
+	}
+	pool->count = count;
+	pool->fn = NULL;
+	pool->arg = NULL;
+	pool->jobs = 0;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->generation = 0;
+	pool->quit = 0;
+	pool->started = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->threads = ouster_os_calloc(sizeof(pthread_t) * count);
+	ouster_assert_notnull(pool->threads);
+	for (int i = 0; i < (count - 1); ++i) {
+		int rc = pthread_create(pool->threads + i, NULL, pool_thread, pool);
+		ouster_assert(rc == 0, "pthread_create failed: %i", rc);
 	}
+}
 
-	freeaddrinfo(info);
-	return s;
+void ouster_pool_fini(ouster_pool_t *pool)
+{
+	ouster_assert_notnull(pool);
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 0; i < (pool->count - 1); ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	ouster_os_free(pool->threads);
+	pool->threads = NULL;
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+}
 
-error:
-	if (info) {
-		ouster_log("freeaddrinfo()\n");
-		freeaddrinfo(info);
+void ouster_pool_run(ouster_pool_t *pool, ouster_pool_fn_t fn, void *arg, int count)
+{
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(fn);
+	ouster_assert(count >= 0, "");
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->jobs = count;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	// The calling thread is the last worker
+	work(pool, pool->count - 1);
+	while (pool->finished < pool->jobs) {
+		pthread_cond_wait(&pool->done, &pool->lock);
 	}
-	if (s >= 0) {
-		ouster_log("close() socket\n");
-		close(s);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+#include <string.h>
+
+typedef struct
+{
+	int64_t count;
+	int64_t sum;
+	/** Stored as INT64_MAX - min so zero means no samples */
+	int64_t min_inv;
+	int64_t max;
+	int64_t buckets[OUSTER_PROFILE_BUCKETS];
+} profile_stage_t;
+
+static profile_stage_t profile_stages[OUSTER_STAGE_COUNT];
+
+/* Log-linear bucket: values below 16 have their own bucket, above that every power of two has 16 buckets */
+static int profile_bucket(int64_t ns)
+{
+	uint64_t v = (uint64_t)ns;
+	if (v >= ((uint64_t)1 << OUSTER_PROFILE_MAX_BITS)) {
+		return OUSTER_PROFILE_BUCKETS - 1;
 	}
-	return -1;
+	if (v < (1 << OUSTER_PROFILE_SUB_BITS)) {
+		return (int)v;
+	}
+	int e = 63 - __builtin_clzll(v);
+	int shift = e - OUSTER_PROFILE_SUB_BITS;
+	int sub = (int)(v >> shift) & ((1 << OUSTER_PROFILE_SUB_BITS) - 1);
+	return ((shift + 1) << OUSTER_PROFILE_SUB_BITS) + sub;
 }
 
-int64_t ouster_net_read(int sock, char *buf, int len)
+/* Largest value that goes into bucket i */
+static int64_t profile_bucket_upper(int i)
 {
-	ouster_assert(sock >= 0, "");
-	ouster_assert_notnull(buf);
+	if (i < (1 << OUSTER_PROFILE_SUB_BITS)) {
+		return i;
+	}
+	int shift = (i >> OUSTER_PROFILE_SUB_BITS) - 1;
+	int64_t sub = i & ((1 << OUSTER_PROFILE_SUB_BITS) - 1);
+	return ((((int64_t)1 << OUSTER_PROFILE_SUB_BITS) + sub + 1) << shift) - 1;
+}
 
-	int64_t bytes_read = recv(sock, (char *)buf, len, 0);
-	return bytes_read;
+void ouster_profile_record(int stage, int64_t ns)
+{
+	ouster_assert((stage >= 0) && (stage < OUSTER_STAGE_COUNT), "");
+	profile_stage_t *s = profile_stages + stage;
+	ns = ns < 0 ? 0 : ns;
+	__atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->sum, ns, __ATOMIC_RELAXED);
+	__atomic_fetch_add(s->buckets + profile_bucket(ns), 1, __ATOMIC_RELAXED);
+	int64_t min_inv = __atomic_load_n(&s->min_inv, __ATOMIC_RELAXED);
+	while (((INT64_MAX - ns) > min_inv) && !__atomic_compare_exchange_n(&s->min_inv, &min_inv, INT64_MAX - ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	int64_t max = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	while ((ns > max) && !__atomic_compare_exchange_n(&s->max, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
 }
 
-int64_t net_write(int sock, char *buf, int len)
+void ouster_profile_span(int stage, int64_t begin_ns, int64_t end_ns)
 {
-	ouster_assert(sock >= 0, "");
-	ouster_assert_notnull(buf);
+	ouster_unused(stage);
+	ouster_unused(begin_ns);
+	ouster_unused(end_ns);
+#ifdef OUSTER_ENABLE_PROFILE
+	ouster_profile_record(stage, end_ns - begin_ns);
+#endif
+#ifdef OUSTER_ENABLE_TRACE
+	ouster_trace_record(ouster_profile_stage_str(stage), begin_ns, end_ns, -1);
+#endif
+}
 
-	int64_t bytes_read = recv(sock, (char *)buf, len, 0);
-	return bytes_read;
+int64_t ouster_profile_percentile(int stage, double q)
+{
+	ouster_assert((stage >= 0) && (stage < OUSTER_STAGE_COUNT), "");
+	profile_stage_t *s = profile_stages + stage;
+	int64_t total = 0;
+	for (int i = 0; i < OUSTER_PROFILE_BUCKETS; ++i) {
+		total += __atomic_load_n(s->buckets + i, __ATOMIC_RELAXED);
+	}
+	if (total == 0) {
+		return 0;
+	}
+	int64_t rank = (int64_t)(q * (double)total + 0.5);
+	rank = rank < 1 ? 1 : (rank > total ? total : rank);
+	int64_t sum = 0;
+	int i = 0;
+	for (; i < (OUSTER_PROFILE_BUCKETS - 1); ++i) {
+		sum += __atomic_load_n(s->buckets + i, __ATOMIC_RELAXED);
+		if (sum >= rank) {
+			break;
+		}
+	}
+	// The bucket bound can be above the largest sample, the last bucket also holds all larger values
+	int64_t max = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	int64_t upper = (i < (OUSTER_PROFILE_BUCKETS - 1)) ? profile_bucket_upper(i) : max;
+	return upper < max ? upper : max;
 }
 
-/*
-https://stackoverflow.com/questions/5647503/with-a-single-file-descriptor-is-there-any-performance-difference-between-selec
-*/
-uint64_t ouster_net_select(int socks[], int n, const int timeout_sec, const int timeout_usec)
+void ouster_profile_stats(int stage, ouster_profile_stats_t *stats)
 {
-	ouster_assert_notnull(socks);
+	ouster_assert((stage >= 0) && (stage < OUSTER_STAGE_COUNT), "");
+	ouster_assert_notnull(stats);
+	profile_stage_t *s = profile_stages + stage;
+	memset(stats, 0, sizeof(ouster_profile_stats_t));
+	stats->count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+	if (stats->count == 0) {
+		return;
+	}
+	stats->sum_ns = __atomic_load_n(&s->sum, __ATOMIC_RELAXED);
+	stats->min_ns = INT64_MAX - __atomic_load_n(&s->min_inv, __ATOMIC_RELAXED);
+	stats->max_ns = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	stats->mean_ns = stats->sum_ns / stats->count;
+	stats->p50_ns = ouster_profile_percentile(stage, 0.5);
+	stats->p90_ns = ouster_profile_percentile(stage, 0.9);
+	stats->p99_ns = ouster_profile_percentile(stage, 0.99);
+	stats->p999_ns = ouster_profile_percentile(stage, 0.999);
+}
 
-	fd_set rfds;
-	FD_ZERO(&rfds);
-	for (int i = 0; i < n; ++i) {
-		ouster_assert(socks[i] >= 0, "Socket not in range");
-		FD_SET(socks[i], &rfds);
+char const *ouster_profile_stage_str(int stage)
+{
+	switch (stage) {
+	case OUSTER_STAGE_RECEIVE:
+		return "receive";
+	case OUSTER_STAGE_DECODE:
+		return "decode";
+	case OUSTER_STAGE_FRAME:
+		return "frame";
+	case OUSTER_STAGE_DESTAGGER:
+		return "destagger";
+	case OUSTER_STAGE_CARTESIAN:
+		return "cartesian";
+	case OUSTER_STAGE_HANDOFF:
+		return "handoff";
+	default:
+		return "unknown";
 	}
+}
 
-	int max = 0;
-	for (int i = 0; i < n; ++i) {
-		if (socks[i] > max) {
-			max = socks[i];
+void ouster_profile_reset(void)
+{
+	for (int i = 0; i < OUSTER_STAGE_COUNT; ++i) {
+		profile_stage_t *s = profile_stages + i;
+		__atomic_store_n(&s->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->sum, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->min_inv, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->max, 0, __ATOMIC_RELAXED);
+		for (int j = 0; j < OUSTER_PROFILE_BUCKETS; ++j) {
+			__atomic_store_n(s->buckets + j, 0, __ATOMIC_RELAXED);
 		}
 	}
+}
 
-	uint64_t result = 0;
-	struct timeval tv;
-	tv.tv_sec = timeout_sec;
-	tv.tv_usec = timeout_usec;
+#include <math.h>
+#include <string.h>
 
-	int rc = select((int)max + 1, &rfds, NULL, NULL, &tv);
-	if (rc == -1) {
-		ouster_log("select(): error\n");
-		return 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OUSTER_PROJECTION_X86
+#include <immintrin.h>
+#endif
+
+#define PROJECTION_PI ((float)OUSTER_M_PI)
+#define PROJECTION_PI_2 ((float)(OUSTER_M_PI / 2.0))
+
+/* Minimax polynomial of atan on [0, 1], max error about 1e-7 rad */
+#define PROJECTION_ATAN_C0 0.99997726f
+#define PROJECTION_ATAN_C1 -0.33262347f
+#define PROJECTION_ATAN_C2 0.19354346f
+#define PROJECTION_ATAN_C3 -0.11643287f
+#define PROJECTION_ATAN_C4 0.05265332f
+#define PROJECTION_ATAN_C5 -0.01172120f
+
+/* The AVX2 version does the same float operations in the same order so both give the same pixels */
+static inline float projection_atan2(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float mx = ax > ay ? ax : ay;
+	float mn = ax > ay ? ay : ax;
+	float a = mx > 0 ? mn / mx : 0;
+	float s = a * a;
+	float r = (((((PROJECTION_ATAN_C5 * s + PROJECTION_ATAN_C4) * s + PROJECTION_ATAN_C3) * s + PROJECTION_ATAN_C2) * s + PROJECTION_ATAN_C1) * s + PROJECTION_ATAN_C0) * a;
+	r = ay > ax ? PROJECTION_PI_2 - r : r;
+	r = x < 0 ? PROJECTION_PI - r : r;
+	r = y < 0 ? -r : r;
+	return r;
+}
+
+/* Returns pixel index in the destaggered image or -1 */
+static inline int32_t projection_pixel(ouster_projection_t const *proj, float x, float y, float z)
+{
+	float const *m = proj->sensor_to_lidar;
+	float xl = m[0] * x + m[1] * y + m[2] * z + m[3];
+	float yl = m[4] * x + m[5] * y + m[6] * z + m[7];
+	float zl = m[8] * x + m[9] * y + m[10] * z + m[11];
+	float rho2 = xl * xl + yl * yl;
+	float rho = sqrtf(rho2);
+
+	// Row, binary search over altitude edges sorted from top to bottom
+	float phi = projection_atan2(zl - proj->beam_z, rho - proj->beam_x);
+	if (!((phi <= proj->edge[0]) && (phi > proj->edge[proj->h]))) {
+		return -1;
 	}
-	for (int i = 0; i < n; ++i) {
-		if (FD_ISSET(socks[i], &rfds)) {
-			result |= (1 << i);
-		}
+	int pos = 0;
+	for (int step = proj->search_step; step > 0; step >>= 1) {
+		pos += (proj->edge[pos + step] >= phi) ? step : 0;
 	}
+	int row = proj->edge_row[pos];
+
+	// Column, remove the angle the beam origin and beam azimuth offset add to the encoder angle
+	float sa = proj->azimuth_sin[row];
+	float ca = proj->azimuth_cos[row];
+	float b = proj->beam_x;
+	float l2 = rho2 - (b * b) * (sa * sa);
+	float l = sqrtf(l2 > 0 ? l2 : 0) - b * ca;
+	float delta = projection_atan2(l * sa, l * ca + b);
+	float encoder = projection_atan2(yl, xl) - delta;
+	int mid = (int)nearbyintf(encoder * (-(float)proj->columns_per_frame / (2.0f * PROJECTION_PI)));
+	mid += (mid < 0) ? proj->columns_per_frame : 0;
+	mid -= (mid >= proj->columns_per_frame) ? proj->columns_per_frame : 0;
+	int col = mid - proj->mid0;
+	if ((col < 0) || (col >= proj->w)) {
+		return -1;
+	}
+	col += proj->shift[row];
+	col -= (col >= proj->w) ? proj->w : 0;
+	return row * proj->w + col;
+}
 
-	return result;
+#ifdef OUSTER_PROJECTION_X86
+__attribute__((target("avx2"))) static inline __m256 projection_atan2_avx2(__m256 y, __m256 x)
+{
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 ax = _mm256_andnot_ps(sign, x);
+	__m256 ay = _mm256_andnot_ps(sign, y);
+	__m256 mx = _mm256_max_ps(ax, ay);
+	__m256 mn = _mm256_min_ps(ay, ax);
+	__m256 a = _mm256_and_ps(_mm256_div_ps(mn, mx), _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+	__m256 s = _mm256_mul_ps(a, a);
+	__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(PROJECTION_ATAN_C5), s), _mm256_set1_ps(PROJECTION_ATAN_C4));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C3));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C2));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C1));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C0));
+	r = _mm256_mul_ps(r, a);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(PROJECTION_PI_2), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(PROJECTION_PI), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(zero, r), _mm256_cmp_ps(y, zero, _CMP_LT_OQ));
+	return r;
 }
 
-#include <stdio.h>
-#include <stdlib.h>
+__attribute__((target("avx2"))) static void projection_pixels_avx2(ouster_projection_t const *proj, char const *xyz, int xyz_stride, int n, int32_t *pixels)
+{
+	float const *m = proj->sensor_to_lidar;
+	__m256 zero = _mm256_setzero_ps();
+	__m256i w = _mm256_set1_epi32(proj->w);
+	__m256i cpf = _mm256_set1_epi32(proj->columns_per_frame);
+	__m256 scale = _mm256_set1_ps(-(float)proj->columns_per_frame / (2.0f * PROJECTION_PI));
+	__m256 beam_x = _mm256_set1_ps(proj->beam_x);
+	__m256 beam_x2 = _mm256_set1_ps(proj->beam_x * proj->beam_x);
+	// Byte offsets of 8 points, gathering avoids store forwarding stalls of a scalar deinterleave
+	__m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(xyz_stride));
+	int i = 0;
+	for (; (i + 8) <= n; i += 8) {
+		float const *p = (float const *)(xyz + (int64_t)i * xyz_stride);
+		__m256 x = _mm256_i32gather_ps(p + 0, offsets, 1);
+		__m256 y = _mm256_i32gather_ps(p + 1, offsets, 1);
+		__m256 z = _mm256_i32gather_ps(p + 2, offsets, 1);
+		__m256 v[3];
+		for (int j = 0; j < 3; ++j) {
+			__m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[j * 4 + 0]), x), _mm256_mul_ps(_mm256_set1_ps(m[j * 4 + 1]), y));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_set1_ps(m[j * 4 + 2]), z));
+			v[j] = _mm256_add_ps(t, _mm256_set1_ps(m[j * 4 + 3]));
+		}
+		__m256 rho2 = _mm256_add_ps(_mm256_mul_ps(v[0], v[0]), _mm256_mul_ps(v[1], v[1]));
+		__m256 rho = _mm256_sqrt_ps(rho2);
+
+		__m256 phi = projection_atan2_avx2(_mm256_sub_ps(v[2], _mm256_set1_ps(proj->beam_z)), _mm256_sub_ps(rho, beam_x));
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(phi, _mm256_set1_ps(proj->edge[0]), _CMP_LE_OQ), _mm256_cmp_ps(phi, _mm256_set1_ps(proj->edge[proj->h]), _CMP_GT_OQ));
+		__m256i pos = _mm256_setzero_si256();
+		for (int step = proj->search_step; step > 0; step >>= 1) {
+			__m256i cand = _mm256_add_epi32(pos, _mm256_set1_epi32(step));
+			__m256 e = _mm256_i32gather_ps(proj->edge, cand, 4);
+			__m256i ge = _mm256_castps_si256(_mm256_cmp_ps(e, phi, _CMP_GE_OQ));
+			pos = _mm256_add_epi32(pos, _mm256_and_si256(ge, _mm256_set1_epi32(step)));
+		}
+		// Lanes outside the altitude range may have pos beyond the rows
+		pos = _mm256_and_si256(pos, _mm256_castps_si256(inside));
+		__m256i row = _mm256_i32gather_epi32(proj->edge_row, pos, 4);
+
+		__m256 sa = _mm256_i32gather_ps(proj->azimuth_sin, row, 4);
+		__m256 ca = _mm256_i32gather_ps(proj->azimuth_cos, row, 4);
+		__m256 l2 = _mm256_sub_ps(rho2, _mm256_mul_ps(beam_x2, _mm256_mul_ps(sa, sa)));
+		l2 = _mm256_and_ps(l2, _mm256_cmp_ps(l2, zero, _CMP_GT_OQ));
+		__m256 l = _mm256_sub_ps(_mm256_sqrt_ps(l2), _mm256_mul_ps(beam_x, ca));
+		__m256 delta = projection_atan2_avx2(_mm256_mul_ps(l, sa), _mm256_add_ps(_mm256_mul_ps(l, ca), beam_x));
+		__m256 encoder = _mm256_sub_ps(projection_atan2_avx2(v[1], v[0]), delta);
+		__m256i mid = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(encoder, scale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		mid = _mm256_add_epi32(mid, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), mid), cpf));
+		mid = _mm256_sub_epi32(mid, _mm256_andnot_si256(_mm256_cmpgt_epi32(cpf, mid), cpf));
+		__m256i col = _mm256_sub_epi32(mid, _mm256_set1_epi32(proj->mid0));
+		__m256i valid = _mm256_castps_si256(inside);
+		valid = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), col), valid);
+		valid = _mm256_and_si256(_mm256_cmpgt_epi32(w, col), valid);
+		col = _mm256_add_epi32(col, _mm256_i32gather_epi32(proj->shift, row, 4));
+		col = _mm256_sub_epi32(col, _mm256_andnot_si256(_mm256_cmpgt_epi32(w, col), w));
+		__m256i pixel = _mm256_add_epi32(_mm256_mullo_epi32(row, w), col);
+		pixel = _mm256_or_si256(_mm256_and_si256(valid, pixel), _mm256_andnot_si256(valid, _mm256_set1_epi32(-1)));
+		_mm256_storeu_si256((__m256i *)(pixels + i), pixel);
+	}
+	for (; i < n; ++i) {
+		float const *p = (float const *)(xyz + (int64_t)i * xyz_stride);
+		pixels[i] = projection_pixel(proj, p[0], p[1], p[2]);
+	}
+}
+#endif
+
+void ouster_projection_init(ouster_projection_t *proj, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(proj);
+	ouster_assert_notnull(meta);
+	int h = meta->pixels_per_column;
+	ouster_assert(meta->midw > 0, "");
+	ouster_assert(h > 0, "");
+	ouster_assert(h <= OUSTER_MAX_ROWS, "");
+
+	memset(proj, 0, sizeof(ouster_projection_t));
+	proj->w = meta->midw;
+	proj->h = h;
+	proj->mid0 = meta->mid0;
+	proj->columns_per_frame = meta->columns_per_frame;
+	proj->beam_x = (float)meta->beam_to_lidar_transform[OUSTER_M4(0, 3)];
+	proj->beam_z = (float)meta->beam_to_lidar_transform[OUSTER_M4(2, 3)];
+
+	// Inverse of the rigid lidar_to_sensor_transform, the rotation is transposed
+	double const *t = meta->lidar_to_sensor_transform;
+	for (int j = 0; j < 3; ++j) {
+		double translation = 0;
+		for (int k = 0; k < 3; ++k) {
+			proj->sensor_to_lidar[j * 4 + k] = (float)(t[OUSTER_M4(k, j)] * 1000.0);
+			translation -= t[OUSTER_M4(k, j)] * t[OUSTER_M4(k, 3)];
+		}
+		proj->sensor_to_lidar[j * 4 + 3] = (float)translation;
+	}
+
+	// Sort beams by altitude from top to bottom, insertion sort keeps equal beams in row order
+	double altitude[OUSTER_MAX_ROWS];
+	for (int r = 0; r < h; ++r) {
+		int k = r;
+		double a = meta->beam_altitude_angles[r] * OUSTER_M_PI / 180.0;
+		for (; (k > 0) && (altitude[k - 1] < a); --k) {
+			altitude[k] = altitude[k - 1];
+			proj->edge_row[k] = proj->edge_row[k - 1];
+		}
+		altitude[k] = a;
+		proj->edge_row[k] = r;
+	}
+
+	// Edges halfway between beams, the outer edges are half a beam spacing outside
+	double outer = (h > 1) ? (altitude[0] - altitude[h - 1]) / (2.0 * (h - 1)) : (OUSTER_M_PI / 360.0);
+	proj->edge[0] = (float)(altitude[0] + outer);
+	for (int k = 1; k < h; ++k) {
+		proj->edge[k] = (float)((altitude[k - 1] + altitude[k]) / 2.0);
+	}
+	proj->edge[h] = (float)(altitude[h - 1] - outer);
+	// First step of the binary search, half the smallest power of two that holds all h + 1 edges
+	proj->search_step = 1;
+	while ((proj->search_step * 2) < (h + 1)) {
+		proj->search_step *= 2;
+	}
+	for (int k = h + 1; k < OUSTER_PROJECTION_EDGES; ++k) {
+		proj->edge[k] = -INFINITY;
+	}
 
-ouster_os_api_t ouster_os_api;
-int64_t ouster_os_api_malloc_count = 0;
-int64_t ouster_os_api_realloc_count = 0;
-int64_t ouster_os_api_calloc_count = 0;
-int64_t ouster_os_api_free_count = 0;
+	for (int r = 0; r < h; ++r) {
+		double azimuth = -meta->beam_azimuth_angles[r] * OUSTER_M_PI / 180.0;
+		proj->azimuth_sin[r] = (float)sin(azimuth);
+		proj->azimuth_cos[r] = (float)cos(azimuth);
+		proj->shift[r] = ((meta->pixel_shift_by_row[r] % proj->w) + proj->w) % proj->w;
+	}
+}
 
-static void *ouster_os_api_calloc(size_t size)
+int ouster_projection_pixel(ouster_projection_t const *proj, float const xyz[3], int *row, int *col)
 {
-	ouster_os_api_calloc_count++;
-	return calloc(1, (size_t)size);
+	ouster_assert_notnull(proj);
+	ouster_assert_notnull(xyz);
+	ouster_assert_notnull(row);
+	ouster_assert_notnull(col);
+	int32_t pixel = projection_pixel(proj, xyz[0], xyz[1], xyz[2]);
+	if (pixel < 0) {
+		return 0;
+	}
+	*row = pixel / proj->w;
+	*col = pixel % proj->w;
+	return 1;
 }
 
-static void *ouster_os_api_malloc(size_t size)
+void ouster_projection_pixels(ouster_projection_t const *proj, void const *xyz, int xyz_stride, int n, int32_t *pixels)
 {
-	ouster_os_api_malloc_count++;
-	return malloc((size_t)size);
+	ouster_assert_notnull(proj);
+	ouster_assert_notnull(xyz);
+	ouster_assert_notnull(pixels);
+#ifdef OUSTER_PROJECTION_X86
+	if (__builtin_cpu_supports("avx2")) {
+		projection_pixels_avx2(proj, xyz, xyz_stride, n, pixels);
+		return;
+	}
+#endif
+	char const *p8 = xyz;
+	for (int i = 0; i < n; ++i, p8 += xyz_stride) {
+		float const *p = (float const *)p8;
+		pixels[i] = projection_pixel(proj, p[0], p[1], p[2]);
+	}
 }
 
-static void ouster_os_api_free(void *ptr)
+#include <string.h>
+
+void ouster_spsc_init(ouster_spsc_t *q, int capacity)
 {
-	ouster_os_api_free_count++;
-	free(ptr);
+	ouster_assert_notnull(q);
+	ouster_assert(capacity > 0, "");
+	uint64_t n = 1;
+	while (n < (uint64_t)capacity) {
+		n <<= 1;
+	}
+	memset(q, 0, sizeof(ouster_spsc_t));
+	q->items = ouster_os_calloc(n * sizeof(void *));
+	ouster_assert_notnull(q->items);
+	q->mask = n - 1;
 }
 
-static void * ouster_os_api_realloc(void *ptr, size_t size)
+void ouster_spsc_fini(ouster_spsc_t *q)
 {
-	ouster_os_api_realloc_count++;
-	return realloc(ptr, size);
+	ouster_assert_notnull(q);
+	ouster_os_free(q->items);
+	memset(q, 0, sizeof(ouster_spsc_t));
 }
 
-static void ouster_log_msg(int32_t level, const char *file, int32_t line, const char *msg)
+int ouster_spsc_push(ouster_spsc_t *q, void *item)
 {
-	FILE *stream;
-	if (level >= 0) {
-		stream = stdout;
-	} else {
-		stream = stderr;
+	ouster_assert_notnull(q);
+	ouster_assert_notnull(item);
+	uint64_t head = q->head;
+	if ((head - q->tail_cache) > q->mask) {
+		// Only read the consumer index when the cached one says full
+		q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		if ((head - q->tail_cache) > q->mask) {
+			return -1;
+		}
 	}
-	fputs(msg, stream);
-	//fputs("\n", stream);
+	__atomic_store_n(q->items + (head & q->mask), item, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
 }
 
-void ouster_os_set_api_defaults(void)
+void *ouster_spsc_pop(ouster_spsc_t *q)
 {
-	/* Memory management */
-	ouster_os_api.malloc_ = ouster_os_api_malloc;
-	ouster_os_api.free_ = ouster_os_api_free;
-	ouster_os_api.realloc_ = ouster_os_api_realloc;
-	ouster_os_api.calloc_ = ouster_os_api_calloc;
+	ouster_assert_notnull(q);
+	uint64_t tail = q->tail;
+	if (tail == q->head_cache) {
+		q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		if (tail == q->head_cache) {
+			return NULL;
+		}
+	}
+	void *item = __atomic_load_n(q->items + (tail & q->mask), __ATOMIC_RELAXED);
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	return item;
+}
 
-	/* Logging */
-	ouster_os_api.log_level_ = -1;
-	ouster_os_api.log_ = ouster_log_msg;
+void *ouster_mailbox_put(ouster_mailbox_t *mb, void *item)
+{
+	ouster_assert_notnull(mb);
+	ouster_assert_notnull(item);
+	return __atomic_exchange_n(&mb->item, item, __ATOMIC_ACQ_REL);
+}
 
-	ouster_os_api.abort_ = abort;
+void *ouster_mailbox_take(ouster_mailbox_t *mb)
+{
+	ouster_assert_notnull(mb);
+	// Cheap check first so polling an empty mailbox does not write the cache line
+	if (__atomic_load_n(&mb->item, __ATOMIC_RELAXED) == NULL) {
+		return NULL;
+	}
+	return __atomic_exchange_n(&mb->item, NULL, __ATOMIC_ACQ_REL);
 }
 #include <stddef.h>
 
@@ -2188,9 +6743,155 @@ int ouster_sock_create_tcp(char const *hint_name, int port)
 }
 
 
+#include <string.h>
+
+/* Slots are written field by field with atomics, seq is n + 1 once event n is complete */
+typedef struct
+{
+	uint64_t seq;
+	char const *name;
+	int64_t begin;
+	int64_t end;
+	int64_t arg;
+	int32_t tid;
+} trace_event_t;
+
+typedef struct
+{
+	trace_event_t *events;
+	uint64_t capacity;
+	uint64_t next;
+	int64_t start_ns;
+} trace_t;
+
+static trace_t trace;
+static char const *trace_thread_names[OUSTER_TRACE_MAX_THREADS];
+static int trace_thread_count;
+static __thread int trace_tid;
+
+static int trace_tid_get(void)
+{
+	if (trace_tid == 0) {
+		trace_tid = __atomic_add_fetch(&trace_thread_count, 1, __ATOMIC_RELAXED);
+	}
+	return trace_tid;
+}
+
+int ouster_trace_start(int capacity)
+{
+	ouster_assert(capacity > 0, "");
+	ouster_trace_stop();
+	trace_event_t *events = ouster_os_calloc((size_t)capacity * sizeof(trace_event_t));
+	if (events == NULL) {
+		return -1;
+	}
+	trace.capacity = (uint64_t)capacity;
+	trace.next = 0;
+	trace.start_ns = ouster_os_clock_ns();
+	__atomic_store_n(&trace.events, events, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void ouster_trace_stop(void)
+{
+	trace_event_t *events = __atomic_exchange_n(&trace.events, NULL, __ATOMIC_ACQ_REL);
+	ouster_os_free(events);
+}
+
+void ouster_trace_record(char const *name, int64_t begin_ns, int64_t end_ns, int64_t arg)
+{
+	trace_event_t *events = __atomic_load_n(&trace.events, __ATOMIC_ACQUIRE);
+	if (events == NULL) {
+		return;
+	}
+	uint64_t n = __atomic_fetch_add(&trace.next, 1, __ATOMIC_RELAXED);
+	trace_event_t *e = events + (n % trace.capacity);
+	__atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&e->name, name, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->begin, begin_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->end, end_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->arg, arg, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->tid, trace_tid_get(), __ATOMIC_RELAXED);
+	__atomic_store_n(&e->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+void ouster_trace_thread_name_(char const *name)
+{
+	int tid = trace_tid_get();
+	if (tid < OUSTER_TRACE_MAX_THREADS) {
+		__atomic_store_n(trace_thread_names + tid, name, __ATOMIC_RELAXED);
+	}
+}
+
+/* Copies event n, returns 0 when it is being written or was overwritten */
+static int trace_read(trace_event_t const *events, uint64_t n, trace_event_t *out)
+{
+	trace_event_t const *e = events + (n % trace.capacity);
+	if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != (n + 1)) {
+		return 0;
+	}
+	out->name = __atomic_load_n(&e->name, __ATOMIC_RELAXED);
+	out->begin = __atomic_load_n(&e->begin, __ATOMIC_RELAXED);
+	out->end = __atomic_load_n(&e->end, __ATOMIC_RELAXED);
+	out->arg = __atomic_load_n(&e->arg, __ATOMIC_RELAXED);
+	out->tid = __atomic_load_n(&e->tid, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == (n + 1);
+}
+
+int ouster_trace_dump(FILE *f)
+{
+	ouster_assert_notnull(f);
+	trace_event_t const *events = __atomic_load_n(&trace.events, __ATOMIC_ACQUIRE);
+	int count = 0;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	int threads = __atomic_load_n(&trace_thread_count, __ATOMIC_RELAXED);
+	threads = threads < (OUSTER_TRACE_MAX_THREADS - 1) ? threads : (OUSTER_TRACE_MAX_THREADS - 1);
+	for (int tid = 1; tid <= threads; ++tid) {
+		char const *name = __atomic_load_n(trace_thread_names + tid, __ATOMIC_RELAXED);
+		if (name) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}", count ? ",\n" : "", tid, name);
+			count++;
+		}
+	}
+	int written = 0;
+	if (events) {
+		uint64_t end = __atomic_load_n(&trace.next, __ATOMIC_ACQUIRE);
+		uint64_t n = end > trace.capacity ? (end - trace.capacity) : 0;
+		for (; n < end; ++n) {
+			trace_event_t e;
+			if (trace_read(events, n, &e) == 0) {
+				continue;
+			}
+			// Timestamps are microseconds since ouster_trace_start()
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f",
+			        count ? ",\n" : "",
+			        e.name,
+			        (int)e.tid,
+			        (double)(e.begin - trace.start_ns) / 1000.0,
+			        (double)(e.end - e.begin) / 1000.0);
+			if (e.arg >= 0) {
+				fprintf(f, ",\"args\":{\"arg\":%ji}", (intmax_t)e.arg);
+			}
+			fprintf(f, "}");
+			count++;
+			written++;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	return written;
+}
+
+#include <dirent.h>
 #include <endian.h>
 #include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <unistd.h>
+
+#define OUSTER_UDPCAP_FLUSH_NS INT64_C(1000000000)
 
 
 /*
@@ -2250,11 +6951,79 @@ int ouster_udpcap_sendto(ouster_udpcap_t *cap, int sock, ouster_net_addr_t *addr
 	return rc;
 }
 
+int ouster_udpcap_sendmmsg(ouster_udpcap_t *caps[], int n, int sock, ouster_net_addr_t *addr)
+{
+	ouster_assert_notnull(caps);
+	ouster_assert(n >= 0, "");
+	ouster_assert(sock >= 0, "");
+	ouster_assert_notnull(addr);
+
+	ouster_net_addr_t addrs[OUSTER_NET_SENDMMSG_MAX];
+	ouster_net_msg_t msgs[OUSTER_NET_SENDMMSG_MAX];
+	int sent = 0;
+	while (sent < n) {
+		int count = n - sent;
+		count = (count > OUSTER_NET_SENDMMSG_MAX) ? OUSTER_NET_SENDMMSG_MAX : count;
+		for (int i = 0; i < count; ++i) {
+			ouster_udpcap_t *cap = caps[sent + i];
+			// Send UDP content to the the same port as the capture
+			addrs[i] = *addr;
+			ouster_net_addr_set_port(addrs + i, cap->port);
+			msgs[i].buf = cap->buf;
+			msgs[i].size = cap->size;
+			msgs[i].addr = addrs + i;
+		}
+		int rc = ouster_net_sendmmsg(sock, msgs, count, 0);
+		if (rc < 0) {
+			return sent ? sent : -1;
+		}
+		sent += rc;
+		if (rc < count) {
+			break;
+		}
+	}
+	return sent;
+}
+
 void ouster_udpcap_set_port(ouster_udpcap_t *cap, int port)
 {
 	ouster_assert_notnull(cap);
 
-	cap->port = htole32(port);
+	cap->port = port;
+}
+
+int ouster_udpcap_recv(ouster_udpcap_t *cap, int sock)
+{
+	ouster_assert_notnull(cap);
+	ouster_assert(sock >= 0, "");
+
+	int64_t n = ouster_net_read(sock, cap->buf, cap->size);
+	if (n <= 0) {
+		return OUSTER_UDPCAP_ERROR_RECV;
+	}
+	if (n > cap->size) {
+		return OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL;
+	}
+	cap->size = n;
+	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_write(ouster_udpcap_t const *cap, FILE *f)
+{
+	ouster_assert_notnull(cap);
+	ouster_assert_notnull(f);
+
+	// Convert host to little endian
+	ouster_udpcap_t header;
+	header.port = htole32(cap->port);
+	header.size = htole32(cap->size);
+	if (fwrite(&header, sizeof(ouster_udpcap_t), 1, f) != 1) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	if (cap->size && (fwrite(cap->buf, cap->size, 1, f) != 1)) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	return OUSTER_UDPCAP_OK;
 }
 
 int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f)
@@ -2263,29 +7032,447 @@ int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f)
 	ouster_assert(sock >= 0, "");
 	ouster_assert_notnull(f);
 
-	int64_t write_size;
+	int rc = ouster_udpcap_recv(cap, sock);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+	return ouster_udpcap_write(cap, f);
+}
 
-	{
-		int64_t n = ouster_net_read(sock, cap->buf, cap->size);
-		if (n <= 0) {
-			return OUSTER_UDPCAP_ERROR_RECV;
+static int footer_write(ouster_udpcap_footer_t const *footer, FILE *f)
+{
+	ouster_udpcap_footer_t le;
+	le.magic = htole32(footer->magic);
+	le.segment = htole32(footer->segment);
+	le.records = htole64(footer->records);
+	le.bytes = htole64(footer->bytes);
+	le.t_open = htole64(footer->t_open);
+	le.t_close = htole64(footer->t_close);
+	ouster_udpcap_t header;
+	header.port = htole32(OUSTER_UDPCAP_PORT_FOOTER);
+	header.size = htole32(sizeof(ouster_udpcap_footer_t));
+	if (fwrite(&header, sizeof(ouster_udpcap_t), 1, f) != 1) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	if (fwrite(&le, sizeof(ouster_udpcap_footer_t), 1, f) != 1) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	return OUSTER_UDPCAP_OK;
+}
+
+static int footer_parse(ouster_udpcap_t const *cap, ouster_udpcap_footer_t *footer)
+{
+	if (cap->port != OUSTER_UDPCAP_PORT_FOOTER || cap->size != sizeof(ouster_udpcap_footer_t)) {
+		return 0;
+	}
+	ouster_udpcap_footer_t le;
+	memcpy(&le, cap->buf, sizeof(ouster_udpcap_footer_t));
+	if (le32toh(le.magic) != OUSTER_UDPCAP_FOOTER_MAGIC) {
+		return 0;
+	}
+	footer->magic = le32toh(le.magic);
+	footer->segment = le32toh(le.segment);
+	footer->records = le64toh(le.records);
+	footer->bytes = le64toh(le.bytes);
+	footer->t_open = le64toh(le.t_open);
+	footer->t_close = le64toh(le.t_close);
+	return 1;
+}
+
+int ouster_udpcap_recover(char const *filename, int segment, ouster_udpcap_footer_t *footer)
+{
+	ouster_assert_notnull(filename);
+
+	FILE *f = fopen(filename, "r+b");
+	if (f == NULL) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	fseeko(f, 0, SEEK_END);
+	int64_t end = ftello(f);
+	rewind(f);
+
+	ouster_udpcap_footer_t found = {0};
+	int64_t pos = 0;
+	int64_t records = 0;
+	int has_footer = 0;
+	while (pos < end) {
+		ouster_udpcap_t header;
+		if (fread(&header, sizeof(ouster_udpcap_t), 1, f) != 1) {
+			break;
 		}
-		if (n > cap->size) {
-			return OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL;
+		uint32_t port = le32toh(header.port);
+		uint32_t size = le32toh(header.size);
+		int64_t next = pos + (int64_t)sizeof(ouster_udpcap_t) + size;
+		// Zero filled or torn tail after power loss
+		if (size == 0 || size > OUSTER_NET_UDP_MAX_SIZE || next > end) {
+			break;
+		}
+		if (port == OUSTER_UDPCAP_PORT_FOOTER && next == end) {
+			char buf[sizeof(ouster_udpcap_t) + sizeof(ouster_udpcap_footer_t)];
+			ouster_udpcap_t *cap = (void *)buf;
+			cap->port = port;
+			cap->size = size;
+			if (fread(cap->buf, size, 1, f) == 1 && footer_parse(cap, &found)) {
+				has_footer = 1;
+				break;
+			}
+		}
+		if (fseeko(f, next, SEEK_SET)) {
+			break;
 		}
-		cap->size = htole32(n);
-		write_size = sizeof(ouster_udpcap_t) + n;
+		pos = next;
+		records++;
 	}
 
-	{
-		size_t n = fwrite((void *)cap, write_size, 1, f);
-		if (n != 1) {
-			return OUSTER_UDPCAP_ERROR_FWRITE;
+	int rc = OUSTER_UDPCAP_OK;
+	if (has_footer == 0) {
+		if (pos < end) {
+			ouster_log("%s: truncating incomplete record at %ji of %ji bytes\n", filename, (intmax_t)pos, (intmax_t)end);
+			fflush(f);
+			if (ftruncate(fileno(f), pos)) {
+				rc = OUSTER_UDPCAP_ERROR_FWRITE;
+			}
+		}
+		found.magic = OUSTER_UDPCAP_FOOTER_MAGIC;
+		found.segment = segment;
+		found.records = records;
+		found.bytes = pos;
+		fseeko(f, pos, SEEK_SET);
+		if (rc == OUSTER_UDPCAP_OK) {
+			rc = footer_write(&found, f);
+		}
+		fflush(f);
+		fsync(fileno(f));
+	}
+	fclose(f);
+	if (footer) {
+		*footer = found;
+	}
+	return rc;
+}
+
+/* Finds the first and last existing segment number of a segmented capture */
+static int segment_scan(char const *path, int *first, int *last)
+{
+	char dirname[OUSTER_UDPCAP_PATH_MAX];
+	char const *slash = strrchr(path, '/');
+	char const *basename = slash ? slash + 1 : path;
+	if (slash) {
+		snprintf(dirname, sizeof(dirname), "%.*s", (int)(slash - path + 1), path);
+	} else {
+		snprintf(dirname, sizeof(dirname), ".");
+	}
+	DIR *dir = opendir(dirname);
+	if (dir == NULL) {
+		return 0;
+	}
+	int count = 0;
+	size_t len = strlen(basename);
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		char const *name = entry->d_name;
+		if (strncmp(name, basename, len) || name[len] != '.') {
+			continue;
+		}
+		char *end;
+		long segment = strtol(name + len + 1, &end, 10);
+		if (end == name + len + 1 || *end != '\0' || segment < 0) {
+			continue;
+		}
+		*first = (count == 0 || segment < *first) ? (int)segment : *first;
+		*last = (count == 0 || segment > *last) ? (int)segment : *last;
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+static int writer_open_segment(ouster_udpcap_writer_t *w)
+{
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	if (w->segmented) {
+		snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, w->path, w->segment);
+	} else {
+		snprintf(filename, sizeof(filename), "%s", w->path);
+	}
+	ouster_log("Opening capture segment '%s'\n", filename);
+	w->file = fopen(filename, "wb");
+	if (w->file == NULL) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	w->bytes = 0;
+	w->records = 0;
+	w->t_open = ouster_os_clock_ns();
+	w->t_flush = w->t_open;
+	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_writer_open(ouster_udpcap_writer_t *w, char const *path, int64_t max_bytes, int64_t max_ns)
+{
+	ouster_assert_notnull(w);
+	ouster_assert_notnull(path);
+	ouster_assert(max_bytes >= 0, "");
+	ouster_assert(max_ns >= 0, "");
+
+	memset(w, 0, sizeof(ouster_udpcap_writer_t));
+	snprintf(w->path, sizeof(w->path), "%s", path);
+	w->max_bytes = max_bytes;
+	w->max_ns = max_ns;
+	w->segmented = (max_bytes > 0) || (max_ns > 0);
+
+	if (w->segmented) {
+		int first;
+		int last;
+		if (segment_scan(path, &first, &last) > 0) {
+			// Continue after a previous capture, which might have been interrupted
+			char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+			snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, path, last);
+			ouster_udpcap_recover(filename, last, NULL);
+			w->segment = last + 1;
+		}
+	}
+
+	return writer_open_segment(w);
+}
+
+static int writer_close_segment(ouster_udpcap_writer_t *w)
+{
+	if (w->file == NULL) {
+		return OUSTER_UDPCAP_OK;
+	}
+	ouster_udpcap_footer_t footer = {
+	    .magic = OUSTER_UDPCAP_FOOTER_MAGIC,
+	    .segment = w->segment,
+	    .records = w->records,
+	    .bytes = w->bytes,
+	    .t_open = w->t_open,
+	    .t_close = ouster_os_clock_ns()};
+	int rc = footer_write(&footer, w->file);
+	if (fflush(w->file) || fsync(fileno(w->file))) {
+		rc = OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	fclose(w->file);
+	w->file = NULL;
+	return rc;
+}
+
+static int writer_write(ouster_udpcap_writer_t *w, ouster_udpcap_t const *cap)
+{
+	int rc;
+	int64_t size = sizeof(ouster_udpcap_t) + cap->size;
+	int64_t now = ouster_os_clock_ns();
+
+	if (w->segmented && (w->records > 0)) {
+		int full = (w->max_bytes > 0) && ((w->bytes + size) > w->max_bytes);
+		int expired = (w->max_ns > 0) && ((now - w->t_open) >= w->max_ns);
+		if (full || expired) {
+			rc = writer_close_segment(w);
+			if (rc != OUSTER_UDPCAP_OK) {
+				return rc;
+			}
+			w->segment++;
+		}
+	}
+
+	if (w->file == NULL) {
+		rc = writer_open_segment(w);
+		if (rc != OUSTER_UDPCAP_OK) {
+			return rc;
 		}
 	}
 
+	rc = ouster_udpcap_write(cap, w->file);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+	w->bytes += size;
+	w->records++;
+
+	// Bound the amount of data lost if the process dies
+	if ((now - w->t_flush) >= OUSTER_UDPCAP_FLUSH_NS) {
+		fflush(w->file);
+		w->t_flush = now;
+	}
+
+	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_writer_write(ouster_udpcap_writer_t *w, ouster_udpcap_t const *cap)
+{
+	ouster_assert_notnull(w);
+	ouster_assert_notnull(cap);
+	ouster_trace_begin(t);
+	int rc = writer_write(w, cap);
+	ouster_trace_end(t, "udpcap_write", -1);
+	return rc;
+}
+
+int ouster_udpcap_writer_close(ouster_udpcap_writer_t *w)
+{
+	ouster_assert_notnull(w);
+	return writer_close_segment(w);
+}
+
+static int reader_open_segment(ouster_udpcap_reader_t *r)
+{
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, r->path, r->segment);
+	r->file = fopen(filename, "rb");
+	if (r->file == NULL) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
 	return OUSTER_UDPCAP_OK;
 }
+
+int ouster_udpcap_reader_open(ouster_udpcap_reader_t *r, char const *path)
+{
+	ouster_assert_notnull(r);
+	ouster_assert_notnull(path);
+
+	memset(r, 0, sizeof(ouster_udpcap_reader_t));
+	snprintf(r->path, sizeof(r->path), "%s", path);
+
+	r->file = fopen(path, "rb");
+	if (r->file) {
+		return OUSTER_UDPCAP_OK;
+	}
+
+	if (segment_scan(path, &r->segment, &r->last) == 0) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	r->segmented = 1;
+	return reader_open_segment(r);
+}
+
+static void reader_next_segment(ouster_udpcap_reader_t *r)
+{
+	fclose(r->file);
+	r->file = NULL;
+	if (r->segmented == 0) {
+		return;
+	}
+	// A gap in the segment numbers does not end the capture
+	while (r->segment < r->last) {
+		r->segment++;
+		if (reader_open_segment(r) == OUSTER_UDPCAP_OK) {
+			return;
+		}
+		ouster_log("%s: segment %i is missing\n", r->path, r->segment);
+		r->missing++;
+	}
+}
+
+static int reader_read(ouster_udpcap_reader_t *r, ouster_udpcap_t *cap)
+{
+	uint32_t maxsize = cap->size;
+	while (r->file) {
+		// Distinguish end of segment from an incomplete record
+		int c = fgetc(r->file);
+		if (c == EOF) {
+			reader_next_segment(r);
+			continue;
+		}
+		ungetc(c, r->file);
+
+		cap->size = maxsize;
+		int rc = ouster_udpcap_read(cap, r->file);
+		if (rc == OUSTER_UDPCAP_OK) {
+			if (cap->port == OUSTER_UDPCAP_PORT_FOOTER) {
+				footer_parse(cap, &r->footer);
+				continue;
+			}
+			return OUSTER_UDPCAP_OK;
+		}
+		if ((rc == OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL) && (cap->size <= OUSTER_NET_UDP_MAX_SIZE)) {
+			return rc;
+		}
+		// The rest of the segment is unreadable, continue with next segment
+		ouster_log("%s: segment %i is truncated\n", r->path, r->segment);
+		r->truncated++;
+		reader_next_segment(r);
+	}
+	return OUSTER_UDPCAP_ERROR_EOF;
+}
+
+int ouster_udpcap_reader_read(ouster_udpcap_reader_t *r, ouster_udpcap_t *cap)
+{
+	ouster_assert_notnull(r);
+	ouster_assert_notnull(cap);
+	ouster_trace_begin(t);
+	int rc = reader_read(r, cap);
+	ouster_trace_end(t, "udpcap_read", -1);
+	return rc;
+}
+
+void ouster_udpcap_reader_close(ouster_udpcap_reader_t *r)
+{
+	ouster_assert_notnull(r);
+	if (r->file) {
+		fclose(r->file);
+		r->file = NULL;
+	}
+}
+
+int test_ouster_udpcap(char const *path)
+{
+	int const count = 1100;
+	int const per_segment = 100;
+	int const removed = 5;
+	uint32_t const size = 64;
+	ouster_udpcap_t *cap = ouster_os_malloc(sizeof(ouster_udpcap_t) + OUSTER_NET_UDP_MAX_SIZE);
+	ouster_assert_notnull(cap);
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	int ok = 1;
+
+	ouster_udpcap_writer_t w;
+	int rc = ouster_udpcap_writer_open(&w, path, per_segment * (sizeof(ouster_udpcap_t) + size), 0);
+	ok &= (rc == OUSTER_UDPCAP_OK);
+	for (int i = 0; (i < count) && ok; ++i) {
+		memset(cap->buf, 0, size);
+		memcpy(cap->buf, &i, sizeof(i));
+		cap->port = 7502;
+		cap->size = size;
+		ok &= (ouster_udpcap_writer_write(&w, cap) == OUSTER_UDPCAP_OK);
+	}
+	ok &= (ouster_udpcap_writer_close(&w) == OUSTER_UDPCAP_OK);
+	int last = w.segment;
+
+	snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, path, removed);
+	ok &= (remove(filename) == 0);
+
+	ouster_udpcap_reader_t r;
+	rc = ouster_udpcap_reader_open(&r, path);
+	ok &= (rc == OUSTER_UDPCAP_OK);
+	int expect = 0;
+	int records = 0;
+	while (ok) {
+		cap->size = OUSTER_NET_UDP_MAX_SIZE;
+		rc = ouster_udpcap_reader_read(&r, cap);
+		if (rc != OUSTER_UDPCAP_OK) {
+			break;
+		}
+		if (expect == removed * per_segment) {
+			expect += per_segment;
+		}
+		int i;
+		memcpy(&i, cap->buf, sizeof(i));
+		ok &= (cap->size == size) && (i == expect);
+		expect++;
+		records++;
+	}
+	ouster_udpcap_reader_close(&r);
+	ok &= (rc == OUSTER_UDPCAP_ERROR_EOF);
+	ok &= (records == count - per_segment);
+	ok &= (r.missing == 1) && (r.truncated == 0);
+
+	for (int s = 0; s <= last; ++s) {
+		snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, path, s);
+		remove(filename);
+	}
+	ouster_os_free(cap);
+	ouster_assert(ok, "");
+	return ok;
+}
 #include <string.h>
 #include <stdint.h>
 
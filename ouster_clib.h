@@ -70,6 +70,21 @@
 #undef OUSTER_ENABLE_LOG
 #endif
 
+/** \def OUSTER_LOG_MAX_LEVEL
+ * Log calls with a level above this are removed at compile time, see OUSTER_LOG_LEVEL_ERROR
+ */
+#ifndef OUSTER_LOG_MAX_LEVEL
+#define OUSTER_LOG_MAX_LEVEL 1
+#endif
+
+/** \def OUSTER_ENABLE_PROFILE
+ * Record latency histograms of the pipeline stages, see ouster_profile.h. Not defined by default
+ */
+
+/** \def OUSTER_ENABLE_TRACE
+ * Record begin and end events of the pipeline stages, see ouster_trace.h. Not defined by default
+ */
+
 /** @} */ // end of options
 
 /** @} */ // end of core
@@ -92,20 +107,72 @@ extern "C" {
 #endif
 
 
+/** Log levels, messages with a level above ouster_os_api_t::log_level_ are skipped */
+#define OUSTER_LOG_LEVEL_ERROR -3
+#define OUSTER_LOG_LEVEL_WARN -2
+#define OUSTER_LOG_LEVEL_INFO 0
+#define OUSTER_LOG_LEVEL_DEBUG 1
+
+#ifndef OUSTER_LOG_MAX_LEVEL
+#define OUSTER_LOG_MAX_LEVEL OUSTER_LOG_LEVEL_DEBUG
+#endif
+
+/** Max number of living threads that can log while the asynchronous logger runs, a thread gives its ring back when it exits */
+#define OUSTER_LOG_ASYNC_THREADS 32
+
+/** Size of the record ring of every logging thread */
+#define OUSTER_LOG_ASYNC_RING_SIZE (64 * 1024)
+
 int32_t ouster_log_set_level(int32_t level);
 
+/** Starts a background thread that formats and writes log messages.
+ * Until ouster_log_async_stop() every log call only copies the format pointer and its arguments
+ * into a lock-free ring of the calling thread, it never blocks, allocates or formats.
+ * String arguments are copied, up to OUSTER_LOG_ASYNC_STRING_MAX bytes each.
+ * Messages are dropped when the ring is full, see ouster_log_async_dropped().
+ * The format string must be a literal or otherwise outlive the logger.
+ *
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_log_async_start(void);
+
+/** Writes all pending messages and stops the background thread, logging is synchronous again.
+ * Other threads must not log while this is called.
+ */
+void ouster_log_async_stop(void);
+
+/** Number of messages dropped because a ring was full or too many threads logged */
+int64_t ouster_log_async_dropped(void);
+
+/** Strings are truncated to this many bytes in asynchronous mode */
+#define OUSTER_LOG_ASYNC_STRING_MAX 128
+
 /** Logging */
 #ifdef OUSTER_ENABLE_LOG
 void ouster_log_(int32_t level, char const * file, int32_t line, char const *fmt, ...);
 void ouster_log_m4_(double const a[16]);
 void ouster_log_m3_(double const a[9]);
 void ouster_log_v3_(double const a[3]);
-#define ouster_log(...) ouster_log_(0, __FILE__, __LINE__, __VA_ARGS__)
+/* The level is a constant so calls above OUSTER_LOG_MAX_LEVEL are removed by the compiler */
+#define ouster_log_level(level, ...)                                  \
+	do {                                                              \
+		if ((level) <= OUSTER_LOG_MAX_LEVEL) {                        \
+			ouster_log_((level), __FILE__, __LINE__, __VA_ARGS__);    \
+		}                                                             \
+	} while (0)
+#define ouster_log(...) ouster_log_level(OUSTER_LOG_LEVEL_INFO, __VA_ARGS__)
+#define ouster_log_error(...) ouster_log_level(OUSTER_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define ouster_log_warn(...) ouster_log_level(OUSTER_LOG_LEVEL_WARN, __VA_ARGS__)
+#define ouster_log_debug(...) ouster_log_level(OUSTER_LOG_LEVEL_DEBUG, __VA_ARGS__)
 #define ouster_log_m4(...) ouster_log_m4_(__VA_ARGS__)
 #define ouster_log_m3(...) ouster_log_m3_(__VA_ARGS__)
 #define ouster_log_v3(...) ouster_log_v3_(__VA_ARGS__)
 #else
+#define ouster_log_level(...)
 #define ouster_log(...)
+#define ouster_log_error(...)
+#define ouster_log_warn(...)
+#define ouster_log_debug(...)
 #define ouster_log_m4(...)
 #define ouster_log_m3(...)
 #define ouster_log_v3(...)
@@ -327,6 +394,12 @@ typedef struct
 	int last_mid;
 	int mid_loss;
 	int num_valid_pixels;
+	/* First and last valid mid of the last packet, -1 when the packet had no valid columns */
+	int packet_mid0;
+	int packet_mid1;
+	/* Optional bitmap owned by the caller with one bit per column of the fields,
+	 * bit (mid - mid0) is set for every valid column copied. See ouster_frame_pool_t */
+	uint64_t *valid_cols;
 } ouster_lidar_t;
 
 typedef struct
@@ -382,8 +455,49 @@ typedef struct
 	int h;
 	double *direction;
 	double *offset;
+	/* User transform folded into direction and offset, row major, translation in meters */
+	double transform[16];
+	/* direction and offset without user transform, allocated by the first ouster_lut_set_transform() */
+	double *direction_base;
+	double *offset_base;
+	/* Memory map of a LUT cache file that holds direction and offset, see ouster_lut_load() */
+	void *map;
+	int64_t map_size;
 } ouster_lut_t;
 
+/* Float32 structure of arrays LUT, each plane is 64 byte aligned */
+typedef struct
+{
+	int w;
+	int h;
+	float *dx;
+	float *dy;
+	float *dz;
+	float *ox;
+	float *oy;
+	float *oz;
+	/* Allocation that holds all planes */
+	void *memory;
+} ouster_lut_f32_t;
+
+/* Fixed-point LUT for integer xyz output.
+ * direction planes are Q20 output units per mm, offset planes are Q10 output units */
+typedef struct
+{
+	int w;
+	int h;
+	/* Output unit in mm, e.g. 1 or 4 */
+	int unit_mm;
+	int32_t *dx;
+	int32_t *dy;
+	int32_t *dz;
+	int32_t *ox;
+	int32_t *oy;
+	int32_t *oz;
+	/* Allocation that holds all planes */
+	void *memory;
+} ouster_lut_fixed_t;
+
 /*
 https://static.ouster.dev/sensor-docs/image_route1/image_route2/sensor_data/sensor-data.html#single-return-profile
 RRRR Y0SS NN00
@@ -535,6 +649,35 @@ extern int64_t ouster_os_api_realloc_count;
 extern int64_t ouster_os_api_calloc_count;
 extern int64_t ouster_os_api_free_count;
 
+/** Subsystem an allocation is counted under, see ouster_os_mem_tag_set() */
+typedef enum {
+	OUSTER_OS_MEM_TAG_OTHER,
+	OUSTER_OS_MEM_TAG_LUT,
+	OUSTER_OS_MEM_TAG_FIELD,
+	OUSTER_OS_MEM_TAG_HTTP,
+	OUSTER_OS_MEM_TAG_LOG,
+	OUSTER_OS_MEM_TAG_COUNT
+} ouster_os_mem_tag_t;
+
+/** Snapshot of the allocation statistics, see ouster_os_mem_stats() */
+typedef struct
+{
+	int64_t malloc_count;
+	int64_t realloc_count;
+	int64_t calloc_count;
+	int64_t free_count;
+	/** Sum of malloc_count, realloc_count and calloc_count. Compare two snapshots to assert that a frame did not allocate */
+	int64_t allocs;
+	/** Requested bytes currently allocated */
+	int64_t bytes;
+	/** Highest value bytes has had */
+	int64_t bytes_peak;
+	/** Requested bytes currently allocated per ouster_os_mem_tag_t */
+	int64_t tag_bytes[OUSTER_OS_MEM_TAG_COUNT];
+	/** Number of allocations per ouster_os_mem_tag_t */
+	int64_t tag_allocs[OUSTER_OS_MEM_TAG_COUNT];
+} ouster_os_mem_stats_t;
+
 #ifndef ouster_os_malloc
 #define ouster_os_malloc(size) ouster_os_api.malloc_(size)
 #endif
@@ -557,12 +700,320 @@ extern int64_t ouster_os_api_free_count;
 
 void ouster_os_set_api_defaults(void);
 
+/** Sets the subsystem that following allocations of the calling thread are counted under.
+ * A free is counted under the tag of the allocation, also from another thread.
+ *
+ * @param tag One of ouster_os_mem_tag_t
+ * @return Returns the previous tag so it can be restored
+ */
+int ouster_os_mem_tag_set(int tag);
+
+/** Counts an allocation, for allocators installed in ouster_os_api
+ *
+ * @param size Requested size in bytes
+ * @return Returns the tag of the calling thread, store it with the block and pass it to ouster_os_mem_count_free()
+ */
+int ouster_os_mem_count_alloc(size_t size);
+
+/** Counts a free or the old size of a realloc, for allocators installed in ouster_os_api
+ *
+ * @param tag Tag returned by ouster_os_mem_count_alloc()
+ * @param size Requested size in bytes given to ouster_os_mem_count_alloc()
+ */
+void ouster_os_mem_count_free(int tag, size_t size);
+
+/** Reads all allocation statistics, every counter is read atomically
+ *
+ * @param stats Snapshot output
+ */
+void ouster_os_mem_stats(ouster_os_mem_stats_t *stats);
+
+/** Monotonic clock
+ *
+ * @return Nanoseconds since an unspecified starting point
+ */
+int64_t ouster_os_clock_ns(void);
+
 #ifdef __cplusplus
 }
 #endif
 
 #endif // OUSTER_OUSTER_OS_API_H
 
+/** @} */
+/**
+ * @defgroup arena Arena allocator
+ * @brief Huge page backed bump allocator and a pooled allocator for ouster_os_api
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_ARENA_H
+#define OUSTER_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Alignment of all allocations */
+#define OUSTER_ARENA_ALIGN 16
+
+typedef struct
+{
+	char *base;
+	size_t capacity;
+	/** Bytes handed out, only grows until ouster_arena_reset() */
+	size_t used;
+	/** Size of the mapping including alignment */
+	size_t map_size;
+	char *map;
+} ouster_arena_t;
+
+/** Reserves capacity bytes of anonymous memory aligned to 2 MB and asks for transparent huge pages.
+ * Pages are touched on first use, call ouster_arena_prefault() to move that cost out of the real-time path.
+ *
+ * @param arena The arena
+ * @param capacity Size in bytes
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_arena_init(ouster_arena_t *arena, size_t capacity);
+
+/** Unmaps the memory, all allocations become invalid
+ *
+ * @param arena The arena
+ */
+void ouster_arena_fini(ouster_arena_t *arena);
+
+/** Touches every page so later allocations do not page fault
+ *
+ * @param arena The arena
+ */
+void ouster_arena_prefault(ouster_arena_t *arena);
+
+/** Allocates from the arena, thread safe
+ *
+ * @param arena The arena
+ * @param size Bytes
+ * @return Memory aligned to OUSTER_ARENA_ALIGN or NULL when the arena is full
+ */
+void *ouster_arena_alloc(ouster_arena_t *arena, size_t size);
+
+/** Frees everything allocated since ouster_arena_init() or the last reset, e.g. at the end of each frame
+ *
+ * @param arena The arena
+ */
+void ouster_arena_reset(ouster_arena_t *arena);
+
+/** Installs a pooled allocator in ouster_os_api.
+ * Blocks come in power of two size classes from one huge page backed arena and are recycled, never returned to the system.
+ * Each thread keeps a small cache of free blocks per class, so steady state malloc and free take no lock and make no system calls.
+ * Blocks larger than 16 MB or beyond capacity fall back to the system allocator.
+ * Call once before any other ouster function allocates.
+ *
+ * @param capacity Size of the arena in bytes
+ * @return Returns 0 on ok otherwise -1 and the defaults of ouster_os_set_api_defaults() are kept
+ */
+int ouster_os_set_api_arena(size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_ARENA_H
+
+/** @} */
+/**
+ * @defgroup profile Stage profiling
+ * @brief Latency histograms of the pipeline stages
+ *
+ * The library records the stages it runs itself: receive in ouster_net_read(), decode in ouster_lidar_get_fields(),
+ * frame from first packet to completion in ouster_frame_pool_push(), destagger in ouster_field_destagger() and
+ * cartesian in the ouster_lut_cartesian and ouster_lut_f32_cartesian functions.
+ * Applications record OUSTER_STAGE_HANDOFF where a consumer takes over the result.
+ *
+ * Instrumentation is only compiled in when OUSTER_ENABLE_PROFILE or OUSTER_ENABLE_TRACE is defined,
+ * otherwise ouster_profile_begin() and ouster_profile_end() expand to nothing and all counts stay zero.
+ * With OUSTER_ENABLE_TRACE every stage is also recorded as an event of @ref trace.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_PROFILE_H
+#define OUSTER_PROFILE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	OUSTER_STAGE_RECEIVE,
+	OUSTER_STAGE_DECODE,
+	OUSTER_STAGE_FRAME,
+	OUSTER_STAGE_DESTAGGER,
+	OUSTER_STAGE_CARTESIAN,
+	OUSTER_STAGE_HANDOFF,
+	OUSTER_STAGE_COUNT
+} ouster_stage_t;
+
+/** Every power of two is split in 1 << OUSTER_PROFILE_SUB_BITS buckets, the error of a value is at most 1/16 */
+#define OUSTER_PROFILE_SUB_BITS 4
+
+/** Values from 2^OUSTER_PROFILE_MAX_BITS ns (about 18 minutes) go into the last bucket */
+#define OUSTER_PROFILE_MAX_BITS 40
+
+#define OUSTER_PROFILE_BUCKETS ((OUSTER_PROFILE_MAX_BITS - OUSTER_PROFILE_SUB_BITS + 1) << OUSTER_PROFILE_SUB_BITS)
+
+typedef struct
+{
+	int64_t count;
+	int64_t sum_ns;
+	int64_t min_ns;
+	int64_t max_ns;
+	int64_t mean_ns;
+	/** Percentiles are the upper bound of their bucket */
+	int64_t p50_ns;
+	int64_t p90_ns;
+	int64_t p99_ns;
+	int64_t p999_ns;
+} ouster_profile_stats_t;
+
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+#define ouster_profile_begin(t) int64_t t = ouster_os_clock_ns()
+#define ouster_profile_end(t, stage) ouster_profile_span((stage), (t), ouster_os_clock_ns())
+#else
+#define ouster_profile_begin(t)
+#define ouster_profile_end(t, stage)
+#endif
+
+/** Adds one latency sample, safe to call from any thread
+ *
+ * @param stage One of ouster_stage_t
+ * @param ns Latency in nanoseconds
+ */
+void ouster_profile_record(int stage, int64_t ns);
+
+/** Records a stage that ran from begin_ns to end_ns in the histogram with OUSTER_ENABLE_PROFILE
+ * and as a trace event with OUSTER_ENABLE_TRACE
+ *
+ * @param stage One of ouster_stage_t
+ * @param begin_ns ouster_os_clock_ns() at begin
+ * @param end_ns ouster_os_clock_ns() at end
+ */
+void ouster_profile_span(int stage, int64_t begin_ns, int64_t end_ns);
+
+/** Reads count, min, max, mean and percentiles of a stage
+ *
+ * @param stage One of ouster_stage_t
+ * @param stats Output
+ */
+void ouster_profile_stats(int stage, ouster_profile_stats_t *stats);
+
+/** Latency below which a fraction q of the samples are
+ *
+ * @param stage One of ouster_stage_t
+ * @param q Fraction from 0 to 1
+ * @return Returns the upper bound of the bucket in nanoseconds but at most the max, 0 without samples
+ */
+int64_t ouster_profile_percentile(int stage, double q);
+
+/** Name of a stage
+ *
+ * @param stage One of ouster_stage_t
+ */
+char const *ouster_profile_stage_str(int stage);
+
+/** Clears all stages, samples recorded at the same time may be lost */
+void ouster_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_PROFILE_H
+
+/** @} */
+/**
+ * @defgroup trace Event tracing
+ * @brief Records begin and end of every stage per thread and writes Chrome trace-event JSON
+ *
+ * Open the output in chrome://tracing or https://ui.perfetto.dev to see how receive, decode and
+ * worker threads overlap. Events go into one lock-free ring, the oldest are overwritten when it is full.
+ *
+ * The library records the stages of @ref profile, the jobs of the thread pool and the capture reads and writes,
+ * but only when compiled with OUSTER_ENABLE_TRACE. Applications can always call ouster_trace_record().
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_TRACE_H
+#define OUSTER_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Max number of threads that get a name in the output */
+#define OUSTER_TRACE_MAX_THREADS 256
+
+#ifdef OUSTER_ENABLE_TRACE
+#define ouster_trace_begin(t) int64_t t = ouster_os_clock_ns()
+#define ouster_trace_end(t, name, arg) ouster_trace_record((name), (t), ouster_os_clock_ns(), (arg))
+#define ouster_trace_thread_name(name) ouster_trace_thread_name_(name)
+#else
+#define ouster_trace_begin(t)
+#define ouster_trace_end(t, name, arg)
+#define ouster_trace_thread_name(name)
+#endif
+
+/** Allocates the ring and starts recording
+ *
+ * @param capacity Number of events kept
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_trace_start(int capacity);
+
+/** Stops recording and frees the ring, no other thread may record at the same time */
+void ouster_trace_stop(void);
+
+/** Adds a complete event, safe to call from any thread and does nothing when not started
+ *
+ * @param name Name of the event, must be a string literal or otherwise outlive the trace, no JSON escaping is done
+ * @param begin_ns ouster_os_clock_ns() at begin
+ * @param end_ns ouster_os_clock_ns() at end
+ * @param arg Shown as args.arg, for example a frame id, negative values are left out
+ */
+void ouster_trace_record(char const *name, int64_t begin_ns, int64_t end_ns, int64_t arg);
+
+/** Names the calling thread in the output
+ *
+ * @param name Thread name, must be a string literal or otherwise outlive the trace
+ */
+void ouster_trace_thread_name_(char const *name);
+
+/** Writes the events in the ring as Chrome trace-event JSON, can be called while recording
+ *
+ * @param f Output file
+ * @return Returns the number of events written
+ */
+int ouster_trace_dump(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_TRACE_H
+
 /** @} */
 /**
  * @defgroup assert Assertion
@@ -654,6 +1105,19 @@ void ouster_field_init(ouster_field_t fields[], int count, ouster_meta_t *meta);
 void ouster_field_fini(ouster_field_t fields[], int count);
 void ouster_destagger(void *data, int cols, int rows, int depth, int rowsize, int pixel_shift_by_row[]);
 void ouster_field_destagger(ouster_field_t fields[], int count, ouster_meta_t *meta);
+
+/** Destaggers src into dst, the source is only read so it can keep being filled by the receiver */
+void ouster_destagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[]);
+
+/** Inverse of ouster_destagger_cpy(), converts destaggered data back to measurement order */
+void ouster_restagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[]);
+
+/** Destaggers fields into other fields of the same size, see ouster_destagger_cpy() */
+void ouster_field_destagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta);
+
+/** Restaggers fields into other fields of the same size, see ouster_restagger_cpy() */
+void ouster_field_restagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta);
+
 void ouster_field_apply_mask_u32(ouster_field_t *field, ouster_meta_t *meta);
 void ouster_field_zero(ouster_field_t fields[], int count);
 void ouster_field_cpy(ouster_field_t dst[], ouster_field_t src[], int count);
@@ -664,6 +1128,91 @@ void ouster_field_cpy(ouster_field_t dst[], ouster_field_t src[], int count);
 
 #endif // OUSTER_FIELD_H
 
+/** @} */
+/**
+ * @defgroup codec Lossless field codec
+ * @brief Compresses fields by predicting each pixel from its neighbours and entropy coding the residual
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_CODEC_H
+#define OUSTER_CODEC_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** First four bytes of an encoded field */
+#define OUSTER_CODEC_MAGIC 0x4344434F
+
+typedef enum {
+	OUSTER_CODEC_OK,
+	OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL,
+	OUSTER_CODEC_ERROR_MAGIC,
+	OUSTER_CODEC_ERROR_SHAPE,
+	OUSTER_CODEC_ERROR_CORRUPT,
+} ouster_codec_error_t;
+
+typedef enum {
+	/** Prediction residuals in Golomb-Rice codes */
+	OUSTER_CODEC_METHOD_RICE,
+	/** Pixels stored little endian without coding, used when the field does not compress */
+	OUSTER_CODEC_METHOD_RAW,
+} ouster_codec_method_t;
+
+/** Header in front of an encoded field.
+ * All values are little endian in the encoded field, as are raw pixels. */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t rows;
+	uint16_t cols;
+	uint8_t depth;
+	/** ouster_codec_method_t */
+	uint8_t method;
+	uint8_t reserved[2];
+	/** Size of the data following the header */
+	uint32_t size;
+} ouster_codec_header_t;
+
+/** Returns the worst case encoded size of a field
+ *
+ * @param field The field
+ * @return Max number of bytes ouster_codec_encode() writes
+ */
+int ouster_codec_bound(ouster_field_t const *field);
+
+/** Encodes a field.
+ * Each pixel is predicted from its left, upper and upper left neighbour (MED predictor)
+ * and the residual is written with adaptive Golomb-Rice codes.
+ * Fields that do not compress are stored raw, the output is never larger than ouster_codec_bound().
+ *
+ * @param field The field to encode, depth 1, 2 or 4
+ * @param dst Destination buffer
+ * @param capacity Size of the destination buffer, ouster_codec_bound() is always enough
+ * @param size Number of bytes written to dst
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_codec_encode(ouster_field_t const *field, void *dst, int capacity, int *size);
+
+/** Decodes a field
+ *
+ * @param field Destination field, rows, cols and depth must match the encoded field
+ * @param src Encoded field
+ * @param size Size of src in bytes
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_codec_decode(ouster_field_t *field, void const *src, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_CODEC_H
+
 /** @} */
 /**
  * @defgroup fs Files
@@ -693,7 +1242,7 @@ int ouster_fs_readfile_failed_reason(char const *filename, char *buf, int len);
 /** Prints current working directory */
 void ouster_fs_pwd();
 
-/** Read whole file and allocates memory
+/** Read whole file and allocates memory, free it with ouster_os_free()
  *
  * @param path filename to read
  */
@@ -731,6 +1280,11 @@ void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char co
  * @defgroup lut XYZ vector field lookup table
  * @brief Provides a vector field that converts image to pointcloud
  *
+ * The LUT is in staggered order, the same order as the fields from ouster_lidar_get_fields().
+ * Convert the raw fields to pointcloud before or independent of ouster_field_destagger(),
+ * a destaggered range image gives wrong points. Use ouster_lut_cartesian_f32_destagger()
+ * to get the destaggered range image and a pointcloud in the same pixel order in one pass.
+ *
  * \ingroup c
  * @{
  */
@@ -738,6 +1292,87 @@ void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char co
 #ifndef OUSTER_LUT_H
 #define OUSTER_LUT_H
 
+/**
+ * @defgroup pool Thread pool
+ * @brief Runs a parallel for loop on a fixed set of threads
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_POOL_H
+#define OUSTER_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Job function
+ *
+ * @param arg User argument given to ouster_pool_run()
+ * @param index Job index from 0 to count-1
+ * @param worker Index of the executing worker from 0 to ouster_pool_t::count-1, use it to index per-worker buffers
+ */
+typedef void (*ouster_pool_fn_t)(void *arg, int index, int worker);
+
+typedef struct
+{
+	/** Number of workers including the thread calling ouster_pool_run() */
+	int count;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	ouster_pool_fn_t fn;
+	void *arg;
+	/** Number of jobs in the current run */
+	int jobs;
+	/** Next job to hand out */
+	int next;
+	/** Number of jobs finished */
+	int finished;
+	/** Incremented for every run, wakes the workers */
+	uint64_t generation;
+	int quit;
+	/** Number of threads that have picked their worker index */
+	int started;
+} ouster_pool_t;
+
+/** Returns the number of online CPUs */
+int ouster_pool_cpu_count(void);
+
+/** Starts count-1 worker threads, the caller of ouster_pool_run() is the last worker
+ *
+ * @param pool The pool
+ * @param count Number of workers, 0 or less uses ouster_pool_cpu_count()
+ */
+void ouster_pool_init(ouster_pool_t *pool, int count);
+
+/** Stops and joins the worker threads
+ *
+ * @param pool The pool
+ */
+void ouster_pool_fini(ouster_pool_t *pool);
+
+/** Calls fn(arg, index, worker) for index 0 to count-1 and returns when all calls have finished
+ *
+ * @param pool The pool
+ * @param fn Job function
+ * @param arg User argument
+ * @param count Number of jobs
+ */
+void ouster_pool_run(ouster_pool_t *pool, ouster_pool_fn_t fn, void *arg, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_POOL_H
+
+/** @} */
 
 #ifdef __cplusplus
 extern "C" {
@@ -759,11 +1394,54 @@ void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta);
  */
 void ouster_lut_fini(ouster_lut_t *lut);
 
-/** Converts 2D hightmap to pointcloud
+/** Hash of the meta fields that ouster_lut_init() depends on
  *
- * @param lut Input LUT unit vector direction field
- * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
- * @param xyz Output Image pointcloud
+ * @param meta meta configuration
+ * @return 64 bit FNV-1a hash
+ */
+uint64_t ouster_lut_meta_hash(ouster_meta_t const *meta);
+
+/** Writes a LUT from ouster_lut_init() to a binary cache file.
+ * The file is written to a temporary name and renamed so readers never see a partial file.
+ *
+ * @param lut The xyz lut table, a transform from ouster_lut_set_transform() is not saved
+ * @param meta meta configuration the LUT was made from
+ * @param path Cache file
+ * @return Returns 0 on ok otherwise -1 and errno is set
+ */
+int ouster_lut_save(ouster_lut_t const *lut, ouster_meta_t const *meta, char const *path);
+
+/** Maps a LUT cache file written by ouster_lut_save().
+ * The mapping is private, modifying the tables e.g. by ouster_lut_set_transform() does not change the file.
+ *
+ * @param lut The xyz lut table
+ * @param meta meta configuration, the cache is rejected if its hash does not match
+ * @param path Cache file
+ * @return Returns 0 on ok otherwise -1
+ */
+int ouster_lut_load(ouster_lut_t *lut, ouster_meta_t const *meta, char const *path);
+
+/** Unmaps a LUT loaded by ouster_lut_load(), also called by ouster_lut_fini()
+ *
+ * @param lut The xyz lut table
+ */
+void ouster_lut_unmap(ouster_lut_t *lut);
+
+/** Loads the LUT from the cache directory or inits and saves it there.
+ * The cache file name is ouster_lut_<hash>.bin
+ *
+ * @param lut The xyz lut table
+ * @param meta meta configuration
+ * @param dir Cache directory
+ * @return Returns 1 when loaded from cache, 0 when computed
+ */
+int ouster_lut_init_cached(ouster_lut_t *lut, ouster_meta_t const *meta, char const *dir);
+
+/** Converts 2D hightmap to pointcloud
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param xyz Output Image pointcloud
  */
 void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride);
 
@@ -775,6 +1453,59 @@ void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, vo
  */
 void ouster_lut_cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride);
 
+/** Converts a staggered 2D hightmap to a pointcloud in destaggered pixel order and optionally
+ * writes the destaggered range image in the same pass, so the point of image pixel (row, col) is out[row * w + col].
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param meta meta configuration with pixel_shift_by_row
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap, staggered
+ * @param range_out Optional output destaggered RANGE field, must not be range
+ * @param out Output Image pointcloud, destaggered
+ * @param out_stride Bytes between pixels in out
+ */
+void ouster_lut_cartesian_f32_destagger(ouster_lut_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride);
+
+/** Converts 2D hightmap to pointcloud, rows are split across the workers of a thread pool.
+ * The LUT is only read, the same LUT can be used by several pools at once.
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param out Output Image pointcloud
+ * @param out_stride Bytes between pixels in out
+ * @param pool Thread pool, see ouster_pool_init()
+ */
+void ouster_lut_cartesian_f64_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool);
+
+/** Converts 2D hightmap to float pointcloud on a thread pool, see ouster_lut_cartesian_f64_parallel()
+ */
+void ouster_lut_cartesian_f32_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool);
+
+/** Converts a range of columns of a 2D hightmap to pointcloud, e.g. the columns of the last packet
+ * so the pointcloud is ready as soon as the last packet of a frame has arrived
+ *
+ * @param lut Input LUT unit vector direction field
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param out Output Image pointcloud of the whole frame
+ * @param out_stride Bytes between pixels in out
+ * @param col0 First column, e.g. ouster_lidar_t::packet_mid0 - ouster_meta_t::mid0
+ * @param col1 Last column, e.g. ouster_lidar_t::packet_mid1 - ouster_meta_t::mid0
+ */
+void ouster_lut_cartesian_f64_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1);
+
+/** Converts a range of columns of a 2D hightmap to pointcloud, see ouster_lut_cartesian_f64_columns()
+ */
+void ouster_lut_cartesian_f32_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1);
+
+/** Folds a user transform, e.g. sensor to vehicle extrinsic, into the LUT so points come out transformed.
+ * Applied on top of lidar_to_sensor_transform. Only multiplies the tables, the trigonometry is not recomputed,
+ * so it is cheap to call again when the transform changes. Each call replaces the previous transform.
+ * Derived LUTs such as ouster_lut_f32_t must be converted again.
+ *
+ * @param lut The xyz lut table
+ * @param transform Row major 4x4 matrix, translation in meters
+ */
+void ouster_lut_set_transform(ouster_lut_t *lut, double const transform[16]);
+
 void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y, float mag, float *out);
 
 /** Allocates size for xyz pointcloud
@@ -783,12 +1514,197 @@ void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y,
  */
 double *ouster_lut_alloc(ouster_lut_t const *lut);
 
+/** Converts a LUT to float32 structure of arrays
+ *
+ * @param dst The float32 LUT
+ * @param src The LUT from ouster_lut_init()
+ */
+void ouster_lut_f32_init(ouster_lut_f32_t *dst, ouster_lut_t const *src);
+
+/** Frees memory of float32 LUT
+ *
+ * @param lut The float32 LUT
+ */
+void ouster_lut_f32_fini(ouster_lut_f32_t *lut);
+
+/** Converts 2D hightmap to pointcloud planes, uses AVX2 or SSE2 when available
+ *
+ * @param lut Input float32 LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param x Output x plane, w*h floats
+ * @param y Output y plane, w*h floats
+ * @param z Output z plane, w*h floats
+ */
+void ouster_lut_f32_cartesian_soa(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z);
+
+/** Converts 2D hightmap to interleaved pointcloud, uses AVX2 or SSE2 when available
+ *
+ * @param lut Input float32 LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param out Output x,y,z floats per pixel
+ * @param out_stride Bytes between pixels in out
+ */
+void ouster_lut_f32_cartesian_aos(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride);
+
+/** Converts 2D hightmap to interleaved pointcloud on a thread pool, see ouster_lut_cartesian_f64_parallel()
+ */
+void ouster_lut_f32_cartesian_aos_parallel(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool);
+
+/** Converts a staggered 2D hightmap to interleaved pointcloud in destaggered pixel order,
+ * see ouster_lut_cartesian_f32_destagger()
+ */
+void ouster_lut_f32_cartesian_aos_destagger(ouster_lut_f32_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride);
+
+/** Converts a range of columns to pointcloud planes, see ouster_lut_cartesian_f64_columns()
+ */
+void ouster_lut_f32_cartesian_soa_columns(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z, int col0, int col1);
+
+/** Converts a range of columns to interleaved pointcloud, see ouster_lut_cartesian_f64_columns()
+ */
+void ouster_lut_f32_cartesian_aos_columns(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1);
+
+/** Converts the pixels with range in [min_range, max_range] to a dense interleaved pointcloud.
+ * Pixels without return have range 0, use min_range 1 to skip them. Uses AVX2 left-packing when available.
+ *
+ * @param lut Input float32 LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap
+ * @param min_range Smallest range to keep in mm
+ * @param max_range Largest range to keep in mm
+ * @param out Output x,y,z floats per point, w*h points is always enough
+ * @param out_stride Bytes between points in out
+ * @param indices Optional output, pixel index of every point to gather other fields
+ * @return Number of points written
+ */
+int ouster_lut_f32_cartesian_compact(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices);
+
+/** Converts the pixels of a range of columns with range in [min_range, max_range] to a dense pointcloud,
+ * see ouster_lut_f32_cartesian_compact() and ouster_lut_cartesian_f64_columns().
+ * Points are written from the start of out, append per packet by offsetting out and indices with the count so far.
+ */
+int ouster_lut_f32_cartesian_compact_columns(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices, int col0, int col1);
+
+/** Converts a LUT to fixed-point for integer xyz output
+ *
+ * @param dst The fixed-point LUT
+ * @param src The LUT from ouster_lut_init()
+ * @param unit_mm Output unit in mm, e.g. 1 for millimetre or 4 for 4 mm quantized coordinates
+ */
+void ouster_lut_fixed_init(ouster_lut_fixed_t *dst, ouster_lut_t const *src, int unit_mm);
+
+/** Frees memory of fixed-point LUT
+ *
+ * @param lut The fixed-point LUT
+ */
+void ouster_lut_fixed_fini(ouster_lut_fixed_t *lut);
+
+/** Converts 2D hightmap to interleaved int32 pointcloud in units of ouster_lut_fixed_t::unit_mm.
+ * Only integer math is used, coordinates are within one unit of the rounded float result.
+ * Uses AVX2 when available.
+ *
+ * @param lut Input fixed-point LUT
+ * @param range Input Raw LiDAR Sensor RANGE field 2D hightmap, at most 20 bits
+ * @param out Output x,y,z int32 per pixel
+ * @param out_stride Bytes between pixels in out
+ */
+void ouster_lut_cartesian_i32(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride);
+
+/** Converts 2D hightmap to interleaved int16 pointcloud, see ouster_lut_cartesian_i32().
+ * Coordinates outside the int16 range saturate, that is +-32 m with 1 mm unit and +-131 m with 4 mm unit.
+ */
+void ouster_lut_cartesian_i16(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride);
+
+/** Checks all LUT conversions against a reference implementation for every lidar mode,
+ * 512, 1024 and 2048 columns with 16, 32, 64 and 128 rows, using synthetic meta.
+ *
+ * @return Returns 1 when all conversions are within tolerance
+ */
+int test_ouster_lut();
+
 #ifdef __cplusplus
 }
 #endif
 
 #endif // OUSTER_LUT_H
 
+/** @} */
+/**
+ * @defgroup projection Inverse projection
+ * @brief Maps 3D points in the sensor frame to pixels of the destaggered range image
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_PROJECTION_H
+#define OUSTER_PROJECTION_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of the altitude edge table, power of two larger than OUSTER_MAX_ROWS */
+#define OUSTER_PROJECTION_EDGES (OUSTER_MAX_ROWS * 2)
+
+typedef struct
+{
+	int w;
+	int h;
+	int mid0;
+	int columns_per_frame;
+	/** Sensor frame in meters to lidar frame in mm, rows of a 3x4 matrix */
+	float sensor_to_lidar[12];
+	/** Beam origin offsets in mm */
+	float beam_x;
+	float beam_z;
+	/** Altitude in radians between beam k-1 and k sorted from top to bottom, padded with -inf */
+	float edge[OUSTER_PROJECTION_EDGES];
+	/** First step of the binary search over edge */
+	int search_step;
+	/** Row of beam k sorted from top to bottom */
+	int32_t edge_row[OUSTER_MAX_ROWS];
+	/** Per row sin and cos of the beam azimuth offset */
+	float azimuth_sin[OUSTER_MAX_ROWS];
+	float azimuth_cos[OUSTER_MAX_ROWS];
+	/** Per row destagger shift in [0, w) */
+	int32_t shift[OUSTER_MAX_ROWS];
+} ouster_projection_t;
+
+/** Precomputes the inverse of ouster_lut_init() from meta configuration
+ *
+ * @param proj The projection
+ * @param meta meta configuration
+ */
+void ouster_projection_init(ouster_projection_t *proj, ouster_meta_t const *meta);
+
+/** Finds the pixel of the destaggered range image that a point was measured by.
+ * The row is found by binary search over the beam altitudes, the column from the azimuth.
+ *
+ * @param proj The projection
+ * @param xyz Point in the sensor frame in meters, as given by ouster_lut_cartesian_f32()
+ * @param row Output row
+ * @param col Output column in the destaggered image
+ * @return Returns 1 if the point is inside the field of view and column window otherwise 0
+ */
+int ouster_projection_pixel(ouster_projection_t const *proj, float const xyz[3], int *row, int *col);
+
+/** Maps many points to pixels of the destaggered range image, uses AVX2 when available.
+ * Gives the same pixels as ouster_projection_pixel().
+ *
+ * @param proj The projection
+ * @param xyz Points in the sensor frame in meters
+ * @param xyz_stride Bytes between points in xyz
+ * @param n Number of points
+ * @param pixels Output pixel index row * w + col per point, -1 when outside
+ */
+void ouster_projection_pixels(ouster_projection_t const *proj, void const *xyz, int xyz_stride, int n, int32_t *pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_PROJECTION_H
+
 /** @} */
 /**
  * @defgroup net Network and sockets
@@ -816,6 +1732,9 @@ double *ouster_lut_alloc(ouster_lut_t const *lut);
 #define OUSTER_NET_FLAGS_BIND 0x0100
 #define OUSTER_NET_FLAGS_CONNECT 0x0200
 
+/** Max number of messages handed to the kernel in one sendmmsg() call */
+#define OUSTER_NET_SENDMMSG_MAX 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -836,6 +1755,14 @@ typedef struct
 	char data[OUSTER_NET_ADDRSTRLEN];
 } ouster_net_addr_t;
 
+/** One datagram of a batched send */
+typedef struct
+{
+	char *buf;
+	int size;
+	ouster_net_addr_t *addr;
+} ouster_net_msg_t;
+
 /** Set a IPv4 address
  *
  * @param addr The address
@@ -862,6 +1789,19 @@ void ouster_net_addr_set_port(ouster_net_addr_t *addr, int port);
  */
 int ouster_net_sendto(int sock, char *buf, int size, int flags, ouster_net_addr_t *addr);
 
+/**
+ * @brief Send multiple datagrams from a socket using as few system calls as possible
+ *
+ * Uses sendmmsg() when compiled with _GNU_SOURCE, otherwise falls back to one sendto() per message.
+ *
+ * @param sock The source socket filedescriptor
+ * @param msgs Datagrams to send
+ * @param n Number of datagrams
+ * @param flags
+ * @return Returns the number of datagrams sent, or -1 for errors.
+ */
+int ouster_net_sendmmsg(int sock, ouster_net_msg_t msgs[], int n, int flags);
+
 int ouster_net_create(ouster_net_sock_desc_t *desc);
 
 int64_t ouster_net_read(int sock, char *buf, int len);
@@ -972,6 +1912,468 @@ void ouster_http_request(int sock, char const *host, char const *path, ouster_ve
 
 #endif // OUSTER_HTTP_H
 
+/** @} */
+/**
+ * @defgroup queue Lock-free handoff
+ * @brief Single producer single consumer queue and latest item mailbox
+ *
+ * Typical use with @ref frame: the receive thread puts completed frames in a mailbox, the consumer takes the newest
+ * and pushes it on a queue back to the receive thread when done, which then returns it to the frame pool.
+ * Nothing is copied and neither side ever waits for the other.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_QUEUE_H
+#define OUSTER_QUEUE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Producer and consumer indices are kept this far apart so they do not share a cache line */
+#define OUSTER_QUEUE_CACHELINE 64
+
+typedef struct
+{
+	void **items;
+	/** Capacity - 1, capacity is a power of two */
+	uint64_t mask;
+	char pad0[OUSTER_QUEUE_CACHELINE];
+	/** Next slot to push, written by the producer */
+	uint64_t head;
+	/** Last tail seen by the producer */
+	uint64_t tail_cache;
+	char pad1[OUSTER_QUEUE_CACHELINE];
+	/** Next slot to pop, written by the consumer */
+	uint64_t tail;
+	/** Last head seen by the consumer */
+	uint64_t head_cache;
+	char pad2[OUSTER_QUEUE_CACHELINE];
+} ouster_spsc_t;
+
+/** Holds at most one item, a new item replaces the one not taken yet */
+typedef struct
+{
+	void *item;
+} ouster_mailbox_t;
+
+/** Allocates a queue
+ *
+ * @param q The queue
+ * @param capacity Max number of items, rounded up to a power of two
+ */
+void ouster_spsc_init(ouster_spsc_t *q, int capacity);
+
+/** Frees the queue
+ *
+ * @param q The queue
+ */
+void ouster_spsc_fini(ouster_spsc_t *q);
+
+/** Adds an item, only call from the producer thread
+ *
+ * @param q The queue
+ * @param item Item, not NULL
+ * @return Returns 0 on ok otherwise -1 when the queue is full
+ */
+int ouster_spsc_push(ouster_spsc_t *q, void *item);
+
+/** Removes the oldest item, only call from the consumer thread
+ *
+ * @param q The queue
+ * @return Returns the item or NULL when the queue is empty
+ */
+void *ouster_spsc_pop(ouster_spsc_t *q);
+
+/** Puts an item in the mailbox, wait-free
+ *
+ * @param mb The mailbox
+ * @param item Item, not NULL
+ * @return Returns the previous item when the consumer did not take it, the caller owns it again
+ */
+void *ouster_mailbox_put(ouster_mailbox_t *mb, void *item);
+
+/** Takes the newest item from the mailbox, wait-free
+ *
+ * @param mb The mailbox
+ * @return Returns the item or NULL when nothing new was put
+ */
+void *ouster_mailbox_take(ouster_mailbox_t *mb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_QUEUE_H
+
+/** @} */
+/**
+ * @defgroup frame Frame pool
+ * @brief Recycled frame buffers that only clear the columns that need it
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_FRAME_H
+#define OUSTER_FRAME_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of 64 bit words in a column bitmap */
+#define OUSTER_FRAME_BITMAP_WORDS(cols) (((cols) + 63) / 64)
+
+/** Non zero when column col was received in the frame */
+#define OUSTER_FRAME_COL_VALID(frame, col) (((frame)->valid_cols[(col) / 64] >> ((col) % 64)) & 1)
+
+typedef struct
+{
+	int frame_id;
+	/** Staggered fields with the quantities and depths given to ouster_frame_pool_init() */
+	ouster_field_t *fields;
+	int fcount;
+	/** Bit c is set when column c was received, columns not received are zero */
+	uint64_t *valid_cols;
+	/** Number of columns received */
+	int valid_count;
+	/** Packet decoding state, mid_loss and num_valid_pixels of the frame */
+	ouster_lidar_t lidar;
+	/** Columns holding data from the previous use of the buffer */
+	uint64_t *stale_cols;
+	/** ouster_os_clock_ns() at the first packet and at completion, only set when OUSTER_ENABLE_PROFILE or OUSTER_ENABLE_TRACE is defined */
+	int64_t first_ns;
+	int64_t complete_ns;
+} ouster_frame_t;
+
+typedef struct
+{
+	ouster_meta_t *meta;
+	int count;
+	ouster_frame_t *frames;
+	/** The frame being filled by ouster_frame_pool_push() */
+	ouster_frame_t *current;
+	/** The frame the last packet was decoded into, it may be complete already. Valid until the next push */
+	ouster_frame_t *last;
+	/** Free frames, protected by lock */
+	ouster_frame_t **free;
+	int free_count;
+	pthread_mutex_t lock;
+	/** Completed frames dropped because consumers held all other frames */
+	int64_t dropped;
+} ouster_frame_pool_t;
+
+/** Allocates count frame buffers
+ *
+ * @param pool The frame pool
+ * @param meta meta configuration, must outlive the pool
+ * @param fields Quantity and depth of every field, data is not used
+ * @param fcount Number of fields
+ * @param count Number of frames, one is always being filled
+ */
+void ouster_frame_pool_init(ouster_frame_pool_t *pool, ouster_meta_t *meta, ouster_field_t const fields[], int fcount, int count);
+
+/** Frees all frames, none may be held by consumers
+ *
+ * @param pool The frame pool
+ */
+void ouster_frame_pool_fini(ouster_frame_pool_t *pool);
+
+/** Decodes a lidar packet into the current frame.
+ * A frame is complete at its last column or when a packet of the next frame arrives.
+ * Instead of zeroing the whole frame only the columns that held data before and were not received again are cleared.
+ * Call from one thread only.
+ *
+ * @param pool The frame pool
+ * @param buf Lidar packet of meta::lidar_packet_size bytes
+ * @return The completed frame which must be given back with ouster_frame_pool_release(), otherwise NULL
+ */
+ouster_frame_t *ouster_frame_pool_push(ouster_frame_pool_t *pool, char const *buf);
+
+/** Gives a frame back to the pool, can be called from any thread
+ *
+ * @param pool The frame pool
+ * @param frame Frame from ouster_frame_pool_push()
+ */
+void ouster_frame_pool_release(ouster_frame_pool_t *pool, ouster_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_FRAME_H
+
+/** @} */
+/**
+ * @defgroup broadcast Frame broadcast
+ * @brief Single producer multiple consumer ring of reference counted frames
+ *
+ * The receive thread publishes every completed frame of a @ref frame pool, each consumer reads them in order
+ * at its own pace without copies. A consumer that falls more than the ring capacity behind loses the oldest frames,
+ * it never blocks the producer or the other consumers. Frames go back to the pool on the producer thread once
+ * the ring and every consumer let go of them.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_BROADCAST_H
+#define OUSTER_BROADCAST_H
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	/** (seq + 1) << 16 | frame index, zero when nothing was published in the slot */
+	uint64_t *slots;
+	/** Capacity - 1, capacity is a power of two */
+	uint64_t mask;
+	/** Sequence number of the next frame to publish */
+	uint64_t head;
+	/** References of every pool frame, one for the ring and one per consumer holding it */
+	int *refs;
+	/** Non zero when the frame was published and not yet given back to the pool, producer only */
+	char *held;
+	ouster_frame_pool_t *pool;
+} ouster_broadcast_t;
+
+/** Read position of one consumer, owned by the consumer thread */
+typedef struct
+{
+	/** Sequence number of the next frame to read */
+	uint64_t next;
+	/** Number of frames read */
+	int64_t received;
+	/** Number of frames overwritten before this consumer read them */
+	int64_t dropped;
+} ouster_broadcast_reader_t;
+
+/** Allocates the ring
+ *
+ * The pool needs at least capacity + 2 frames plus one for every frame the consumers hold at the same time,
+ * otherwise the pool drops frames instead of the ring.
+ *
+ * @param b The broadcast ring
+ * @param pool Frame pool of the producer, must outlive the ring
+ * @param capacity Number of recent frames kept for lagging consumers, rounded up to a power of two
+ */
+void ouster_broadcast_init(ouster_broadcast_t *b, ouster_frame_pool_t *pool, int capacity);
+
+/** Gives all published frames back to the pool and frees the ring, no consumer may hold a frame
+ *
+ * @param b The broadcast ring
+ */
+void ouster_broadcast_fini(ouster_broadcast_t *b);
+
+/** Publishes a frame and gives frames no longer referenced back to the pool.
+ * Call from the producer thread only, the same thread that calls ouster_frame_pool_push().
+ *
+ * @param b The broadcast ring
+ * @param frame Completed frame from ouster_frame_pool_push(), the ring owns it now
+ */
+void ouster_broadcast_publish(ouster_broadcast_t *b, ouster_frame_t *frame);
+
+/** Starts reading at the next published frame
+ *
+ * @param b The broadcast ring
+ * @param r Read position of the consumer
+ */
+void ouster_broadcast_reader_init(ouster_broadcast_t *b, ouster_broadcast_reader_t *r);
+
+/** Takes a reference to the next frame of this consumer, lock-free.
+ * Frames overwritten since the last call are skipped and counted in ouster_broadcast_reader_t::dropped.
+ *
+ * @param b The broadcast ring
+ * @param r Read position of the consumer
+ * @return The frame which must be given back with ouster_broadcast_release(), NULL when no new frame is published
+ */
+ouster_frame_t *ouster_broadcast_acquire(ouster_broadcast_t *b, ouster_broadcast_reader_t *r);
+
+/** Drops the reference taken by ouster_broadcast_acquire(), lock-free
+ *
+ * @param b The broadcast ring
+ * @param frame Frame from ouster_broadcast_acquire()
+ */
+void ouster_broadcast_release(ouster_broadcast_t *b, ouster_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_BROADCAST_H
+
+/** @} */
+/**
+ * @defgroup pipeline Staged pipeline
+ * @brief Receives, decodes, destaggers and converts frames on one thread per stage
+ *
+ * Every stage runs on its own thread, optionally pinned to a CPU, and hands its work to the next stage through a
+ * bounded @ref queue. A full queue either makes the stage wait, which pushes back up to the socket receive buffer,
+ * or drops the packet or frame. The cartesian stage can fan out on a @ref pool. Stage times are recorded in
+ * the @ref profile histograms when built with OUSTER_ENABLE_PROFILE.
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_PIPELINE_H
+#define OUSTER_PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	/** Reads lidar packets from the socket */
+	OUSTER_PIPELINE_RECEIVE,
+	/** Decodes packets into frames of a frame pool */
+	OUSTER_PIPELINE_DECODE,
+	/** Copies the fields to destaggered fields */
+	OUSTER_PIPELINE_DESTAGGER,
+	/** Converts the range field to xyz */
+	OUSTER_PIPELINE_CARTESIAN,
+	/** Calls the user callback */
+	OUSTER_PIPELINE_CALLBACK,
+	OUSTER_PIPELINE_COUNT
+} ouster_pipeline_stage_t;
+
+typedef enum {
+	/** The producing stage waits until the queue has room */
+	OUSTER_PIPELINE_WAIT,
+	/** The newest packet or frame is dropped when the queue is full */
+	OUSTER_PIPELINE_DROP,
+} ouster_pipeline_policy_t;
+
+typedef struct
+{
+	/** Staggered fields in the order of ouster_pipeline_desc_t::fields, frame_id and mid_loss are in frame->lidar */
+	ouster_frame_t *frame;
+	/** Destaggered copies of the fields. NULL when ouster_pipeline_desc_t::destagger is zero */
+	ouster_field_t *destaggered;
+	/** Pointcloud in staggered pixel order, x,y,z doubles per pixel. NULL when no lut is given */
+	double *xyz;
+} ouster_pipeline_frame_t;
+
+/** Frame callback, called in frame order from the callback stage thread
+ *
+ * @param arg User argument
+ * @param frame The frame, only valid during the call
+ */
+typedef void (*ouster_pipeline_fn_t)(void *arg, ouster_pipeline_frame_t const *frame);
+
+typedef struct
+{
+	ouster_meta_t *meta;
+	/** Optional, converts the OUSTER_QUANTITY_RANGE field to xyz */
+	ouster_lut_t const *lut;
+	/** Quantity and depth of the fields to decode, like ouster_field_init() */
+	ouster_field_t const *fields;
+	int fcount;
+	/** Non zero also delivers destaggered copies of the fields */
+	int destagger;
+	/** Lidar UDP socket, e.g. from ouster_sock_create_udp_lidar(), not closed by the pipeline */
+	int sock;
+	/** Capacity of the packet queue, 0 uses 1024 */
+	int packets;
+	/** Capacity of every frame queue, 0 uses 2 */
+	int frames;
+	/** What happens when the queue into a stage is full, the receive entry is not used */
+	ouster_pipeline_policy_t policy[OUSTER_PIPELINE_COUNT];
+	/** Non zero pins every stage thread to its ouster_pipeline_desc_t::cpu */
+	int pin;
+	/** CPU of each stage thread when pinned, a negative value lets the scheduler decide */
+	int cpu[OUSTER_PIPELINE_COUNT];
+	/** Optional, the cartesian stage splits its work on this pool. Only used by the pipeline while it runs */
+	ouster_pool_t *workers;
+	ouster_pipeline_fn_t fn;
+	void *arg;
+} ouster_pipeline_desc_t;
+
+typedef struct
+{
+	ouster_pipeline_desc_t desc;
+	pthread_t threads[OUSTER_PIPELINE_COUNT];
+	/** Packets to decode and free packet buffers handed back to the receive stage */
+	ouster_spsc_t packets;
+	ouster_spsc_t packets_free;
+	char *packet_buf;
+	int packet_size;
+	/** Owned by the decode stage */
+	ouster_frame_pool_t pool;
+	/** Outputs of every pool frame */
+	ouster_pipeline_frame_t *outputs;
+	int range_index;
+	/** Frames into each stage from the stage before */
+	ouster_spsc_t queues[OUSTER_PIPELINE_COUNT];
+	/** Frames that stage is done with, released by the decode stage */
+	ouster_spsc_t returns[OUSTER_PIPELINE_COUNT];
+	/** Packets or frames finished by each stage, read with ouster_pipeline_stats() */
+	int64_t processed[OUSTER_PIPELINE_COUNT];
+	/** Packets or frames dropped because the queue into each stage was full */
+	int64_t dropped[OUSTER_PIPELINE_COUNT];
+	int quit;
+} ouster_pipeline_t;
+
+/** Per stage counters */
+typedef struct
+{
+	int64_t processed;
+	int64_t dropped;
+} ouster_pipeline_stats_t;
+
+/** Allocates the queues and frames and starts one thread per stage
+ *
+ * @param p The pipeline
+ * @param desc What to decode and where to deliver it, copied
+ * @return Returns 0 on ok otherwise -1 when a thread could not be started
+ */
+int ouster_pipeline_start(ouster_pipeline_t *p, ouster_pipeline_desc_t const *desc);
+
+/** Stops and joins the stage threads and frees everything, frames still queued are discarded
+ *
+ * @param p The pipeline
+ */
+void ouster_pipeline_stop(ouster_pipeline_t *p);
+
+/** Reads the counters of a stage, can be called from any thread
+ *
+ * @param p The pipeline
+ * @param stage The stage
+ * @param stats Counters
+ */
+void ouster_pipeline_stats(ouster_pipeline_t *p, ouster_pipeline_stage_t stage, ouster_pipeline_stats_t *stats);
+
+/** Returns the name of a stage
+ *
+ * @param stage The stage
+ * @return Stage name
+ */
+char const *ouster_pipeline_stage_str(ouster_pipeline_stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_PIPELINE_H
+
 /** @} */
 
 #ifdef OUSTER_NO_UDPCAP
@@ -1009,8 +2411,22 @@ typedef enum {
 	OUSTER_UDPCAP_ERROR_FREAD,
 	OUSTER_UDPCAP_ERROR_FWRITE,
 	OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL,
+	OUSTER_UDPCAP_ERROR_FOPEN,
+	OUSTER_UDPCAP_ERROR_EOF,
 } ouster_udpcap_error_t;
 
+/** Port of the footer record that closes a capture segment */
+#define OUSTER_UDPCAP_PORT_FOOTER UINT32_C(0xFFFFFFFF)
+
+/** Identifies a footer record, "OUCF" */
+#define OUSTER_UDPCAP_FOOTER_MAGIC UINT32_C(0x4643554F)
+
+/** Max length of capture file paths */
+#define OUSTER_UDPCAP_PATH_MAX 1024
+
+/** Segmented captures are named <path>.<segment> */
+#define OUSTER_UDPCAP_SEGMENT_FORMAT "%s.%06i"
+
 typedef struct
 {
 	uint32_t port;
@@ -1018,6 +2434,56 @@ typedef struct
 	char buf[];
 } ouster_udpcap_t;
 
+/** Payload of the footer record written when a segment is closed.
+ * All values are little endian in the file. */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t segment;
+	/** Number of records in the segment, footer excluded */
+	uint64_t records;
+	/** Number of bytes in the segment, footer excluded */
+	uint64_t bytes;
+	/** Monotonic time in nanoseconds when the segment was opened */
+	uint64_t t_open;
+	/** Monotonic time in nanoseconds when the segment was closed */
+	uint64_t t_close;
+} ouster_udpcap_footer_t;
+
+/** Writes capture records and rotates to a new segment file at size or time limits */
+typedef struct
+{
+	char path[OUSTER_UDPCAP_PATH_MAX];
+	/** Rotate before a segment grows beyond this many bytes, 0 = no limit */
+	int64_t max_bytes;
+	/** Rotate when a segment has been open this many nanoseconds, 0 = no limit */
+	int64_t max_ns;
+	FILE *file;
+	int segmented;
+	int segment;
+	int64_t bytes;
+	int64_t records;
+	int64_t t_open;
+	int64_t t_flush;
+} ouster_udpcap_writer_t;
+
+/** Reads a plain capture file or all segments of a segmented capture as one stream */
+typedef struct
+{
+	char path[OUSTER_UDPCAP_PATH_MAX];
+	FILE *file;
+	int segmented;
+	int segment;
+	/** Last segment found when the capture was opened */
+	int last;
+	/** Number of segments that ended with an incomplete record */
+	int truncated;
+	/** Number of segments between the first and last segment that could not be opened */
+	int missing;
+	/** Footer of the most recently finished segment */
+	ouster_udpcap_footer_t footer;
+} ouster_udpcap_reader_t;
+
 /** Read file into capture buffer
  *
  * @param cap The capture buffer.
@@ -1035,6 +2501,18 @@ int ouster_udpcap_read(ouster_udpcap_t *cap, FILE *f);
  */
 int ouster_udpcap_sendto(ouster_udpcap_t *cap, int sock, ouster_net_addr_t *addr);
 
+/** Send multiple capture buffers from sock to addr in batches
+ *
+ * Each capture buffer is sent to the port stored in the capture buffer.
+ *
+ * @param caps The capture buffers.
+ * @param n Number of capture buffers
+ * @param sock The source socket filedescriptor
+ * @param addr The destination address
+ * @return Returns the number of capture buffers sent, or -1 for errors
+ */
+int ouster_udpcap_sendmmsg(ouster_udpcap_t *caps[], int n, int sock, ouster_net_addr_t *addr);
+
 /** Find header in request.
  *
  * @param cap The capture buffer.
@@ -1044,6 +2522,84 @@ int ouster_udpcap_sendto(ouster_udpcap_t *cap, int sock, ouster_net_addr_t *addr
  */
 int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f);
 
+/** Receive one UDP packet into the capture buffer
+ *
+ * @param cap The capture buffer, cap->size is the buffer capacity.
+ * @param sock The socket filedescriptor
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_recv(ouster_udpcap_t *cap, int sock);
+
+/** Write the capture buffer as one record
+ *
+ * @param cap The capture buffer.
+ * @param f Destination file
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_write(ouster_udpcap_t const *cap, FILE *f);
+
+/** Truncates an incomplete record at the end of a capture file and appends a footer
+ *
+ * @param filename The capture file
+ * @param segment Segment number stored in a new footer
+ * @param footer Optional output of the footer that was found or written
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_recover(char const *filename, int segment, ouster_udpcap_footer_t *footer);
+
+/** Open a capture writer.
+ * Without any limits a single plain capture file is written to path,
+ * otherwise segments are written to path.000000, path.000001, ...
+ * continuing after the last existing segment.
+ *
+ * @param w The writer
+ * @param path Capture file path
+ * @param max_bytes Segment size limit in bytes, 0 = no limit
+ * @param max_ns Segment duration limit in nanoseconds, 0 = no limit
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_writer_open(ouster_udpcap_writer_t *w, char const *path, int64_t max_bytes, int64_t max_ns);
+
+/** Write a capture record, rotates segment when a limit is reached
+ *
+ * @param w The writer
+ * @param cap The capture buffer.
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_writer_write(ouster_udpcap_writer_t *w, ouster_udpcap_t const *cap);
+
+/** Write footer, sync and close the current segment
+ *
+ * @param w The writer
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_writer_close(ouster_udpcap_writer_t *w);
+
+/** Open a capture reader.
+ * Opens path as a plain capture file if it exists, otherwise as a segmented capture.
+ *
+ * @param r The reader
+ * @param path Capture file path
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_udpcap_reader_open(ouster_udpcap_reader_t *r, char const *path);
+
+/** Read the next record, footers are skipped and segments are stitched together.
+ * A truncated segment ends at its last complete record.
+ * Segments that are missing are skipped and counted in r->missing.
+ *
+ * @param r The reader
+ * @param cap The capture buffer, cap->size is the buffer capacity.
+ * @return Returns 0 on ok, OUSTER_UDPCAP_ERROR_EOF at the end of the capture, otherwise error code
+ */
+int ouster_udpcap_reader_read(ouster_udpcap_reader_t *r, ouster_udpcap_t *cap);
+
+/** Close the capture reader
+ *
+ * @param r The reader
+ */
+void ouster_udpcap_reader_close(ouster_udpcap_reader_t *r);
+
 /** Set the UDP port of the capture buffer.
  *
  * @param cap The capture buffer.
@@ -1051,12 +2607,209 @@ int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f);
  */
 void ouster_udpcap_set_port(ouster_udpcap_t *cap, int port);
 
+/** Writes a segmented capture to path, removes a segment in the middle and reads it back.
+ * The segment files are removed afterwards.
+ *
+ * @param path Capture file path
+ * @return Returns 1 when all records of the remaining segments are read and the gap is counted
+ */
+int test_ouster_udpcap(char const *path);
+
 #ifdef __cplusplus
 }
 #endif
 
 #endif // OUSTER_UDPCAP_H
 
+/** @} */
+/**
+ * @defgroup blackbox Black-box recorder
+ * @brief Keeps the last seconds of UDP packets in memory and dumps them to a capture file on trigger
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_BLACKBOX_H
+#define OUSTER_BLACKBOX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+/** Incident captures are named <path>.incidentNNNN */
+#define OUSTER_BLACKBOX_FILE_FORMAT "%s.incident%04i"
+
+typedef struct
+{
+	char path[OUSTER_UDPCAP_PATH_MAX];
+	/** Preallocated ring memory */
+	char *data;
+	int64_t capacity;
+	/** Offset of the next record to write */
+	int64_t head;
+	/** Offset of the oldest record */
+	int64_t tail;
+	/** Offset of the oldest record not yet written to the incident capture */
+	int64_t dump;
+	/** Bytes in use including padding */
+	int64_t used;
+	/** Bytes from dump to head not yet written to the incident capture */
+	int64_t dump_used;
+	/** Records younger than this are kept */
+	int64_t window_ns;
+	/** Keep writing this long after a trigger */
+	int64_t post_ns;
+	/** Set by ouster_blackbox_trigger() */
+	int trigger_request;
+	/** Time of the last trigger, valid while dumping */
+	int64_t trigger_t;
+	int dumping;
+	/** The post trigger time has passed, only the backlog remains to be written */
+	int dump_closing;
+	int incidents;
+	/** Records evicted before they were older than window_ns */
+	int64_t overwritten;
+	/** Packets not stored because writing an incident failed */
+	int64_t dropped;
+	ouster_udpcap_writer_t writer;
+} ouster_blackbox_t;
+
+/** Allocates the ring buffer
+ *
+ * @param bb The black-box recorder
+ * @param path Incident captures are written to path.incident0000, path.incident0001, ...
+ * @param capacity Size of the ring buffer in bytes
+ * @param window_ns How many nanoseconds of packets before a trigger to keep
+ * @param post_ns How many nanoseconds of packets after a trigger to write
+ */
+void ouster_blackbox_init(ouster_blackbox_t *bb, char const *path, int64_t capacity, int64_t window_ns, int64_t post_ns);
+
+/** Finishes an ongoing incident capture and frees the ring buffer
+ *
+ * @param bb The black-box recorder
+ */
+void ouster_blackbox_fini(ouster_blackbox_t *bb);
+
+/** Request an incident capture.
+ * Only sets a flag, which makes it safe to call from signal handlers and other threads.
+ * The capture is started by the next ouster_blackbox_push() or ouster_blackbox_flush().
+ *
+ * @param bb The black-box recorder
+ */
+void ouster_blackbox_trigger(ouster_blackbox_t *bb);
+
+/** Store a packet in the ring buffer.
+ * While an incident capture is ongoing a bounded part of the backlog is written per call.
+ *
+ * @param bb The black-box recorder
+ * @param cap The capture buffer
+ * @param t Monotonic time in nanoseconds, see ouster_os_clock_ns()
+ * @return Returns 0 on ok otherwise error code, the packet is not stored and counted in ouster_blackbox_t::dropped
+ */
+int ouster_blackbox_push(ouster_blackbox_t *bb, ouster_udpcap_t const *cap, int64_t t);
+
+/** Write backlog of an ongoing incident capture, e.g. when the receive loop is idle
+ *
+ * @param bb The black-box recorder
+ * @param max_bytes Max number of bytes to write, -1 writes all
+ * @param t Monotonic time in nanoseconds, see ouster_os_clock_ns()
+ * @return Returns 0 on ok otherwise error code
+ */
+int ouster_blackbox_flush(ouster_blackbox_t *bb, int64_t max_bytes, int64_t t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_BLACKBOX_H
+
+/** @} */
+/**
+ * @defgroup batch Parallel capture decoding
+ * @brief Decodes the frames of a capture file on a thread pool and delivers them in order
+ *
+ * \ingroup c
+ * @{
+ */
+
+#ifndef OUSTER_BATCH_H
+#define OUSTER_BATCH_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	/** Frame number counted from the start of the capture */
+	int index;
+	/** Decode state after the last packet of the frame, e.g. frame_id and mid_loss */
+	ouster_lidar_t lidar;
+	/** Number of lidar packets in the frame */
+	int packets;
+	/** Decoded fields in the order of ouster_batch_desc_t::fields */
+	ouster_field_t *fields;
+	int fcount;
+	/** Pointcloud, x,y,z doubles per pixel. NULL when no lut is given */
+	double *xyz;
+} ouster_batch_frame_t;
+
+/** Frame callback, called in capture order from the thread calling ouster_batch_run()
+ *
+ * @param arg User argument
+ * @param frame The decoded frame, only valid during the call
+ */
+typedef void (*ouster_batch_fn_t)(void *arg, ouster_batch_frame_t const *frame);
+
+typedef struct
+{
+	ouster_meta_t *meta;
+	/** Optional, converts the OUSTER_QUANTITY_RANGE field to xyz */
+	ouster_lut_t const *lut;
+	/** Quantity and depth of the fields to decode, like ouster_field_init() */
+	ouster_field_t const *fields;
+	int fcount;
+	/** Number of decode threads, 0 uses all CPUs */
+	int threads;
+	/** Frames decoded per thread before delivering them, 0 uses 2 */
+	int frames_per_thread;
+	ouster_batch_fn_t fn;
+	void *arg;
+} ouster_batch_desc_t;
+
+typedef struct
+{
+	/** Number of frames delivered */
+	int frames;
+	/** Number of capture segments that ended with an incomplete record */
+	int truncated;
+	/** Number of capture segments that could not be opened */
+	int missing;
+} ouster_batch_stats_t;
+
+/** Decodes all frames of a capture file.
+ * Packets of a batch of frames are read sequentially, then the frames are decoded in parallel
+ * with their own ouster_lidar_t, fields and xyz buffers, then delivered in order.
+ * Frames read before a read error are still delivered.
+ *
+ * @param desc What to decode and where to deliver it
+ * @param path Capture file or segmented capture, see ouster_udpcap_reader_open()
+ * @param stats Optional output of what was read, also when an error is returned
+ * @return Returns 0 on ok otherwise udpcap error code
+ */
+int ouster_batch_run(ouster_batch_desc_t const *desc, char const *path, ouster_batch_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OUSTER_BATCH_H
+
 /** @} */
 #endif
 
@@ -1085,6 +2838,9 @@ void ouster_dump_column(FILE * f, ouster_column_t const *column);
 
 void ouster_dump_meta(FILE *f, ouster_meta_t const *meta);
 
+/** Prints count, mean, percentiles and max of every profile stage in microseconds */
+void ouster_dump_profile(FILE *f);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,301 @@
+#include "ouster_clib.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Transparent huge page size on x86_64 and aarch64 with 4 kB pages */
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+#define ARENA_PAGE 4096
+
+/* Size classes are 16 << k bytes including the block header, the largest is 16 MB */
+#define ARENA_CLASS_MIN_SHIFT 4
+#define ARENA_CLASS_COUNT 21
+
+/* Free blocks a thread keeps per class before half of them go back to the shared lists */
+#define ARENA_CACHE_MAX 64
+
+/* Class of blocks from the system allocator */
+#define ARENA_CLASS_SYSTEM UINT16_C(0xFFFF)
+#define ARENA_MAGIC UINT32_C(0x4E455241)
+
+typedef struct
+{
+	uint16_t cls;
+	/** Subsystem from ouster_os_mem_count_alloc() */
+	uint16_t tag;
+	uint32_t magic;
+	/** Requested size */
+	uint64_t size;
+} arena_header_t;
+
+typedef struct arena_block_t
+{
+	struct arena_block_t *next;
+} arena_block_t;
+
+typedef struct
+{
+	arena_block_t *head[ARENA_CLASS_COUNT];
+	int count[ARENA_CLASS_COUNT];
+	int registered;
+} arena_cache_t;
+
+static ouster_arena_t arena_memory;
+static arena_block_t *arena_shared[ARENA_CLASS_COUNT];
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static __thread arena_cache_t arena_cache;
+
+int ouster_arena_init(ouster_arena_t *arena, size_t capacity)
+{
+	ouster_assert_notnull(arena);
+	memset(arena, 0, sizeof(ouster_arena_t));
+	capacity = (capacity + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+	// Map one extra huge page so the base can be aligned for the kernel to use huge pages
+	size_t map_size = capacity + ARENA_HUGE_PAGE;
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	arena->map = map;
+	arena->map_size = map_size;
+	arena->base = (char *)(((uintptr_t)map + ARENA_HUGE_PAGE - 1) & ~(uintptr_t)(ARENA_HUGE_PAGE - 1));
+	arena->capacity = capacity;
+	arena->used = 0;
+#ifdef MADV_HUGEPAGE
+	// Only a hint, the arena works with normal pages when transparent huge pages are disabled
+	madvise(arena->base, capacity, MADV_HUGEPAGE);
+#endif
+	return 0;
+}
+
+void ouster_arena_fini(ouster_arena_t *arena)
+{
+	ouster_assert_notnull(arena);
+	if (arena->map) {
+		munmap(arena->map, arena->map_size);
+	}
+	memset(arena, 0, sizeof(ouster_arena_t));
+}
+
+void ouster_arena_prefault(ouster_arena_t *arena)
+{
+	ouster_assert_notnull(arena);
+	for (size_t i = 0; i < arena->capacity; i += ARENA_PAGE) {
+		((volatile char *)arena->base)[i] = 0;
+	}
+}
+
+void *ouster_arena_alloc(ouster_arena_t *arena, size_t size)
+{
+	ouster_assert_notnull(arena);
+	size = (size + OUSTER_ARENA_ALIGN - 1) & ~(size_t)(OUSTER_ARENA_ALIGN - 1);
+	size_t offset = __atomic_fetch_add(&arena->used, size, __ATOMIC_RELAXED);
+	if ((offset + size) > arena->capacity) {
+		return NULL;
+	}
+	return arena->base + offset;
+}
+
+void ouster_arena_reset(ouster_arena_t *arena)
+{
+	ouster_assert_notnull(arena);
+	__atomic_store_n(&arena->used, 0, __ATOMIC_RELAXED);
+}
+
+/* Smallest class holding size bytes plus header, ARENA_CLASS_COUNT when too large */
+static int arena_class(size_t size)
+{
+	uint64_t total = (uint64_t)size + sizeof(arena_header_t);
+	if (total > ((uint64_t)1 << (ARENA_CLASS_MIN_SHIFT + ARENA_CLASS_COUNT - 1))) {
+		return ARENA_CLASS_COUNT;
+	}
+	// Number of bits of total - 1 is log2 of the next power of two, total is at least 16
+	int bits = 64 - __builtin_clzll(total - 1);
+	return bits > ARENA_CLASS_MIN_SHIFT ? (bits - ARENA_CLASS_MIN_SHIFT) : 0;
+}
+
+/* Returns the blocks cached by an exiting thread to the shared lists */
+static void arena_cache_flush(void *arg)
+{
+	arena_cache_t *cache = arg;
+	pthread_mutex_lock(&arena_lock);
+	for (int k = 0; k < ARENA_CLASS_COUNT; ++k) {
+		while (cache->head[k]) {
+			arena_block_t *b = cache->head[k];
+			cache->head[k] = b->next;
+			b->next = arena_shared[k];
+			arena_shared[k] = b;
+		}
+		cache->count[k] = 0;
+	}
+	pthread_mutex_unlock(&arena_lock);
+}
+
+static void arena_key_create(void)
+{
+	pthread_key_create(&arena_key, arena_cache_flush);
+}
+
+static arena_cache_t *arena_cache_get(void)
+{
+	arena_cache_t *cache = &arena_cache;
+	if (cache->registered == 0) {
+		pthread_once(&arena_key_once, arena_key_create);
+		pthread_setspecific(arena_key, cache);
+		cache->registered = 1;
+	}
+	return cache;
+}
+
+static void *arena_system_alloc(size_t size)
+{
+	arena_header_t *h = malloc(sizeof(arena_header_t) + size);
+	if (h == NULL) {
+		return NULL;
+	}
+	h->cls = ARENA_CLASS_SYSTEM;
+	h->tag = (uint16_t)ouster_os_mem_count_alloc(size);
+	h->magic = ARENA_MAGIC;
+	h->size = size;
+	return h + 1;
+}
+
+static void *arena_alloc(size_t size)
+{
+	int k = arena_class(size);
+	if (k >= ARENA_CLASS_COUNT) {
+		return arena_system_alloc(size);
+	}
+	arena_cache_t *cache = arena_cache_get();
+	if (cache->head[k] == NULL) {
+		// Take half a cache worth of blocks from the shared list
+		pthread_mutex_lock(&arena_lock);
+		while (arena_shared[k] && (cache->count[k] < (ARENA_CACHE_MAX / 2))) {
+			arena_block_t *b = arena_shared[k];
+			arena_shared[k] = b->next;
+			b->next = cache->head[k];
+			cache->head[k] = b;
+			cache->count[k]++;
+		}
+		pthread_mutex_unlock(&arena_lock);
+	}
+	arena_header_t *h;
+	if (cache->head[k]) {
+		arena_block_t *b = cache->head[k];
+		cache->head[k] = b->next;
+		cache->count[k]--;
+		h = (arena_header_t *)b;
+	} else {
+		h = ouster_arena_alloc(&arena_memory, (size_t)1 << (ARENA_CLASS_MIN_SHIFT + k));
+		if (h == NULL) {
+			return arena_system_alloc(size);
+		}
+	}
+	h->cls = (uint16_t)k;
+	h->tag = (uint16_t)ouster_os_mem_count_alloc(size);
+	h->magic = ARENA_MAGIC;
+	h->size = size;
+	return h + 1;
+}
+
+static size_t arena_usable(arena_header_t const *h)
+{
+	if (h->cls == ARENA_CLASS_SYSTEM) {
+		return h->size;
+	}
+	return ((size_t)1 << (ARENA_CLASS_MIN_SHIFT + h->cls)) - sizeof(arena_header_t);
+}
+
+static void arena_free(void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	arena_header_t *h = (arena_header_t *)ptr - 1;
+	ouster_assert(h->magic == ARENA_MAGIC, "Not allocated by the arena allocator");
+	ouster_os_mem_count_free(h->tag, h->size);
+	if (h->cls == ARENA_CLASS_SYSTEM) {
+		free(h);
+		return;
+	}
+	int k = (int)h->cls;
+	arena_cache_t *cache = arena_cache_get();
+	arena_block_t *b = (arena_block_t *)h;
+	b->next = cache->head[k];
+	cache->head[k] = b;
+	cache->count[k]++;
+	if (cache->count[k] > ARENA_CACHE_MAX) {
+		pthread_mutex_lock(&arena_lock);
+		while (cache->count[k] > (ARENA_CACHE_MAX / 2)) {
+			b = cache->head[k];
+			cache->head[k] = b->next;
+			b->next = arena_shared[k];
+			arena_shared[k] = b;
+			cache->count[k]--;
+		}
+		pthread_mutex_unlock(&arena_lock);
+	}
+}
+
+static void *ouster_os_arena_malloc(size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_malloc_count, 1, __ATOMIC_RELAXED);
+	return arena_alloc(size);
+}
+
+static void *ouster_os_arena_calloc(size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_calloc_count, 1, __ATOMIC_RELAXED);
+	void *ptr = arena_alloc(size);
+	if (ptr) {
+		// Recycled blocks are not zero
+		memset(ptr, 0, size);
+	}
+	return ptr;
+}
+
+static void ouster_os_arena_free(void *ptr)
+{
+	__atomic_fetch_add(&ouster_os_api_free_count, 1, __ATOMIC_RELAXED);
+	arena_free(ptr);
+}
+
+static void *ouster_os_arena_realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&ouster_os_api_realloc_count, 1, __ATOMIC_RELAXED);
+	if (ptr == NULL) {
+		return arena_alloc(size);
+	}
+	arena_header_t *h = (arena_header_t *)ptr - 1;
+	ouster_assert(h->magic == ARENA_MAGIC, "Not allocated by the arena allocator");
+	size_t usable = arena_usable(h);
+	if ((h->cls != ARENA_CLASS_SYSTEM) && (size <= usable)) {
+		ouster_os_mem_count_free(h->tag, h->size);
+		h->tag = (uint16_t)ouster_os_mem_count_alloc(size);
+		h->size = size;
+		return ptr;
+	}
+	void *dst = arena_alloc(size);
+	if (dst) {
+		memcpy(dst, ptr, usable < size ? usable : size);
+		arena_free(ptr);
+	}
+	return dst;
+}
+
+int ouster_os_set_api_arena(size_t capacity)
+{
+	ouster_os_set_api_defaults();
+	if (ouster_arena_init(&arena_memory, capacity) != 0) {
+		return -1;
+	}
+	ouster_os_api.malloc_ = ouster_os_arena_malloc;
+	ouster_os_api.free_ = ouster_os_arena_free;
+	ouster_os_api.realloc_ = ouster_os_arena_realloc;
+	ouster_os_api.calloc_ = ouster_os_arena_calloc;
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+typedef struct
+{
+	ouster_batch_frame_t frame;
+	/** Raw lidar packets of the frame, lidar_packet_size each */
+	char *buf;
+	int cap;
+	int range_index;
+} batch_slot_t;
+
+typedef struct
+{
+	ouster_batch_desc_t const *desc;
+	batch_slot_t *slots;
+} batch_t;
+
+static void slot_init(batch_slot_t *slot, ouster_batch_desc_t const *desc)
+{
+	memset(slot, 0, sizeof(batch_slot_t));
+	slot->range_index = -1;
+	slot->frame.fcount = desc->fcount;
+	slot->frame.fields = ouster_os_calloc(sizeof(ouster_field_t) * desc->fcount);
+	ouster_assert_notnull(slot->frame.fields);
+	for (int i = 0; i < desc->fcount; ++i) {
+		slot->frame.fields[i].quantity = desc->fields[i].quantity;
+		slot->frame.fields[i].depth = desc->fields[i].depth;
+		if ((desc->fields[i].quantity == OUSTER_QUANTITY_RANGE) && (desc->fields[i].depth == 4)) {
+			slot->range_index = i;
+		}
+	}
+	ouster_field_init(slot->frame.fields, desc->fcount, desc->meta);
+	if (desc->lut) {
+		ouster_assert(slot->range_index >= 0, "A 4 byte OUSTER_QUANTITY_RANGE field is needed for xyz");
+		slot->frame.xyz = ouster_lut_alloc(desc->lut);
+	}
+}
+
+static void slot_fini(batch_slot_t *slot)
+{
+	for (int i = 0; i < slot->frame.fcount; ++i) {
+		ouster_os_free(slot->frame.fields[i].data);
+	}
+	ouster_os_free(slot->frame.fields);
+	ouster_os_free(slot->frame.xyz);
+	ouster_os_free(slot->buf);
+}
+
+static void slot_append(batch_slot_t *slot, char const *packet, int size)
+{
+	int need = (slot->frame.packets + 1) * size;
+	if (need > slot->cap) {
+		slot->cap = need * 2;
+		slot->buf = ouster_os_realloc(slot->buf, slot->cap);
+		ouster_assert_notnull(slot->buf);
+	}
+	memcpy(slot->buf + slot->frame.packets * size, packet, size);
+	slot->frame.packets++;
+}
+
+/* Returns the reader result, other packets such as IMU are skipped */
+static int read_lidar_packet(ouster_udpcap_reader_t *reader, ouster_udpcap_t *cap, int size)
+{
+	do {
+		cap->size = OUSTER_NET_UDP_MAX_SIZE;
+		int rc = ouster_udpcap_reader_read(reader, cap);
+		if (rc != OUSTER_UDPCAP_OK) {
+			return rc;
+		}
+	} while ((int)cap->size != size);
+	return OUSTER_UDPCAP_OK;
+}
+
+static int packet_frame_id(ouster_udpcap_t const *cap)
+{
+	ouster_lidar_header_t header;
+	ouster_lidar_header_get(cap->buf, &header);
+	return (int)header.frame_id;
+}
+
+static void decode(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	batch_t *batch = arg;
+	ouster_batch_desc_t const *desc = batch->desc;
+	batch_slot_t *slot = batch->slots + index;
+	ouster_batch_frame_t *frame = &slot->frame;
+	int size = desc->meta->lidar_packet_size;
+
+	ouster_trace_begin(t);
+	ouster_field_zero(frame->fields, frame->fcount);
+	memset(&frame->lidar, 0, sizeof(ouster_lidar_t));
+	frame->lidar.frame_id = -1;
+	for (int i = 0; i < frame->packets; ++i) {
+		ouster_lidar_get_fields(&frame->lidar, desc->meta, slot->buf + i * size, frame->fields, frame->fcount);
+	}
+	ouster_trace_end(t, "batch_decode", frame->lidar.frame_id);
+	if (desc->lut) {
+		ouster_lut_cartesian_f64(desc->lut, frame->fields[slot->range_index].data, frame->xyz, 3 * sizeof(double));
+	}
+}
+
+int ouster_batch_run(ouster_batch_desc_t const *desc, char const *path, ouster_batch_stats_t *stats)
+{
+	ouster_assert_notnull(desc);
+	ouster_assert_notnull(desc->meta);
+	ouster_assert_notnull(desc->fn);
+	ouster_assert_notnull(path);
+	ouster_assert(desc->fields || (desc->fcount == 0), "");
+
+	if (stats) {
+		memset(stats, 0, sizeof(ouster_batch_stats_t));
+	}
+
+	ouster_udpcap_reader_t reader;
+	int rc = ouster_udpcap_reader_open(&reader, path);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+
+	ouster_pool_t pool;
+	ouster_pool_init(&pool, desc->threads);
+	int nslots = pool.count * (desc->frames_per_thread > 0 ? desc->frames_per_thread : 2);
+	batch_t batch = {desc, ouster_os_calloc(sizeof(batch_slot_t) * nslots)};
+	ouster_assert_notnull(batch.slots);
+	for (int i = 0; i < nslots; ++i) {
+		slot_init(batch.slots + i, desc);
+	}
+
+	int size = desc->meta->lidar_packet_size;
+	ouster_udpcap_t *cap = ouster_os_calloc(sizeof(ouster_udpcap_t) + OUSTER_NET_UDP_MAX_SIZE);
+	ouster_assert_notnull(cap);
+	int index = 0;
+	// cap always holds the next lidar packet
+	rc = read_lidar_packet(&reader, cap, size);
+	int more = (rc == OUSTER_UDPCAP_OK);
+	while (more) {
+		int n = 0;
+		while (more && (n < nslots)) {
+			batch_slot_t *slot = batch.slots + n++;
+			slot->frame.packets = 0;
+			slot->frame.index = index++;
+			int frame_id = packet_frame_id(cap);
+			do {
+				slot_append(slot, cap->buf, size);
+				rc = read_lidar_packet(&reader, cap, size);
+				more = (rc == OUSTER_UDPCAP_OK);
+			} while (more && (packet_frame_id(cap) == frame_id));
+		}
+		ouster_pool_run(&pool, decode, &batch, n);
+		for (int i = 0; i < n; ++i) {
+			desc->fn(desc->arg, &batch.slots[i].frame);
+		}
+	}
+
+	if (rc == OUSTER_UDPCAP_ERROR_EOF) {
+		rc = OUSTER_UDPCAP_OK;
+	} else {
+		ouster_log_error("%s: reading frame %i failed, error %i\n", path, index, rc);
+	}
+	if (reader.truncated || reader.missing) {
+		ouster_log_warn("%s: %i truncated and %i missing segments\n", path, reader.truncated, reader.missing);
+	}
+	if (stats) {
+		stats->frames = index;
+		stats->truncated = reader.truncated;
+		stats->missing = reader.missing;
+	}
+
+	ouster_os_free(cap);
+	for (int i = 0; i < nslots; ++i) {
+		slot_fini(batch.slots + i);
+	}
+	ouster_os_free(batch.slots);
+	ouster_pool_fini(&pool);
+	ouster_udpcap_reader_close(&reader);
+	return rc;
+}
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+/* Marks unused space at the end of the ring */
+#define BLACKBOX_PORT_PAD UINT32_C(0xFFFFFFFE)
+
+/* Backlog written per pushed byte while an incident capture is ongoing */
+#define BLACKBOX_FLUSH_FACTOR 4
+
+/* Ring records are 8 byte aligned: [int64_t t][ouster_udpcap_t][payload] */
+#define BLACKBOX_RECORD_HEADER_SIZE (sizeof(int64_t) + sizeof(ouster_udpcap_t))
+#define BLACKBOX_RECORD_SIZE(size) ((BLACKBOX_RECORD_HEADER_SIZE + (size) + 7) & ~(int64_t)7)
+
+static int64_t record_t(ouster_blackbox_t const *bb, int64_t offset)
+{
+	int64_t t;
+	memcpy(&t, bb->data + offset, sizeof(int64_t));
+	return t;
+}
+
+static ouster_udpcap_t *record_cap(ouster_blackbox_t const *bb, int64_t offset)
+{
+	return (void *)(bb->data + offset + sizeof(int64_t));
+}
+
+/* Returns the number of padding bytes at offset, 0 if a record starts there */
+static int64_t padding_at(ouster_blackbox_t const *bb, int64_t offset)
+{
+	int64_t rest = bb->capacity - offset;
+	if ((rest < (int64_t)BLACKBOX_RECORD_HEADER_SIZE) || (record_cap(bb, offset)->port == BLACKBOX_PORT_PAD)) {
+		return rest;
+	}
+	return 0;
+}
+
+/* Moves tail and dump past padding, returns non zero if tail moved */
+static int skip_padding(ouster_blackbox_t *bb)
+{
+	int moved = 0;
+	if (bb->used > 0) {
+		int64_t pad = padding_at(bb, bb->tail);
+		if (pad) {
+			bb->used -= pad;
+			bb->tail = 0;
+			moved = 1;
+		}
+	}
+	if (bb->dump_used > 0) {
+		int64_t pad = padding_at(bb, bb->dump);
+		if (pad) {
+			bb->dump_used -= pad;
+			bb->dump = 0;
+		}
+	}
+	return moved;
+}
+
+/* The oldest record has not been written to the incident capture yet */
+static int oldest_undumped(ouster_blackbox_t const *bb)
+{
+	return (bb->dump_used > 0) && (bb->dump == bb->tail);
+}
+
+static int dump_start(ouster_blackbox_t *bb, int64_t t)
+{
+	bb->trigger_t = t;
+	if (bb->dumping) {
+		// Extend the ongoing incident
+		bb->dump_closing = 0;
+		return OUSTER_UDPCAP_OK;
+	}
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	snprintf(filename, sizeof(filename), OUSTER_BLACKBOX_FILE_FORMAT, bb->path, bb->incidents);
+	ouster_log("Black-box incident capture '%s'\n", filename);
+	int rc = ouster_udpcap_writer_open(&bb->writer, filename, 0, 0);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+	bb->incidents++;
+	bb->dumping = 1;
+	bb->dump_closing = 0;
+	bb->dump = bb->tail;
+	bb->dump_used = bb->used;
+	return OUSTER_UDPCAP_OK;
+}
+
+/* Writes the oldest record not yet written to the incident capture */
+static int dump_one(ouster_blackbox_t *bb)
+{
+	skip_padding(bb);
+	if (bb->dump_used == 0) {
+		return OUSTER_UDPCAP_OK;
+	}
+	ouster_udpcap_t const *cap = record_cap(bb, bb->dump);
+	int64_t size = BLACKBOX_RECORD_SIZE(cap->size);
+	int rc = ouster_udpcap_writer_write(&bb->writer, cap);
+	bb->dump = (bb->dump + size) % bb->capacity;
+	bb->dump_used -= size;
+	return rc;
+}
+
+static int dump_finish(ouster_blackbox_t *bb)
+{
+	bb->dumping = 0;
+	bb->dump_closing = 0;
+	bb->dump_used = 0;
+	return ouster_udpcap_writer_close(&bb->writer);
+}
+
+/* Removes the oldest record, it is written first if it is part of an incident */
+static int pop(ouster_blackbox_t *bb)
+{
+	int rc = OUSTER_UDPCAP_OK;
+	skip_padding(bb);
+	if (bb->used == 0) {
+		return rc;
+	}
+	if (oldest_undumped(bb)) {
+		rc = dump_one(bb);
+	}
+	int64_t size = BLACKBOX_RECORD_SIZE(record_cap(bb, bb->tail)->size);
+	bb->tail = (bb->tail + size) % bb->capacity;
+	bb->used -= size;
+	return rc;
+}
+
+/* Makes room for a record of size bytes at head */
+static int make_room(ouster_blackbox_t *bb, int64_t size)
+{
+	int rc = OUSTER_UDPCAP_OK;
+	while (rc == OUSTER_UDPCAP_OK) {
+		if (bb->used == 0) {
+			bb->head = 0;
+			bb->tail = 0;
+			bb->dump = 0;
+		}
+		if ((bb->head > bb->tail) || (bb->used == 0)) {
+			int64_t rest = bb->capacity - bb->head;
+			if (rest >= size) {
+				break;
+			}
+			// Not enough room at the end, wrap around to the start
+			if (rest >= (int64_t)BLACKBOX_RECORD_HEADER_SIZE) {
+				record_cap(bb, bb->head)->port = BLACKBOX_PORT_PAD;
+			}
+			bb->used += rest;
+			bb->dump_used += (bb->dumping && !bb->dump_closing) ? rest : 0;
+			bb->head = 0;
+		} else if ((bb->tail - bb->head) >= size) {
+			break;
+		} else if (skip_padding(bb) == 0) {
+			bb->overwritten += !oldest_undumped(bb);
+			rc = pop(bb);
+		}
+	}
+	return rc;
+}
+
+void ouster_blackbox_init(ouster_blackbox_t *bb, char const *path, int64_t capacity, int64_t window_ns, int64_t post_ns)
+{
+	ouster_assert_notnull(bb);
+	ouster_assert_notnull(path);
+	ouster_assert(capacity > 0, "");
+	ouster_assert(window_ns >= 0, "");
+	ouster_assert(post_ns >= 0, "");
+
+	memset(bb, 0, sizeof(ouster_blackbox_t));
+	snprintf(bb->path, sizeof(bb->path), "%s", path);
+	bb->capacity = capacity & ~(int64_t)7;
+	bb->window_ns = window_ns;
+	bb->post_ns = post_ns;
+	bb->data = ouster_os_malloc(bb->capacity);
+	ouster_assert_notnull(bb->data);
+	// Touch every page now instead of page faulting on the receive thread
+	memset(bb->data, 0, bb->capacity);
+}
+
+void ouster_blackbox_fini(ouster_blackbox_t *bb)
+{
+	ouster_assert_notnull(bb);
+	if (bb->dumping) {
+		while (bb->dump_used > 0) {
+			dump_one(bb);
+		}
+		dump_finish(bb);
+	}
+	ouster_os_free(bb->data);
+	bb->data = NULL;
+}
+
+void ouster_blackbox_trigger(ouster_blackbox_t *bb)
+{
+	ouster_assert_notnull(bb);
+	__atomic_store_n(&bb->trigger_request, 1, __ATOMIC_RELEASE);
+}
+
+int ouster_blackbox_flush(ouster_blackbox_t *bb, int64_t max_bytes, int64_t t)
+{
+	ouster_assert_notnull(bb);
+
+	int rc = OUSTER_UDPCAP_OK;
+	if (__atomic_exchange_n(&bb->trigger_request, 0, __ATOMIC_ACQUIRE)) {
+		rc = dump_start(bb, t);
+	}
+	if (bb->dumping == 0) {
+		return rc;
+	}
+	if ((t - bb->trigger_t) >= bb->post_ns) {
+		bb->dump_closing = 1;
+	}
+	int64_t written = 0;
+	while ((rc == OUSTER_UDPCAP_OK) && (bb->dump_used > 0) && ((max_bytes < 0) || (written < max_bytes))) {
+		int64_t before = bb->dump_used;
+		rc = dump_one(bb);
+		written += before - bb->dump_used;
+	}
+	if (bb->dump_closing && (bb->dump_used == 0)) {
+		int rc2 = dump_finish(bb);
+		rc = (rc == OUSTER_UDPCAP_OK) ? rc2 : rc;
+	}
+	return rc;
+}
+
+int ouster_blackbox_push(ouster_blackbox_t *bb, ouster_udpcap_t const *cap, int64_t t)
+{
+	ouster_assert_notnull(bb);
+	ouster_assert_notnull(cap);
+
+	int64_t size = BLACKBOX_RECORD_SIZE(cap->size);
+	if (size > bb->capacity) {
+		return OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL;
+	}
+
+	int rc = ouster_blackbox_flush(bb, 0, t);
+
+	// Forget packets older than the window unless they still belong to an incident
+	while ((rc == OUSTER_UDPCAP_OK) && (bb->used > 0)) {
+		skip_padding(bb);
+		if ((bb->used == 0) || oldest_undumped(bb) || ((t - record_t(bb, bb->tail)) < bb->window_ns)) {
+			break;
+		}
+		rc = pop(bb);
+	}
+
+	if (rc == OUSTER_UDPCAP_OK) {
+		rc = make_room(bb, size);
+	}
+	if (rc != OUSTER_UDPCAP_OK) {
+		// Writing the incident failed, there may be no room for the packet
+		bb->dropped++;
+		return rc;
+	}
+
+	memcpy(bb->data + bb->head, &t, sizeof(int64_t));
+	ouster_udpcap_t *dst = record_cap(bb, bb->head);
+	dst->port = cap->port;
+	dst->size = cap->size;
+	memcpy(dst->buf, cap->buf, cap->size);
+	bb->head += size;
+	bb->used += size;
+
+	if (bb->dumping) {
+		bb->dump_used += bb->dump_closing ? 0 : size;
+		int rc2 = ouster_blackbox_flush(bb, size * BLACKBOX_FLUSH_FACTOR, t);
+		rc = (rc == OUSTER_UDPCAP_OK) ? rc2 : rc;
+	}
+
+	return rc;
+}
\ No newline at end of file
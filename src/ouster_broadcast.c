@@ -0,0 +1,140 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+#define SLOT_INDEX_BITS 16
+#define SLOT_INDEX_MASK ((1 << SLOT_INDEX_BITS) - 1)
+
+static inline uint64_t slot_state(uint64_t seq, int index)
+{
+	return ((seq + 1) << SLOT_INDEX_BITS) | (uint64_t)index;
+}
+
+/* Gives frames that nobody references anymore back to the pool */
+static void broadcast_collect(ouster_broadcast_t *b)
+{
+	for (int i = 0; i < b->pool->count; ++i) {
+		if (b->held[i] && (__atomic_load_n(b->refs + i, __ATOMIC_ACQUIRE) == 0)) {
+			b->held[i] = 0;
+			ouster_frame_pool_release(b->pool, b->pool->frames + i);
+		}
+	}
+}
+
+void ouster_broadcast_init(ouster_broadcast_t *b, ouster_frame_pool_t *pool, int capacity)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(pool);
+	ouster_assert(capacity > 0, "");
+	ouster_assert(pool->count <= SLOT_INDEX_MASK, "Too many frames to index");
+	uint64_t n = 1;
+	while (n < (uint64_t)capacity) {
+		n <<= 1;
+	}
+	memset(b, 0, sizeof(ouster_broadcast_t));
+	b->pool = pool;
+	b->mask = n - 1;
+	b->slots = ouster_os_calloc(n * sizeof(uint64_t));
+	b->refs = ouster_os_calloc(pool->count * sizeof(int));
+	b->held = ouster_os_calloc(pool->count);
+	ouster_assert_notnull(b->slots);
+	ouster_assert_notnull(b->refs);
+	ouster_assert_notnull(b->held);
+}
+
+void ouster_broadcast_fini(ouster_broadcast_t *b)
+{
+	ouster_assert_notnull(b);
+	for (uint64_t i = 0; i <= b->mask; ++i) {
+		uint64_t state = b->slots[i];
+		if (state) {
+			b->refs[state & SLOT_INDEX_MASK]--;
+		}
+	}
+	broadcast_collect(b);
+	for (int i = 0; i < b->pool->count; ++i) {
+		ouster_assert(b->held[i] == 0, "A consumer still holds a frame");
+	}
+	ouster_os_free(b->slots);
+	ouster_os_free(b->refs);
+	ouster_os_free(b->held);
+	memset(b, 0, sizeof(ouster_broadcast_t));
+}
+
+void ouster_broadcast_publish(ouster_broadcast_t *b, ouster_frame_t *frame)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(frame);
+	int index = frame - b->pool->frames;
+	ouster_assert(index >= 0 && index < b->pool->count, "Frame is not from the pool");
+	ouster_assert(b->held[index] == 0, "Frame published twice");
+
+	// Added instead of stored, a consumer may still be undoing a reference taken on an overwritten slot
+	__atomic_add_fetch(b->refs + index, 1, __ATOMIC_SEQ_CST);
+	b->held[index] = 1;
+
+	uint64_t seq = b->head;
+	uint64_t *slot = b->slots + (seq & b->mask);
+	uint64_t old = *slot;
+	__atomic_store_n(slot, slot_state(seq, index), __ATOMIC_SEQ_CST);
+	if (old) {
+		// Consumers that still read the old frame hold their own reference
+		__atomic_sub_fetch(b->refs + (old & SLOT_INDEX_MASK), 1, __ATOMIC_SEQ_CST);
+	}
+	__atomic_store_n(&b->head, seq + 1, __ATOMIC_RELEASE);
+
+	broadcast_collect(b);
+}
+
+void ouster_broadcast_reader_init(ouster_broadcast_t *b, ouster_broadcast_reader_t *r)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(r);
+	memset(r, 0, sizeof(ouster_broadcast_reader_t));
+	r->next = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+}
+
+ouster_frame_t *ouster_broadcast_acquire(ouster_broadcast_t *b, ouster_broadcast_reader_t *r)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(r);
+	uint64_t capacity = b->mask + 1;
+	while (1) {
+		uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+		if (r->next == head) {
+			return NULL;
+		}
+		if ((head - r->next) > capacity) {
+			// The oldest frames of this consumer were overwritten
+			r->dropped += (head - capacity) - r->next;
+			r->next = head - capacity;
+		}
+		uint64_t *slot = b->slots + (r->next & b->mask);
+		uint64_t state = __atomic_load_n(slot, __ATOMIC_SEQ_CST);
+		if (state != slot_state(r->next, state & SLOT_INDEX_MASK)) {
+			// Overwritten after head was read, skip ahead
+			continue;
+		}
+		int index = state & SLOT_INDEX_MASK;
+		__atomic_add_fetch(b->refs + index, 1, __ATOMIC_SEQ_CST);
+		// The ring holds its reference until the slot changes, so if it did not change the frame is ours
+		if (__atomic_load_n(slot, __ATOMIC_SEQ_CST) != state) {
+			__atomic_sub_fetch(b->refs + index, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		r->next++;
+		r->received++;
+		return b->pool->frames + index;
+	}
+}
+
+void ouster_broadcast_release(ouster_broadcast_t *b, ouster_frame_t *frame)
+{
+	ouster_assert_notnull(b);
+	ouster_assert_notnull(frame);
+	int index = frame - b->pool->frames;
+	ouster_assert(index >= 0 && index < b->pool->count, "Frame is not from the pool");
+	int refs = __atomic_sub_fetch(b->refs + index, 1, __ATOMIC_ACQ_REL);
+	ouster_assert(refs >= 0, "Frame released twice");
+	ouster_unused(refs);
+}
\ No newline at end of file
@@ -0,0 +1,419 @@
+#include "ouster_clib.h"
+
+#include <endian.h>
+#include <string.h>
+
+/* Residuals with a larger unary part are escaped and written raw */
+#define CODEC_UNARY_LIMIT 24
+
+/* Adaptive statistics are halved after this many samples */
+#define CODEC_RESET 64
+
+/* Contexts are selected by bit length of the local gradient */
+#define CODEC_CONTEXTS 34
+
+typedef struct
+{
+	uint32_t a[CODEC_CONTEXTS];
+	uint32_t n[CODEC_CONTEXTS];
+} codec_state_t;
+
+typedef struct
+{
+	uint8_t *data;
+	int capacity;
+	int pos;
+	uint64_t acc;
+	int nbits;
+} bit_writer_t;
+
+typedef struct
+{
+	uint8_t const *data;
+	int size;
+	int pos;
+	uint64_t acc;
+	int nbits;
+} bit_reader_t;
+
+static void state_init(codec_state_t *s)
+{
+	for (int i = 0; i < CODEC_CONTEXTS; ++i) {
+		s->a[i] = 4;
+		s->n[i] = 1;
+	}
+}
+
+static int bitlen(uint64_t x)
+{
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+/* Bit length of the local gradient, flat areas and edges get different statistics */
+static int context(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint64_t da = a > c ? a - c : c - a;
+	uint64_t db = b > c ? b - c : c - b;
+	int ctx = bitlen(da + db);
+	return ctx < CODEC_CONTEXTS ? ctx : CODEC_CONTEXTS - 1;
+}
+
+/* Median edge detector from LOCO-I */
+static uint32_t predict(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t mn = a < b ? a : b;
+	uint32_t mx = a < b ? b : a;
+	if (c >= mx) {
+		return mn;
+	}
+	if (c <= mn) {
+		return mx;
+	}
+	return a + b - c;
+}
+
+static int rice_k(codec_state_t const *s, int ctx, int bits)
+{
+	uint64_t n = s->n[ctx];
+	uint64_t a = s->a[ctx];
+	int k = 0;
+	while (((n << k) < a) && (k < (bits - 1))) {
+		k++;
+	}
+	return k;
+}
+
+static void state_update(codec_state_t *s, int ctx, uint32_t zz)
+{
+	s->a[ctx] += zz;
+	s->n[ctx]++;
+	if ((s->n[ctx] >= CODEC_RESET) || (s->a[ctx] >= UINT32_C(0x80000000))) {
+		s->a[ctx] = (s->a[ctx] + 1) >> 1;
+		s->n[ctx] = (s->n[ctx] + 1) >> 1;
+	}
+}
+
+static uint32_t get_pixel(void const *row, int depth, int col)
+{
+	switch (depth) {
+	case 1:
+		return ((uint8_t const *)row)[col];
+	case 2:
+		return ((uint16_t const *)row)[col];
+	default:
+		return ((uint32_t const *)row)[col];
+	}
+}
+
+static void set_pixel(void *row, int depth, int col, uint32_t value)
+{
+	switch (depth) {
+	case 1:
+		((uint8_t *)row)[col] = (uint8_t)value;
+		break;
+	case 2:
+		((uint16_t *)row)[col] = (uint16_t)value;
+		break;
+	default:
+		((uint32_t *)row)[col] = value;
+		break;
+	}
+}
+
+/* Left, upper and upper left neighbour, missing neighbours are replaced by existing ones */
+static void neighbours(void const *row, void const *up, int depth, int col, uint32_t *a, uint32_t *b, uint32_t *c)
+{
+	if (up == NULL) {
+		*a = col ? get_pixel(row, depth, col - 1) : 0;
+		*b = *a;
+		*c = *a;
+		return;
+	}
+	*b = get_pixel(up, depth, col);
+	*a = col ? get_pixel(row, depth, col - 1) : *b;
+	*c = col ? get_pixel(up, depth, col - 1) : *b;
+}
+
+/* Writes up to 32 bits, LSB first */
+static int put_bits(bit_writer_t *w, uint32_t value, int n)
+{
+	w->acc |= (uint64_t)value << w->nbits;
+	w->nbits += n;
+	if (w->nbits >= 32) {
+		if ((w->pos + 4) > w->capacity) {
+			return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+		}
+		for (int i = 0; i < 4; ++i) {
+			w->data[w->pos++] = (uint8_t)(w->acc >> (i * 8));
+		}
+		w->acc >>= 32;
+		w->nbits -= 32;
+	}
+	return OUSTER_CODEC_OK;
+}
+
+static int flush_bits(bit_writer_t *w)
+{
+	while (w->nbits > 0) {
+		if (w->pos >= w->capacity) {
+			return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+		}
+		w->data[w->pos++] = (uint8_t)w->acc;
+		w->acc >>= 8;
+		w->nbits -= 8;
+	}
+	w->nbits = 0;
+	return OUSTER_CODEC_OK;
+}
+
+/* Makes sure at least 57 bits are buffered, missing bytes past the end read as zero */
+static void refill(bit_reader_t *r)
+{
+	while (r->nbits <= 56) {
+		uint64_t byte = (r->pos < r->size) ? r->data[r->pos] : 0;
+		r->acc |= byte << r->nbits;
+		r->pos++;
+		r->nbits += 8;
+	}
+}
+
+static uint32_t get_bits(bit_reader_t *r, int n)
+{
+	uint32_t value = (uint32_t)(r->acc & ((UINT64_C(1) << n) - 1));
+	r->acc >>= n;
+	r->nbits -= n;
+	return value;
+}
+
+static int put_residual(bit_writer_t *w, uint32_t zz, int k, int bits)
+{
+	uint32_t q = zz >> k;
+	if (q >= CODEC_UNARY_LIMIT) {
+		int rc = put_bits(w, UINT32_C(1) << CODEC_UNARY_LIMIT, CODEC_UNARY_LIMIT + 1);
+		return rc ? rc : put_bits(w, zz, bits);
+	}
+	int rc = put_bits(w, UINT32_C(1) << q, q + 1);
+	if (rc || (k == 0)) {
+		return rc;
+	}
+	return put_bits(w, zz & (uint32_t)((UINT64_C(1) << k) - 1), k);
+}
+
+static int get_residual(bit_reader_t *r, int k, int bits, uint32_t *zz)
+{
+	refill(r);
+	if (r->acc == 0) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
+	}
+	int q = __builtin_ctzll(r->acc);
+	if (q > CODEC_UNARY_LIMIT) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
+	}
+	get_bits(r, q + 1);
+	refill(r);
+	if (q == CODEC_UNARY_LIMIT) {
+		*zz = get_bits(r, bits);
+	} else {
+		*zz = ((uint32_t)q << k) | (k ? get_bits(r, k) : 0);
+	}
+	return OUSTER_CODEC_OK;
+}
+
+static uint32_t depth_mask(int depth)
+{
+	return (uint32_t)((UINT64_C(1) << (depth * 8)) - 1);
+}
+
+static void header_write(ouster_codec_header_t const *header, void *dst)
+{
+	ouster_codec_header_t le = *header;
+	le.magic = htole32(header->magic);
+	le.rows = htole16(header->rows);
+	le.cols = htole16(header->cols);
+	le.size = htole32(header->size);
+	memcpy(dst, &le, sizeof(ouster_codec_header_t));
+}
+
+static void header_read(ouster_codec_header_t *header, void const *src)
+{
+	memcpy(header, src, sizeof(ouster_codec_header_t));
+	header->magic = le32toh(header->magic);
+	header->rows = le16toh(header->rows);
+	header->cols = le16toh(header->cols);
+	header->size = le32toh(header->size);
+}
+
+static int encode_raw(ouster_field_t const *field, void *dst, int capacity, int *size)
+{
+	int hsize = (int)sizeof(ouster_codec_header_t);
+	int rowsize = field->cols * field->depth;
+	if (capacity < (hsize + field->rows * rowsize)) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
+	ouster_codec_header_t header = {0};
+	header.magic = OUSTER_CODEC_MAGIC;
+	header.rows = (uint16_t)field->rows;
+	header.cols = (uint16_t)field->cols;
+	header.depth = (uint8_t)field->depth;
+	header.method = OUSTER_CODEC_METHOD_RAW;
+	header.size = (uint32_t)(field->rows * rowsize);
+	header_write(&header, dst);
+	// Pixels are stored little endian, byte by byte
+	uint8_t *out = (uint8_t *)dst + hsize;
+	for (int r = 0; r < field->rows; ++r) {
+		char const *row = (char const *)field->data + r * field->rowsize;
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t value = get_pixel(row, field->depth, c);
+			for (int b = 0; b < field->depth; ++b) {
+				*out++ = (uint8_t)(value >> (b * 8));
+			}
+		}
+	}
+	*size = hsize + (int)header.size;
+	return OUSTER_CODEC_OK;
+}
+
+static int decode_raw(ouster_field_t *field, char const *src)
+{
+	uint8_t const *in = (uint8_t const *)src;
+	for (int r = 0; r < field->rows; ++r) {
+		char *row = (char *)field->data + r * field->rowsize;
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t value = 0;
+			for (int b = 0; b < field->depth; ++b) {
+				value |= (uint32_t)*in++ << (b * 8);
+			}
+			set_pixel(row, field->depth, c, value);
+		}
+	}
+	return OUSTER_CODEC_OK;
+}
+
+int ouster_codec_bound(ouster_field_t const *field)
+{
+	ouster_assert_notnull(field);
+	return (int)sizeof(ouster_codec_header_t) + field->rows * field->cols * field->depth;
+}
+
+int ouster_codec_encode(ouster_field_t const *field, void *dst, int capacity, int *size)
+{
+	ouster_assert_notnull(field);
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(size);
+	ouster_assert(field->depth == 1 || field->depth == 2 || field->depth == 4, "");
+	ouster_assert(field->rows <= UINT16_MAX && field->cols <= UINT16_MAX, "");
+
+	*size = 0;
+	int hsize = (int)sizeof(ouster_codec_header_t);
+	if (capacity < hsize) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
+
+	int depth = field->depth;
+	int bits = depth * 8;
+	uint32_t mask = depth_mask(depth);
+	uint32_t sign = UINT32_C(1) << (bits - 1);
+	int raw_size = field->rows * field->cols * depth;
+	codec_state_t state;
+	state_init(&state);
+	// Give up as soon as the bitstream gets larger than the raw pixels
+	bit_writer_t w = {(uint8_t *)dst + hsize, (capacity - hsize) < raw_size ? (capacity - hsize) : raw_size, 0, 0, 0};
+
+	char const *row = field->data;
+	char const *up = NULL;
+	int rc = OUSTER_CODEC_OK;
+	for (int r = 0; r < field->rows; ++r, up = row, row += field->rowsize) {
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t a, b, d;
+			neighbours(row, up, depth, c, &a, &b, &d);
+			int ctx = context(a, b, d);
+			int k = rice_k(&state, ctx, bits);
+			uint32_t e = (get_pixel(row, depth, c) - predict(a, b, d)) & mask;
+			uint32_t zz = (e & sign) ? (((~e & mask) << 1) | 1) : (e << 1);
+			rc = put_residual(&w, zz, k, bits);
+			if (rc) {
+				return encode_raw(field, dst, capacity, size);
+			}
+			state_update(&state, ctx, zz);
+		}
+	}
+	rc = flush_bits(&w);
+	if (rc) {
+		return encode_raw(field, dst, capacity, size);
+	}
+
+	ouster_codec_header_t header = {0};
+	header.magic = OUSTER_CODEC_MAGIC;
+	header.rows = (uint16_t)field->rows;
+	header.cols = (uint16_t)field->cols;
+	header.depth = (uint8_t)depth;
+	header.method = OUSTER_CODEC_METHOD_RICE;
+	header.size = (uint32_t)w.pos;
+	header_write(&header, dst);
+	*size = hsize + w.pos;
+	return OUSTER_CODEC_OK;
+}
+
+int ouster_codec_decode(ouster_field_t *field, void const *src, int size)
+{
+	ouster_assert_notnull(field);
+	ouster_assert_notnull(src);
+
+	ouster_codec_header_t header;
+	int hsize = (int)sizeof(ouster_codec_header_t);
+	if (size < hsize) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
+	header_read(&header, src);
+	if (header.magic != OUSTER_CODEC_MAGIC) {
+		return OUSTER_CODEC_ERROR_MAGIC;
+	}
+	if ((header.rows != field->rows) || (header.cols != field->cols) || (header.depth != field->depth)) {
+		return OUSTER_CODEC_ERROR_SHAPE;
+	}
+	if (header.size > (uint32_t)(size - hsize)) {
+		return OUSTER_CODEC_ERROR_BUFFER_TOO_SMALL;
+	}
+
+	if (header.method == OUSTER_CODEC_METHOD_RAW) {
+		if (header.size != (uint32_t)(field->rows * field->cols * field->depth)) {
+			return OUSTER_CODEC_ERROR_CORRUPT;
+		}
+		return decode_raw(field, (char const *)src + hsize);
+	}
+	if (header.method != OUSTER_CODEC_METHOD_RICE) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
+	}
+
+	int depth = field->depth;
+	int bits = depth * 8;
+	uint32_t mask = depth_mask(depth);
+	codec_state_t state;
+	state_init(&state);
+	bit_reader_t rd = {(uint8_t const *)src + hsize, (int)header.size, 0, 0, 0};
+
+	char *row = field->data;
+	char *up = NULL;
+	for (int r = 0; r < field->rows; ++r, up = row, row += field->rowsize) {
+		for (int c = 0; c < field->cols; ++c) {
+			uint32_t a, b, d;
+			neighbours(row, up, depth, c, &a, &b, &d);
+			int ctx = context(a, b, d);
+			int k = rice_k(&state, ctx, bits);
+			uint32_t zz;
+			int rc = get_residual(&rd, k, bits, &zz);
+			if (rc) {
+				return rc;
+			}
+			uint32_t e = (zz & 1) ? (~(zz >> 1) & mask) : (zz >> 1);
+			set_pixel(row, depth, c, (predict(a, b, d) + e) & mask);
+			state_update(&state, ctx, zz);
+		}
+	}
+
+	// Bits consumed must not go past the end of the bitstream
+	if (((int64_t)rd.pos * 8 - rd.nbits) > ((int64_t)header.size * 8)) {
+		return OUSTER_CODEC_ERROR_CORRUPT;
+	}
+	return OUSTER_CODEC_OK;
+}
\ No newline at end of file
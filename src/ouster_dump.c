@@ -41,4 +41,22 @@ void ouster_dump_meta(FILE * f, ouster_meta_t const *meta)
 	fprintf(f, "%40s: %i\n", "channel_data_size", meta->channel_data_size);
 	fprintf(f, "%40s: %iB\n", "col_size", meta->col_size);
 	fprintf(f, "%40s: %iB\n", "lidar_packet_size", meta->lidar_packet_size);
-} 
\ No newline at end of file
+} 
+
+void ouster_dump_profile(FILE *f)
+{
+	ouster_assert_notnull(f);
+	fprintf(f, "%-10s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "mean_us", "p50_us", "p99_us", "p999_us", "max_us");
+	for (int i = 0; i < OUSTER_STAGE_COUNT; ++i) {
+		ouster_profile_stats_t s;
+		ouster_profile_stats(i, &s);
+		fprintf(f, "%-10s %10ji %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		        ouster_profile_stage_str(i),
+		        (intmax_t)s.count,
+		        s.mean_ns / 1000.0,
+		        s.p50_ns / 1000.0,
+		        s.p99_ns / 1000.0,
+		        s.p999_ns / 1000.0,
+		        s.max_ns / 1000.0);
+	}
+}
\ No newline at end of file
@@ -7,6 +7,7 @@ void ouster_field_init(ouster_field_t fields[], int count, ouster_meta_t *meta)
 	ouster_assert_notnull(fields);
 	ouster_assert_notnull(meta);
 	ouster_field_t *f = fields;
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_FIELD);
 	for (int i = 0; i < count; ++i, f++) {
 		ouster_assert(f->depth > 0, "");
 		f->rows = meta->pixels_per_column;
@@ -15,6 +16,7 @@ void ouster_field_init(ouster_field_t fields[], int count, ouster_meta_t *meta)
 		f->size = f->rows * f->cols * f->depth;
 		f->data = ouster_os_calloc(f->size);
 	}
+	ouster_os_mem_tag_set(tag);
 }
 
 void ouster_field_fini(ouster_field_t fields[], int count)
@@ -37,6 +39,26 @@ void ouster_field_cpy(ouster_field_t dst[], ouster_field_t src[], int count)
 	}
 }
 
+/* Reverses the order of n pixels of depth bytes */
+static void reverse_pixels(char *p, int n, int depth)
+{
+	char *a = p;
+	char *b = p + (n - 1) * depth;
+	for (; a < b; a += depth, b -= depth) {
+		for (int k = 0; k < depth; ++k) {
+			char t = a[k];
+			a[k] = b[k];
+			b[k] = t;
+		}
+	}
+}
+
+/* Staggered column c goes to destaggered column (c + shift) % cols */
+static int destagger_shift(int shift, int cols)
+{
+	return ((shift % cols) + cols) % cols;
+}
+
 /*
 https://static.ouster.dev/sdk-docs/reference/lidar-scan.html#staggering-and-destaggering
 */
@@ -46,9 +68,42 @@ void ouster_destagger(void *data, int cols, int rows, int depth, int rowsize, in
 	ouster_assert_notnull(pixel_shift_by_row);
 	char *row = data;
 	for (int irow = 0; irow < rows; ++irow, row += rowsize) {
-		int offset = (pixel_shift_by_row[irow] + cols) % cols;
-		memmove(row + depth * offset, row, depth * (cols - offset));
-		memmove(row, row + depth * (cols - offset), depth * offset);
+		int offset = destagger_shift(pixel_shift_by_row[irow], cols);
+		// Rotate right by offset in place: reverse the whole row then both parts
+		reverse_pixels(row, cols, depth);
+		reverse_pixels(row, offset, depth);
+		reverse_pixels(row + depth * offset, cols - offset, depth);
+	}
+}
+
+void ouster_destagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[])
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(pixel_shift_by_row);
+	ouster_assert(dst != src, "Use ouster_destagger() in place");
+	char *d = dst;
+	char const *s = src;
+	for (int irow = 0; irow < rows; ++irow, d += rowsize, s += rowsize) {
+		int offset = destagger_shift(pixel_shift_by_row[irow], cols);
+		// Two contiguous chunks per row, memcpy picks the widest aligned vector stores
+		memcpy(d + depth * offset, s, depth * (cols - offset));
+		memcpy(d, s + depth * (cols - offset), depth * offset);
+	}
+}
+
+void ouster_restagger_cpy(void *dst, void const *src, int cols, int rows, int depth, int rowsize, int const pixel_shift_by_row[])
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(pixel_shift_by_row);
+	ouster_assert(dst != src, "");
+	char *d = dst;
+	char const *s = src;
+	for (int irow = 0; irow < rows; ++irow, d += rowsize, s += rowsize) {
+		int offset = destagger_shift(pixel_shift_by_row[irow], cols);
+		memcpy(d, s + depth * offset, depth * (cols - offset));
+		memcpy(d + depth * (cols - offset), s, depth * offset);
 	}
 }
 
@@ -56,9 +111,35 @@ void ouster_field_destagger(ouster_field_t fields[], int count, ouster_meta_t *m
 {
 	ouster_assert_notnull(fields);
 	ouster_assert_notnull(meta);
+	ouster_profile_begin(t);
 	for (int i = 0; i < count; ++i, ++fields) {
 		ouster_destagger(fields->data, fields->cols, fields->rows, fields->depth, fields->rowsize, meta->pixel_shift_by_row);
 	}
+	ouster_profile_end(t, OUSTER_STAGE_DESTAGGER);
+}
+
+void ouster_field_destagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(meta);
+	ouster_profile_begin(t);
+	for (int i = 0; i < count; ++i, ++dst, ++src) {
+		ouster_assert(dst->size == src->size, "");
+		ouster_destagger_cpy(dst->data, src->data, src->cols, src->rows, src->depth, src->rowsize, meta->pixel_shift_by_row);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_DESTAGGER);
+}
+
+void ouster_field_restagger_cpy(ouster_field_t dst[], ouster_field_t const src[], int count, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert_notnull(meta);
+	for (int i = 0; i < count; ++i, ++dst, ++src) {
+		ouster_assert(dst->size == src->size, "");
+		ouster_restagger_cpy(dst->data, src->data, src->cols, src->rows, src->depth, src->rowsize, meta->pixel_shift_by_row);
+	}
 }
 
 void ouster_field_apply_mask_u32(ouster_field_t *field, ouster_meta_t *meta)
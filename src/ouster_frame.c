@@ -0,0 +1,197 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+/* Sets all fields of columns [c0, c1) to zero */
+static void clear_columns(ouster_frame_t *frame, int c0, int c1)
+{
+	for (int j = 0; j < frame->fcount; ++j) {
+		ouster_field_t *f = frame->fields + j;
+		char *row = (char *)f->data + c0 * f->depth;
+		for (int r = 0; r < f->rows; ++r, row += f->rowsize) {
+			memset(row, 0, (c1 - c0) * f->depth);
+		}
+	}
+}
+
+/* Clears the stale columns that were not received again */
+static void clear_stale(ouster_frame_t *frame, int cols)
+{
+	int words = OUSTER_FRAME_BITMAP_WORDS(cols);
+	int c0 = -1;
+	for (int k = 0; k < words; ++k) {
+		uint64_t clear = frame->stale_cols[k] & ~frame->valid_cols[k];
+		if ((clear == 0) && (c0 < 0)) {
+			continue;
+		}
+		for (int b = 0; b < 64; ++b) {
+			int c = k * 64 + b;
+			int set = (c < cols) && ((clear >> b) & 1);
+			if (set && (c0 < 0)) {
+				c0 = c;
+			} else if (!set && (c0 >= 0)) {
+				clear_columns(frame, c0, c);
+				c0 = -1;
+			}
+		}
+	}
+	if (c0 >= 0) {
+		clear_columns(frame, c0, cols);
+	}
+}
+
+static int bitmap_count(uint64_t const *bitmap, int words)
+{
+	int n = 0;
+	for (int k = 0; k < words; ++k) {
+		n += __builtin_popcountll(bitmap[k]);
+	}
+	return n;
+}
+
+/* Prepares a frame for filling, the columns received last time become stale */
+static void frame_start(ouster_frame_t *frame)
+{
+	uint64_t *stale = frame->stale_cols;
+	frame->stale_cols = frame->valid_cols;
+	frame->valid_cols = stale;
+	frame->valid_count = 0;
+	frame->frame_id = -1;
+	memset(&frame->lidar, 0, sizeof(ouster_lidar_t));
+	frame->lidar.frame_id = -1;
+	frame->lidar.valid_cols = frame->valid_cols;
+}
+
+/* Completes the current frame, returns NULL when it was dropped */
+static ouster_frame_t *frame_finish(ouster_frame_pool_t *pool)
+{
+	ouster_frame_t *frame = pool->current;
+	int cols = pool->meta->midw;
+	clear_stale(frame, cols);
+	memset(frame->stale_cols, 0, OUSTER_FRAME_BITMAP_WORDS(cols) * sizeof(uint64_t));
+	frame->valid_count = bitmap_count(frame->valid_cols, OUSTER_FRAME_BITMAP_WORDS(cols));
+	frame->frame_id = frame->lidar.frame_id;
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+	frame->complete_ns = ouster_os_clock_ns();
+	ouster_profile_span(OUSTER_STAGE_FRAME, frame->first_ns, frame->complete_ns);
+#endif
+
+	ouster_frame_t *next = NULL;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->free_count > 0) {
+		next = pool->free[--pool->free_count];
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (next == NULL) {
+		// Consumers hold every other frame, fill this one again
+		pool->dropped++;
+		frame_start(frame);
+		return NULL;
+	}
+	frame_start(next);
+	pool->current = next;
+	return frame;
+}
+
+void ouster_frame_pool_init(ouster_frame_pool_t *pool, ouster_meta_t *meta, ouster_field_t const fields[], int fcount, int count)
+{
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(meta);
+	ouster_assert(fields || (fcount == 0), "");
+	ouster_assert(count >= 2, "One frame is filled while others are held by consumers");
+
+	memset(pool, 0, sizeof(ouster_frame_pool_t));
+	pool->meta = meta;
+	pool->count = count;
+	// Frame buffers are counted as field memory
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_FIELD);
+	pool->frames = ouster_os_calloc(count * sizeof(ouster_frame_t));
+	pool->free = ouster_os_calloc(count * sizeof(ouster_frame_t *));
+	ouster_assert_notnull(pool->frames);
+	ouster_assert_notnull(pool->free);
+	pthread_mutex_init(&pool->lock, NULL);
+
+	int words = OUSTER_FRAME_BITMAP_WORDS(meta->midw);
+	for (int i = 0; i < count; ++i) {
+		ouster_frame_t *frame = pool->frames + i;
+		frame->fcount = fcount;
+		frame->fields = ouster_os_calloc((fcount > 0 ? fcount : 1) * sizeof(ouster_field_t));
+		frame->valid_cols = ouster_os_calloc(words * sizeof(uint64_t));
+		frame->stale_cols = ouster_os_calloc(words * sizeof(uint64_t));
+		ouster_assert_notnull(frame->fields);
+		ouster_assert_notnull(frame->valid_cols);
+		ouster_assert_notnull(frame->stale_cols);
+		for (int j = 0; j < fcount; ++j) {
+			frame->fields[j].quantity = fields[j].quantity;
+			frame->fields[j].depth = fields[j].depth;
+		}
+		ouster_field_init(frame->fields, fcount, meta);
+		if (i > 0) {
+			pool->free[pool->free_count++] = frame;
+		}
+	}
+	ouster_os_mem_tag_set(tag);
+	pool->current = pool->frames;
+	frame_start(pool->current);
+}
+
+void ouster_frame_pool_fini(ouster_frame_pool_t *pool)
+{
+	ouster_assert_notnull(pool);
+	for (int i = 0; i < pool->count; ++i) {
+		ouster_frame_t *frame = pool->frames + i;
+		for (int j = 0; j < frame->fcount; ++j) {
+			ouster_os_free(frame->fields[j].data);
+		}
+		ouster_os_free(frame->fields);
+		ouster_os_free(frame->valid_cols);
+		ouster_os_free(frame->stale_cols);
+	}
+	ouster_os_free(pool->frames);
+	ouster_os_free(pool->free);
+	pthread_mutex_destroy(&pool->lock);
+	memset(pool, 0, sizeof(ouster_frame_pool_t));
+}
+
+ouster_frame_t *ouster_frame_pool_push(ouster_frame_pool_t *pool, char const *buf)
+{
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(buf);
+
+	ouster_frame_t *done = NULL;
+	ouster_lidar_header_t header;
+	ouster_lidar_header_get(buf, &header);
+	if ((pool->current->lidar.frame_id >= 0) && (pool->current->lidar.frame_id != (int)header.frame_id)) {
+		// The last packet of the current frame was lost
+		done = frame_finish(pool);
+	}
+
+	ouster_frame_t *frame = pool->current;
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+	if (frame->lidar.frame_id < 0) {
+		frame->first_ns = ouster_os_clock_ns();
+	}
+#endif
+	ouster_lidar_get_fields(&frame->lidar, pool->meta, buf, frame->fields, frame->fcount);
+	pool->last = frame;
+	if (frame->lidar.last_mid == pool->meta->mid1) {
+		if (done) {
+			// Only possible with one packet per frame, keep the newest
+			ouster_frame_pool_release(pool, done);
+			pool->dropped++;
+		}
+		done = frame_finish(pool);
+	}
+	return done;
+}
+
+void ouster_frame_pool_release(ouster_frame_pool_t *pool, ouster_frame_t *frame)
+{
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(frame);
+	pthread_mutex_lock(&pool->lock);
+	ouster_assert(pool->free_count < pool->count, "Frame released twice");
+	pool->free[pool->free_count++] = frame;
+	pthread_mutex_unlock(&pool->lock);
+}
\ No newline at end of file
@@ -32,7 +32,9 @@ void ouster_http_request(int sock, char const *host, char const *path, ouster_ve
 		if (n <= 0) {
 			break;
 		}
+		int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_HTTP);
 		ouster_vec_append(v, buf, n, 1.5f);
+		ouster_os_mem_tag_set(tag);
 	}
 	{
 		char *e = OUSTER_OFFSET(v->data, v->esize * v->count);
@@ -117,6 +117,7 @@ void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char co
 	ouster_assert_notnull(lidar);
 	ouster_assert_notnull(buf);
 	ouster_assert(fields || ((fields == NULL) && (fcount == 0)), "");
+	ouster_profile_begin(t);
 
 	char const *colbuf = buf + OUSTER_PACKET_HEADER_SIZE;
 	ouster_lidar_header_t header = {0};
@@ -138,6 +139,9 @@ void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char co
 	// ouster_log("mid_delta %i\n", mid_delta);
 	lidar->mid_loss += (mid_delta - 1);
 
+	lidar->packet_mid0 = -1;
+	lidar->packet_mid1 = -1;
+
 	// col_size = 1584
 	for (int icol = 0; icol < meta->columns_per_packet; icol++, colbuf += meta->col_size) {
 		ouster_column_get(colbuf, &column);
@@ -156,6 +160,14 @@ void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char co
 			lidar->num_valid_pixels += meta->pixels_per_column;
 		}
 		lidar->last_mid = column.mid;
+		if (lidar->valid_cols) {
+			int col = column.mid - meta->mid0;
+			lidar->valid_cols[col / 64] |= UINT64_C(1) << (col % 64);
+		}
+		if (lidar->packet_mid0 < 0) {
+			lidar->packet_mid0 = column.mid;
+		}
+		lidar->packet_mid1 = column.mid;
 	}
 
 	for (int j = 0; j < fcount; ++j) {
@@ -169,4 +181,5 @@ void ouster_lidar_get_fields(ouster_lidar_t *lidar, ouster_meta_t *meta, char co
 		ouster_assert(fields[j].rows > 0, "");
 		ouster_assert(fields[j].depth > 0, "");
 	}
+	ouster_profile_end(t, OUSTER_STAGE_DECODE);
 }
\ No newline at end of file
@@ -1,58 +1,570 @@
 #include "ouster_clib.h"
 #include "ouster_math.h"
 
+#include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Messages up to this size are formatted on the stack */
+#define LOG_STACK_MSG 256
+
+/* Largest asynchronous record, arguments that do not fit are dropped with the message */
+#define LOG_RECORD_MAX 1024
+
+/* Background thread sleeps this long when all rings are empty */
+#define LOG_IDLE_NS 1000000
+
+typedef enum {
+	LOG_ARG_NONE,
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_INTMAX,
+	LOG_ARG_PTRDIFF,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LDOUBLE,
+	LOG_ARG_STRING,
+	LOG_ARG_POINTER,
+} log_arg_t;
+
+/* One conversion specification of a printf format */
+typedef struct
+{
+	log_arg_t arg;
+	int star_width;
+	int star_precision;
+	/* Length of the specification including % */
+	int length;
+} log_spec_t;
+
+typedef struct
+{
+	uint32_t size;
+	int32_t level;
+	int32_t line;
+	int32_t reserved;
+	char const *fmt;
+	char const *file;
+} log_record_t;
+
+/* Single producer single consumer byte ring, records never wrap, a record of size 0 pads to the end */
+typedef struct
+{
+	char *data;
+	uint64_t head;
+	uint64_t tail;
+	/* Non zero while a thread logs into the ring */
+	int owned;
+} log_ring_t;
+
+typedef struct
+{
+	log_ring_t rings[OUSTER_LOG_ASYNC_THREADS];
+	char *memory;
+	/* Highest ring ever claimed plus one, the background thread drains rings below it */
+	int ring_count;
+	int generation;
+	int running;
+	int quit;
+	int64_t dropped;
+	pthread_t thread;
+} log_async_t;
+
+static log_async_t log_async;
+static __thread log_ring_t *log_thread_ring;
+static __thread int log_thread_generation;
+static pthread_key_t log_key;
+static pthread_once_t log_key_once = PTHREAD_ONCE_INIT;
 
 int32_t ouster_log_set_level(int32_t level)
 {
-    int prev = level;
-    ouster_os_api.log_level_ = level;
-    return prev;
+	int prev = ouster_os_api.log_level_;
+	ouster_os_api.log_level_ = level;
+	return prev;
 }
 
-static char *ouster_vasprintf_malloc(const char *fmt, va_list args)
+/* Parses the conversion specification at p, which points to % */
+static void log_spec_parse(char const *p, log_spec_t *spec)
 {
-	size_t size = 0;
-	char *result = NULL;
-	va_list tmpa;
+	char const *s = p + 1;
+	memset(spec, 0, sizeof(log_spec_t));
+	while (*s && strchr("-+ #0", *s)) {
+		s++;
+	}
+	if (*s == '*') {
+		spec->star_width = 1;
+		s++;
+	}
+	while ((*s >= '0') && (*s <= '9')) {
+		s++;
+	}
+	if (*s == '.') {
+		s++;
+		if (*s == '*') {
+			spec->star_precision = 1;
+			s++;
+		}
+		while ((*s >= '0') && (*s <= '9')) {
+			s++;
+		}
+	}
+	log_arg_t integer = LOG_ARG_INT;
+	int ldouble = 0;
+	if ((s[0] == 'h') && (s[1] == 'h')) {
+		s += 2;
+	} else if (s[0] == 'h') {
+		s += 1;
+	} else if ((s[0] == 'l') && (s[1] == 'l')) {
+		integer = LOG_ARG_LLONG;
+		s += 2;
+	} else if (s[0] == 'l') {
+		integer = LOG_ARG_LONG;
+		s += 1;
+	} else if (s[0] == 'z') {
+		integer = LOG_ARG_SIZE;
+		s += 1;
+	} else if (s[0] == 'j') {
+		integer = LOG_ARG_INTMAX;
+		s += 1;
+	} else if (s[0] == 't') {
+		integer = LOG_ARG_PTRDIFF;
+		s += 1;
+	} else if (s[0] == 'L') {
+		ldouble = 1;
+		s += 1;
+	}
+	switch (*s) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		spec->arg = integer;
+		break;
+	case 'c':
+		spec->arg = LOG_ARG_INT;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->arg = ldouble ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+		break;
+	case 's':
+		spec->arg = LOG_ARG_STRING;
+		break;
+	case 'p':
+		spec->arg = LOG_ARG_POINTER;
+		break;
+	default:
+		// %% and unsupported conversions take no argument
+		spec->arg = LOG_ARG_NONE;
+		break;
+	}
+	spec->length = (int)(s - p) + (*s ? 1 : 0);
+}
 
-	va_copy(tmpa, args);
+/* Appends n bytes to the record, returns 0 when the record is full */
+static int log_put(char *rec, uint32_t *size, void const *src, uint32_t n)
+{
+	uint32_t aligned = (n + 7) & ~(uint32_t)7;
+	if ((*size + aligned) > LOG_RECORD_MAX) {
+		return 0;
+	}
+	memcpy(rec + *size, src, n);
+	*size += aligned;
+	return 1;
+}
 
-	size = vsnprintf(result, 0, fmt, tmpa);
+/* Copies the arguments of fmt into a record, returns the record size or 0 when it does not fit */
+static uint32_t log_encode(char *rec, int32_t level, char const *file, int32_t line, char const *fmt, va_list args)
+{
+	log_record_t header = {0, level, line, 0, fmt, file};
+	uint32_t size = sizeof(log_record_t);
+	int ok = 1;
+	for (char const *p = fmt; ok && *p; ++p) {
+		if (*p != '%') {
+			continue;
+		}
+		log_spec_t spec;
+		log_spec_parse(p, &spec);
+		p += spec.length - 1;
+		if (spec.star_width) {
+			int v = va_arg(args, int);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		}
+		if (spec.star_precision) {
+			int v = va_arg(args, int);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		}
+		switch (spec.arg) {
+		case LOG_ARG_NONE:
+			break;
+		case LOG_ARG_INT: {
+			int v = va_arg(args, int);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_LONG: {
+			long v = va_arg(args, long);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_LLONG: {
+			long long v = va_arg(args, long long);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_SIZE: {
+			size_t v = va_arg(args, size_t);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_INTMAX: {
+			intmax_t v = va_arg(args, intmax_t);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_PTRDIFF: {
+			ptrdiff_t v = va_arg(args, ptrdiff_t);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_DOUBLE: {
+			double v = va_arg(args, double);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_LDOUBLE: {
+			long double v = va_arg(args, long double);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_POINTER: {
+			void *v = va_arg(args, void *);
+			ok = ok && log_put(rec, &size, &v, sizeof(v));
+		} break;
+		case LOG_ARG_STRING: {
+			char const *v = va_arg(args, char const *);
+			char buf[OUSTER_LOG_ASYNC_STRING_MAX + 1];
+			snprintf(buf, sizeof(buf), "%s", v ? v : "(null)");
+			ok = ok && log_put(rec, &size, buf, (uint32_t)strlen(buf) + 1);
+		} break;
+		}
+	}
+	if (!ok) {
+		return 0;
+	}
+	header.size = size;
+	memcpy(rec, &header, sizeof(log_record_t));
+	return size;
+}
 
-	va_end(tmpa);
+/* Takes the next value of n bytes from a record */
+static char const *log_get(char const **cursor, uint32_t n)
+{
+	char const *v = *cursor;
+	*cursor += (n + 7) & ~(uint32_t)7;
+	return v;
+}
+
+/* Formats a record the same way vsnprintf would have */
+static void log_decode(char const *rec, char *out, int capacity)
+{
+	log_record_t header;
+	memcpy(&header, rec, sizeof(log_record_t));
+	char const *cursor = rec + sizeof(log_record_t);
+	int n = 0;
+	for (char const *p = header.fmt; *p && (n < (capacity - 1)); ++p) {
+		if (*p != '%') {
+			out[n++] = *p;
+			continue;
+		}
+		log_spec_t spec;
+		log_spec_parse(p, &spec);
+		// Copy the specification, star arguments become numbers and L is removed
+		char f[64];
+		int fn = 0;
+		for (int i = 0; (i < spec.length) && (fn < (int)sizeof(f) - 16); ++i) {
+			if (p[i] == '*') {
+				int v;
+				memcpy(&v, log_get(&cursor, sizeof(int)), sizeof(int));
+				fn += snprintf(f + fn, sizeof(f) - fn, "%i", v);
+			} else if (p[i] != 'L') {
+				f[fn++] = p[i];
+			}
+		}
+		f[fn] = '\0';
+		p += spec.length - 1;
+		int rest = capacity - n;
+		int w = 0;
+		switch (spec.arg) {
+		case LOG_ARG_NONE:
+			w = snprintf(out + n, rest, f, 0);
+			break;
+		case LOG_ARG_INT: {
+			int v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_LONG: {
+			long v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_LLONG: {
+			long long v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_SIZE: {
+			size_t v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_INTMAX: {
+			intmax_t v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_PTRDIFF: {
+			ptrdiff_t v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_DOUBLE: {
+			double v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_LDOUBLE: {
+			long double v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, (double)v);
+		} break;
+		case LOG_ARG_POINTER: {
+			void *v;
+			memcpy(&v, log_get(&cursor, sizeof(v)), sizeof(v));
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		case LOG_ARG_STRING: {
+			char const *v = cursor;
+			log_get(&cursor, (uint32_t)strlen(v) + 1);
+			w = snprintf(out + n, rest, f, v);
+		} break;
+		}
+		n += (w < 0) ? 0 : (w < rest ? w : rest - 1);
+	}
+	out[n] = '\0';
+}
 
-	if ((int32_t)size < 0) {
-		return NULL;
+/* Gives the ring back when its thread exits, records not written yet stay in it for the next owner */
+static void log_ring_release(void *arg)
+{
+	log_ring_t *ring = arg;
+	// A ring from before the last ouster_log_async_start() may belong to another thread now
+	if (log_thread_generation == __atomic_load_n(&log_async.generation, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
 	}
+}
 
-	result = (char *)ouster_os_malloc(size + 1);
+static void log_key_create(void)
+{
+	pthread_key_create(&log_key, log_ring_release);
+}
 
-	if (!result) {
-		return NULL;
+/* Claims a ring no living thread owns, NULL when all are taken */
+static log_ring_t *log_ring_claim(void)
+{
+	for (int i = 0; i < OUSTER_LOG_ASYNC_THREADS; ++i) {
+		log_ring_t *ring = log_async.rings + i;
+		int expected = 0;
+		if (__atomic_load_n(&ring->owned, __ATOMIC_RELAXED) || !__atomic_compare_exchange_n(&ring->owned, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			continue;
+		}
+		int count = __atomic_load_n(&log_async.ring_count, __ATOMIC_RELAXED);
+		while ((count <= i) && !__atomic_compare_exchange_n(&log_async.ring_count, &count, i + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		}
+		pthread_once(&log_key_once, log_key_create);
+		pthread_setspecific(log_key, ring);
+		return ring;
+	}
+	return NULL;
+}
+
+/* Returns the ring of the calling thread, NULL when all rings are taken */
+static log_ring_t *log_ring_get(void)
+{
+	int generation = __atomic_load_n(&log_async.generation, __ATOMIC_ACQUIRE);
+	if ((log_thread_ring == NULL) || (log_thread_generation != generation)) {
+		log_thread_ring = log_ring_claim();
+		log_thread_generation = generation;
+	}
+	return log_thread_ring;
+}
+
+/* Producer side, never blocks */
+static void log_async_push(int32_t level, char const *file, int32_t line, char const *fmt, va_list args)
+{
+	log_ring_t *ring = log_ring_get();
+	char rec[LOG_RECORD_MAX];
+	uint32_t size = ring ? log_encode(rec, level, file, line, fmt, args) : 0;
+	if (size == 0) {
+		__atomic_fetch_add(&log_async.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	uint64_t offset = head % OUSTER_LOG_ASYNC_RING_SIZE;
+	uint64_t pad = ((offset + size) > OUSTER_LOG_ASYNC_RING_SIZE) ? (OUSTER_LOG_ASYNC_RING_SIZE - offset) : 0;
+	if ((head + pad + size - tail) > OUSTER_LOG_ASYNC_RING_SIZE) {
+		__atomic_fetch_add(&log_async.dropped, 1, __ATOMIC_RELAXED);
+		return;
 	}
+	if (pad) {
+		// A zero size tells the consumer to continue at the start of the ring
+		memset(ring->data + offset, 0, sizeof(uint32_t));
+		head += pad;
+		offset = 0;
+	}
+	memcpy(ring->data + offset, rec, size);
+	__atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+}
 
-	vsprintf(result, fmt, args);
+/* Consumer side, returns number of records written */
+static int log_async_drain(log_ring_t *ring)
+{
+	int count = 0;
+	uint64_t tail = ring->tail;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	while (tail != head) {
+		uint64_t offset = tail % OUSTER_LOG_ASYNC_RING_SIZE;
+		uint32_t size = 0;
+		if ((OUSTER_LOG_ASYNC_RING_SIZE - offset) >= sizeof(uint32_t)) {
+			memcpy(&size, ring->data + offset, sizeof(uint32_t));
+		}
+		if (size == 0) {
+			tail += OUSTER_LOG_ASYNC_RING_SIZE - offset;
+			continue;
+		}
+		log_record_t header;
+		memcpy(&header, ring->data + offset, sizeof(log_record_t));
+		char msg[LOG_STACK_MSG * 4];
+		log_decode(ring->data + offset, msg, sizeof(msg));
+		ouster_os_api.log_(header.level, header.file, header.line, msg);
+		tail += size;
+		count++;
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return count;
+}
 
-	return result;
+static void *log_async_thread(void *arg)
+{
+	ouster_unused(arg);
+	while (1) {
+		int quit = __atomic_load_n(&log_async.quit, __ATOMIC_ACQUIRE);
+		int count = 0;
+		int rings = __atomic_load_n(&log_async.ring_count, __ATOMIC_RELAXED);
+		rings = rings < OUSTER_LOG_ASYNC_THREADS ? rings : OUSTER_LOG_ASYNC_THREADS;
+		for (int i = 0; i < rings; ++i) {
+			count += log_async_drain(log_async.rings + i);
+		}
+		if (quit && (count == 0)) {
+			break;
+		}
+		if (count == 0) {
+			struct timespec ts = {0, LOG_IDLE_NS};
+			nanosleep(&ts, NULL);
+		}
+	}
+	return NULL;
+}
+
+int ouster_log_async_start(void)
+{
+	if (log_async.running) {
+		return 0;
+	}
+	int generation = log_async.generation;
+	memset(&log_async, 0, sizeof(log_async_t));
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LOG);
+	log_async.memory = ouster_os_calloc(OUSTER_LOG_ASYNC_THREADS * OUSTER_LOG_ASYNC_RING_SIZE);
+	ouster_os_mem_tag_set(tag);
+	if (log_async.memory == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < OUSTER_LOG_ASYNC_THREADS; ++i) {
+		log_async.rings[i].data = log_async.memory + i * OUSTER_LOG_ASYNC_RING_SIZE;
+	}
+	// Threads pick a new ring when the generation changes
+	__atomic_store_n(&log_async.generation, generation + 1, __ATOMIC_RELEASE);
+	if (pthread_create(&log_async.thread, NULL, log_async_thread, NULL) != 0) {
+		ouster_os_free(log_async.memory);
+		log_async.memory = NULL;
+		return -1;
+	}
+	__atomic_store_n(&log_async.running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void ouster_log_async_stop(void)
+{
+	if (!log_async.running) {
+		return;
+	}
+	// New messages are written synchronously from now on, the thread drains what is left
+	__atomic_store_n(&log_async.running, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&log_async.quit, 1, __ATOMIC_RELEASE);
+	pthread_join(log_async.thread, NULL);
+	ouster_os_free(log_async.memory);
+	log_async.memory = NULL;
+}
+
+int64_t ouster_log_async_dropped(void)
+{
+	return __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
 }
 
 void ouster_log_(int32_t level, char const *file, int32_t line, char const *fmt, ...)
 {
 	ouster_assert_notnull(fmt);
 
-    if (level > ouster_os_api.log_level_) {
-        return;
-    }
+	if (level > ouster_os_api.log_level_) {
+		return;
+	}
 
 	va_list args;
 	va_start(args, fmt);
 
-	char *msg = ouster_vasprintf_malloc(fmt, args);
-	ouster_assert_notnull(msg);
-	ouster_os_api.log_(0, file, line, msg);
-	ouster_os_free(msg);
+	if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+		log_async_push(level, file, line, fmt, args);
+		va_end(args);
+		return;
+	}
+
+	// Short messages are formatted on the stack, only long ones allocate
+	char buf[LOG_STACK_MSG];
+	va_list tmpa;
+	va_copy(tmpa, args);
+	int size = vsnprintf(buf, sizeof(buf), fmt, tmpa);
+	va_end(tmpa);
+	if (size < 0) {
+		va_end(args);
+		return;
+	}
+	if (size < (int)sizeof(buf)) {
+		ouster_os_api.log_(level, file, line, buf);
+	} else {
+		int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LOG);
+		char *msg = ouster_os_malloc(size + 1);
+		ouster_os_mem_tag_set(tag);
+		ouster_assert_notnull(msg);
+		vsnprintf(msg, size + 1, fmt, args);
+		ouster_os_api.log_(level, file, line, msg);
+		ouster_os_free(msg);
+	}
 
 	va_end(args);
 }
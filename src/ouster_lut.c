@@ -1,17 +1,27 @@
 #include "ouster_clib.h"
 #include "ouster_math.h"
+#include "ouster_lut_job.h"
 
 //#define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 
 void ouster_lut_fini(ouster_lut_t *lut)
 {
-	ouster_os_free(lut->direction);
-	ouster_os_free(lut->offset);
+	if (lut->map) {
+		ouster_lut_unmap(lut);
+	} else {
+		ouster_os_free(lut->direction);
+		ouster_os_free(lut->offset);
+	}
+	ouster_os_free(lut->direction_base);
+	ouster_os_free(lut->offset_base);
 	lut->direction = NULL;
 	lut->offset = NULL;
+	lut->direction_base = NULL;
+	lut->offset_base = NULL;
 }
 
 /*
@@ -25,16 +35,18 @@ void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta)
 
 	int w = meta->midw;
 	int h = meta->pixels_per_column;
-	ouster_assert(w >= 0, "");
-	ouster_assert(w <= 1024, "");
-	ouster_assert(h >= 0, "");
-	ouster_assert(h <= 128, "");
+	// Any width, the tables are allocated from w and h. Rows are limited by the beam arrays in meta.
+	ouster_assert(w > 0, "");
+	ouster_assert(h > 0, "");
+	ouster_assert(h <= OUSTER_MAX_ROWS, "");
 
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
 	double *encoder = ouster_os_calloc(w * h * sizeof(double));  // theta_e
 	double *azimuth = ouster_os_calloc(w * h * sizeof(double));  // theta_a
 	double *altitude = ouster_os_calloc(w * h * sizeof(double)); // phi
 	double *direction = ouster_os_calloc(w * h * 3 * sizeof(double));
 	double *offset = ouster_os_calloc(w * h * 3 * sizeof(double));
+	ouster_os_mem_tag_set(tag);
 	ouster_assert_notnull(encoder);
 	ouster_assert_notnull(azimuth);
 	ouster_assert_notnull(altitude);
@@ -127,6 +139,15 @@ void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta)
 	lut->offset = offset;
 	lut->w = w;
 	lut->h = h;
+	lut->direction_base = NULL;
+	lut->offset_base = NULL;
+	lut->map = NULL;
+	lut->map_size = 0;
+	memset(lut->transform, 0, sizeof(lut->transform));
+	lut->transform[OUSTER_M4(0, 0)] = 1.0;
+	lut->transform[OUSTER_M4(1, 1)] = 1.0;
+	lut->transform[OUSTER_M4(2, 2)] = 1.0;
+	lut->transform[OUSTER_M4(3, 3)] = 1.0;
 
 	/*
 	for (int i = 0; i < w * h; ++i) {
@@ -137,17 +158,14 @@ void ouster_lut_init(ouster_lut_t *lut, ouster_meta_t const *meta)
 	*/
 }
 
-void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
+/* Converts pixel i0 to i1-1, out points to the whole frame */
+static void cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int i0, int i1)
 {
-	ouster_assert_notnull(lut);
-	ouster_assert_notnull(range);
-	ouster_assert_notnull(out);
-
-	double const *d = lut->direction;
-	double const *o = lut->offset;
-	char *out8 = out;
+	double const *d = lut->direction + i0 * 3;
+	double const *o = lut->offset + i0 * 3;
+	char *out8 = (char *)out + i0 * out_stride;
 
-	for (int i = 0; i < (lut->w * lut->h); ++i, out8 += out_stride, d += 3, o += 3) {
+	for (int i = i0; i < i1; ++i, out8 += out_stride, d += 3, o += 3) {
 		double mag = range[i];
 		double *outd = (double *)out8;
 		outd[0] = (float)(mag * d[0] + o[0]);
@@ -157,38 +175,204 @@ void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, vo
 	}
 }
 
-void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y, float mag, float *out)
+/* Converts pixel i0 to i1-1, out points to the whole frame */
+static void cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int i0, int i1)
+{
+	double const *d = lut->direction + i0 * 3;
+	double const *o = lut->offset + i0 * 3;
+	char *out8 = (char *)out + i0 * out_stride;
+
+	for (int i = i0; i < i1; ++i, out8 += out_stride, d += 3, o += 3) {
+		double mag = range[i];
+		float *outf = (float *)out8;
+		outf[0] = (float)(mag * d[0] + o[0]);
+		outf[1] = (float)(mag * d[1] + o[1]);
+		outf[2] = (float)(mag * d[2] + o[2]);
+	}
+}
+
+void ouster_lut_cartesian_f64(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
 {
 	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
 	ouster_assert_notnull(out);
-	int i = round(y) * lut->w + round(x);
-	ouster_assert(i >= 0, "");
-	ouster_assert(i < lut->w * lut->h, "");
-	double const *d = lut->direction + i;
-	double const *o = lut->offset + i;
-	out[0] = (float)(mag * d[0] + o[0]);
-	out[1] = (float)(mag * d[1] + o[1]);
-	out[2] = (float)(mag * d[2] + o[2]);
+	ouster_profile_begin(t);
+	cartesian_f64(lut, range, out, out_stride, 0, lut->w * lut->h);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
 }
 
-void ouster_lut_cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
+typedef struct
+{
+	ouster_lut_t const *lut;
+	uint32_t const *range;
+	void *out;
+	int out_stride;
+	int jobs;
+} lut_parallel_t;
+
+static void job_f64(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	lut_parallel_t const *p = arg;
+	int i0, i1;
+	lut_job_range(p->lut->w, p->lut->h, p->jobs, index, &i0, &i1);
+	cartesian_f64(p->lut, p->range, p->out, p->out_stride, i0, i1);
+}
+
+static void job_f32(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	lut_parallel_t const *p = arg;
+	int i0, i1;
+	lut_job_range(p->lut->w, p->lut->h, p->jobs, index, &i0, &i1);
+	cartesian_f32(p->lut, p->range, p->out, p->out_stride, i0, i1);
+}
+
+void ouster_lut_cartesian_f64_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool)
 {
 	ouster_assert_notnull(lut);
 	ouster_assert_notnull(range);
 	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	lut_parallel_t p = {lut, range, out, out_stride, lut_job_count(pool, lut->h)};
+	ouster_profile_begin(t);
+	ouster_pool_run(pool, job_f64, &p, p.jobs);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
 
-	double const *d = lut->direction;
-	double const *o = lut->offset;
-	char *out8 = out;
+void ouster_lut_cartesian_f32_parallel(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	lut_parallel_t p = {lut, range, out, out_stride, lut_job_count(pool, lut->h)};
+	ouster_profile_begin(t);
+	ouster_pool_run(pool, job_f32, &p, p.jobs);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
 
-	for (int i = 0; i < (lut->w * lut->h); ++i, out8 += out_stride, d += 3, o += 3) {
+/* Converts staggered pixel i0 to i1-1 and writes them starting at destaggered pixel j0 */
+static void cartesian_f32_destagger(ouster_lut_t const *lut, uint32_t const *range, uint32_t *range_out, char *out, int out_stride, int i0, int i1, int j0)
+{
+	double const *d = lut->direction + i0 * 3;
+	double const *o = lut->offset + i0 * 3;
+	char *out8 = out + j0 * out_stride;
+	for (int i = i0, j = j0; i < i1; ++i, ++j, out8 += out_stride, d += 3, o += 3) {
 		double mag = range[i];
 		float *outf = (float *)out8;
 		outf[0] = (float)(mag * d[0] + o[0]);
 		outf[1] = (float)(mag * d[1] + o[1]);
 		outf[2] = (float)(mag * d[2] + o[2]);
-		// printf("%+f %+f\n", mag, sqrt(OUSTER_V3_DOT(out_xyz, out_xyz)));
+		if (range_out) {
+			range_out[j] = range[i];
+		}
+	}
+}
+
+void ouster_lut_cartesian_f32_destagger(ouster_lut_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(range != range_out, "Destagger in place is not supported");
+	ouster_profile_begin(t);
+	int w = lut->w;
+	for (int row = 0; row < lut->h; ++row) {
+		// Same shift as ouster_destagger(), staggered column c goes to (c + shift) % w
+		int shift = ((meta->pixel_shift_by_row[row] % w) + w) % w;
+		int i = row * w;
+		cartesian_f32_destagger(lut, range, range_out, out, out_stride, i, i + w - shift, i + shift);
+		cartesian_f32_destagger(lut, range, range_out, out, out_stride, i + w - shift, i + w, i);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_f64_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	for (int row = 0; row < lut->h; ++row) {
+		int i = row * lut->w;
+		cartesian_f64(lut, range, out, out_stride, i + col0, i + col1 + 1);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_f32_columns(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	for (int row = 0; row < lut->h; ++row) {
+		int i = row * lut->w;
+		cartesian_f32(lut, range, out, out_stride, i + col0, i + col1 + 1);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_set_transform(ouster_lut_t *lut, double const transform[16])
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(transform);
+	int n = lut->w * lut->h;
+
+	// Keep the untransformed tables so every update starts from them and no error accumulates
+	if (lut->direction_base == NULL) {
+		int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+		lut->direction_base = ouster_os_malloc(n * 3 * sizeof(double));
+		lut->offset_base = ouster_os_malloc(n * 3 * sizeof(double));
+		ouster_os_mem_tag_set(tag);
+		ouster_assert_notnull(lut->direction_base);
+		ouster_assert_notnull(lut->offset_base);
+		memcpy(lut->direction_base, lut->direction, n * 3 * sizeof(double));
+		memcpy(lut->offset_base, lut->offset, n * 3 * sizeof(double));
+	}
+
+	double const *t = transform;
+	for (int i = 0; i < n; ++i) {
+		double const *d = lut->direction_base + i * 3;
+		double const *o = lut->offset_base + i * 3;
+		double *dd = lut->direction + i * 3;
+		double *oo = lut->offset + i * 3;
+		for (int j = 0; j < 3; ++j) {
+			dd[j] = t[OUSTER_M4(j, 0)] * d[0] + t[OUSTER_M4(j, 1)] * d[1] + t[OUSTER_M4(j, 2)] * d[2];
+			oo[j] = t[OUSTER_M4(j, 0)] * o[0] + t[OUSTER_M4(j, 1)] * o[1] + t[OUSTER_M4(j, 2)] * o[2] + t[OUSTER_M4(j, 3)];
+		}
 	}
+	memcpy(lut->transform, transform, sizeof(lut->transform));
+}
+
+void ouster_lut_cartesian_f32_single(ouster_lut_t const *lut, float x, float y, float mag, float *out)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(out);
+	int i = round(y) * lut->w + round(x);
+	ouster_assert(i >= 0, "");
+	ouster_assert(i < lut->w * lut->h, "");
+	double const *d = lut->direction + i * 3;
+	double const *o = lut->offset + i * 3;
+	out[0] = (float)(mag * d[0] + o[0]);
+	out[1] = (float)(mag * d[1] + o[1]);
+	out[2] = (float)(mag * d[2] + o[2]);
+}
+
+void ouster_lut_cartesian_f32(ouster_lut_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_profile_begin(t);
+	cartesian_f32(lut, range, out, out_stride, 0, lut->w * lut->h);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
 }
 
 double *ouster_lut_alloc(ouster_lut_t const *lut)
@@ -197,6 +381,160 @@ double *ouster_lut_alloc(ouster_lut_t const *lut)
 
 	int n = lut->w * lut->h;
 	int size = n * sizeof(double) * 3;
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
 	void *memory = ouster_os_calloc(size);
+	ouster_os_mem_tag_set(tag);
 	return memory;
+}
+
+/* Synthetic meta of a full width lidar mode, angles roughly like an OS1 */
+static void test_meta(ouster_meta_t *meta, int w, int h)
+{
+	memset(meta, 0, sizeof(ouster_meta_t));
+	meta->columns_per_frame = w;
+	meta->pixels_per_column = h;
+	meta->mid0 = 0;
+	meta->mid1 = w - 1;
+	meta->midw = w;
+	meta->lidar_origin_to_beam_origin_mm = 15.806;
+	for (int r = 0; r < h; ++r) {
+		meta->beam_altitude_angles[r] = 22.5 - (45.0 * r) / h;
+		meta->beam_azimuth_angles[r] = ((r % 4) - 1.5) * 2.8;
+	}
+	meta->beam_to_lidar_transform[OUSTER_M4(0, 0)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(1, 1)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(2, 2)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(3, 3)] = 1.0;
+	meta->beam_to_lidar_transform[OUSTER_M4(0, 3)] = 15.806;
+	meta->beam_to_lidar_transform[OUSTER_M4(2, 3)] = 1.5;
+	// Rotation of 30 degrees around z, not symmetric so a transposed rotation is caught
+	double c = cos(OUSTER_M_PI / 6.0);
+	double s = sin(OUSTER_M_PI / 6.0);
+	meta->lidar_to_sensor_transform[OUSTER_M4(0, 0)] = c;
+	meta->lidar_to_sensor_transform[OUSTER_M4(0, 1)] = -s;
+	meta->lidar_to_sensor_transform[OUSTER_M4(1, 0)] = s;
+	meta->lidar_to_sensor_transform[OUSTER_M4(1, 1)] = c;
+	meta->lidar_to_sensor_transform[OUSTER_M4(2, 2)] = 1.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(3, 3)] = 1.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(0, 3)] = 3.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(1, 3)] = -2.0;
+	meta->lidar_to_sensor_transform[OUSTER_M4(2, 3)] = 36.18;
+}
+
+/* Reference point of pixel (r, c) in meters, straight from the sensor documentation */
+static void test_reference(ouster_meta_t const *meta, int r, int c, double range, double out[3])
+{
+	double n = meta->lidar_origin_to_beam_origin_mm;
+	double encoder = 2.0 * OUSTER_M_PI * (1.0 - (double)(meta->mid0 + c) / meta->columns_per_frame);
+	double azimuth = -2.0 * OUSTER_M_PI * meta->beam_azimuth_angles[r] / 360.0;
+	double altitude = 2.0 * OUSTER_M_PI * meta->beam_altitude_angles[r] / 360.0;
+	double p[3] = {
+	    (range - n) * cos(encoder + azimuth) * cos(altitude) + meta->beam_to_lidar_transform[OUSTER_M4(0, 3)] * cos(encoder),
+	    (range - n) * sin(encoder + azimuth) * cos(altitude) + meta->beam_to_lidar_transform[OUSTER_M4(0, 3)] * sin(encoder),
+	    (range - n) * sin(altitude) + meta->beam_to_lidar_transform[OUSTER_M4(2, 3)],
+	};
+	double const *t = meta->lidar_to_sensor_transform;
+	for (int j = 0; j < 3; ++j) {
+		out[j] = (t[OUSTER_M4(j, 0)] * p[0] + t[OUSTER_M4(j, 1)] * p[1] + t[OUSTER_M4(j, 2)] * p[2] + t[OUSTER_M4(j, 3)]) * 0.001;
+	}
+}
+
+/* Largest distance in meters between the reference and xyz of all pixels */
+static double test_error(ouster_meta_t const *meta, double const *ref, float const *xyz)
+{
+	double e = 0;
+	for (int i = 0; i < meta->midw * meta->pixels_per_column; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			double d = fabs(ref[i * 3 + j] - xyz[i * 3 + j]);
+			e = d > e ? d : e;
+		}
+	}
+	return e;
+}
+
+int test_ouster_lut()
+{
+	int const widths[] = {512, 1024, 2048};
+	int const heights[] = {16, 32, 64, 128};
+	// Float keeps 24 bits, that is 8 um at 100 m. Fixed-point is within 1 mm.
+	double const tolerance_float = 0.0001;
+	double const tolerance_fixed = 0.0015;
+	int ok = 1;
+
+	for (int wi = 0; wi < 3; ++wi) {
+		for (int hi = 0; hi < 4; ++hi) {
+			int w = widths[wi];
+			int h = heights[hi];
+			int n = w * h;
+			ouster_meta_t meta;
+			test_meta(&meta, w, h);
+
+			uint32_t *range = ouster_os_malloc(n * sizeof(uint32_t));
+			double *ref = ouster_os_malloc(n * 3 * sizeof(double));
+			double *out64 = ouster_os_malloc(n * 3 * sizeof(double));
+			float *out32 = ouster_os_malloc(n * 3 * sizeof(float));
+			int32_t *outi = ouster_os_malloc(n * 3 * sizeof(int32_t));
+			ouster_assert_notnull(range);
+			ouster_assert_notnull(ref);
+			ouster_assert_notnull(out64);
+			ouster_assert_notnull(out32);
+			ouster_assert_notnull(outi);
+
+			for (int r = 0; r < h; ++r) {
+				for (int c = 0; c < w; ++c) {
+					int i = r * w + c;
+					// Deterministic ranges up to 200 m, every 97th pixel has no return
+					range[i] = (i % 97) ? (uint32_t)((i * 7919u) % 200000u) : 0;
+					test_reference(&meta, r, c, range[i], ref + i * 3);
+				}
+			}
+
+			ouster_lut_t lut;
+			ouster_lut_f32_t lut32;
+			ouster_lut_fixed_t lutfixed;
+			ouster_lut_init(&lut, &meta);
+			ouster_lut_f32_init(&lut32, &lut);
+			ouster_lut_fixed_init(&lutfixed, &lut, 1);
+
+			double e[5];
+			ouster_lut_cartesian_f64(&lut, range, out64, sizeof(double) * 3);
+			for (int i = 0; i < n * 3; ++i) {
+				out32[i] = (float)out64[i];
+			}
+			e[0] = test_error(&meta, ref, out32);
+
+			ouster_lut_cartesian_f32(&lut, range, out32, sizeof(float) * 3);
+			e[1] = test_error(&meta, ref, out32);
+
+			ouster_lut_f32_cartesian_aos(&lut32, range, out32, sizeof(float) * 3);
+			e[2] = test_error(&meta, ref, out32);
+
+			for (int i = 0; i < n; ++i) {
+				ouster_lut_cartesian_f32_single(&lut, i % w, i / w, range[i], out32 + i * 3);
+			}
+			e[3] = test_error(&meta, ref, out32);
+
+			ouster_lut_cartesian_i32(&lutfixed, range, outi, sizeof(int32_t) * 3);
+			for (int i = 0; i < n * 3; ++i) {
+				out32[i] = (float)(outi[i] * 0.001);
+			}
+			e[4] = test_error(&meta, ref, out32);
+
+			int pass = (e[0] < tolerance_float) && (e[1] < tolerance_float) && (e[2] < tolerance_float) && (e[3] < tolerance_float) && (e[4] < tolerance_fixed);
+			if (!pass) {
+				ouster_log("LUT %ix%i error f64=%g f32=%g f32_lut=%g single=%g i32=%g\n", w, h, e[0], e[1], e[2], e[3], e[4]);
+				ok = 0;
+			}
+
+			ouster_lut_fixed_fini(&lutfixed);
+			ouster_lut_f32_fini(&lut32);
+			ouster_lut_fini(&lut);
+			ouster_os_free(range);
+			ouster_os_free(ref);
+			ouster_os_free(out64);
+			ouster_os_free(out32);
+			ouster_os_free(outi);
+		}
+	}
+	return ok;
 }
\ No newline at end of file
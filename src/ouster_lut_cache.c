@@ -0,0 +1,197 @@
+#include "ouster_clib.h"
+#include "ouster_math.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LUT_CACHE_MAGIC 0x54554C4F
+#define LUT_CACHE_VERSION 1
+
+#define FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+/* 64 bytes so the tables that follow are cache line aligned in the mapping */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t hash;
+	int32_t w;
+	int32_t h;
+	uint8_t reserved[40];
+} lut_cache_header_t;
+
+static uint64_t fnv1a(uint64_t h, void const *data, int size)
+{
+	uint8_t const *p = data;
+	for (int i = 0; i < size; ++i) {
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+uint64_t ouster_lut_meta_hash(ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(meta);
+	int h = meta->pixels_per_column;
+	ouster_assert(h >= 0, "");
+	ouster_assert(h <= OUSTER_MAX_ROWS, "");
+	uint32_t version = LUT_CACHE_VERSION;
+	uint64_t hash = FNV_OFFSET;
+	hash = fnv1a(hash, &version, sizeof(version));
+	hash = fnv1a(hash, &meta->columns_per_frame, sizeof(meta->columns_per_frame));
+	hash = fnv1a(hash, &meta->pixels_per_column, sizeof(meta->pixels_per_column));
+	hash = fnv1a(hash, &meta->mid0, sizeof(meta->mid0));
+	hash = fnv1a(hash, &meta->mid1, sizeof(meta->mid1));
+	hash = fnv1a(hash, &meta->midw, sizeof(meta->midw));
+	hash = fnv1a(hash, meta->beam_altitude_angles, h * sizeof(double));
+	hash = fnv1a(hash, meta->beam_azimuth_angles, h * sizeof(double));
+	hash = fnv1a(hash, meta->beam_to_lidar_transform, sizeof(meta->beam_to_lidar_transform));
+	hash = fnv1a(hash, &meta->lidar_origin_to_beam_origin_mm, sizeof(meta->lidar_origin_to_beam_origin_mm));
+	hash = fnv1a(hash, meta->lidar_to_sensor_transform, sizeof(meta->lidar_to_sensor_transform));
+	return hash;
+}
+
+static int write_all(int fd, void const *data, size_t size)
+{
+	char const *p = data;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+int ouster_lut_save(ouster_lut_t const *lut, ouster_meta_t const *meta, char const *path)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(path);
+
+	lut_cache_header_t header = {0};
+	header.magic = LUT_CACHE_MAGIC;
+	header.version = LUT_CACHE_VERSION;
+	header.hash = ouster_lut_meta_hash(meta);
+	header.w = lut->w;
+	header.h = lut->h;
+	size_t table_size = (size_t)lut->w * lut->h * 3 * sizeof(double);
+
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.%i.tmp", path, (int)getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	// The cache is keyed by meta only, store the tables from before ouster_lut_set_transform()
+	double const *direction = lut->direction_base ? lut->direction_base : lut->direction;
+	double const *offset = lut->offset_base ? lut->offset_base : lut->offset;
+	int rc = write_all(fd, &header, sizeof(header));
+	rc = rc ? rc : write_all(fd, direction, table_size);
+	rc = rc ? rc : write_all(fd, offset, table_size);
+	rc = rc ? rc : fsync(fd);
+	int e = errno;
+	close(fd);
+	if ((rc == 0) && (rename(tmp, path) == 0)) {
+		return 0;
+	}
+	e = rc ? e : errno;
+	unlink(tmp);
+	errno = e;
+	return -1;
+}
+
+int ouster_lut_load(ouster_lut_t *lut, ouster_meta_t const *meta, char const *path)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(path);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	int w = meta->midw;
+	int h = meta->pixels_per_column;
+	size_t table_size = (size_t)w * h * 3 * sizeof(double);
+	size_t size = sizeof(lut_cache_header_t) + 2 * table_size;
+	if ((size_t)st.st_size != size) {
+		close(fd);
+		return -1;
+	}
+
+	// Private so the tables can be modified in memory, e.g. by ouster_lut_set_transform()
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	lut_cache_header_t const *header = map;
+	if ((header->magic != LUT_CACHE_MAGIC) || (header->version != LUT_CACHE_VERSION) || (header->hash != ouster_lut_meta_hash(meta)) || (header->w != w) || (header->h != h)) {
+		munmap(map, size);
+		return -1;
+	}
+
+	char *tables = (char *)map + sizeof(lut_cache_header_t);
+	memset(lut, 0, sizeof(ouster_lut_t));
+	lut->w = w;
+	lut->h = h;
+	lut->direction = (double *)tables;
+	lut->offset = (double *)(tables + table_size);
+	lut->transform[OUSTER_M4(0, 0)] = 1.0;
+	lut->transform[OUSTER_M4(1, 1)] = 1.0;
+	lut->transform[OUSTER_M4(2, 2)] = 1.0;
+	lut->transform[OUSTER_M4(3, 3)] = 1.0;
+	lut->map = map;
+	lut->map_size = (int64_t)size;
+	return 0;
+}
+
+void ouster_lut_unmap(ouster_lut_t *lut)
+{
+	ouster_assert_notnull(lut);
+	if (lut->map) {
+		munmap(lut->map, (size_t)lut->map_size);
+	}
+	lut->map = NULL;
+	lut->map_size = 0;
+	lut->direction = NULL;
+	lut->offset = NULL;
+}
+
+int ouster_lut_init_cached(ouster_lut_t *lut, ouster_meta_t const *meta, char const *dir)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(dir);
+
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/ouster_lut_%016jx.bin", dir, (uintmax_t)ouster_lut_meta_hash(meta));
+	if (ouster_lut_load(lut, meta, path) == 0) {
+		return 1;
+	}
+	ouster_lut_init(lut, meta);
+	if (ouster_lut_save(lut, meta, path) != 0) {
+		ouster_log("Could not write LUT cache '%s': %s\n", path, strerror(errno));
+	}
+	return 0;
+}
\ No newline at end of file
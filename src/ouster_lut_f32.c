@@ -0,0 +1,478 @@
+#include "ouster_clib.h"
+#include "ouster_lut_job.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OUSTER_LUT_X86
+#include <immintrin.h>
+#endif
+
+#define LUT_ALIGN 64
+
+/* Number of pixels converted per block in the interleaved kernels */
+#define LUT_BLOCK 256
+
+typedef void (*lut_kernel_t)(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z);
+
+typedef void (*lut_block_t)(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride);
+
+typedef int (*lut_compact_t)(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, uint32_t min_range, uint32_t max_range, char *out, int out_stride, int32_t *indices);
+
+static inline void interleave(float const *x, float const *y, float const *z, int n, float *out)
+{
+	int i = 0;
+#if defined(OUSTER_LUT_X86) && defined(__SSE2__)
+	for (; (i + 4) <= n; i += 4) {
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vy = _mm_loadu_ps(y + i);
+		__m128 vz = _mm_loadu_ps(z + i);
+		__m128 xy_lo = _mm_unpacklo_ps(vx, vy);
+		__m128 xy_hi = _mm_unpackhi_ps(vx, vy);
+		__m128 zx = _mm_shuffle_ps(vz, vx, _MM_SHUFFLE(1, 1, 0, 0));
+		__m128 yz1 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 zx3 = _mm_shuffle_ps(vz, xy_hi, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 yz3 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(3, 3, 3, 3));
+		// x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+		_mm_storeu_ps(out + i * 3 + 0, _mm_shuffle_ps(xy_lo, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out + i * 3 + 4, _mm_shuffle_ps(yz1, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+		_mm_storeu_ps(out + i * 3 + 8, _mm_shuffle_ps(zx3, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+#endif
+	for (; i < n; ++i) {
+		out[i * 3 + 0] = x[i];
+		out[i * 3 + 1] = y[i];
+		out[i * 3 + 2] = z[i];
+	}
+}
+
+static inline void store_aos(float const *x, float const *y, float const *z, int n, char *out, int out_stride)
+{
+	if (out_stride == (3 * sizeof(float))) {
+		interleave(x, y, z, n, (float *)out);
+		return;
+	}
+	for (int i = 0; i < n; ++i, out += out_stride) {
+		float *outf = (float *)out;
+		outf[0] = x[i];
+		outf[1] = y[i];
+		outf[2] = z[i];
+	}
+}
+
+static inline void kernel_scalar(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z)
+{
+	for (int i = i0; i < i1; ++i) {
+		float r = (float)range[i];
+		x[i - i0] = r * lut->dx[i] + lut->ox[i];
+		y[i - i0] = r * lut->dy[i] + lut->oy[i];
+		z[i - i0] = r * lut->dz[i] + lut->oz[i];
+	}
+}
+
+#ifdef OUSTER_LUT_X86
+
+#ifdef __SSE2__
+static inline void kernel_sse2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z)
+{
+	int i = i0;
+	for (; (i + 4) <= i1; i += 4) {
+		__m128 r = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i const *)(range + i)));
+		_mm_storeu_ps(x + i - i0, _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(lut->dx + i)), _mm_loadu_ps(lut->ox + i)));
+		_mm_storeu_ps(y + i - i0, _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(lut->dy + i)), _mm_loadu_ps(lut->oy + i)));
+		_mm_storeu_ps(z + i - i0, _mm_add_ps(_mm_mul_ps(r, _mm_loadu_ps(lut->dz + i)), _mm_loadu_ps(lut->oz + i)));
+	}
+	kernel_scalar(lut, range, i, i1, x + i - i0, y + i - i0, z + i - i0);
+}
+#endif
+
+__attribute__((target("avx2"))) static inline void kernel_avx2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, float *x, float *y, float *z)
+{
+	int i = i0;
+	for (; (i + 8) <= i1; i += 8) {
+		__m256 r = _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i const *)(range + i)));
+		_mm256_storeu_ps(x + i - i0, _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dx + i)), _mm256_loadu_ps(lut->ox + i)));
+		_mm256_storeu_ps(y + i - i0, _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dy + i)), _mm256_loadu_ps(lut->oy + i)));
+		_mm256_storeu_ps(z + i - i0, _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dz + i)), _mm256_loadu_ps(lut->oz + i)));
+	}
+	kernel_scalar(lut, range, i, i1, x + i - i0, y + i - i0, z + i - i0);
+}
+
+#endif
+
+/* Converts a block to planes on the stack then interleaves. Each ISA gets its own
+ * block function so the kernel and interleave are inlined with the same encoding,
+ * mixing VEX and legacy SSE code is slow on some CPUs. */
+static void block_scalar(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	kernel_scalar(lut, range, i0, i1, x, y, z);
+	store_aos(x, y, z, i1 - i0, out, out_stride);
+}
+
+#ifdef OUSTER_LUT_X86
+#ifdef __SSE2__
+static void block_sse2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	kernel_sse2(lut, range, i0, i1, x, y, z);
+	store_aos(x, y, z, i1 - i0, out, out_stride);
+}
+#endif
+
+__attribute__((target("avx2"))) static void block_avx2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	kernel_avx2(lut, range, i0, i1, x, y, z);
+	store_aos(x, y, z, i1 - i0, out, out_stride);
+}
+#endif
+
+static lut_block_t block_select(void)
+{
+#ifdef OUSTER_LUT_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return block_avx2;
+	}
+#ifdef __SSE2__
+	return block_sse2;
+#endif
+#endif
+	return block_scalar;
+}
+
+/* Writes the pixels with range in [min_range, max_range] densely, returns number of points written */
+static int compact_scalar(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, uint32_t min_range, uint32_t max_range, char *out, int out_stride, int32_t *indices)
+{
+	float x[LUT_BLOCK];
+	float y[LUT_BLOCK];
+	float z[LUT_BLOCK];
+	int32_t index[LUT_BLOCK];
+	int n = 0;
+	for (int i = i0; i < i1; ++i) {
+		// Branchless, always write and only advance on valid pixels
+		float r = (float)range[i];
+		x[n] = r * lut->dx[i] + lut->ox[i];
+		y[n] = r * lut->dy[i] + lut->oy[i];
+		z[n] = r * lut->dz[i] + lut->oz[i];
+		index[n] = i;
+		n += (range[i] >= min_range) & (range[i] <= max_range);
+	}
+	store_aos(x, y, z, n, out, out_stride);
+	if (indices) {
+		memcpy(indices, index, n * sizeof(int32_t));
+	}
+	return n;
+}
+
+#ifdef OUSTER_LUT_X86
+
+/* Left-pack permutations for every 8 bit lane mask, 3 bit lane index per destination lane */
+static const uint32_t compact_perm[256] = {
+	0x000000, 0x000000, 0x000001, 0x000008, 0x000002, 0x000010, 0x000011, 0x000088,
+	0x000003, 0x000018, 0x000019, 0x0000C8, 0x00001A, 0x0000D0, 0x0000D1, 0x000688,
+	0x000004, 0x000020, 0x000021, 0x000108, 0x000022, 0x000110, 0x000111, 0x000888,
+	0x000023, 0x000118, 0x000119, 0x0008C8, 0x00011A, 0x0008D0, 0x0008D1, 0x004688,
+	0x000005, 0x000028, 0x000029, 0x000148, 0x00002A, 0x000150, 0x000151, 0x000A88,
+	0x00002B, 0x000158, 0x000159, 0x000AC8, 0x00015A, 0x000AD0, 0x000AD1, 0x005688,
+	0x00002C, 0x000160, 0x000161, 0x000B08, 0x000162, 0x000B10, 0x000B11, 0x005888,
+	0x000163, 0x000B18, 0x000B19, 0x0058C8, 0x000B1A, 0x0058D0, 0x0058D1, 0x02C688,
+	0x000006, 0x000030, 0x000031, 0x000188, 0x000032, 0x000190, 0x000191, 0x000C88,
+	0x000033, 0x000198, 0x000199, 0x000CC8, 0x00019A, 0x000CD0, 0x000CD1, 0x006688,
+	0x000034, 0x0001A0, 0x0001A1, 0x000D08, 0x0001A2, 0x000D10, 0x000D11, 0x006888,
+	0x0001A3, 0x000D18, 0x000D19, 0x0068C8, 0x000D1A, 0x0068D0, 0x0068D1, 0x034688,
+	0x000035, 0x0001A8, 0x0001A9, 0x000D48, 0x0001AA, 0x000D50, 0x000D51, 0x006A88,
+	0x0001AB, 0x000D58, 0x000D59, 0x006AC8, 0x000D5A, 0x006AD0, 0x006AD1, 0x035688,
+	0x0001AC, 0x000D60, 0x000D61, 0x006B08, 0x000D62, 0x006B10, 0x006B11, 0x035888,
+	0x000D63, 0x006B18, 0x006B19, 0x0358C8, 0x006B1A, 0x0358D0, 0x0358D1, 0x1AC688,
+	0x000007, 0x000038, 0x000039, 0x0001C8, 0x00003A, 0x0001D0, 0x0001D1, 0x000E88,
+	0x00003B, 0x0001D8, 0x0001D9, 0x000EC8, 0x0001DA, 0x000ED0, 0x000ED1, 0x007688,
+	0x00003C, 0x0001E0, 0x0001E1, 0x000F08, 0x0001E2, 0x000F10, 0x000F11, 0x007888,
+	0x0001E3, 0x000F18, 0x000F19, 0x0078C8, 0x000F1A, 0x0078D0, 0x0078D1, 0x03C688,
+	0x00003D, 0x0001E8, 0x0001E9, 0x000F48, 0x0001EA, 0x000F50, 0x000F51, 0x007A88,
+	0x0001EB, 0x000F58, 0x000F59, 0x007AC8, 0x000F5A, 0x007AD0, 0x007AD1, 0x03D688,
+	0x0001EC, 0x000F60, 0x000F61, 0x007B08, 0x000F62, 0x007B10, 0x007B11, 0x03D888,
+	0x000F63, 0x007B18, 0x007B19, 0x03D8C8, 0x007B1A, 0x03D8D0, 0x03D8D1, 0x1EC688,
+	0x00003E, 0x0001F0, 0x0001F1, 0x000F88, 0x0001F2, 0x000F90, 0x000F91, 0x007C88,
+	0x0001F3, 0x000F98, 0x000F99, 0x007CC8, 0x000F9A, 0x007CD0, 0x007CD1, 0x03E688,
+	0x0001F4, 0x000FA0, 0x000FA1, 0x007D08, 0x000FA2, 0x007D10, 0x007D11, 0x03E888,
+	0x000FA3, 0x007D18, 0x007D19, 0x03E8C8, 0x007D1A, 0x03E8D0, 0x03E8D1, 0x1F4688,
+	0x0001F5, 0x000FA8, 0x000FA9, 0x007D48, 0x000FAA, 0x007D50, 0x007D51, 0x03EA88,
+	0x000FAB, 0x007D58, 0x007D59, 0x03EAC8, 0x007D5A, 0x03EAD0, 0x03EAD1, 0x1F5688,
+	0x000FAC, 0x007D60, 0x007D61, 0x03EB08, 0x007D62, 0x03EB10, 0x03EB11, 0x1F5888,
+	0x007D63, 0x03EB18, 0x03EB19, 0x1F58C8, 0x03EB1A, 0x1F58D0, 0x1F58D1, 0xFAC688,
+};
+
+__attribute__((target("avx2"))) static int compact_avx2(ouster_lut_f32_t const *lut, uint32_t const *range, int i0, int i1, uint32_t min_range, uint32_t max_range, char *out, int out_stride, int32_t *indices)
+{
+	// One vector of slack for the full width stores at the end of the packed data
+	float x[LUT_BLOCK + 8];
+	float y[LUT_BLOCK + 8];
+	float z[LUT_BLOCK + 8];
+	int32_t index[LUT_BLOCK + 8];
+	// Ranges are at most 20 bits so signed compares work after clamping the band
+	__m256i vmin = _mm256_set1_epi32((int32_t)(min_range < INT32_MAX ? min_range : INT32_MAX));
+	__m256i vmax = _mm256_set1_epi32((int32_t)(max_range < INT32_MAX ? max_range : INT32_MAX));
+	__m256i shift = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	__m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	int n = 0;
+	int i = i0;
+	for (; (i + 8) <= i1; i += 8) {
+		__m256i ri = _mm256_loadu_si256((__m256i const *)(range + i));
+		__m256i invalid = _mm256_or_si256(_mm256_cmpgt_epi32(vmin, ri), _mm256_cmpgt_epi32(ri, vmax));
+		int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(invalid)) & 0xFF;
+		__m256i perm = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int32_t)compact_perm[mask]), shift), _mm256_set1_epi32(7));
+		__m256 r = _mm256_cvtepi32_ps(ri);
+		__m256 vx = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dx + i)), _mm256_loadu_ps(lut->ox + i));
+		__m256 vy = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dy + i)), _mm256_loadu_ps(lut->oy + i));
+		__m256 vz = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(lut->dz + i)), _mm256_loadu_ps(lut->oz + i));
+		__m256i vi = _mm256_add_epi32(_mm256_set1_epi32(i), iota);
+		_mm256_storeu_ps(x + n, _mm256_permutevar8x32_ps(vx, perm));
+		_mm256_storeu_ps(y + n, _mm256_permutevar8x32_ps(vy, perm));
+		_mm256_storeu_ps(z + n, _mm256_permutevar8x32_ps(vz, perm));
+		_mm256_storeu_si256((__m256i *)(index + n), _mm256_permutevar8x32_epi32(vi, perm));
+		n += __builtin_popcount(mask);
+	}
+	for (; i < i1; ++i) {
+		float r = (float)range[i];
+		x[n] = r * lut->dx[i] + lut->ox[i];
+		y[n] = r * lut->dy[i] + lut->oy[i];
+		z[n] = r * lut->dz[i] + lut->oz[i];
+		index[n] = i;
+		n += (range[i] >= min_range) & (range[i] <= max_range);
+	}
+	store_aos(x, y, z, n, out, out_stride);
+	if (indices) {
+		memcpy(indices, index, n * sizeof(int32_t));
+	}
+	return n;
+}
+
+#endif
+
+static lut_compact_t compact_select(void)
+{
+#ifdef OUSTER_LUT_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return compact_avx2;
+	}
+#endif
+	return compact_scalar;
+}
+
+/* Picks the widest kernel the CPU supports */
+static lut_kernel_t kernel_select(void)
+{
+#ifdef OUSTER_LUT_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return kernel_avx2;
+	}
+#ifdef __SSE2__
+	return kernel_sse2;
+#endif
+#endif
+	return kernel_scalar;
+}
+
+void ouster_lut_f32_init(ouster_lut_f32_t *dst, ouster_lut_t const *src)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	int n = src->w * src->h;
+	// Round each plane up to a multiple of 64 bytes so every plane stays aligned
+	int plane = (n + (LUT_ALIGN / sizeof(float)) - 1) & ~(int)((LUT_ALIGN / sizeof(float)) - 1);
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+	dst->memory = ouster_os_calloc(plane * 6 * sizeof(float) + LUT_ALIGN);
+	ouster_os_mem_tag_set(tag);
+	ouster_assert_notnull(dst->memory);
+	float *base = (float *)(((uintptr_t)dst->memory + LUT_ALIGN - 1) & ~(uintptr_t)(LUT_ALIGN - 1));
+	dst->w = src->w;
+	dst->h = src->h;
+	dst->dx = base + plane * 0;
+	dst->dy = base + plane * 1;
+	dst->dz = base + plane * 2;
+	dst->ox = base + plane * 3;
+	dst->oy = base + plane * 4;
+	dst->oz = base + plane * 5;
+	for (int i = 0; i < n; ++i) {
+		dst->dx[i] = (float)src->direction[i * 3 + 0];
+		dst->dy[i] = (float)src->direction[i * 3 + 1];
+		dst->dz[i] = (float)src->direction[i * 3 + 2];
+		dst->ox[i] = (float)src->offset[i * 3 + 0];
+		dst->oy[i] = (float)src->offset[i * 3 + 1];
+		dst->oz[i] = (float)src->offset[i * 3 + 2];
+	}
+}
+
+void ouster_lut_f32_fini(ouster_lut_f32_t *lut)
+{
+	ouster_assert_notnull(lut);
+	ouster_os_free(lut->memory);
+	memset(lut, 0, sizeof(ouster_lut_f32_t));
+}
+
+void ouster_lut_f32_cartesian_soa(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(x);
+	ouster_assert_notnull(y);
+	ouster_assert_notnull(z);
+	ouster_profile_begin(t);
+	kernel_select()(lut, range, 0, lut->w * lut->h, x, y, z);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_soa_columns(ouster_lut_f32_t const *lut, uint32_t const *range, float *x, float *y, float *z, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(x);
+	ouster_assert_notnull(y);
+	ouster_assert_notnull(z);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	lut_kernel_t kernel = kernel_select();
+	for (int row = 0; row < lut->h; ++row) {
+		int i0 = row * lut->w + col0;
+		kernel(lut, range, i0, i0 + col1 - col0 + 1, x + i0, y + i0, z + i0);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_aos(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_profile_begin(t);
+	lut_block_t block = block_select();
+	int n = lut->w * lut->h;
+	char *out8 = out;
+	for (int i0 = 0; i0 < n; i0 += LUT_BLOCK, out8 += LUT_BLOCK * out_stride) {
+		int i1 = (i0 + LUT_BLOCK) < n ? (i0 + LUT_BLOCK) : n;
+		block(lut, range, i0, i1, out8, out_stride);
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_aos_columns(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	lut_block_t block = block_select();
+	for (int row = 0; row < lut->h; ++row) {
+		int end = row * lut->w + col1 + 1;
+		for (int i0 = row * lut->w + col0; i0 < end; i0 += LUT_BLOCK) {
+			int i1 = (i0 + LUT_BLOCK) < end ? (i0 + LUT_BLOCK) : end;
+			block(lut, range, i0, i1, (char *)out + i0 * out_stride, out_stride);
+		}
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+int ouster_lut_f32_cartesian_compact_columns(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices, int col0, int col1)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(col0 >= 0, "");
+	ouster_assert(col1 < lut->w, "");
+	ouster_profile_begin(t);
+	lut_compact_t compact = compact_select();
+	char *out8 = out;
+	int count = 0;
+	for (int row = 0; row < lut->h; ++row) {
+		int end = row * lut->w + col1 + 1;
+		for (int i0 = row * lut->w + col0; i0 < end; i0 += LUT_BLOCK) {
+			int i1 = (i0 + LUT_BLOCK) < end ? (i0 + LUT_BLOCK) : end;
+			int n = compact(lut, range, i0, i1, min_range, max_range, out8 + count * out_stride, out_stride, indices ? indices + count : NULL);
+			count += n;
+		}
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+	return count;
+}
+
+int ouster_lut_f32_cartesian_compact(ouster_lut_f32_t const *lut, uint32_t const *range, uint32_t min_range, uint32_t max_range, void *out, int out_stride, int32_t *indices)
+{
+	ouster_assert_notnull(lut);
+	return ouster_lut_f32_cartesian_compact_columns(lut, range, min_range, max_range, out, out_stride, indices, 0, lut->w - 1);
+}
+
+typedef struct
+{
+	ouster_lut_f32_t const *lut;
+	uint32_t const *range;
+	char *out;
+	int out_stride;
+	int jobs;
+	lut_block_t block;
+} lut_f32_parallel_t;
+
+static void job_aos(void *arg, int index, int worker)
+{
+	ouster_unused(worker);
+	lut_f32_parallel_t const *p = arg;
+	int begin, end;
+	lut_job_range(p->lut->w, p->lut->h, p->jobs, index, &begin, &end);
+	for (int i0 = begin; i0 < end; i0 += LUT_BLOCK) {
+		int i1 = (i0 + LUT_BLOCK) < end ? (i0 + LUT_BLOCK) : end;
+		p->block(p->lut, p->range, i0, i1, p->out + i0 * p->out_stride, p->out_stride);
+	}
+}
+
+void ouster_lut_f32_cartesian_aos_parallel(ouster_lut_f32_t const *lut, uint32_t const *range, void *out, int out_stride, ouster_pool_t *pool)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert_notnull(pool);
+	ouster_profile_begin(t);
+	lut_f32_parallel_t p = {lut, range, out, out_stride, lut_job_count(pool, lut->h), block_select()};
+	ouster_pool_run(pool, job_aos, &p, p.jobs);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_f32_cartesian_aos_destagger(ouster_lut_f32_t const *lut, ouster_meta_t const *meta, uint32_t const *range, uint32_t *range_out, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(meta);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	ouster_assert(range != range_out, "Destagger in place is not supported");
+	ouster_profile_begin(t);
+	lut_block_t block = block_select();
+	char *out8 = out;
+	int w = lut->w;
+	for (int row = 0; row < lut->h; ++row) {
+		int shift = ((meta->pixel_shift_by_row[row] % w) + w) % w;
+		int i = row * w;
+		// Two runs per row: [0, w - shift) moves right by shift, [w - shift, w) wraps to the start
+		int src[2] = {i, i + w - shift};
+		int end[2] = {i + w - shift, i + w};
+		int dst[2] = {i + shift, i};
+		for (int k = 0; k < 2; ++k) {
+			for (int i0 = src[k]; i0 < end[k]; i0 += LUT_BLOCK) {
+				int i1 = (i0 + LUT_BLOCK) < end[k] ? (i0 + LUT_BLOCK) : end[k];
+				int j0 = dst[k] + (i0 - src[k]);
+				block(lut, range, i0, i1, out8 + j0 * out_stride, out_stride);
+			}
+			if (range_out) {
+				memcpy(range_out + dst[k], range + src[k], (end[k] - src[k]) * sizeof(uint32_t));
+			}
+		}
+	}
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
\ No newline at end of file
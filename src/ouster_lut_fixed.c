@@ -0,0 +1,264 @@
+#include "ouster_clib.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OUSTER_LUT_X86
+#include <immintrin.h>
+#endif
+
+#define FIXED_ALIGN 64
+
+/* Number of pixels converted per block */
+#define FIXED_BLOCK 256
+
+/* Ranges are split in high and low 10 bits so every product fits in int32 */
+#define FIXED_RANGE_SPLIT 10
+#define FIXED_RANGE_MAX ((1 << 20) - 1)
+#define FIXED_DIRECTION_Q 20
+#define FIXED_OFFSET_Q (FIXED_DIRECTION_Q - FIXED_RANGE_SPLIT)
+
+typedef void (*fixed_block_t)(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride);
+
+/*
+r * d / 2^20 = (rh * 2^10 * d + rl * d) / 2^20 = (rh * d + ((rl * d) >> 10)) / 2^10
+with |d| <= 2^20 and rh, rl < 2^10 every term stays below 2^31.
+*/
+static inline int32_t fixed_mul(int32_t rh, int32_t rl, int32_t d, int32_t o)
+{
+	return (rh * d + ((rl * d) >> FIXED_RANGE_SPLIT) + o + (1 << (FIXED_OFFSET_Q - 1))) >> FIXED_OFFSET_Q;
+}
+
+static inline void fixed_kernel_scalar(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, int32_t *x, int32_t *y, int32_t *z)
+{
+	for (int i = i0; i < i1; ++i) {
+		int32_t r = (int32_t)(range[i] < FIXED_RANGE_MAX ? range[i] : FIXED_RANGE_MAX);
+		int32_t rh = r >> FIXED_RANGE_SPLIT;
+		int32_t rl = r & ((1 << FIXED_RANGE_SPLIT) - 1);
+		x[i - i0] = fixed_mul(rh, rl, lut->dx[i], lut->ox[i]);
+		y[i - i0] = fixed_mul(rh, rl, lut->dy[i], lut->oy[i]);
+		z[i - i0] = fixed_mul(rh, rl, lut->dz[i], lut->oz[i]);
+	}
+}
+
+static inline int16_t saturate_i16(int32_t v)
+{
+	return (int16_t)(v < INT16_MIN ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v));
+}
+
+static inline void store_i32(int32_t const *x, int32_t const *y, int32_t const *z, int n, char *out, int out_stride)
+{
+	int i = 0;
+#if defined(OUSTER_LUT_X86) && defined(__SSE2__)
+	if (out_stride == (3 * sizeof(int32_t))) {
+		// x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+		for (; (i + 4) <= n; i += 4, out += 4 * out_stride) {
+			__m128 vx = _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(x + i)));
+			__m128 vy = _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(y + i)));
+			__m128 vz = _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(z + i)));
+			__m128 xy_lo = _mm_unpacklo_ps(vx, vy);
+			__m128 xy_hi = _mm_unpackhi_ps(vx, vy);
+			__m128 zx = _mm_shuffle_ps(vz, vx, _MM_SHUFFLE(1, 1, 0, 0));
+			__m128 yz1 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(1, 1, 1, 1));
+			__m128 zx3 = _mm_shuffle_ps(vz, xy_hi, _MM_SHUFFLE(2, 2, 2, 2));
+			__m128 yz3 = _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(3, 3, 3, 3));
+			_mm_storeu_ps((float *)out + 0, _mm_shuffle_ps(xy_lo, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+			_mm_storeu_ps((float *)out + 4, _mm_shuffle_ps(yz1, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+			_mm_storeu_ps((float *)out + 8, _mm_shuffle_ps(zx3, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+		}
+	}
+#endif
+	for (; i < n; ++i, out += out_stride) {
+		int32_t *o = (int32_t *)out;
+		o[0] = x[i];
+		o[1] = y[i];
+		o[2] = z[i];
+	}
+}
+
+static inline void store_i16(int32_t const *x, int32_t const *y, int32_t const *z, int n, char *out, int out_stride)
+{
+	int i = 0;
+#if defined(OUSTER_LUT_X86) && defined(__SSE2__)
+	// Saturate 8 pixels at a time, then interleave
+	for (; (i + 8) <= n; i += 8) {
+		int16_t sx[8];
+		int16_t sy[8];
+		int16_t sz[8];
+		_mm_storeu_si128((__m128i *)sx, _mm_packs_epi32(_mm_loadu_si128((__m128i const *)(x + i)), _mm_loadu_si128((__m128i const *)(x + i + 4))));
+		_mm_storeu_si128((__m128i *)sy, _mm_packs_epi32(_mm_loadu_si128((__m128i const *)(y + i)), _mm_loadu_si128((__m128i const *)(y + i + 4))));
+		_mm_storeu_si128((__m128i *)sz, _mm_packs_epi32(_mm_loadu_si128((__m128i const *)(z + i)), _mm_loadu_si128((__m128i const *)(z + i + 4))));
+		for (int k = 0; k < 8; ++k, out += out_stride) {
+			int16_t *o = (int16_t *)out;
+			o[0] = sx[k];
+			o[1] = sy[k];
+			o[2] = sz[k];
+		}
+	}
+#endif
+	for (; i < n; ++i, out += out_stride) {
+		int16_t *o = (int16_t *)out;
+		o[0] = saturate_i16(x[i]);
+		o[1] = saturate_i16(y[i]);
+		o[2] = saturate_i16(z[i]);
+	}
+}
+
+static void fixed_block_i32_scalar(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_scalar(lut, range, i0, i1, x, y, z);
+	store_i32(x, y, z, i1 - i0, out, out_stride);
+}
+
+static void fixed_block_i16_scalar(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_scalar(lut, range, i0, i1, x, y, z);
+	store_i16(x, y, z, i1 - i0, out, out_stride);
+}
+
+#ifdef OUSTER_LUT_X86
+
+__attribute__((target("avx2"))) static inline __m256i fixed_mul_avx2(__m256i rh, __m256i rl, int32_t const *d, int32_t const *o)
+{
+	__m256i vd = _mm256_loadu_si256((__m256i const *)d);
+	__m256i vo = _mm256_loadu_si256((__m256i const *)o);
+	__m256i t = _mm256_add_epi32(_mm256_mullo_epi32(rh, vd), _mm256_srai_epi32(_mm256_mullo_epi32(rl, vd), FIXED_RANGE_SPLIT));
+	t = _mm256_add_epi32(t, _mm256_add_epi32(vo, _mm256_set1_epi32(1 << (FIXED_OFFSET_Q - 1))));
+	return _mm256_srai_epi32(t, FIXED_OFFSET_Q);
+}
+
+__attribute__((target("avx2"))) static inline void fixed_kernel_avx2(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, int32_t *x, int32_t *y, int32_t *z)
+{
+	__m256i rmax = _mm256_set1_epi32(FIXED_RANGE_MAX);
+	__m256i lo = _mm256_set1_epi32((1 << FIXED_RANGE_SPLIT) - 1);
+	int i = i0;
+	for (; (i + 8) <= i1; i += 8) {
+		__m256i r = _mm256_min_epu32(_mm256_loadu_si256((__m256i const *)(range + i)), rmax);
+		__m256i rh = _mm256_srli_epi32(r, FIXED_RANGE_SPLIT);
+		__m256i rl = _mm256_and_si256(r, lo);
+		_mm256_storeu_si256((__m256i *)(x + i - i0), fixed_mul_avx2(rh, rl, lut->dx + i, lut->ox + i));
+		_mm256_storeu_si256((__m256i *)(y + i - i0), fixed_mul_avx2(rh, rl, lut->dy + i, lut->oy + i));
+		_mm256_storeu_si256((__m256i *)(z + i - i0), fixed_mul_avx2(rh, rl, lut->dz + i, lut->oz + i));
+	}
+	fixed_kernel_scalar(lut, range, i, i1, x + i - i0, y + i - i0, z + i - i0);
+}
+
+__attribute__((target("avx2"))) static void fixed_block_i32_avx2(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_avx2(lut, range, i0, i1, x, y, z);
+	store_i32(x, y, z, i1 - i0, out, out_stride);
+}
+
+__attribute__((target("avx2"))) static void fixed_block_i16_avx2(ouster_lut_fixed_t const *lut, uint32_t const *range, int i0, int i1, char *out, int out_stride)
+{
+	int32_t x[FIXED_BLOCK];
+	int32_t y[FIXED_BLOCK];
+	int32_t z[FIXED_BLOCK];
+	fixed_kernel_avx2(lut, range, i0, i1, x, y, z);
+	store_i16(x, y, z, i1 - i0, out, out_stride);
+}
+
+#endif
+
+static int fixed_has_avx2(void)
+{
+#ifdef OUSTER_LUT_X86
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+static void fixed_run_blocks(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride, fixed_block_t block)
+{
+	int n = lut->w * lut->h;
+	char *out8 = out;
+	for (int i0 = 0; i0 < n; i0 += FIXED_BLOCK, out8 += FIXED_BLOCK * out_stride) {
+		int i1 = (i0 + FIXED_BLOCK) < n ? (i0 + FIXED_BLOCK) : n;
+		block(lut, range, i0, i1, out8, out_stride);
+	}
+}
+
+void ouster_lut_fixed_init(ouster_lut_fixed_t *dst, ouster_lut_t const *src, int unit_mm)
+{
+	ouster_assert_notnull(dst);
+	ouster_assert_notnull(src);
+	ouster_assert(unit_mm > 0, "");
+	int n = src->w * src->h;
+	// Round each plane up to a multiple of 64 bytes so every plane stays aligned
+	int plane = (n + (FIXED_ALIGN / sizeof(int32_t)) - 1) & ~(int)((FIXED_ALIGN / sizeof(int32_t)) - 1);
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_LUT);
+	dst->memory = ouster_os_calloc(plane * 6 * sizeof(int32_t) + FIXED_ALIGN);
+	ouster_os_mem_tag_set(tag);
+	ouster_assert_notnull(dst->memory);
+	int32_t *base = (int32_t *)(((uintptr_t)dst->memory + FIXED_ALIGN - 1) & ~(uintptr_t)(FIXED_ALIGN - 1));
+	dst->w = src->w;
+	dst->h = src->h;
+	dst->unit_mm = unit_mm;
+	dst->dx = base + plane * 0;
+	dst->dy = base + plane * 1;
+	dst->dz = base + plane * 2;
+	dst->ox = base + plane * 3;
+	dst->oy = base + plane * 4;
+	dst->oz = base + plane * 5;
+	// The LUT is in meters per mm, convert to output units per mm and output units
+	double d_scale = 1000.0 * (1 << FIXED_DIRECTION_Q) / unit_mm;
+	double o_scale = 1000.0 * (1 << FIXED_OFFSET_Q) / unit_mm;
+	for (int i = 0; i < n; ++i) {
+		dst->dx[i] = (int32_t)lround(src->direction[i * 3 + 0] * d_scale);
+		dst->dy[i] = (int32_t)lround(src->direction[i * 3 + 1] * d_scale);
+		dst->dz[i] = (int32_t)lround(src->direction[i * 3 + 2] * d_scale);
+		dst->ox[i] = (int32_t)lround(src->offset[i * 3 + 0] * o_scale);
+		dst->oy[i] = (int32_t)lround(src->offset[i * 3 + 1] * o_scale);
+		dst->oz[i] = (int32_t)lround(src->offset[i * 3 + 2] * o_scale);
+	}
+}
+
+void ouster_lut_fixed_fini(ouster_lut_fixed_t *lut)
+{
+	ouster_assert_notnull(lut);
+	ouster_os_free(lut->memory);
+	memset(lut, 0, sizeof(ouster_lut_fixed_t));
+}
+
+void ouster_lut_cartesian_i32(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	fixed_block_t block = fixed_block_i32_scalar;
+#ifdef OUSTER_LUT_X86
+	if (fixed_has_avx2()) {
+		block = fixed_block_i32_avx2;
+	}
+#endif
+	ouster_profile_begin(t);
+	fixed_run_blocks(lut, range, out, out_stride, block);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
+
+void ouster_lut_cartesian_i16(ouster_lut_fixed_t const *lut, uint32_t const *range, void *out, int out_stride)
+{
+	ouster_assert_notnull(lut);
+	ouster_assert_notnull(range);
+	ouster_assert_notnull(out);
+	fixed_block_t block = fixed_block_i16_scalar;
+#ifdef OUSTER_LUT_X86
+	if (fixed_has_avx2()) {
+		block = fixed_block_i16_avx2;
+	}
+#endif
+	ouster_profile_begin(t);
+	fixed_run_blocks(lut, range, out, out_stride, block);
+	ouster_profile_end(t, OUSTER_STAGE_CARTESIAN);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef OUSTER_LUT_JOB_H
+#define OUSTER_LUT_JOB_H
+
+#include "ouster_clib/ouster_pool.h"
+
+#include <stdint.h>
+
+/* Rows are split in this many jobs per worker to even out scheduling noise */
+#define LUT_JOBS_PER_WORKER 4
+
+/* Number of jobs a LUT of h rows is split into on the pool */
+static inline int lut_job_count(ouster_pool_t const *pool, int h)
+{
+	int jobs = pool->count * LUT_JOBS_PER_WORKER;
+	return jobs < h ? jobs : h;
+}
+
+/* Pixel range [i0, i1) of a job, whole rows */
+static inline void lut_job_range(int w, int h, int jobs, int index, int *i0, int *i1)
+{
+	*i0 = (int)((int64_t)h * index / jobs) * w;
+	*i1 = (int)((int64_t)h * (index + 1) / jobs) * w;
+}
+
+#endif // OUSTER_LUT_JOB_H
\ No newline at end of file
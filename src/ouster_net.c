@@ -62,6 +62,66 @@ int ouster_net_sendto(int sock, char *buf, int size, int flags, ouster_net_addr_
 	return rc;
 }
 
+static socklen_t ouster_net_addr_len(ouster_net_addr_t *addr)
+{
+	struct sockaddr *sa = (void *)addr;
+	switch (sa->sa_family) {
+	case AF_INET:
+		return sizeof(struct sockaddr_in);
+	case AF_INET6:
+		return sizeof(struct sockaddr_in6);
+	}
+	return 0;
+}
+
+int ouster_net_sendmmsg(int sock, ouster_net_msg_t msgs[], int n, int flags)
+{
+	ouster_assert(sock >= 0, "");
+	ouster_assert_notnull(msgs);
+	ouster_assert(n >= 0, "");
+
+	int sent = 0;
+#ifdef _GNU_SOURCE
+	struct mmsghdr hdrs[OUSTER_NET_SENDMMSG_MAX];
+	struct iovec iovs[OUSTER_NET_SENDMMSG_MAX];
+	while (sent < n) {
+		int count = n - sent;
+		count = (count > OUSTER_NET_SENDMMSG_MAX) ? OUSTER_NET_SENDMMSG_MAX : count;
+		memset(hdrs, 0, sizeof(struct mmsghdr) * count);
+		for (int i = 0; i < count; ++i) {
+			ouster_net_msg_t *m = msgs + sent + i;
+			iovs[i].iov_base = m->buf;
+			iovs[i].iov_len = m->size;
+			hdrs[i].msg_hdr.msg_iov = iovs + i;
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+			hdrs[i].msg_hdr.msg_name = m->addr;
+			hdrs[i].msg_hdr.msg_namelen = ouster_net_addr_len(m->addr);
+		}
+		int rc = sendmmsg(sock, hdrs, count, flags);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return sent ? sent : -1;
+		}
+		sent += rc;
+		if (rc < count) {
+			// The socket buffer is full, let the caller decide when to retry
+			break;
+		}
+	}
+#else
+	for (; sent < n; ++sent) {
+		ouster_net_msg_t *m = msgs + sent;
+		ssize_t rc = sendto(sock, m->buf, m->size, flags, (void *)m->addr, ouster_net_addr_len(m->addr));
+		if (rc < 0) {
+			return sent ? sent : -1;
+		}
+	}
+#endif
+	return sent;
+}
+
 int32_t ouster_net_get_port(int sock)
 {
 	ouster_assert(sock >= 0, "Socket not in range");
@@ -176,8 +236,9 @@ int try_create_socket(ouster_net_sock_desc_t *desc, struct addrinfo *ai)
 			goto error;
 		}
 		ouster_log("IP_ADD_MEMBERSHIP(): %s\n", desc->group);
-#endif
+#else
 		ouster_log("ip_mreq requires #define _GNU_SOURCE. Compile with -D_GNU_SOURCE or --std=gnu99\n");
+#endif
 	}
 
 	if (desc->flags & OUSTER_NET_FLAGS_NONBLOCK) {
@@ -314,7 +375,9 @@ int64_t ouster_net_read(int sock, char *buf, int len)
 	ouster_assert(sock >= 0, "");
 	ouster_assert_notnull(buf);
 
+	ouster_profile_begin(t);
 	int64_t bytes_read = recv(sock, (char *)buf, len, 0);
+	ouster_profile_end(t, OUSTER_STAGE_RECEIVE);
 	return bytes_read;
 }
 
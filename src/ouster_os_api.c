@@ -1,6 +1,18 @@
-#include "ouster_clib/ouster_os_api.h"
+#include "ouster_clib.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OS_API_MAGIC UINT32_C(0x434F4C4C)
+
+/* Every block of the default allocator starts with this header, it keeps the 16 byte alignment of malloc */
+typedef struct
+{
+	uint64_t size;
+	uint32_t tag;
+	uint32_t magic;
+} os_api_header_t;
 
 ouster_os_api_t ouster_os_api;
 int64_t ouster_os_api_malloc_count = 0;
@@ -8,28 +20,111 @@ int64_t ouster_os_api_realloc_count = 0;
 int64_t ouster_os_api_calloc_count = 0;
 int64_t ouster_os_api_free_count = 0;
 
+static int64_t os_api_bytes;
+static int64_t os_api_bytes_peak;
+static int64_t os_api_tag_bytes[OUSTER_OS_MEM_TAG_COUNT];
+static int64_t os_api_tag_allocs[OUSTER_OS_MEM_TAG_COUNT];
+static __thread int os_api_tag;
+
+int ouster_os_mem_tag_set(int tag)
+{
+	ouster_assert((tag >= 0) && (tag < OUSTER_OS_MEM_TAG_COUNT), "");
+	int prev = os_api_tag;
+	os_api_tag = tag;
+	return prev;
+}
+
+int ouster_os_mem_count_alloc(size_t size)
+{
+	int tag = os_api_tag;
+	int64_t bytes = __atomic_add_fetch(&os_api_bytes, (int64_t)size, __ATOMIC_RELAXED);
+	int64_t peak = __atomic_load_n(&os_api_bytes_peak, __ATOMIC_RELAXED);
+	while ((bytes > peak) && !__atomic_compare_exchange_n(&os_api_bytes_peak, &peak, bytes, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	__atomic_fetch_add(os_api_tag_bytes + tag, (int64_t)size, __ATOMIC_RELAXED);
+	__atomic_fetch_add(os_api_tag_allocs + tag, 1, __ATOMIC_RELAXED);
+	return tag;
+}
+
+void ouster_os_mem_count_free(int tag, size_t size)
+{
+	ouster_assert((tag >= 0) && (tag < OUSTER_OS_MEM_TAG_COUNT), "");
+	__atomic_fetch_sub(&os_api_bytes, (int64_t)size, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(os_api_tag_bytes + tag, (int64_t)size, __ATOMIC_RELAXED);
+}
+
+void ouster_os_mem_stats(ouster_os_mem_stats_t *stats)
+{
+	ouster_assert_notnull(stats);
+	stats->malloc_count = __atomic_load_n(&ouster_os_api_malloc_count, __ATOMIC_RELAXED);
+	stats->realloc_count = __atomic_load_n(&ouster_os_api_realloc_count, __ATOMIC_RELAXED);
+	stats->calloc_count = __atomic_load_n(&ouster_os_api_calloc_count, __ATOMIC_RELAXED);
+	stats->free_count = __atomic_load_n(&ouster_os_api_free_count, __ATOMIC_RELAXED);
+	stats->allocs = stats->malloc_count + stats->realloc_count + stats->calloc_count;
+	stats->bytes = __atomic_load_n(&os_api_bytes, __ATOMIC_RELAXED);
+	stats->bytes_peak = __atomic_load_n(&os_api_bytes_peak, __ATOMIC_RELAXED);
+	for (int i = 0; i < OUSTER_OS_MEM_TAG_COUNT; ++i) {
+		stats->tag_bytes[i] = __atomic_load_n(os_api_tag_bytes + i, __ATOMIC_RELAXED);
+		stats->tag_allocs[i] = __atomic_load_n(os_api_tag_allocs + i, __ATOMIC_RELAXED);
+	}
+}
+
+static void *os_api_block(os_api_header_t *h, size_t size)
+{
+	if (h == NULL) {
+		return NULL;
+	}
+	h->size = size;
+	h->tag = (uint32_t)ouster_os_mem_count_alloc(size);
+	h->magic = OS_API_MAGIC;
+	return h + 1;
+}
+
+static os_api_header_t *os_api_header(void *ptr)
+{
+	os_api_header_t *h = (os_api_header_t *)ptr - 1;
+	ouster_assert(h->magic == OS_API_MAGIC, "Not allocated by ouster_os_malloc");
+	return h;
+}
+
 static void *ouster_os_api_calloc(size_t size)
 {
-	ouster_os_api_calloc_count++;
-	return calloc(1, (size_t)size);
+	__atomic_fetch_add(&ouster_os_api_calloc_count, 1, __ATOMIC_RELAXED);
+	return os_api_block(calloc(1, sizeof(os_api_header_t) + size), size);
 }
 
 static void *ouster_os_api_malloc(size_t size)
 {
-	ouster_os_api_malloc_count++;
-	return malloc((size_t)size);
+	__atomic_fetch_add(&ouster_os_api_malloc_count, 1, __ATOMIC_RELAXED);
+	return os_api_block(malloc(sizeof(os_api_header_t) + size), size);
 }
 
 static void ouster_os_api_free(void *ptr)
 {
-	ouster_os_api_free_count++;
-	free(ptr);
+	__atomic_fetch_add(&ouster_os_api_free_count, 1, __ATOMIC_RELAXED);
+	if (ptr == NULL) {
+		return;
+	}
+	os_api_header_t *h = os_api_header(ptr);
+	ouster_os_mem_count_free((int)h->tag, h->size);
+	h->magic = 0;
+	free(h);
 }
 
-static void * ouster_os_api_realloc(void *ptr, size_t size)
+static void *ouster_os_api_realloc(void *ptr, size_t size)
 {
-	ouster_os_api_realloc_count++;
-	return realloc(ptr, size);
+	__atomic_fetch_add(&ouster_os_api_realloc_count, 1, __ATOMIC_RELAXED);
+	if (ptr == NULL) {
+		return os_api_block(malloc(sizeof(os_api_header_t) + size), size);
+	}
+	os_api_header_t *h = os_api_header(ptr);
+	os_api_header_t old = *h;
+	h = realloc(h, sizeof(os_api_header_t) + size);
+	if (h == NULL) {
+		return NULL;
+	}
+	ouster_os_mem_count_free((int)old.tag, old.size);
+	return os_api_block(h, size);
 }
 
 static void ouster_log_msg(int32_t level, const char *file, int32_t line, const char *msg)
@@ -57,4 +152,11 @@ void ouster_os_set_api_defaults(void)
 	ouster_os_api.log_ = ouster_log_msg;
 
 	ouster_os_api.abort_ = abort;
+}
+
+int64_t ouster_os_clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * INT64_C(1000000000) + (int64_t)ts.tv_nsec;
 }
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include "ouster_clib.h"
+
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#define PIPELINE_PACKETS_DEFAULT 1024
+#define PIPELINE_FRAMES_DEFAULT 2
+#define PIPELINE_SPINS 64
+#define PIPELINE_IDLE_NS 50000
+#define PIPELINE_SELECT_USEC 100000
+
+static int pipeline_quit(ouster_pipeline_t *p)
+{
+	return __atomic_load_n(&p->quit, __ATOMIC_ACQUIRE);
+}
+
+/* Yields a few times then sleeps, idle stages do not burn a whole CPU */
+static void pipeline_idle(int *idle)
+{
+	if (*idle < PIPELINE_SPINS) {
+		(*idle)++;
+		sched_yield();
+		return;
+	}
+	struct timespec ts = {0, PIPELINE_IDLE_NS};
+	nanosleep(&ts, NULL);
+}
+
+static void pipeline_count(int64_t *counter)
+{
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+static void pipeline_setup(ouster_pipeline_t *p, int stage, char const *name)
+{
+	ouster_trace_thread_name(name);
+	int cpu = p->desc.cpu[stage];
+	if (!p->desc.pin || (cpu < 0)) {
+		return;
+	}
+#ifdef _GNU_SOURCE
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	if (rc != 0) {
+		ouster_log_warn("Could not pin %s to CPU %i: %s\n", name, cpu, strerror(rc));
+	}
+#else
+	ouster_log_warn("Pinning %s requires #define _GNU_SOURCE. Compile with -D_GNU_SOURCE or --std=gnu99\n", name);
+#endif
+}
+
+/* Pushes a frame to the queue into stage, returns -1 when it was dropped */
+static int pipeline_push(ouster_pipeline_t *p, int stage, ouster_pipeline_frame_t *out)
+{
+	int idle = 0;
+	while (ouster_spsc_push(p->queues + stage, out) != 0) {
+		if (p->desc.policy[stage] == OUSTER_PIPELINE_DROP) {
+			pipeline_count(p->dropped + stage);
+			return -1;
+		}
+		if (pipeline_quit(p)) {
+			return -1;
+		}
+		pipeline_idle(&idle);
+	}
+	return 0;
+}
+
+/* Passes a frame on to the next stage or back to the decode stage when it was dropped */
+static void pipeline_forward(ouster_pipeline_t *p, int stage, ouster_pipeline_frame_t *out)
+{
+	pipeline_count(p->processed + stage);
+	if (pipeline_push(p, stage + 1, out) != 0) {
+		// Can not fail, the queue holds every frame of the pool
+		ouster_spsc_push(p->returns + stage, out->frame);
+	}
+}
+
+/* Waits for the next frame into stage, returns NULL when quitting */
+static ouster_pipeline_frame_t *pipeline_pop(ouster_pipeline_t *p, int stage)
+{
+	int idle = 0;
+	while (!pipeline_quit(p)) {
+		ouster_pipeline_frame_t *out = ouster_spsc_pop(p->queues + stage);
+		if (out) {
+			return out;
+		}
+		pipeline_idle(&idle);
+	}
+	return NULL;
+}
+
+static void *pipeline_receive(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_RECEIVE, "pipeline receive");
+	int sock = p->desc.sock;
+	int size = p->desc.meta->lidar_packet_size;
+	char *buf = NULL;
+	int idle = 0;
+	while (!pipeline_quit(p)) {
+		if (buf == NULL) {
+			buf = ouster_spsc_pop(&p->packets_free);
+		}
+		if ((buf == NULL) && (p->desc.policy[OUSTER_PIPELINE_DECODE] == OUSTER_PIPELINE_WAIT)) {
+			// Every buffer waits for decode, packets queue up in the socket receive buffer meanwhile
+			pipeline_idle(&idle);
+			continue;
+		}
+		idle = 0;
+		if (ouster_net_select(&sock, 1, 0, PIPELINE_SELECT_USEC) == 0) {
+			continue;
+		}
+		if (buf == NULL) {
+			// Read the packet anyway so the socket does not fill up with stale packets
+			char drop[OUSTER_NET_UDP_MAX_SIZE];
+			ouster_net_read(sock, drop, sizeof(drop));
+			pipeline_count(p->dropped + OUSTER_PIPELINE_DECODE);
+			continue;
+		}
+		// One byte more than a lidar packet to tell longer packets apart
+		int64_t n = ouster_net_read(sock, buf, p->packet_size);
+		if (n != size) {
+			ouster_log_debug("Bytes received (%ji) does not match lidar_packet_size (%ji)\n", (intmax_t)n, (intmax_t)size);
+			continue;
+		}
+		pipeline_count(p->processed + OUSTER_PIPELINE_RECEIVE);
+		// Can not fail, the queue holds every packet buffer
+		ouster_spsc_push(&p->packets, buf);
+		buf = NULL;
+	}
+	return NULL;
+}
+
+static void *pipeline_decode(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_DECODE, "pipeline decode");
+	int idle = 0;
+	while (!pipeline_quit(p)) {
+		// The pool is only touched by this thread, the later stages hand frames back through queues
+		for (int i = OUSTER_PIPELINE_DESTAGGER; i < OUSTER_PIPELINE_COUNT; ++i) {
+			ouster_frame_t *frame;
+			while ((frame = ouster_spsc_pop(p->returns + i)) != NULL) {
+				ouster_frame_pool_release(&p->pool, frame);
+			}
+		}
+		char *buf = ouster_spsc_pop(&p->packets);
+		if (buf == NULL) {
+			pipeline_idle(&idle);
+			continue;
+		}
+		idle = 0;
+		ouster_frame_t *done = ouster_frame_pool_push(&p->pool, buf);
+		ouster_spsc_push(&p->packets_free, buf);
+		pipeline_count(p->processed + OUSTER_PIPELINE_DECODE);
+		if (done == NULL) {
+			continue;
+		}
+		ouster_pipeline_frame_t *out = p->outputs + (done - p->pool.frames);
+		if (pipeline_push(p, OUSTER_PIPELINE_DESTAGGER, out) != 0) {
+			ouster_frame_pool_release(&p->pool, done);
+		}
+	}
+	return NULL;
+}
+
+static void *pipeline_destagger(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_DESTAGGER, "pipeline destagger");
+	ouster_pipeline_frame_t *out;
+	while ((out = pipeline_pop(p, OUSTER_PIPELINE_DESTAGGER)) != NULL) {
+		if (out->destaggered) {
+			ouster_field_destagger_cpy(out->destaggered, out->frame->fields, out->frame->fcount, p->desc.meta);
+		}
+		pipeline_forward(p, OUSTER_PIPELINE_DESTAGGER, out);
+	}
+	return NULL;
+}
+
+static void *pipeline_cartesian(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_CARTESIAN, "pipeline cartesian");
+	ouster_pipeline_frame_t *out;
+	while ((out = pipeline_pop(p, OUSTER_PIPELINE_CARTESIAN)) != NULL) {
+		if (out->xyz) {
+			uint32_t const *range = out->frame->fields[p->range_index].data;
+			if (p->desc.workers) {
+				ouster_lut_cartesian_f64_parallel(p->desc.lut, range, out->xyz, sizeof(double) * 3, p->desc.workers);
+			} else {
+				ouster_lut_cartesian_f64(p->desc.lut, range, out->xyz, sizeof(double) * 3);
+			}
+		}
+		pipeline_forward(p, OUSTER_PIPELINE_CARTESIAN, out);
+	}
+	return NULL;
+}
+
+static void *pipeline_callback(void *arg)
+{
+	ouster_pipeline_t *p = arg;
+	pipeline_setup(p, OUSTER_PIPELINE_CALLBACK, "pipeline callback");
+	ouster_pipeline_frame_t *out;
+	while ((out = pipeline_pop(p, OUSTER_PIPELINE_CALLBACK)) != NULL) {
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+		ouster_profile_span(OUSTER_STAGE_HANDOFF, out->frame->complete_ns, ouster_os_clock_ns());
+#endif
+		if (p->desc.fn) {
+			p->desc.fn(p->desc.arg, out);
+		}
+		pipeline_count(p->processed + OUSTER_PIPELINE_CALLBACK);
+		ouster_spsc_push(p->returns + OUSTER_PIPELINE_CALLBACK, out->frame);
+	}
+	return NULL;
+}
+
+static void *(*const pipeline_threads[OUSTER_PIPELINE_COUNT])(void *) = {
+    [OUSTER_PIPELINE_RECEIVE] = pipeline_receive,
+    [OUSTER_PIPELINE_DECODE] = pipeline_decode,
+    [OUSTER_PIPELINE_DESTAGGER] = pipeline_destagger,
+    [OUSTER_PIPELINE_CARTESIAN] = pipeline_cartesian,
+    [OUSTER_PIPELINE_CALLBACK] = pipeline_callback,
+};
+
+static void pipeline_free(ouster_pipeline_t *p)
+{
+	for (int i = 0; i < p->pool.count; ++i) {
+		ouster_pipeline_frame_t *out = p->outputs + i;
+		if (out->destaggered) {
+			for (int j = 0; j < p->desc.fcount; ++j) {
+				ouster_os_free(out->destaggered[j].data);
+			}
+			ouster_os_free(out->destaggered);
+		}
+		ouster_os_free(out->xyz);
+	}
+	ouster_os_free(p->outputs);
+	ouster_frame_pool_fini(&p->pool);
+	for (int i = 0; i < OUSTER_PIPELINE_COUNT; ++i) {
+		if (p->queues[i].items) {
+			ouster_spsc_fini(p->queues + i);
+		}
+		if (p->returns[i].items) {
+			ouster_spsc_fini(p->returns + i);
+		}
+	}
+	ouster_spsc_fini(&p->packets);
+	ouster_spsc_fini(&p->packets_free);
+	ouster_os_free(p->packet_buf);
+	memset(p, 0, sizeof(ouster_pipeline_t));
+}
+
+int ouster_pipeline_start(ouster_pipeline_t *p, ouster_pipeline_desc_t const *desc)
+{
+	ouster_assert_notnull(p);
+	ouster_assert_notnull(desc);
+	ouster_assert_notnull(desc->meta);
+	ouster_assert(desc->fields || (desc->fcount == 0), "");
+
+	memset(p, 0, sizeof(ouster_pipeline_t));
+	p->desc = *desc;
+	ouster_meta_t *meta = desc->meta;
+	int packets = desc->packets > 0 ? desc->packets : PIPELINE_PACKETS_DEFAULT;
+	int frames = desc->frames > 0 ? desc->frames : PIPELINE_FRAMES_DEFAULT;
+
+	// Packet buffers are either in one of the two queues or held by the receive or decode stage
+	ouster_spsc_init(&p->packets, packets);
+	int buffers = p->packets.mask + 1;
+	ouster_spsc_init(&p->packets_free, buffers);
+	p->packet_size = meta->lidar_packet_size + 1;
+	p->packet_buf = ouster_os_malloc(buffers * p->packet_size);
+	ouster_assert_notnull(p->packet_buf);
+	for (int i = 0; i < buffers; ++i) {
+		ouster_spsc_push(&p->packets_free, p->packet_buf + i * p->packet_size);
+	}
+
+	// One frame being filled, one completed frame waiting in decode, the frame queues full and one frame in each later stage.
+	// The pool never runs dry, a full pipeline waits or drops at the queues instead.
+	int count = 2;
+	for (int i = OUSTER_PIPELINE_DESTAGGER; i < OUSTER_PIPELINE_COUNT; ++i) {
+		ouster_spsc_init(p->queues + i, frames);
+		count += p->queues[i].mask + 2;
+	}
+	for (int i = OUSTER_PIPELINE_DESTAGGER; i < OUSTER_PIPELINE_COUNT; ++i) {
+		ouster_spsc_init(p->returns + i, count);
+	}
+	ouster_frame_pool_init(&p->pool, meta, desc->fields, desc->fcount, count);
+
+	p->range_index = -1;
+	for (int j = 0; j < desc->fcount; ++j) {
+		if ((desc->fields[j].quantity == OUSTER_QUANTITY_RANGE) && (desc->fields[j].depth == 4)) {
+			p->range_index = j;
+		}
+	}
+	ouster_assert((desc->lut == NULL) || (p->range_index >= 0), "A 4 byte OUSTER_QUANTITY_RANGE field is needed for xyz");
+
+	int tag = ouster_os_mem_tag_set(OUSTER_OS_MEM_TAG_FIELD);
+	p->outputs = ouster_os_calloc(count * sizeof(ouster_pipeline_frame_t));
+	ouster_assert_notnull(p->outputs);
+	for (int i = 0; i < count; ++i) {
+		ouster_pipeline_frame_t *out = p->outputs + i;
+		out->frame = p->pool.frames + i;
+		if (desc->destagger && (desc->fcount > 0)) {
+			out->destaggered = ouster_os_calloc(desc->fcount * sizeof(ouster_field_t));
+			ouster_assert_notnull(out->destaggered);
+			for (int j = 0; j < desc->fcount; ++j) {
+				out->destaggered[j].quantity = desc->fields[j].quantity;
+				out->destaggered[j].depth = desc->fields[j].depth;
+			}
+			ouster_field_init(out->destaggered, desc->fcount, meta);
+		}
+		if (desc->lut) {
+			out->xyz = ouster_lut_alloc(desc->lut);
+		}
+	}
+	ouster_os_mem_tag_set(tag);
+
+	for (int i = 0; i < OUSTER_PIPELINE_COUNT; ++i) {
+		int rc = pthread_create(p->threads + i, NULL, pipeline_threads[i], p);
+		if (rc != 0) {
+			ouster_log_error("pthread_create: %s\n", strerror(rc));
+			__atomic_store_n(&p->quit, 1, __ATOMIC_RELEASE);
+			for (int j = 0; j < i; ++j) {
+				pthread_join(p->threads[j], NULL);
+			}
+			pipeline_free(p);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void ouster_pipeline_stop(ouster_pipeline_t *p)
+{
+	ouster_assert_notnull(p);
+	__atomic_store_n(&p->quit, 1, __ATOMIC_RELEASE);
+	for (int i = 0; i < OUSTER_PIPELINE_COUNT; ++i) {
+		pthread_join(p->threads[i], NULL);
+	}
+	pipeline_free(p);
+}
+
+void ouster_pipeline_stats(ouster_pipeline_t *p, ouster_pipeline_stage_t stage, ouster_pipeline_stats_t *stats)
+{
+	ouster_assert_notnull(p);
+	ouster_assert_notnull(stats);
+	ouster_assert((stage >= 0) && (stage < OUSTER_PIPELINE_COUNT), "");
+	stats->processed = __atomic_load_n(p->processed + stage, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(p->dropped + stage, __ATOMIC_RELAXED);
+}
+
+char const *ouster_pipeline_stage_str(ouster_pipeline_stage_t stage)
+{
+	switch (stage) {
+	case OUSTER_PIPELINE_RECEIVE:
+		return "receive";
+	case OUSTER_PIPELINE_DECODE:
+		return "decode";
+	case OUSTER_PIPELINE_DESTAGGER:
+		return "destagger";
+	case OUSTER_PIPELINE_CARTESIAN:
+		return "cartesian";
+	case OUSTER_PIPELINE_CALLBACK:
+		return "callback";
+	default:
+		return "unknown";
+	}
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "ouster_clib.h"
+
+#include <unistd.h>
+
+/* Runs jobs of the current generation until there are none left, lock must be held */
+static void work(ouster_pool_t *pool, int worker)
+{
+	while (pool->next < pool->jobs) {
+		int index = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		ouster_trace_begin(t);
+		pool->fn(pool->arg, index, worker);
+		ouster_trace_end(t, "pool_job", index);
+		pthread_mutex_lock(&pool->lock);
+		pool->finished++;
+		if (pool->finished == pool->jobs) {
+			pthread_cond_broadcast(&pool->done);
+		}
+	}
+}
+
+static void *pool_thread(void *arg)
+{
+	ouster_pool_t *pool = arg;
+	uint64_t generation = 0;
+	ouster_trace_thread_name("pool worker");
+	pthread_mutex_lock(&pool->lock);
+	int worker = pool->started++;
+	while (1) {
+		while ((pool->quit == 0) && (pool->generation == generation)) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->quit) {
+			break;
+		}
+		generation = pool->generation;
+		work(pool, worker);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+int ouster_pool_cpu_count(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+void ouster_pool_init(ouster_pool_t *pool, int count)
+{
+	ouster_assert_notnull(pool);
+	if (count <= 0) {
+		count = ouster_pool_cpu_count();
+	}
+	pool->count = count;
+	pool->fn = NULL;
+	pool->arg = NULL;
+	pool->jobs = 0;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->generation = 0;
+	pool->quit = 0;
+	pool->started = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->threads = ouster_os_calloc(sizeof(pthread_t) * count);
+	ouster_assert_notnull(pool->threads);
+	for (int i = 0; i < (count - 1); ++i) {
+		int rc = pthread_create(pool->threads + i, NULL, pool_thread, pool);
+		ouster_assert(rc == 0, "pthread_create failed: %i", rc);
+	}
+}
+
+void ouster_pool_fini(ouster_pool_t *pool)
+{
+	ouster_assert_notnull(pool);
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 0; i < (pool->count - 1); ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	ouster_os_free(pool->threads);
+	pool->threads = NULL;
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+void ouster_pool_run(ouster_pool_t *pool, ouster_pool_fn_t fn, void *arg, int count)
+{
+	ouster_assert_notnull(pool);
+	ouster_assert_notnull(fn);
+	ouster_assert(count >= 0, "");
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->jobs = count;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	// The calling thread is the last worker
+	work(pool, pool->count - 1);
+	while (pool->finished < pool->jobs) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
\ No newline at end of file
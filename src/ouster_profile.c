@@ -0,0 +1,152 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+typedef struct
+{
+	int64_t count;
+	int64_t sum;
+	/** Stored as INT64_MAX - min so zero means no samples */
+	int64_t min_inv;
+	int64_t max;
+	int64_t buckets[OUSTER_PROFILE_BUCKETS];
+} profile_stage_t;
+
+static profile_stage_t profile_stages[OUSTER_STAGE_COUNT];
+
+/* Log-linear bucket: values below 16 have their own bucket, above that every power of two has 16 buckets */
+static int profile_bucket(int64_t ns)
+{
+	uint64_t v = (uint64_t)ns;
+	if (v >= ((uint64_t)1 << OUSTER_PROFILE_MAX_BITS)) {
+		return OUSTER_PROFILE_BUCKETS - 1;
+	}
+	if (v < (1 << OUSTER_PROFILE_SUB_BITS)) {
+		return (int)v;
+	}
+	int e = 63 - __builtin_clzll(v);
+	int shift = e - OUSTER_PROFILE_SUB_BITS;
+	int sub = (int)(v >> shift) & ((1 << OUSTER_PROFILE_SUB_BITS) - 1);
+	return ((shift + 1) << OUSTER_PROFILE_SUB_BITS) + sub;
+}
+
+/* Largest value that goes into bucket i */
+static int64_t profile_bucket_upper(int i)
+{
+	if (i < (1 << OUSTER_PROFILE_SUB_BITS)) {
+		return i;
+	}
+	int shift = (i >> OUSTER_PROFILE_SUB_BITS) - 1;
+	int64_t sub = i & ((1 << OUSTER_PROFILE_SUB_BITS) - 1);
+	return ((((int64_t)1 << OUSTER_PROFILE_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+void ouster_profile_record(int stage, int64_t ns)
+{
+	ouster_assert((stage >= 0) && (stage < OUSTER_STAGE_COUNT), "");
+	profile_stage_t *s = profile_stages + stage;
+	ns = ns < 0 ? 0 : ns;
+	__atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->sum, ns, __ATOMIC_RELAXED);
+	__atomic_fetch_add(s->buckets + profile_bucket(ns), 1, __ATOMIC_RELAXED);
+	int64_t min_inv = __atomic_load_n(&s->min_inv, __ATOMIC_RELAXED);
+	while (((INT64_MAX - ns) > min_inv) && !__atomic_compare_exchange_n(&s->min_inv, &min_inv, INT64_MAX - ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	int64_t max = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	while ((ns > max) && !__atomic_compare_exchange_n(&s->max, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+void ouster_profile_span(int stage, int64_t begin_ns, int64_t end_ns)
+{
+	ouster_unused(stage);
+	ouster_unused(begin_ns);
+	ouster_unused(end_ns);
+#ifdef OUSTER_ENABLE_PROFILE
+	ouster_profile_record(stage, end_ns - begin_ns);
+#endif
+#ifdef OUSTER_ENABLE_TRACE
+	ouster_trace_record(ouster_profile_stage_str(stage), begin_ns, end_ns, -1);
+#endif
+}
+
+int64_t ouster_profile_percentile(int stage, double q)
+{
+	ouster_assert((stage >= 0) && (stage < OUSTER_STAGE_COUNT), "");
+	profile_stage_t *s = profile_stages + stage;
+	int64_t total = 0;
+	for (int i = 0; i < OUSTER_PROFILE_BUCKETS; ++i) {
+		total += __atomic_load_n(s->buckets + i, __ATOMIC_RELAXED);
+	}
+	if (total == 0) {
+		return 0;
+	}
+	int64_t rank = (int64_t)(q * (double)total + 0.5);
+	rank = rank < 1 ? 1 : (rank > total ? total : rank);
+	int64_t sum = 0;
+	int i = 0;
+	for (; i < (OUSTER_PROFILE_BUCKETS - 1); ++i) {
+		sum += __atomic_load_n(s->buckets + i, __ATOMIC_RELAXED);
+		if (sum >= rank) {
+			break;
+		}
+	}
+	// The bucket bound can be above the largest sample, the last bucket also holds all larger values
+	int64_t max = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	int64_t upper = (i < (OUSTER_PROFILE_BUCKETS - 1)) ? profile_bucket_upper(i) : max;
+	return upper < max ? upper : max;
+}
+
+void ouster_profile_stats(int stage, ouster_profile_stats_t *stats)
+{
+	ouster_assert((stage >= 0) && (stage < OUSTER_STAGE_COUNT), "");
+	ouster_assert_notnull(stats);
+	profile_stage_t *s = profile_stages + stage;
+	memset(stats, 0, sizeof(ouster_profile_stats_t));
+	stats->count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+	if (stats->count == 0) {
+		return;
+	}
+	stats->sum_ns = __atomic_load_n(&s->sum, __ATOMIC_RELAXED);
+	stats->min_ns = INT64_MAX - __atomic_load_n(&s->min_inv, __ATOMIC_RELAXED);
+	stats->max_ns = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+	stats->mean_ns = stats->sum_ns / stats->count;
+	stats->p50_ns = ouster_profile_percentile(stage, 0.5);
+	stats->p90_ns = ouster_profile_percentile(stage, 0.9);
+	stats->p99_ns = ouster_profile_percentile(stage, 0.99);
+	stats->p999_ns = ouster_profile_percentile(stage, 0.999);
+}
+
+char const *ouster_profile_stage_str(int stage)
+{
+	switch (stage) {
+	case OUSTER_STAGE_RECEIVE:
+		return "receive";
+	case OUSTER_STAGE_DECODE:
+		return "decode";
+	case OUSTER_STAGE_FRAME:
+		return "frame";
+	case OUSTER_STAGE_DESTAGGER:
+		return "destagger";
+	case OUSTER_STAGE_CARTESIAN:
+		return "cartesian";
+	case OUSTER_STAGE_HANDOFF:
+		return "handoff";
+	default:
+		return "unknown";
+	}
+}
+
+void ouster_profile_reset(void)
+{
+	for (int i = 0; i < OUSTER_STAGE_COUNT; ++i) {
+		profile_stage_t *s = profile_stages + i;
+		__atomic_store_n(&s->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->sum, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->min_inv, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->max, 0, __ATOMIC_RELAXED);
+		for (int j = 0; j < OUSTER_PROFILE_BUCKETS; ++j) {
+			__atomic_store_n(s->buckets + j, 0, __ATOMIC_RELAXED);
+		}
+	}
+}
\ No newline at end of file
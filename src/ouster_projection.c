@@ -0,0 +1,265 @@
+#include "ouster_clib.h"
+#include "ouster_math.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OUSTER_PROJECTION_X86
+#include <immintrin.h>
+#endif
+
+#define PROJECTION_PI ((float)OUSTER_M_PI)
+#define PROJECTION_PI_2 ((float)(OUSTER_M_PI / 2.0))
+
+/* Minimax polynomial of atan on [0, 1], max error about 1e-7 rad */
+#define PROJECTION_ATAN_C0 0.99997726f
+#define PROJECTION_ATAN_C1 -0.33262347f
+#define PROJECTION_ATAN_C2 0.19354346f
+#define PROJECTION_ATAN_C3 -0.11643287f
+#define PROJECTION_ATAN_C4 0.05265332f
+#define PROJECTION_ATAN_C5 -0.01172120f
+
+/* The AVX2 version does the same float operations in the same order so both give the same pixels */
+static inline float projection_atan2(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float mx = ax > ay ? ax : ay;
+	float mn = ax > ay ? ay : ax;
+	float a = mx > 0 ? mn / mx : 0;
+	float s = a * a;
+	float r = (((((PROJECTION_ATAN_C5 * s + PROJECTION_ATAN_C4) * s + PROJECTION_ATAN_C3) * s + PROJECTION_ATAN_C2) * s + PROJECTION_ATAN_C1) * s + PROJECTION_ATAN_C0) * a;
+	r = ay > ax ? PROJECTION_PI_2 - r : r;
+	r = x < 0 ? PROJECTION_PI - r : r;
+	r = y < 0 ? -r : r;
+	return r;
+}
+
+/* Returns pixel index in the destaggered image or -1 */
+static inline int32_t projection_pixel(ouster_projection_t const *proj, float x, float y, float z)
+{
+	float const *m = proj->sensor_to_lidar;
+	float xl = m[0] * x + m[1] * y + m[2] * z + m[3];
+	float yl = m[4] * x + m[5] * y + m[6] * z + m[7];
+	float zl = m[8] * x + m[9] * y + m[10] * z + m[11];
+	float rho2 = xl * xl + yl * yl;
+	float rho = sqrtf(rho2);
+
+	// Row, binary search over altitude edges sorted from top to bottom
+	float phi = projection_atan2(zl - proj->beam_z, rho - proj->beam_x);
+	if (!((phi <= proj->edge[0]) && (phi > proj->edge[proj->h]))) {
+		return -1;
+	}
+	int pos = 0;
+	for (int step = proj->search_step; step > 0; step >>= 1) {
+		pos += (proj->edge[pos + step] >= phi) ? step : 0;
+	}
+	int row = proj->edge_row[pos];
+
+	// Column, remove the angle the beam origin and beam azimuth offset add to the encoder angle
+	float sa = proj->azimuth_sin[row];
+	float ca = proj->azimuth_cos[row];
+	float b = proj->beam_x;
+	float l2 = rho2 - (b * b) * (sa * sa);
+	float l = sqrtf(l2 > 0 ? l2 : 0) - b * ca;
+	float delta = projection_atan2(l * sa, l * ca + b);
+	float encoder = projection_atan2(yl, xl) - delta;
+	int mid = (int)nearbyintf(encoder * (-(float)proj->columns_per_frame / (2.0f * PROJECTION_PI)));
+	mid += (mid < 0) ? proj->columns_per_frame : 0;
+	mid -= (mid >= proj->columns_per_frame) ? proj->columns_per_frame : 0;
+	int col = mid - proj->mid0;
+	if ((col < 0) || (col >= proj->w)) {
+		return -1;
+	}
+	col += proj->shift[row];
+	col -= (col >= proj->w) ? proj->w : 0;
+	return row * proj->w + col;
+}
+
+#ifdef OUSTER_PROJECTION_X86
+__attribute__((target("avx2"))) static inline __m256 projection_atan2_avx2(__m256 y, __m256 x)
+{
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 ax = _mm256_andnot_ps(sign, x);
+	__m256 ay = _mm256_andnot_ps(sign, y);
+	__m256 mx = _mm256_max_ps(ax, ay);
+	__m256 mn = _mm256_min_ps(ay, ax);
+	__m256 a = _mm256_and_ps(_mm256_div_ps(mn, mx), _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+	__m256 s = _mm256_mul_ps(a, a);
+	__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(PROJECTION_ATAN_C5), s), _mm256_set1_ps(PROJECTION_ATAN_C4));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C3));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C2));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C1));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(PROJECTION_ATAN_C0));
+	r = _mm256_mul_ps(r, a);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(PROJECTION_PI_2), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(PROJECTION_PI), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(zero, r), _mm256_cmp_ps(y, zero, _CMP_LT_OQ));
+	return r;
+}
+
+__attribute__((target("avx2"))) static void projection_pixels_avx2(ouster_projection_t const *proj, char const *xyz, int xyz_stride, int n, int32_t *pixels)
+{
+	float const *m = proj->sensor_to_lidar;
+	__m256 zero = _mm256_setzero_ps();
+	__m256i w = _mm256_set1_epi32(proj->w);
+	__m256i cpf = _mm256_set1_epi32(proj->columns_per_frame);
+	__m256 scale = _mm256_set1_ps(-(float)proj->columns_per_frame / (2.0f * PROJECTION_PI));
+	__m256 beam_x = _mm256_set1_ps(proj->beam_x);
+	__m256 beam_x2 = _mm256_set1_ps(proj->beam_x * proj->beam_x);
+	// Byte offsets of 8 points, gathering avoids store forwarding stalls of a scalar deinterleave
+	__m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(xyz_stride));
+	int i = 0;
+	for (; (i + 8) <= n; i += 8) {
+		float const *p = (float const *)(xyz + (int64_t)i * xyz_stride);
+		__m256 x = _mm256_i32gather_ps(p + 0, offsets, 1);
+		__m256 y = _mm256_i32gather_ps(p + 1, offsets, 1);
+		__m256 z = _mm256_i32gather_ps(p + 2, offsets, 1);
+		__m256 v[3];
+		for (int j = 0; j < 3; ++j) {
+			__m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[j * 4 + 0]), x), _mm256_mul_ps(_mm256_set1_ps(m[j * 4 + 1]), y));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_set1_ps(m[j * 4 + 2]), z));
+			v[j] = _mm256_add_ps(t, _mm256_set1_ps(m[j * 4 + 3]));
+		}
+		__m256 rho2 = _mm256_add_ps(_mm256_mul_ps(v[0], v[0]), _mm256_mul_ps(v[1], v[1]));
+		__m256 rho = _mm256_sqrt_ps(rho2);
+
+		__m256 phi = projection_atan2_avx2(_mm256_sub_ps(v[2], _mm256_set1_ps(proj->beam_z)), _mm256_sub_ps(rho, beam_x));
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(phi, _mm256_set1_ps(proj->edge[0]), _CMP_LE_OQ), _mm256_cmp_ps(phi, _mm256_set1_ps(proj->edge[proj->h]), _CMP_GT_OQ));
+		__m256i pos = _mm256_setzero_si256();
+		for (int step = proj->search_step; step > 0; step >>= 1) {
+			__m256i cand = _mm256_add_epi32(pos, _mm256_set1_epi32(step));
+			__m256 e = _mm256_i32gather_ps(proj->edge, cand, 4);
+			__m256i ge = _mm256_castps_si256(_mm256_cmp_ps(e, phi, _CMP_GE_OQ));
+			pos = _mm256_add_epi32(pos, _mm256_and_si256(ge, _mm256_set1_epi32(step)));
+		}
+		// Lanes outside the altitude range may have pos beyond the rows
+		pos = _mm256_and_si256(pos, _mm256_castps_si256(inside));
+		__m256i row = _mm256_i32gather_epi32(proj->edge_row, pos, 4);
+
+		__m256 sa = _mm256_i32gather_ps(proj->azimuth_sin, row, 4);
+		__m256 ca = _mm256_i32gather_ps(proj->azimuth_cos, row, 4);
+		__m256 l2 = _mm256_sub_ps(rho2, _mm256_mul_ps(beam_x2, _mm256_mul_ps(sa, sa)));
+		l2 = _mm256_and_ps(l2, _mm256_cmp_ps(l2, zero, _CMP_GT_OQ));
+		__m256 l = _mm256_sub_ps(_mm256_sqrt_ps(l2), _mm256_mul_ps(beam_x, ca));
+		__m256 delta = projection_atan2_avx2(_mm256_mul_ps(l, sa), _mm256_add_ps(_mm256_mul_ps(l, ca), beam_x));
+		__m256 encoder = _mm256_sub_ps(projection_atan2_avx2(v[1], v[0]), delta);
+		__m256i mid = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(encoder, scale), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		mid = _mm256_add_epi32(mid, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), mid), cpf));
+		mid = _mm256_sub_epi32(mid, _mm256_andnot_si256(_mm256_cmpgt_epi32(cpf, mid), cpf));
+		__m256i col = _mm256_sub_epi32(mid, _mm256_set1_epi32(proj->mid0));
+		__m256i valid = _mm256_castps_si256(inside);
+		valid = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), col), valid);
+		valid = _mm256_and_si256(_mm256_cmpgt_epi32(w, col), valid);
+		col = _mm256_add_epi32(col, _mm256_i32gather_epi32(proj->shift, row, 4));
+		col = _mm256_sub_epi32(col, _mm256_andnot_si256(_mm256_cmpgt_epi32(w, col), w));
+		__m256i pixel = _mm256_add_epi32(_mm256_mullo_epi32(row, w), col);
+		pixel = _mm256_or_si256(_mm256_and_si256(valid, pixel), _mm256_andnot_si256(valid, _mm256_set1_epi32(-1)));
+		_mm256_storeu_si256((__m256i *)(pixels + i), pixel);
+	}
+	for (; i < n; ++i) {
+		float const *p = (float const *)(xyz + (int64_t)i * xyz_stride);
+		pixels[i] = projection_pixel(proj, p[0], p[1], p[2]);
+	}
+}
+#endif
+
+void ouster_projection_init(ouster_projection_t *proj, ouster_meta_t const *meta)
+{
+	ouster_assert_notnull(proj);
+	ouster_assert_notnull(meta);
+	int h = meta->pixels_per_column;
+	ouster_assert(meta->midw > 0, "");
+	ouster_assert(h > 0, "");
+	ouster_assert(h <= OUSTER_MAX_ROWS, "");
+
+	memset(proj, 0, sizeof(ouster_projection_t));
+	proj->w = meta->midw;
+	proj->h = h;
+	proj->mid0 = meta->mid0;
+	proj->columns_per_frame = meta->columns_per_frame;
+	proj->beam_x = (float)meta->beam_to_lidar_transform[OUSTER_M4(0, 3)];
+	proj->beam_z = (float)meta->beam_to_lidar_transform[OUSTER_M4(2, 3)];
+
+	// Inverse of the rigid lidar_to_sensor_transform, the rotation is transposed
+	double const *t = meta->lidar_to_sensor_transform;
+	for (int j = 0; j < 3; ++j) {
+		double translation = 0;
+		for (int k = 0; k < 3; ++k) {
+			proj->sensor_to_lidar[j * 4 + k] = (float)(t[OUSTER_M4(k, j)] * 1000.0);
+			translation -= t[OUSTER_M4(k, j)] * t[OUSTER_M4(k, 3)];
+		}
+		proj->sensor_to_lidar[j * 4 + 3] = (float)translation;
+	}
+
+	// Sort beams by altitude from top to bottom, insertion sort keeps equal beams in row order
+	double altitude[OUSTER_MAX_ROWS];
+	for (int r = 0; r < h; ++r) {
+		int k = r;
+		double a = meta->beam_altitude_angles[r] * OUSTER_M_PI / 180.0;
+		for (; (k > 0) && (altitude[k - 1] < a); --k) {
+			altitude[k] = altitude[k - 1];
+			proj->edge_row[k] = proj->edge_row[k - 1];
+		}
+		altitude[k] = a;
+		proj->edge_row[k] = r;
+	}
+
+	// Edges halfway between beams, the outer edges are half a beam spacing outside
+	double outer = (h > 1) ? (altitude[0] - altitude[h - 1]) / (2.0 * (h - 1)) : (OUSTER_M_PI / 360.0);
+	proj->edge[0] = (float)(altitude[0] + outer);
+	for (int k = 1; k < h; ++k) {
+		proj->edge[k] = (float)((altitude[k - 1] + altitude[k]) / 2.0);
+	}
+	proj->edge[h] = (float)(altitude[h - 1] - outer);
+	// First step of the binary search, half the smallest power of two that holds all h + 1 edges
+	proj->search_step = 1;
+	while ((proj->search_step * 2) < (h + 1)) {
+		proj->search_step *= 2;
+	}
+	for (int k = h + 1; k < OUSTER_PROJECTION_EDGES; ++k) {
+		proj->edge[k] = -INFINITY;
+	}
+
+	for (int r = 0; r < h; ++r) {
+		double azimuth = -meta->beam_azimuth_angles[r] * OUSTER_M_PI / 180.0;
+		proj->azimuth_sin[r] = (float)sin(azimuth);
+		proj->azimuth_cos[r] = (float)cos(azimuth);
+		proj->shift[r] = ((meta->pixel_shift_by_row[r] % proj->w) + proj->w) % proj->w;
+	}
+}
+
+int ouster_projection_pixel(ouster_projection_t const *proj, float const xyz[3], int *row, int *col)
+{
+	ouster_assert_notnull(proj);
+	ouster_assert_notnull(xyz);
+	ouster_assert_notnull(row);
+	ouster_assert_notnull(col);
+	int32_t pixel = projection_pixel(proj, xyz[0], xyz[1], xyz[2]);
+	if (pixel < 0) {
+		return 0;
+	}
+	*row = pixel / proj->w;
+	*col = pixel % proj->w;
+	return 1;
+}
+
+void ouster_projection_pixels(ouster_projection_t const *proj, void const *xyz, int xyz_stride, int n, int32_t *pixels)
+{
+	ouster_assert_notnull(proj);
+	ouster_assert_notnull(xyz);
+	ouster_assert_notnull(pixels);
+#ifdef OUSTER_PROJECTION_X86
+	if (__builtin_cpu_supports("avx2")) {
+		projection_pixels_avx2(proj, xyz, xyz_stride, n, pixels);
+		return;
+	}
+#endif
+	char const *p8 = xyz;
+	for (int i = 0; i < n; ++i, p8 += xyz_stride) {
+		float const *p = (float const *)p8;
+		pixels[i] = projection_pixel(proj, p[0], p[1], p[2]);
+	}
+}
\ No newline at end of file
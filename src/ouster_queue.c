@@ -0,0 +1,73 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+void ouster_spsc_init(ouster_spsc_t *q, int capacity)
+{
+	ouster_assert_notnull(q);
+	ouster_assert(capacity > 0, "");
+	uint64_t n = 1;
+	while (n < (uint64_t)capacity) {
+		n <<= 1;
+	}
+	memset(q, 0, sizeof(ouster_spsc_t));
+	q->items = ouster_os_calloc(n * sizeof(void *));
+	ouster_assert_notnull(q->items);
+	q->mask = n - 1;
+}
+
+void ouster_spsc_fini(ouster_spsc_t *q)
+{
+	ouster_assert_notnull(q);
+	ouster_os_free(q->items);
+	memset(q, 0, sizeof(ouster_spsc_t));
+}
+
+int ouster_spsc_push(ouster_spsc_t *q, void *item)
+{
+	ouster_assert_notnull(q);
+	ouster_assert_notnull(item);
+	uint64_t head = q->head;
+	if ((head - q->tail_cache) > q->mask) {
+		// Only read the consumer index when the cached one says full
+		q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		if ((head - q->tail_cache) > q->mask) {
+			return -1;
+		}
+	}
+	__atomic_store_n(q->items + (head & q->mask), item, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void *ouster_spsc_pop(ouster_spsc_t *q)
+{
+	ouster_assert_notnull(q);
+	uint64_t tail = q->tail;
+	if (tail == q->head_cache) {
+		q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		if (tail == q->head_cache) {
+			return NULL;
+		}
+	}
+	void *item = __atomic_load_n(q->items + (tail & q->mask), __ATOMIC_RELAXED);
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	return item;
+}
+
+void *ouster_mailbox_put(ouster_mailbox_t *mb, void *item)
+{
+	ouster_assert_notnull(mb);
+	ouster_assert_notnull(item);
+	return __atomic_exchange_n(&mb->item, item, __ATOMIC_ACQ_REL);
+}
+
+void *ouster_mailbox_take(ouster_mailbox_t *mb)
+{
+	ouster_assert_notnull(mb);
+	// Cheap check first so polling an empty mailbox does not write the cache line
+	if (__atomic_load_n(&mb->item, __ATOMIC_RELAXED) == NULL) {
+		return NULL;
+	}
+	return __atomic_exchange_n(&mb->item, NULL, __ATOMIC_ACQ_REL);
+}
\ No newline at end of file
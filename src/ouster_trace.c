@@ -0,0 +1,141 @@
+#include "ouster_clib.h"
+
+#include <string.h>
+
+/* Slots are written field by field with atomics, seq is n + 1 once event n is complete */
+typedef struct
+{
+	uint64_t seq;
+	char const *name;
+	int64_t begin;
+	int64_t end;
+	int64_t arg;
+	int32_t tid;
+} trace_event_t;
+
+typedef struct
+{
+	trace_event_t *events;
+	uint64_t capacity;
+	uint64_t next;
+	int64_t start_ns;
+} trace_t;
+
+static trace_t trace;
+static char const *trace_thread_names[OUSTER_TRACE_MAX_THREADS];
+static int trace_thread_count;
+static __thread int trace_tid;
+
+static int trace_tid_get(void)
+{
+	if (trace_tid == 0) {
+		trace_tid = __atomic_add_fetch(&trace_thread_count, 1, __ATOMIC_RELAXED);
+	}
+	return trace_tid;
+}
+
+int ouster_trace_start(int capacity)
+{
+	ouster_assert(capacity > 0, "");
+	ouster_trace_stop();
+	trace_event_t *events = ouster_os_calloc((size_t)capacity * sizeof(trace_event_t));
+	if (events == NULL) {
+		return -1;
+	}
+	trace.capacity = (uint64_t)capacity;
+	trace.next = 0;
+	trace.start_ns = ouster_os_clock_ns();
+	__atomic_store_n(&trace.events, events, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void ouster_trace_stop(void)
+{
+	trace_event_t *events = __atomic_exchange_n(&trace.events, NULL, __ATOMIC_ACQ_REL);
+	ouster_os_free(events);
+}
+
+void ouster_trace_record(char const *name, int64_t begin_ns, int64_t end_ns, int64_t arg)
+{
+	trace_event_t *events = __atomic_load_n(&trace.events, __ATOMIC_ACQUIRE);
+	if (events == NULL) {
+		return;
+	}
+	uint64_t n = __atomic_fetch_add(&trace.next, 1, __ATOMIC_RELAXED);
+	trace_event_t *e = events + (n % trace.capacity);
+	__atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&e->name, name, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->begin, begin_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->end, end_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->arg, arg, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->tid, trace_tid_get(), __ATOMIC_RELAXED);
+	__atomic_store_n(&e->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+void ouster_trace_thread_name_(char const *name)
+{
+	int tid = trace_tid_get();
+	if (tid < OUSTER_TRACE_MAX_THREADS) {
+		__atomic_store_n(trace_thread_names + tid, name, __ATOMIC_RELAXED);
+	}
+}
+
+/* Copies event n, returns 0 when it is being written or was overwritten */
+static int trace_read(trace_event_t const *events, uint64_t n, trace_event_t *out)
+{
+	trace_event_t const *e = events + (n % trace.capacity);
+	if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != (n + 1)) {
+		return 0;
+	}
+	out->name = __atomic_load_n(&e->name, __ATOMIC_RELAXED);
+	out->begin = __atomic_load_n(&e->begin, __ATOMIC_RELAXED);
+	out->end = __atomic_load_n(&e->end, __ATOMIC_RELAXED);
+	out->arg = __atomic_load_n(&e->arg, __ATOMIC_RELAXED);
+	out->tid = __atomic_load_n(&e->tid, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == (n + 1);
+}
+
+int ouster_trace_dump(FILE *f)
+{
+	ouster_assert_notnull(f);
+	trace_event_t const *events = __atomic_load_n(&trace.events, __ATOMIC_ACQUIRE);
+	int count = 0;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	int threads = __atomic_load_n(&trace_thread_count, __ATOMIC_RELAXED);
+	threads = threads < (OUSTER_TRACE_MAX_THREADS - 1) ? threads : (OUSTER_TRACE_MAX_THREADS - 1);
+	for (int tid = 1; tid <= threads; ++tid) {
+		char const *name = __atomic_load_n(trace_thread_names + tid, __ATOMIC_RELAXED);
+		if (name) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}", count ? ",\n" : "", tid, name);
+			count++;
+		}
+	}
+	int written = 0;
+	if (events) {
+		uint64_t end = __atomic_load_n(&trace.next, __ATOMIC_ACQUIRE);
+		uint64_t n = end > trace.capacity ? (end - trace.capacity) : 0;
+		for (; n < end; ++n) {
+			trace_event_t e;
+			if (trace_read(events, n, &e) == 0) {
+				continue;
+			}
+			// Timestamps are microseconds since ouster_trace_start()
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f",
+			        count ? ",\n" : "",
+			        e.name,
+			        (int)e.tid,
+			        (double)(e.begin - trace.start_ns) / 1000.0,
+			        (double)(e.end - e.begin) / 1000.0);
+			if (e.arg >= 0) {
+				fprintf(f, ",\"args\":{\"arg\":%ji}", (intmax_t)e.arg);
+			}
+			fprintf(f, "}");
+			count++;
+			written++;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	return written;
+}
\ No newline at end of file
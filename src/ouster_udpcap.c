@@ -1,8 +1,14 @@
 #include "ouster_clib.h"
 
+#include <dirent.h>
 #include <endian.h>
 #include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <unistd.h>
+
+#define OUSTER_UDPCAP_FLUSH_NS INT64_C(1000000000)
 
 
 /*
@@ -62,11 +68,79 @@ int ouster_udpcap_sendto(ouster_udpcap_t *cap, int sock, ouster_net_addr_t *addr
 	return rc;
 }
 
+int ouster_udpcap_sendmmsg(ouster_udpcap_t *caps[], int n, int sock, ouster_net_addr_t *addr)
+{
+	ouster_assert_notnull(caps);
+	ouster_assert(n >= 0, "");
+	ouster_assert(sock >= 0, "");
+	ouster_assert_notnull(addr);
+
+	ouster_net_addr_t addrs[OUSTER_NET_SENDMMSG_MAX];
+	ouster_net_msg_t msgs[OUSTER_NET_SENDMMSG_MAX];
+	int sent = 0;
+	while (sent < n) {
+		int count = n - sent;
+		count = (count > OUSTER_NET_SENDMMSG_MAX) ? OUSTER_NET_SENDMMSG_MAX : count;
+		for (int i = 0; i < count; ++i) {
+			ouster_udpcap_t *cap = caps[sent + i];
+			// Send UDP content to the the same port as the capture
+			addrs[i] = *addr;
+			ouster_net_addr_set_port(addrs + i, cap->port);
+			msgs[i].buf = cap->buf;
+			msgs[i].size = cap->size;
+			msgs[i].addr = addrs + i;
+		}
+		int rc = ouster_net_sendmmsg(sock, msgs, count, 0);
+		if (rc < 0) {
+			return sent ? sent : -1;
+		}
+		sent += rc;
+		if (rc < count) {
+			break;
+		}
+	}
+	return sent;
+}
+
 void ouster_udpcap_set_port(ouster_udpcap_t *cap, int port)
 {
 	ouster_assert_notnull(cap);
 
-	cap->port = htole32(port);
+	cap->port = port;
+}
+
+int ouster_udpcap_recv(ouster_udpcap_t *cap, int sock)
+{
+	ouster_assert_notnull(cap);
+	ouster_assert(sock >= 0, "");
+
+	int64_t n = ouster_net_read(sock, cap->buf, cap->size);
+	if (n <= 0) {
+		return OUSTER_UDPCAP_ERROR_RECV;
+	}
+	if (n > cap->size) {
+		return OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL;
+	}
+	cap->size = n;
+	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_write(ouster_udpcap_t const *cap, FILE *f)
+{
+	ouster_assert_notnull(cap);
+	ouster_assert_notnull(f);
+
+	// Convert host to little endian
+	ouster_udpcap_t header;
+	header.port = htole32(cap->port);
+	header.size = htole32(cap->size);
+	if (fwrite(&header, sizeof(ouster_udpcap_t), 1, f) != 1) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	if (cap->size && (fwrite(cap->buf, cap->size, 1, f) != 1)) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	return OUSTER_UDPCAP_OK;
 }
 
 int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f)
@@ -75,26 +149,444 @@ int ouster_udpcap_sock_to_file(ouster_udpcap_t *cap, int sock, FILE *f)
 	ouster_assert(sock >= 0, "");
 	ouster_assert_notnull(f);
 
-	int64_t write_size;
+	int rc = ouster_udpcap_recv(cap, sock);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+	return ouster_udpcap_write(cap, f);
+}
 
-	{
-		int64_t n = ouster_net_read(sock, cap->buf, cap->size);
-		if (n <= 0) {
-			return OUSTER_UDPCAP_ERROR_RECV;
+static int footer_write(ouster_udpcap_footer_t const *footer, FILE *f)
+{
+	ouster_udpcap_footer_t le;
+	le.magic = htole32(footer->magic);
+	le.segment = htole32(footer->segment);
+	le.records = htole64(footer->records);
+	le.bytes = htole64(footer->bytes);
+	le.t_open = htole64(footer->t_open);
+	le.t_close = htole64(footer->t_close);
+	ouster_udpcap_t header;
+	header.port = htole32(OUSTER_UDPCAP_PORT_FOOTER);
+	header.size = htole32(sizeof(ouster_udpcap_footer_t));
+	if (fwrite(&header, sizeof(ouster_udpcap_t), 1, f) != 1) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	if (fwrite(&le, sizeof(ouster_udpcap_footer_t), 1, f) != 1) {
+		return OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	return OUSTER_UDPCAP_OK;
+}
+
+static int footer_parse(ouster_udpcap_t const *cap, ouster_udpcap_footer_t *footer)
+{
+	if (cap->port != OUSTER_UDPCAP_PORT_FOOTER || cap->size != sizeof(ouster_udpcap_footer_t)) {
+		return 0;
+	}
+	ouster_udpcap_footer_t le;
+	memcpy(&le, cap->buf, sizeof(ouster_udpcap_footer_t));
+	if (le32toh(le.magic) != OUSTER_UDPCAP_FOOTER_MAGIC) {
+		return 0;
+	}
+	footer->magic = le32toh(le.magic);
+	footer->segment = le32toh(le.segment);
+	footer->records = le64toh(le.records);
+	footer->bytes = le64toh(le.bytes);
+	footer->t_open = le64toh(le.t_open);
+	footer->t_close = le64toh(le.t_close);
+	return 1;
+}
+
+int ouster_udpcap_recover(char const *filename, int segment, ouster_udpcap_footer_t *footer)
+{
+	ouster_assert_notnull(filename);
+
+	FILE *f = fopen(filename, "r+b");
+	if (f == NULL) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	fseeko(f, 0, SEEK_END);
+	int64_t end = ftello(f);
+	rewind(f);
+
+	ouster_udpcap_footer_t found = {0};
+	int64_t pos = 0;
+	int64_t records = 0;
+	int has_footer = 0;
+	while (pos < end) {
+		ouster_udpcap_t header;
+		if (fread(&header, sizeof(ouster_udpcap_t), 1, f) != 1) {
+			break;
 		}
-		if (n > cap->size) {
-			return OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL;
+		uint32_t port = le32toh(header.port);
+		uint32_t size = le32toh(header.size);
+		int64_t next = pos + (int64_t)sizeof(ouster_udpcap_t) + size;
+		// Zero filled or torn tail after power loss
+		if (size == 0 || size > OUSTER_NET_UDP_MAX_SIZE || next > end) {
+			break;
 		}
-		cap->size = htole32(n);
-		write_size = sizeof(ouster_udpcap_t) + n;
+		if (port == OUSTER_UDPCAP_PORT_FOOTER && next == end) {
+			char buf[sizeof(ouster_udpcap_t) + sizeof(ouster_udpcap_footer_t)];
+			ouster_udpcap_t *cap = (void *)buf;
+			cap->port = port;
+			cap->size = size;
+			if (fread(cap->buf, size, 1, f) == 1 && footer_parse(cap, &found)) {
+				has_footer = 1;
+				break;
+			}
+		}
+		if (fseeko(f, next, SEEK_SET)) {
+			break;
+		}
+		pos = next;
+		records++;
 	}
 
-	{
-		size_t n = fwrite((void *)cap, write_size, 1, f);
-		if (n != 1) {
-			return OUSTER_UDPCAP_ERROR_FWRITE;
+	int rc = OUSTER_UDPCAP_OK;
+	if (has_footer == 0) {
+		if (pos < end) {
+			ouster_log("%s: truncating incomplete record at %ji of %ji bytes\n", filename, (intmax_t)pos, (intmax_t)end);
+			fflush(f);
+			if (ftruncate(fileno(f), pos)) {
+				rc = OUSTER_UDPCAP_ERROR_FWRITE;
+			}
+		}
+		found.magic = OUSTER_UDPCAP_FOOTER_MAGIC;
+		found.segment = segment;
+		found.records = records;
+		found.bytes = pos;
+		fseeko(f, pos, SEEK_SET);
+		if (rc == OUSTER_UDPCAP_OK) {
+			rc = footer_write(&found, f);
+		}
+		fflush(f);
+		fsync(fileno(f));
+	}
+	fclose(f);
+	if (footer) {
+		*footer = found;
+	}
+	return rc;
+}
+
+/* Finds the first and last existing segment number of a segmented capture */
+static int segment_scan(char const *path, int *first, int *last)
+{
+	char dirname[OUSTER_UDPCAP_PATH_MAX];
+	char const *slash = strrchr(path, '/');
+	char const *basename = slash ? slash + 1 : path;
+	if (slash) {
+		snprintf(dirname, sizeof(dirname), "%.*s", (int)(slash - path + 1), path);
+	} else {
+		snprintf(dirname, sizeof(dirname), ".");
+	}
+	DIR *dir = opendir(dirname);
+	if (dir == NULL) {
+		return 0;
+	}
+	int count = 0;
+	size_t len = strlen(basename);
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		char const *name = entry->d_name;
+		if (strncmp(name, basename, len) || name[len] != '.') {
+			continue;
+		}
+		char *end;
+		long segment = strtol(name + len + 1, &end, 10);
+		if (end == name + len + 1 || *end != '\0' || segment < 0) {
+			continue;
+		}
+		*first = (count == 0 || segment < *first) ? (int)segment : *first;
+		*last = (count == 0 || segment > *last) ? (int)segment : *last;
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+static int writer_open_segment(ouster_udpcap_writer_t *w)
+{
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	if (w->segmented) {
+		snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, w->path, w->segment);
+	} else {
+		snprintf(filename, sizeof(filename), "%s", w->path);
+	}
+	ouster_log("Opening capture segment '%s'\n", filename);
+	w->file = fopen(filename, "wb");
+	if (w->file == NULL) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	w->bytes = 0;
+	w->records = 0;
+	w->t_open = ouster_os_clock_ns();
+	w->t_flush = w->t_open;
+	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_writer_open(ouster_udpcap_writer_t *w, char const *path, int64_t max_bytes, int64_t max_ns)
+{
+	ouster_assert_notnull(w);
+	ouster_assert_notnull(path);
+	ouster_assert(max_bytes >= 0, "");
+	ouster_assert(max_ns >= 0, "");
+
+	memset(w, 0, sizeof(ouster_udpcap_writer_t));
+	snprintf(w->path, sizeof(w->path), "%s", path);
+	w->max_bytes = max_bytes;
+	w->max_ns = max_ns;
+	w->segmented = (max_bytes > 0) || (max_ns > 0);
+
+	if (w->segmented) {
+		int first;
+		int last;
+		if (segment_scan(path, &first, &last) > 0) {
+			// Continue after a previous capture, which might have been interrupted
+			char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+			snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, path, last);
+			ouster_udpcap_recover(filename, last, NULL);
+			w->segment = last + 1;
+		}
+	}
+
+	return writer_open_segment(w);
+}
+
+static int writer_close_segment(ouster_udpcap_writer_t *w)
+{
+	if (w->file == NULL) {
+		return OUSTER_UDPCAP_OK;
+	}
+	ouster_udpcap_footer_t footer = {
+	    .magic = OUSTER_UDPCAP_FOOTER_MAGIC,
+	    .segment = w->segment,
+	    .records = w->records,
+	    .bytes = w->bytes,
+	    .t_open = w->t_open,
+	    .t_close = ouster_os_clock_ns()};
+	int rc = footer_write(&footer, w->file);
+	if (fflush(w->file) || fsync(fileno(w->file))) {
+		rc = OUSTER_UDPCAP_ERROR_FWRITE;
+	}
+	fclose(w->file);
+	w->file = NULL;
+	return rc;
+}
+
+static int writer_write(ouster_udpcap_writer_t *w, ouster_udpcap_t const *cap)
+{
+	int rc;
+	int64_t size = sizeof(ouster_udpcap_t) + cap->size;
+	int64_t now = ouster_os_clock_ns();
+
+	if (w->segmented && (w->records > 0)) {
+		int full = (w->max_bytes > 0) && ((w->bytes + size) > w->max_bytes);
+		int expired = (w->max_ns > 0) && ((now - w->t_open) >= w->max_ns);
+		if (full || expired) {
+			rc = writer_close_segment(w);
+			if (rc != OUSTER_UDPCAP_OK) {
+				return rc;
+			}
+			w->segment++;
+		}
+	}
+
+	if (w->file == NULL) {
+		rc = writer_open_segment(w);
+		if (rc != OUSTER_UDPCAP_OK) {
+			return rc;
 		}
 	}
 
+	rc = ouster_udpcap_write(cap, w->file);
+	if (rc != OUSTER_UDPCAP_OK) {
+		return rc;
+	}
+	w->bytes += size;
+	w->records++;
+
+	// Bound the amount of data lost if the process dies
+	if ((now - w->t_flush) >= OUSTER_UDPCAP_FLUSH_NS) {
+		fflush(w->file);
+		w->t_flush = now;
+	}
+
 	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_writer_write(ouster_udpcap_writer_t *w, ouster_udpcap_t const *cap)
+{
+	ouster_assert_notnull(w);
+	ouster_assert_notnull(cap);
+	ouster_trace_begin(t);
+	int rc = writer_write(w, cap);
+	ouster_trace_end(t, "udpcap_write", -1);
+	return rc;
+}
+
+int ouster_udpcap_writer_close(ouster_udpcap_writer_t *w)
+{
+	ouster_assert_notnull(w);
+	return writer_close_segment(w);
+}
+
+static int reader_open_segment(ouster_udpcap_reader_t *r)
+{
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, r->path, r->segment);
+	r->file = fopen(filename, "rb");
+	if (r->file == NULL) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	return OUSTER_UDPCAP_OK;
+}
+
+int ouster_udpcap_reader_open(ouster_udpcap_reader_t *r, char const *path)
+{
+	ouster_assert_notnull(r);
+	ouster_assert_notnull(path);
+
+	memset(r, 0, sizeof(ouster_udpcap_reader_t));
+	snprintf(r->path, sizeof(r->path), "%s", path);
+
+	r->file = fopen(path, "rb");
+	if (r->file) {
+		return OUSTER_UDPCAP_OK;
+	}
+
+	if (segment_scan(path, &r->segment, &r->last) == 0) {
+		return OUSTER_UDPCAP_ERROR_FOPEN;
+	}
+	r->segmented = 1;
+	return reader_open_segment(r);
+}
+
+static void reader_next_segment(ouster_udpcap_reader_t *r)
+{
+	fclose(r->file);
+	r->file = NULL;
+	if (r->segmented == 0) {
+		return;
+	}
+	// A gap in the segment numbers does not end the capture
+	while (r->segment < r->last) {
+		r->segment++;
+		if (reader_open_segment(r) == OUSTER_UDPCAP_OK) {
+			return;
+		}
+		ouster_log("%s: segment %i is missing\n", r->path, r->segment);
+		r->missing++;
+	}
+}
+
+static int reader_read(ouster_udpcap_reader_t *r, ouster_udpcap_t *cap)
+{
+	uint32_t maxsize = cap->size;
+	while (r->file) {
+		// Distinguish end of segment from an incomplete record
+		int c = fgetc(r->file);
+		if (c == EOF) {
+			reader_next_segment(r);
+			continue;
+		}
+		ungetc(c, r->file);
+
+		cap->size = maxsize;
+		int rc = ouster_udpcap_read(cap, r->file);
+		if (rc == OUSTER_UDPCAP_OK) {
+			if (cap->port == OUSTER_UDPCAP_PORT_FOOTER) {
+				footer_parse(cap, &r->footer);
+				continue;
+			}
+			return OUSTER_UDPCAP_OK;
+		}
+		if ((rc == OUSTER_UDPCAP_ERROR_BUFFER_TOO_SMALL) && (cap->size <= OUSTER_NET_UDP_MAX_SIZE)) {
+			return rc;
+		}
+		// The rest of the segment is unreadable, continue with next segment
+		ouster_log("%s: segment %i is truncated\n", r->path, r->segment);
+		r->truncated++;
+		reader_next_segment(r);
+	}
+	return OUSTER_UDPCAP_ERROR_EOF;
+}
+
+int ouster_udpcap_reader_read(ouster_udpcap_reader_t *r, ouster_udpcap_t *cap)
+{
+	ouster_assert_notnull(r);
+	ouster_assert_notnull(cap);
+	ouster_trace_begin(t);
+	int rc = reader_read(r, cap);
+	ouster_trace_end(t, "udpcap_read", -1);
+	return rc;
+}
+
+void ouster_udpcap_reader_close(ouster_udpcap_reader_t *r)
+{
+	ouster_assert_notnull(r);
+	if (r->file) {
+		fclose(r->file);
+		r->file = NULL;
+	}
+}
+
+int test_ouster_udpcap(char const *path)
+{
+	int const count = 1100;
+	int const per_segment = 100;
+	int const removed = 5;
+	uint32_t const size = 64;
+	ouster_udpcap_t *cap = ouster_os_malloc(sizeof(ouster_udpcap_t) + OUSTER_NET_UDP_MAX_SIZE);
+	ouster_assert_notnull(cap);
+	char filename[OUSTER_UDPCAP_PATH_MAX + 16];
+	int ok = 1;
+
+	ouster_udpcap_writer_t w;
+	int rc = ouster_udpcap_writer_open(&w, path, per_segment * (sizeof(ouster_udpcap_t) + size), 0);
+	ok &= (rc == OUSTER_UDPCAP_OK);
+	for (int i = 0; (i < count) && ok; ++i) {
+		memset(cap->buf, 0, size);
+		memcpy(cap->buf, &i, sizeof(i));
+		cap->port = 7502;
+		cap->size = size;
+		ok &= (ouster_udpcap_writer_write(&w, cap) == OUSTER_UDPCAP_OK);
+	}
+	ok &= (ouster_udpcap_writer_close(&w) == OUSTER_UDPCAP_OK);
+	int last = w.segment;
+
+	snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, path, removed);
+	ok &= (remove(filename) == 0);
+
+	ouster_udpcap_reader_t r;
+	rc = ouster_udpcap_reader_open(&r, path);
+	ok &= (rc == OUSTER_UDPCAP_OK);
+	int expect = 0;
+	int records = 0;
+	while (ok) {
+		cap->size = OUSTER_NET_UDP_MAX_SIZE;
+		rc = ouster_udpcap_reader_read(&r, cap);
+		if (rc != OUSTER_UDPCAP_OK) {
+			break;
+		}
+		if (expect == removed * per_segment) {
+			expect += per_segment;
+		}
+		int i;
+		memcpy(&i, cap->buf, sizeof(i));
+		ok &= (cap->size == size) && (i == expect);
+		expect++;
+		records++;
+	}
+	ouster_udpcap_reader_close(&r);
+	ok &= (rc == OUSTER_UDPCAP_ERROR_EOF);
+	ok &= (records == count - per_segment);
+	ok &= (r.missing == 1) && (r.truncated == 0);
+
+	for (int s = 0; s <= last; ++s) {
+		snprintf(filename, sizeof(filename), OUSTER_UDPCAP_SEGMENT_FORMAT, path, s);
+		remove(filename);
+	}
+	ouster_os_free(cap);
+	ouster_assert(ok, "");
+	return ok;
 }
\ No newline at end of file
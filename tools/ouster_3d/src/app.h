@@ -21,17 +21,27 @@ typedef enum {
 	FIELD_COUNT
 } field_t;
 
+#define FRAME_COUNT 4
+
 #define KEY_PRESS 0x1
 #define KEY_PRESSED 0x2
 
 typedef struct {
 	uint8_t keys[512];
 	gcamera_state_t camera;
-	double * points_xyz;
-	int points_count;
+	ouster_frame_pool_t pool;
+	// Pointcloud of each pool frame, converted while its packets arrive
+	float * frame_xyz[FRAME_COUNT];
+	int frame_xyz_count[FRAME_COUNT];
+	int frame_xyz_id[FRAME_COUNT];
+	// Newest complete frame, taken by the render thread
+	ouster_mailbox_t mailbox;
+	// Frames the render thread is done with, released by the receive thread
+	ouster_spsc_t returns;
+	// Frame drawn by the render thread
+	ouster_frame_t *shown;
 	draw_points_t draw_points;
 	pthread_t thread;
-	pthread_mutex_t lock;
 	float dt;
 	float w;
 	float h;
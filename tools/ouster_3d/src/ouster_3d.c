@@ -77,13 +77,11 @@ void gcamera_controller(gcamera_state_t *camera, uint8_t keys[])
 }
 
 
-int convert(vertex_t * v, double * xyz, int n, float thres, float radius)
+int convert(vertex_t * v, float * xyz, int n, float radius)
 {
 	int j = 0;
 	for(int i = 0; i < n; ++i, xyz += 3)
 	{
-		double l2 = V3_DOT(xyz, xyz);
-		if(l2 < (thres*thres)){continue;}
 		v->color = 0XFFFFFFFF;
 		v->x = xyz[0];
 		v->y = xyz[1];
@@ -123,21 +121,34 @@ static void frame_cb(app_t *app)
 
 	if (app->pause == 0)
 	{
-		pthread_mutex_lock(&app->lock);
-		int n = MIN(app->points_count, app->draw_points.vertices_cap);
-		int j = convert(app->draw_points.vertices, app->points_xyz, n, 0.1f, app->gui_point_radius);
+		ouster_frame_t *f = ouster_mailbox_take(&app->mailbox);
+		if (f) {
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+			ouster_profile_span(OUSTER_STAGE_HANDOFF, f->complete_ns, ouster_os_clock_ns());
+#endif
+			if (app->shown) {
+				// Can not fail, the queue holds every frame of the pool
+				ouster_spsc_push(&app->returns, app->shown);
+			}
+			app->shown = f;
+		}
+	}
+
+	if (app->shown)
+	{
+		// The receive thread does not write a frame until it is handed back
+		int i = app->shown - app->pool.frames;
+		int n = MIN(app->frame_xyz_count[i], app->draw_points.vertices_cap);
+		int j = convert(app->draw_points.vertices, app->frame_xyz[i], n, app->gui_point_radius);
 		app->draw_points.vertices_count = j;
-		pthread_mutex_unlock(&app->lock);
 	}
 
 
 	draw_points_pass(&app->draw_points, &app->camera.vp);
 
 	if (app->keys[SAPP_KEYCODE_C] & KEY_PRESSED) {
-		pthread_mutex_lock(&app->lock);
 		printf("savecsv\n");
 		save_csv(app->draw_points.vertices, app->draw_points.vertices_count);
-		pthread_mutex_unlock(&app->lock);
 	}
 
 
@@ -247,7 +258,7 @@ sapp_desc sokol_main(int argc, char *argv[])
 			exit(-1);
 		}
 		ouster_meta_parse(content, &app->meta);
-		free(content);
+		ouster_os_free(content);
 		printf("Column window: %i %i\n", app->meta.mid0, app->meta.mid1);
 	}
 
@@ -7,19 +7,22 @@ void *rec(app_t *app)
 	ouster_field_t fields[FIELD_COUNT] = {
 	    [FIELD_RANGE] = {.quantity = OUSTER_QUANTITY_RANGE, .depth = 4}};
 
-	ouster_field_init(fields, FIELD_COUNT, meta);
+	// One frame being filled, one in the mailbox, one being drawn and one on its way back
+	ouster_frame_pool_init(&app->pool, meta, fields, FIELD_COUNT, FRAME_COUNT);
+	ouster_spsc_init(&app->returns, FRAME_COUNT);
 
 	int socks[2];
 	socks[SOCK_INDEX_LIDAR] = ouster_sock_create_udp_lidar(7502, OUSTER_DEFAULT_RCVBUF_SIZE);
 	socks[SOCK_INDEX_IMU] = ouster_sock_create_udp_imu(7503, OUSTER_DEFAULT_RCVBUF_SIZE);
 
-	ouster_lidar_t lidar = {0};
-
 	ouster_lut_t lut = {0};
+	ouster_lut_f32_t lut32 = {0};
 	ouster_lut_init(&lut, meta);
-	double *xyz = calloc(1, lut.w * lut.h * sizeof(double) * 3);
-	app->points_xyz = calloc(1, lut.w * lut.h * sizeof(double) * 3);
-	app->points_count = lut.w * lut.h;
+	ouster_lut_f32_init(&lut32, &lut);
+	for (int i = 0; i < FRAME_COUNT; ++i) {
+		app->frame_xyz[i] = calloc(1, lut.w * lut.h * sizeof(float) * 3);
+		app->frame_xyz_id[i] = -1;
+	}
 
 	while (1) {
 		int timeout_sec = 1;
@@ -30,20 +33,39 @@ void *rec(app_t *app)
 			ouster_log("Timeout\n");
 		}
 
+		// The pool is only touched by this thread, the render thread hands frames back through the queue
+		ouster_frame_t *f;
+		while ((f = ouster_spsc_pop(&app->returns)) != NULL) {
+			ouster_frame_pool_release(&app->pool, f);
+		}
+
 		if (a & (1 << SOCK_INDEX_LIDAR)) {
 			char buf[OUSTER_NET_UDP_MAX_SIZE];
 			int64_t n = ouster_net_read(socks[SOCK_INDEX_LIDAR], buf, sizeof(buf));
 			if (n == meta->lidar_packet_size) {
-				ouster_lidar_get_fields(&lidar, meta, buf, fields, FIELD_COUNT);
-				if (lidar.last_mid == meta->mid1) {
-					ouster_lut_cartesian_f64(&lut, fields[FIELD_RANGE].data, xyz, sizeof(double)*3);
-					ouster_field_zero(fields, FIELD_COUNT);
-					//printf("frame=%i, mid_loss=%i\n", lidar.frame_id, lidar.mid_loss);
-
-					pthread_mutex_lock(&app->lock);
-					memcpy(app->points_xyz, xyz, app->points_count*sizeof(double)*3);
-					pthread_mutex_unlock(&app->lock);
-
+				ouster_frame_t *done = ouster_frame_pool_push(&app->pool, buf);
+				ouster_frame_t *last = app->pool.last;
+				int i = last - app->pool.frames;
+				if (last->lidar.frame_id != app->frame_xyz_id[i]) {
+					// First packet of a frame, the buffer still holds an older pointcloud
+					app->frame_xyz_id[i] = last->lidar.frame_id;
+					app->frame_xyz_count[i] = 0;
+				}
+				if (last->lidar.packet_mid0 >= 0) {
+					// Convert the columns of this packet now instead of the whole frame at the end.
+					// Points closer than 0.1 m and pixels without return are skipped.
+					int col0 = last->lidar.packet_mid0 - meta->mid0;
+					int col1 = last->lidar.packet_mid1 - meta->mid0;
+					float *xyz = app->frame_xyz[i] + app->frame_xyz_count[i] * 3;
+					app->frame_xyz_count[i] += ouster_lut_f32_cartesian_compact_columns(&lut32, last->fields[FIELD_RANGE].data, 100, UINT32_MAX, xyz, sizeof(float) * 3, NULL, col0, col1);
+				}
+				if (done) {
+					// The render thread did not take the previous frame, it is replaced by the newer one
+					ouster_frame_t *old = ouster_mailbox_put(&app->mailbox, done);
+					if (old) {
+						ouster_frame_pool_release(&app->pool, old);
+					}
+					//printf("frame=%i, mid_loss=%i\n", done->lidar.frame_id, done->lidar.mid_loss);
 				}
 			} else {
 				printf("Bytes received (%ji) does not match lidar_packet_size (%ji)\n", (intmax_t)n, (intmax_t)app->meta.lidar_packet_size);
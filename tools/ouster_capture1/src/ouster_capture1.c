@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +39,45 @@ static const char *const usages[] = {
     NULL,
 };
 
+static volatile sig_atomic_t quit = 0;
+
+static ouster_blackbox_t blackbox;
+
+static void on_signal(int sig)
+{
+	ouster_unused(sig);
+	quit = 1;
+}
+
+static void on_trigger(int sig)
+{
+	ouster_unused(sig);
+	ouster_blackbox_trigger(&blackbox);
+}
+
+static int store(ouster_udpcap_writer_t *writer, ouster_udpcap_t const *cap, int window_sec)
+{
+	if (window_sec > 0) {
+		return ouster_blackbox_push(&blackbox, cap, ouster_os_clock_ns());
+	}
+	return ouster_udpcap_writer_write(writer, cap);
+}
+
+/* Returns non zero when recording can not continue, a failed incident capture does not stop the black-box */
+static int store_failed(int rc, char const *filename, int window_sec)
+{
+	static int failing = 0;
+	if (rc == OUSTER_UDPCAP_OK) {
+		failing = 0;
+		return 0;
+	}
+	if (failing == 0) {
+		// Only the first error of a series, a full disk fails every packet
+		ouster_log_error("Writing '%s' failed with error %i: %s\n", filename, rc, strerror(errno));
+		failing = 1;
+	}
+	return window_sec == 0;
+}
 
 
 int main(int argc, char const *argv[])
@@ -47,7 +88,12 @@ int main(int argc, char const *argv[])
 
 	char const *metafile = NULL;
 	char const *write_filename = NULL;
-	FILE *write_file = NULL;
+	ouster_udpcap_writer_t writer;
+	int max_mb = 0;
+	int max_sec = 0;
+	int window_sec = 0;
+	int post_sec = 5;
+	int ring_mb = 256;
 	ouster_udpcap_t *cap_lidar = NULL;
 	ouster_udpcap_t *cap_imu = NULL;
 	ouster_meta_t meta = {0};
@@ -59,6 +105,12 @@ int main(int argc, char const *argv[])
 	    OPT_GROUP("Basic options"),
 	    OPT_STRING('m', "metafile", &metafile, "The meta file that correspond to the LiDAR sensor configuration", NULL, 0, 0),
 	    OPT_STRING('c', "capture", &write_filename, "The capture file to write", NULL, 0, 0),
+	    OPT_INTEGER('B', "max-mb", &max_mb, "Rotate to a new segment file after this many MB. (Optional)", NULL, 0, 0),
+	    OPT_INTEGER('T', "max-sec", &max_sec, "Rotate to a new segment file after this many seconds. (Optional)", NULL, 0, 0),
+	    OPT_GROUP("Black-box options"),
+	    OPT_INTEGER('W', "window-sec", &window_sec, "Keep this many seconds of packets in memory and only write them on SIGUSR1. (Optional)", NULL, 0, 0),
+	    OPT_INTEGER('P', "post-sec", &post_sec, "Keep writing this many seconds after SIGUSR1. (Optional)", NULL, 0, 0),
+	    OPT_INTEGER('R', "ring-mb", &ring_mb, "Size of the in-memory ring buffer in MB. (Optional)", NULL, 0, 0),
 	    OPT_END(),
 	};
 
@@ -77,6 +129,11 @@ int main(int argc, char const *argv[])
 		return -1;
 	}
 
+	if (max_mb < 0 || max_sec < 0 || window_sec < 0 || post_sec < 0 || ring_mb <= 0) {
+		argparse_usage(&argparse);
+		return -1;
+	}
+
 	{
 		ouster_assert_notnull(metafile);
 		char *content = ouster_fs_readfile(metafile);
@@ -87,14 +144,18 @@ int main(int argc, char const *argv[])
 			return 0;
 		}
 		ouster_meta_parse(content, &meta);
-		free(content);
+		ouster_os_free(content);
 		ouster_dump_meta(stdout, &meta);
 	}
 
 	ouster_assert_notnull(write_filename);
-	ouster_log("Opening file '%s'\n", write_filename);
-	write_file = fopen(write_filename, "w");
-	if (write_file == NULL) {
+	if (window_sec > 0) {
+		ouster_log("Black-box recording %i seconds, send SIGUSR1 to write '%s'\n", window_sec, write_filename);
+		ouster_blackbox_init(&blackbox, write_filename, (int64_t)ring_mb * 1024 * 1024, (int64_t)window_sec * 1000000000, (int64_t)post_sec * 1000000000);
+	} else {
+		ouster_log("Opening file '%s'\n", write_filename);
+	}
+	if ((window_sec == 0) && ouster_udpcap_writer_open(&writer, write_filename, (int64_t)max_mb * 1024 * 1024, (int64_t)max_sec * 1000000000) != OUSTER_UDPCAP_OK) {
 		char buf[1024];
 		ouster_fs_readfile_failed_reason(write_filename, buf, sizeof(buf));
 		fprintf(stderr, "%s", buf);
@@ -109,11 +170,24 @@ int main(int argc, char const *argv[])
 	ouster_udpcap_set_port(cap_lidar, meta.udp_port_lidar);
 	ouster_udpcap_set_port(cap_imu, meta.udp_port_imu);
 
-	while (1) {
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (window_sec > 0) {
+		signal(SIGUSR1, on_trigger);
+	}
+
+	int status = 0;
+	while (!quit) {
 		int timeout_sec = 1;
 		int timeout_usec = 0;
 		uint64_t a = ouster_net_select(socks, SOCK_INDEX_COUNT, timeout_sec, timeout_usec);
 
+		if (window_sec > 0) {
+			// Write the incident backlog and pick up triggers while idle
+			int rc = ouster_blackbox_flush(&blackbox, (a == 0) ? -1 : 0, ouster_os_clock_ns());
+			store_failed(rc, write_filename, window_sec);
+		}
+
 		if (a == 0) {
 			ouster_log("Timeout\n");
 			continue;
@@ -121,24 +195,43 @@ int main(int argc, char const *argv[])
 
 		if (a & (1 << SOCK_INDEX_LIDAR)) {
 			cap_lidar->size = OUSTER_NET_UDP_MAX_SIZE;
-			ouster_udpcap_sock_to_file(cap_lidar, socks[SOCK_INDEX_LIDAR], write_file);
-			ouster_assert(
-			    cap_lidar->size == (uint32_t)meta.lidar_packet_size,
-			    "Received incorrect UDP size %ji of %ji",
-			    (intmax_t)cap_lidar->size,
-			    (intmax_t)meta.lidar_packet_size);
-
-			ouster_lidar_get_fields(&lidar, &meta, cap_lidar->buf, NULL, 0);
-			if (lidar.last_mid == meta.mid1) {
-				printf("mid_loss=%ji\n", (intmax_t)lidar.mid_loss);
+			if (ouster_udpcap_recv(cap_lidar, socks[SOCK_INDEX_LIDAR]) == OUSTER_UDPCAP_OK) {
+				ouster_assert(
+				    cap_lidar->size == (uint32_t)meta.lidar_packet_size,
+				    "Received incorrect UDP size %ji of %ji",
+				    (intmax_t)cap_lidar->size,
+				    (intmax_t)meta.lidar_packet_size);
+				if (store_failed(store(&writer, cap_lidar, window_sec), write_filename, window_sec)) {
+					status = -1;
+					break;
+				}
+
+				ouster_lidar_get_fields(&lidar, &meta, cap_lidar->buf, NULL, 0);
+				if (lidar.last_mid == meta.mid1) {
+					printf("mid_loss=%ji\n", (intmax_t)lidar.mid_loss);
+				}
+			} else {
+				ouster_log_warn("Receiving lidar packet failed: %s\n", strerror(errno));
 			}
 		}
 
 		if (a & (1 << SOCK_INDEX_IMU)) {
 			cap_imu->size = OUSTER_NET_UDP_MAX_SIZE;
-			ouster_udpcap_sock_to_file(cap_imu, socks[SOCK_INDEX_IMU], write_file);
+			if (ouster_udpcap_recv(cap_imu, socks[SOCK_INDEX_IMU]) == OUSTER_UDPCAP_OK) {
+				if (store_failed(store(&writer, cap_imu, window_sec), write_filename, window_sec)) {
+					status = -1;
+					break;
+				}
+			} else {
+				ouster_log_warn("Receiving IMU packet failed: %s\n", strerror(errno));
+			}
 		}
 	}
 
-	return 0;
+	if (window_sec > 0) {
+		ouster_blackbox_fini(&blackbox);
+	} else if (store_failed(ouster_udpcap_writer_close(&writer), write_filename, window_sec)) {
+		status = -1;
+	}
+	return status;
 }
@@ -105,7 +105,7 @@ int main(int argc, char const *argv[])
 			return 0;
 		}
 		ouster_meta_parse(content, &meta);
-		free(content);
+		ouster_os_free(content);
 		ouster_dump_meta(stdout, &meta);
 	}
 
@@ -128,7 +128,7 @@ int main(int argc, char const *argv[])
 			return -1;
 		}
 		ouster_meta_parse(content, &meta);
-		free(content);
+		ouster_os_free(content);
 		ouster_lut_init(&lut, &meta);
 		printf("Column window: %i %i\n", meta.mid0, meta.mid1);
 	}
@@ -18,15 +18,34 @@ https://github.com/csimmonds/periodic-threads/blob/master/timerfd.c
 
 #include "argparse.h"
 
+#define MAX_STREAMS 16
+
+/* Number of trace events kept, the oldest are overwritten */
+#define TRACE_CAPACITY (1024 * 1024)
+
+typedef struct
+{
+	char const *filename;
+	ouster_udpcap_reader_t reader;
+	ouster_udpcap_t **caps;
+	int port_offset;
+	uint64_t packets;
+	int eof;
+} stream_t;
+
 typedef struct
 {
 	char const *metafile;
 	char const *read_filename;
 	char const *ip_dst;
-	FILE *read_file;
+	char const *trace_filename;
 	ouster_meta_t meta;
 	int offset;
 	int delay_us;
+	int batch;
+	int port_stride;
+	stream_t streams[MAX_STREAMS];
+	int streams_count;
 } app_t;
 
 struct periodic_info {
@@ -60,7 +79,7 @@ static int make_periodic(int period_us, struct periodic_info *info)
 	return ret;
 }
 
-static void wait_period(struct periodic_info *info)
+static unsigned long long wait_period(struct periodic_info *info)
 {
 	unsigned long long missed;
 	int ret;
@@ -69,13 +88,76 @@ static void wait_period(struct periodic_info *info)
 	ret = read(info->timer_fd, &missed, sizeof(missed));
 	if (ret == -1) {
 		perror("read timer");
-		return;
+		return 0;
 	}
-	info->wakeups_missed += missed;
+	info->wakeups_missed += missed - 1;
+	return missed;
 }
 
+static int stream_open(stream_t *stream, char const *filename, int port_offset, int batch)
+{
+	stream->filename = filename;
+	stream->port_offset = port_offset;
+	ouster_log("Opening file '%s'\n", filename);
+	if (ouster_udpcap_reader_open(&stream->reader, filename) != OUSTER_UDPCAP_OK) {
+		char buf[1024];
+		ouster_fs_readfile_failed_reason(filename, buf, sizeof(buf));
+		fprintf(stderr, "%s", buf);
+		return -1;
+	}
+	stream->caps = calloc(batch, sizeof(ouster_udpcap_t *));
+	for (int i = 0; i < batch; ++i) {
+		stream->caps[i] = calloc(1, sizeof(ouster_udpcap_t) + OUSTER_NET_UDP_MAX_SIZE);
+	}
+	return 0;
+}
 
+/* Reads up to n packets from the stream, returns the number of packets read or -1 for errors */
+static int stream_read(stream_t *stream, int n)
+{
+	int i;
+	for (i = 0; i < n; ++i) {
+		ouster_udpcap_t *cap = stream->caps[i];
+		cap->size = OUSTER_NET_UDP_MAX_SIZE;
+		int rc = ouster_udpcap_reader_read(&stream->reader, cap);
+		if (rc == OUSTER_UDPCAP_ERROR_EOF) {
+			stream->eof = 1;
+			break;
+		}
+		if (rc != OUSTER_UDPCAP_OK) {
+			fprintf(stderr, "error: ouster_udpcap_reader_read: %s: %i\n", stream->filename, rc);
+			return -1;
+		}
+		cap->port += stream->port_offset;
+	}
+	return i;
+}
 
+/* Sends one batch of every stream, returns the number of streams still active or -1 for errors */
+static int send_batch(app_t *app, int sock, ouster_net_addr_t *dst)
+{
+	int active = 0;
+	for (int i = 0; i < app->streams_count; ++i) {
+		stream_t *stream = app->streams + i;
+		if (stream->eof) {
+			continue;
+		}
+		int n = stream_read(stream, app->batch);
+		if (n < 0) {
+			return -1;
+		}
+		int64_t t = ouster_os_clock_ns();
+		int nsend = ouster_udpcap_sendmmsg(stream->caps, n, sock, dst);
+		ouster_trace_record("sendmmsg", t, ouster_os_clock_ns(), n);
+		if (nsend != n) {
+			fprintf(stderr, "error: ouster_udpcap_sendmmsg: %s: sent %i of %i\n", stream->filename, nsend, n);
+			return -1;
+		}
+		stream->packets += n;
+		active += (stream->eof == 0);
+	}
+	return active;
+}
 
 int main(int argc, char const *argv[])
 {
@@ -85,11 +167,13 @@ int main(int argc, char const *argv[])
 
 	app_t app = {
 	    .ip_dst = "127.0.0.1",
-	    .offset = 0};
+	    .offset = 0,
+	    .batch = 1,
+	    .port_stride = 2};
 
 	{
 		static const char *const usages[] = {
-		    "ouster_replay1 [options] [[--] args]",
+		    "ouster_replay1 [options] [[--] captures]",
 		    "ouster_replay1 [options]",
 		    NULL,
 		};
@@ -97,15 +181,18 @@ int main(int argc, char const *argv[])
 		    OPT_HELP(),
 		    OPT_GROUP("Basic options"),
 		    OPT_STRING('m', "metafile", &app.metafile, "The meta file that correspond to the LiDAR sensor configuration", NULL, 0, 0),
-		    OPT_STRING('c', "capture", &app.read_filename, "The capture file to replay", NULL, 0, 0),
+		    OPT_STRING('c', "capture", &app.read_filename, "The capture file or segmented capture to replay", NULL, 0, 0),
 		    OPT_STRING('d', "destination", &app.ip_dst, "The destination ip address. (Optional, default=127.0.0.1)", NULL, 0, 0),
 		    OPT_INTEGER('o', "offset", &app.offset, "Where to start replay", NULL, 0, 0),
-		    OPT_INTEGER('p', "period", &app.delay_us, "period us per frame", NULL, 0, 0),
+		    OPT_INTEGER('p', "period", &app.delay_us, "period us per packet, 0 sends as fast as possible", NULL, 0, 0),
+		    OPT_INTEGER('b', "batch", &app.batch, "Number of packets per sendmmsg, pacing is done on batch boundaries. (Optional, default=1)", NULL, 0, 0),
+		    OPT_INTEGER('s', "stride", &app.port_stride, "Port offset added per extra capture file. (Optional, default=2)", NULL, 0, 0),
+		    OPT_STRING('t', "trace", &app.trace_filename, "Write a Chrome trace-event JSON file of the replay. (Optional)", NULL, 0, 0),
 		    OPT_END(),
 		};
 		struct argparse argparse;
 		argparse_init(&argparse, options, usages, 0);
-		argparse_describe(&argparse, "\nA brief description of what the program does and how it works.", "\nAdditional description of the program after the description of the arguments.");
+		argparse_describe(&argparse, "\nReplays one or more capture files.", "\nExtra capture files given after the options are replayed at the same time, the n:th extra file is sent to its captured ports plus n*stride.");
 		argc = argparse_parse(&argparse, argc, argv);
 		if (app.metafile == NULL) {
 			argparse_usage(&argparse);
@@ -119,27 +206,44 @@ int main(int argc, char const *argv[])
 			argparse_usage(&argparse);
 			return -1;
 		}
+		if (app.batch < 1 || app.delay_us < 0) {
+			argparse_usage(&argparse);
+			return -1;
+		}
+		if (argc + 1 > MAX_STREAMS) {
+			fprintf(stderr, "error: at most %i capture files\n", MAX_STREAMS);
+			return -1;
+		}
 	}
 
-	ouster_log("Opening file '%s'\n", app.read_filename);
-	app.read_file = fopen(app.read_filename, "r");
-	if (app.read_file == NULL) {
-		char buf[1024];
-		ouster_fs_readfile_failed_reason(app.read_filename, buf, sizeof(buf));
-		fprintf(stderr, "%s", buf);
+	if (app.trace_filename) {
+		if (ouster_trace_start(TRACE_CAPACITY)) {
+			fprintf(stderr, "error: ouster_trace_start\n");
+			return -1;
+		}
+		ouster_trace_thread_name_("replay");
+	}
+
+	if (stream_open(app.streams + 0, app.read_filename, 0, app.batch)) {
 		return -1;
 	}
+	app.streams_count = 1;
+	for (int i = 0; i < argc; ++i, ++app.streams_count) {
+		if (stream_open(app.streams + app.streams_count, argv[i], app.streams_count * app.port_stride, app.batch)) {
+			return -1;
+		}
+	}
 
 	{
 		char *content = ouster_fs_readfile(app.metafile);
 		if (content == NULL) {
 			char buf[1024];
-			ouster_fs_readfile_failed_reason(app.read_filename, buf, sizeof(buf));
+			ouster_fs_readfile_failed_reason(app.metafile, buf, sizeof(buf));
 			fprintf(stderr, "%s", buf);
 			return -1;
 		}
 		ouster_meta_parse(content, &app.meta);
-		free(content);
+		ouster_os_free(content);
 		printf("Column window: %i %i\n", app.meta.mid0, app.meta.mid1);
 	}
 
@@ -150,42 +254,57 @@ int main(int argc, char const *argv[])
 	ouster_net_addr_t dst = {0};
 	ouster_net_addr_set_ip4(&dst, app.ip_dst);
 
-	uint32_t packet_id = 0;
-	ouster_udpcap_t *cap = calloc(1, sizeof(ouster_udpcap_t) + OUSTER_NET_UDP_MAX_SIZE);
-
-	for (int i = 0; i < app.offset; ++i) {
-		cap->size = OUSTER_NET_UDP_MAX_SIZE;
-		int nread = ouster_udpcap_read(cap, app.read_file);
-		if (nread != OUSTER_UDPCAP_OK) {
-			fprintf(stderr, "error: ouster_udpcap_read: %i\n", nread);
-			return -1;
+	for (int i = 0; i < app.streams_count; ++i) {
+		stream_t *stream = app.streams + i;
+		for (int j = 0; j < app.offset; ++j) {
+			if (stream_read(stream, 1) != 1) {
+				fprintf(stderr, "error: %s: offset %i is beyond end of file\n", stream->filename, app.offset);
+				return -1;
+			}
 		}
-		packet_id++;
 	}
 
-	struct periodic_info info;
-	make_periodic(app.delay_us, &info);
+	struct periodic_info info = {.timer_fd = -1};
+	if (app.delay_us > 0) {
+		make_periodic(app.delay_us * app.batch, &info);
+	}
 
-	while (1) {
-		cap->size = OUSTER_NET_UDP_MAX_SIZE;
+	time_t last_print = time(NULL);
+	int active = app.streams_count;
+	while (active > 0) {
+		unsigned long long ticks = 1;
+		if (info.timer_fd >= 0) {
+			ticks = wait_period(&info);
+		}
+		// Catch up with missed wakeups by sending one batch per expiration
+		for (unsigned long long t = 0; t < ticks && active > 0; ++t) {
+			active = send_batch(&app, sock, &dst);
+			if (active < 0) {
+				return -1;
+			}
+		}
 
-		int nread = ouster_udpcap_read(cap, app.read_file);
-		if (nread != OUSTER_UDPCAP_OK) {
-			fprintf(stderr, "error: ouster_udpcap_read: %i\n", nread);
-			return -1;
+		time_t now = time(NULL);
+		if (now != last_print || active == 0) {
+			last_print = now;
+			for (int i = 0; i < app.streams_count; ++i) {
+				stream_t *stream = app.streams + i;
+				printf("%s : ip=%s, port_offset=%i, sent=%ju, segment=%i, truncated=%i, missing=%i%s\n", stream->filename, app.ip_dst, stream->port_offset, (uintmax_t)stream->packets, stream->reader.segment, stream->reader.truncated, stream->reader.missing, stream->eof ? " (done)" : "");
+			}
+			printf("wakeups_missed=%llu\n", info.wakeups_missed);
 		}
-		int nsend = ouster_udpcap_sendto(cap, sock, &dst);
-		if (nsend != (int)cap->size) {
+	}
 
-			fprintf(stderr, "error: ouster_udpcap_sendto: %i\n", nsend);
+	if (app.trace_filename) {
+		FILE *f = fopen(app.trace_filename, "w");
+		if (f == NULL) {
+			perror(app.trace_filename);
 			return -1;
 		}
-
-		packet_id++;
-		printf("%ju : ip=%s:%ji, sent=%ji of %ji\n", (uintmax_t)packet_id, app.ip_dst, (intmax_t)cap->port, (intmax_t)nsend, (intmax_t)cap->size);
-		// getchar();
-		//nanosleep((const struct timespec[]){{0, 10000000L}}, NULL);
-		wait_period(&info);
+		int n = ouster_trace_dump(f);
+		fclose(f);
+		ouster_trace_stop();
+		printf("Wrote %i trace events to %s\n", n, app.trace_filename);
 	}
 
 	return 0;
@@ -101,7 +101,7 @@ int main(int argc, char const *argv[])
 			return -1;
 		}
 		ouster_meta_parse(content, &meta);
-		free(content);
+		ouster_os_free(content);
 		printf("Column window: %i %i\n", meta.mid0, meta.mid1);
 	}
 
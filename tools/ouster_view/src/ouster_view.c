@@ -53,7 +53,11 @@ typedef struct
 	char const *modestr;
 	monitor_mode_t mode;
 	ouster_meta_t meta;
-	pthread_mutex_t lock;
+	ouster_frame_pool_t pool;
+	// Newest complete frame, taken by the UI thread
+	ouster_mailbox_t mailbox;
+	// Frames the UI thread is done with, released by the receive thread
+	ouster_spsc_t returns;
 	Tigr *bmp;
 	tigr_mouse_t mouse;
 } app_t;
@@ -83,20 +87,10 @@ void *rec(void *ptr)
 	app_t *app = ptr;
 	ouster_meta_t *meta = &app->meta;
 
-	ouster_field_t fields[FIELD_COUNT] = {
-	    [FIELD_RANGE] = {.quantity = OUSTER_QUANTITY_RANGE, .depth = 4}};
-
-	ouster_field_init(fields, FIELD_COUNT, meta);
-
 	int socks[2];
 	socks[SOCK_INDEX_LIDAR] = ouster_sock_create_udp_lidar(7502, OUSTER_DEFAULT_RCVBUF_SIZE);
 	socks[SOCK_INDEX_IMU] = ouster_sock_create_udp_imu(7503, OUSTER_DEFAULT_RCVBUF_SIZE);
 
-	ouster_lidar_t lidar = {0};
-
-	int w = app->meta.midw;
-	int h = app->meta.pixels_per_column;
-
 	while (1) {
 		int timeout_sec = 1;
 		int timeout_usec = 0;
@@ -106,25 +100,29 @@ void *rec(void *ptr)
 			ouster_log("Timeout\n");
 		}
 
+		// The pool is only touched by this thread, the UI thread hands frames back through the queue
+		ouster_frame_t *f;
+		while ((f = ouster_spsc_pop(&app->returns)) != NULL) {
+			ouster_frame_pool_release(&app->pool, f);
+		}
+
 		if (a & (1 << SOCK_INDEX_LIDAR)) {
 			char buf[OUSTER_NET_UDP_MAX_SIZE];
 			int64_t n = ouster_net_read(socks[SOCK_INDEX_LIDAR], buf, sizeof(buf));
 			if (n == meta->lidar_packet_size) {
-				ouster_lidar_get_fields(&lidar, meta, buf, fields, FIELD_COUNT);
-				if (lidar.last_mid == meta->mid1) {
+				ouster_frame_t *done = ouster_frame_pool_push(&app->pool, buf);
+				if (done) {
 					if (app->mode == SNAPSHOT_MODE_RAW) {
 					}
 					if (app->mode == SNAPSHOT_MODE_DESTAGGER) {
-						// ouster_field_destagger(fields, FIELD_COUNT, meta);
+						// ouster_field_destagger(done->fields, done->fcount, meta);
 					}
-
-					pthread_mutex_lock(&app->lock);
-					convert_u32_to_bmp(fields[FIELD_RANGE].data, app->bmp, w, h);
-					draw_mouse(app->bmp, &app->mouse, w,h, fields[FIELD_RANGE].data);
-					pthread_mutex_unlock(&app->lock);
-
-					ouster_field_zero(fields, FIELD_COUNT);
-					//printf("frame=%i, mid_loss=%i\n", lidar.frame_id, lidar.mid_loss);
+					// The UI thread did not take the previous frame, it is replaced by the newer one
+					ouster_frame_t *old = ouster_mailbox_put(&app->mailbox, done);
+					if (old) {
+						ouster_frame_pool_release(&app->pool, old);
+					}
+					//printf("frame=%i, mid_loss=%i\n", done->lidar.frame_id, done->lidar.mid_loss);
 				}
 			} else {
 				printf("Bytes received (%ji) does not match lidar_packet_size (%ji)\n", (intmax_t)n, (intmax_t)app->meta.lidar_packet_size);
@@ -146,8 +144,7 @@ int main(int argc, char const *argv[])
 	ouster_os_set_api_defaults();
 	ouster_fs_pwd();
 
-	app_t app = {
-	    .lock = PTHREAD_MUTEX_INITIALIZER};
+	app_t app = {0};
 
 	struct argparse_option options[] = {
 	    OPT_HELP(),
@@ -186,7 +183,7 @@ int main(int argc, char const *argv[])
 			return 0;
 		}
 		ouster_meta_parse(content, &app.meta);
-		free(content);
+		ouster_os_free(content);
 		printf("Column window: %i %i\n", app.meta.mid0, app.meta.mid1);
 	}
 
@@ -195,6 +192,14 @@ int main(int argc, char const *argv[])
 
 	app.bmp = tigrBitmap(w, h);
 
+	{
+		ouster_field_t fields[FIELD_COUNT] = {
+		    [FIELD_RANGE] = {.quantity = OUSTER_QUANTITY_RANGE, .depth = 4}};
+		// One frame being filled, one in the mailbox, one being drawn and one on its way back
+		ouster_frame_pool_init(&app.pool, &app.meta, fields, FIELD_COUNT, 4);
+		ouster_spsc_init(&app.returns, 4);
+	}
+
 	{
 		pthread_t thread1;
 		int rc = pthread_create(&thread1, NULL, rec, (void *)&app);
@@ -215,9 +220,18 @@ int main(int argc, char const *argv[])
 
 		tigrClear(screen, tigrRGB(0x80, 0x90, 0xa0));
 
-		pthread_mutex_lock(&app.lock);
+		ouster_frame_t *f = ouster_mailbox_take(&app.mailbox);
+		if (f) {
+			uint32_t *range = f->fields[FIELD_RANGE].data;
+			convert_u32_to_bmp(range, app.bmp, w, h);
+			draw_mouse(app.bmp, &app.mouse, w, h, range);
+#if defined(OUSTER_ENABLE_PROFILE) || defined(OUSTER_ENABLE_TRACE)
+			ouster_profile_span(OUSTER_STAGE_HANDOFF, f->complete_ns, ouster_os_clock_ns());
+#endif
+			// Can not fail, the queue holds every frame of the pool
+			ouster_spsc_push(&app.returns, f);
+		}
 		tigrBlit(screen, app.bmp, 0, 0, 0, 0, app.bmp->w, app.bmp->h);
-		pthread_mutex_unlock(&app.lock);
 
 		tigrUpdate(screen);
 	}